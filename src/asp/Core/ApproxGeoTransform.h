@@ -0,0 +1,159 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ApproxGeoTransform.h
+///
+/// Approximations of map projections for whole images of points,
+/// built on ApproxTransform. The projection is evaluated exactly on a
+/// lattice over the longitude-latitude extent of each tile and
+/// interpolated within a given error, instead of calling PROJ.4 for
+/// every pixel.
+
+#ifndef __ASP_CORE_APPROX_GEO_TRANSFORM_H__
+#define __ASP_CORE_APPROX_GEO_TRANSFORM_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Cartography/GeoReference.h>
+#include <asp/Core/ApproxTransform.h>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+
+namespace asp {
+
+  /// Maps the nodes of a regular lattice in longitude and latitude,
+  /// starting at 'origin' with spacing 'step', to projected
+  /// coordinates.
+  class LonLatLatticeTrans : public vw::TransformBase<LonLatLatticeTrans> {
+    vw::cartography::GeoReference m_georef;
+    vw::Vector2 m_origin, m_step;
+  public:
+    LonLatLatticeTrans( vw::cartography::GeoReference const& georef,
+                        vw::Vector2 const& origin, vw::Vector2 const& step ) :
+      m_georef(georef), m_origin(origin), m_step(step) {}
+
+    inline vw::Vector2 reverse( vw::Vector2 const& p ) const {
+      return m_georef.lonlat_to_point( m_origin + elem_prod( p, m_step ) );
+    }
+    inline vw::Vector2 forward( vw::Vector2 const& q ) const {
+      return elem_quot( m_georef.point_to_lonlat( q ) - m_origin, m_step );
+    }
+
+    // The lattice is only ever used for the forward map of points, so
+    // there is no input region to compute.
+    inline vw::BBox2i reverse_bbox( vw::BBox2i const& bbox ) const { return bbox; }
+  };
+
+  /// Converts an image of (lon, lat, height) points to (x, y, height)
+  /// in the projection of 'georef', like geodetic_to_point(), with
+  /// the projection interpolated within 'tolerance' projected units.
+  /// Points with a NaN height are passed through. With a tolerance
+  /// of 0 every point is projected exactly.
+  template <class ImageT>
+  class ApproxGeodeticToPointView :
+    public vw::ImageViewBase< ApproxGeodeticToPointView<ImageT> > {
+    ImageT m_img;
+    vw::cartography::GeoReference m_georef;
+    double m_tolerance;
+    int m_lattice_size;
+
+    inline vw::Vector3 exact( vw::Vector3 const& v ) const {
+      if ( boost::math::isnan( v[2] ) ) return v;
+      vw::Vector2 pt = m_georef.lonlat_to_point( subvector( v, 0, 2 ) );
+      return vw::Vector3( pt[0], pt[1], v[2] );
+    }
+
+  public:
+    typedef vw::Vector3 pixel_type;
+    typedef vw::Vector3 result_type;
+    typedef vw::ProceduralPixelAccessor<ApproxGeodeticToPointView> pixel_accessor;
+
+    /// The lattice has 'lattice_size' cells along each side of the
+    /// extent of a tile, before adaptive subdivision.
+    ApproxGeodeticToPointView( vw::ImageViewBase<ImageT> const& img,
+                               vw::cartography::GeoReference const& georef,
+                               double tolerance, int lattice_size = 64 ) :
+      m_img(img.impl()), m_georef(georef), m_tolerance(tolerance),
+      m_lattice_size(lattice_size) {}
+
+    inline vw::int32 cols() const { return m_img.cols(); }
+    inline vw::int32 rows() const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this); }
+
+    inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p=0 ) const {
+      return exact( m_img(i, j, p) );
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize( vw::BBox2i const& bbox ) const {
+      using namespace vw;
+      ImageView<pixel_type> tile = crop( m_img, bbox );
+
+      // Extent of the valid points
+      BBox2 extent;
+      for ( int32 j = 0; j < tile.rows(); j++ )
+        for ( int32 i = 0; i < tile.cols(); i++ )
+          if ( !boost::math::isnan( tile(i,j)[2] ) )
+            extent.grow( subvector( tile(i,j), 0, 2 ) );
+
+      if ( m_tolerance <= 0 || extent.empty() ) {
+        for ( int32 j = 0; j < tile.rows(); j++ )
+          for ( int32 i = 0; i < tile.cols(); i++ )
+            tile(i,j) = exact( tile(i,j) );
+      } else {
+        Vector2 step = extent.size() / double(m_lattice_size);
+        for ( int k = 0; k < 2; k++ )
+          if ( step[k] <= 0 ) step[k] = 1.0;
+        ApproxTransform<LonLatLatticeTrans>
+          lattice( LonLatLatticeTrans( m_georef, extent.min(), step ),
+                   m_tolerance, 8, 1 );
+        lattice.reverse_bbox( BBox2i( 0, 0, m_lattice_size+1, m_lattice_size+1 ) );
+        for ( int32 j = 0; j < tile.rows(); j++ )
+          for ( int32 i = 0; i < tile.cols(); i++ ) {
+            Vector3 & v = tile(i,j);
+            if ( boost::math::isnan( v[2] ) ) continue;
+            Vector2 pt = lattice.reverse( elem_quot( subvector( v, 0, 2 ) - extent.min(), step ) );
+            v[0] = pt[0];
+            v[1] = pt[1];
+          }
+      }
+
+      return prerasterize_type( tile, -bbox.min().x(), -bbox.min().y(), cols(), rows() );
+    }
+    template <class DestT>
+    inline void rasterize( DestT const& dest, vw::BBox2i const& bbox ) const {
+      vw::rasterize( prerasterize(bbox), dest, bbox );
+    }
+  };
+
+  template <class ImageT>
+  ApproxGeodeticToPointView<ImageT>
+  approx_geodetic_to_point( vw::ImageViewBase<ImageT> const& img,
+                            vw::cartography::GeoReference const& georef,
+                            double tolerance ) {
+    return ApproxGeodeticToPointView<ImageT>( img, georef, tolerance );
+  }
+
+} // namespace asp
+
+#endif//__ASP_CORE_APPROX_GEO_TRANSFORM_H__
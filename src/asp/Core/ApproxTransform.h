@@ -0,0 +1,280 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ApproxTransform.h
+///
+/// Error bounded approximation of an expensive transform, such as
+/// Map2CamTrans, whose reverse() runs a camera projection per pixel.
+///
+/// When reverse_bbox() is called for an output tile, the exact
+/// transform is evaluated on a coarse grid of nodes over the tile.
+/// Each grid cell is checked at its center and edge midpoints
+/// against bilinear interpolation of its corners. Cells that miss by
+/// more than the tolerance are split in four, reusing the check
+/// points as new corners, down to a minimum size below which the
+/// cell falls back to the exact transform, evaluated once at each of
+/// its pixels. reverse() then only interpolates or looks up.
+///
+/// The returned input region is computed from the grid itself, as an
+/// interpolated value lies within the box of its cell corners. The
+/// reverse_bbox() of the exact transform, which for Map2CamTrans
+/// projects every pixel of the tile, is never called.
+///
+/// Like Map2CamTrans this keeps per tile state, so each tile must use
+/// its own copy, as TransformView does.
+
+#ifndef __ASP_CORE_APPROX_TRANSFORM_H__
+#define __ASP_CORE_APPROX_TRANSFORM_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/Transform.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace asp {
+
+  template <class TransformT>
+  class ApproxTransform : public vw::TransformBase<ApproxTransform<TransformT> > {
+
+    // A grid cell spans the pixels [x0,x1] x [y0,y1], corners
+    // included. Its children, if any, are at m_cells[child ... child+3].
+    // The exact values at the pixels of an exact cell are at
+    // m_values[values ...], row by row.
+    struct Cell {
+      int x0, y0, x1, y1;
+      vw::Vector2 c00, c10, c01, c11;
+      int child;
+      bool exact;
+      int values;
+    };
+
+    TransformT m_tx;
+    double m_tolerance;
+    int m_spacing, m_min_size;
+
+    // The first m_cols x m_rows cells are the coarse grid over m_bbox
+    mutable vw::BBox2i m_bbox;
+    mutable int m_cols, m_rows;
+    mutable std::vector<Cell> m_cells;
+    mutable std::vector<vw::Vector2> m_values;
+    mutable size_t m_num_evaluations;
+
+    vw::Vector2 evaluate( double x, double y ) const {
+      m_num_evaluations++;
+      return m_tx.reverse( vw::Vector2(x,y) );
+    }
+
+    static vw::Vector2 interpolate( Cell const& c, double x, double y ) {
+      double fx = c.x1 > c.x0 ? (x - c.x0) / double(c.x1 - c.x0) : 0.0;
+      double fy = c.y1 > c.y0 ? (y - c.y0) / double(c.y1 - c.y0) : 0.0;
+      return (1-fy)*((1-fx)*c.c00 + fx*c.c10) + fy*((1-fx)*c.c01 + fx*c.c11);
+    }
+
+    // Distance from the interpolation at a check point. NaN compares
+    // false with the tolerance, so invalid values fail the check.
+    bool close( Cell const& c, double x, double y, vw::Vector2 const& exact ) const {
+      return norm_2( interpolate( c, x, y ) - exact ) <= m_tolerance;
+    }
+
+    // Evaluates the exact transform at the edge midpoints (mx, y0),
+    // (mx, y1), (x0, my), (x1, my) and the center (mx, my) of a cell.
+    // True if all of them are within the tolerance.
+    bool check( Cell const& c, double mx, double my,
+                vw::Vector2& top, vw::Vector2& bottom, vw::Vector2& left,
+                vw::Vector2& right, vw::Vector2& center ) const {
+      top    = evaluate( mx, c.y0 );
+      bottom = evaluate( mx, c.y1 );
+      left   = evaluate( c.x0, my );
+      right  = evaluate( c.x1, my );
+      center = evaluate( mx, my );
+      return close( c, mx, c.y0, top ) && close( c, mx, c.y1, bottom ) &&
+        close( c, c.x0, my, left ) && close( c, c.x1, my, right ) &&
+        close( c, mx, my, center );
+    }
+
+    void refine( size_t index ) const {
+      Cell cell = m_cells[index];
+      vw::Vector2 top, bottom, left, right, center;
+
+      // Every pixel of the cell is a corner, but callers such as
+      // ApproxGeoTransform interpolate between pixels, so the cell is
+      // checked at its fractional midpoints.
+      if ( cell.x1 - cell.x0 <= 1 && cell.y1 - cell.y0 <= 1 ) {
+        if ( !check( cell, 0.5*(cell.x0 + cell.x1), 0.5*(cell.y0 + cell.y1),
+                     top, bottom, left, right, center ) )
+          m_cells[index].exact = true;
+        return;
+      }
+
+      int mx = (cell.x0 + cell.x1) / 2, my = (cell.y0 + cell.y1) / 2;
+      if ( check( cell, mx, my, top, bottom, left, right, center ) )
+        return;
+
+      if ( cell.x1 - cell.x0 <= m_min_size && cell.y1 - cell.y0 <= m_min_size ) {
+        m_cells[index].exact = true;
+        return;
+      }
+
+      Cell quad[4] = {
+        { cell.x0, cell.y0, mx, my, cell.c00, top, left, center, -1, false, -1 },
+        { mx, cell.y0, cell.x1, my, top, cell.c10, center, right, -1, false, -1 },
+        { cell.x0, my, mx, cell.y1, left, center, cell.c01, bottom, -1, false, -1 },
+        { mx, my, cell.x1, cell.y1, center, right, bottom, cell.c11, -1, false, -1 } };
+      int child = m_cells.size();
+      m_cells[index].child = child;
+      m_cells.insert( m_cells.end(), quad, quad+4 );
+      for ( int k = 0; k < 4; k++ )
+        refine( child + k );
+    }
+
+    static void grow( vw::BBox2& box, vw::Vector2 const& p ) {
+      if ( p.x() == p.x() && p.y() == p.y() ) // Skip NaN
+        box.grow( p );
+    }
+
+    // Grows 'box' by the values reverse() may return in the leaves
+    // under the cell, evaluating the pixels of exact cells.
+    void collect( size_t index, vw::BBox2& box ) const {
+      Cell const& cell = m_cells[index];
+      if ( cell.child >= 0 ) {
+        for ( int k = 0; k < 4; k++ )
+          collect( cell.child + k, box );
+        return;
+      }
+      if ( !cell.exact ) {
+        grow( box, cell.c00 ); grow( box, cell.c10 );
+        grow( box, cell.c01 ); grow( box, cell.c11 );
+        return;
+      }
+      int values = m_values.size();
+      for ( int y = cell.y0; y <= cell.y1; y++ )
+        for ( int x = cell.x0; x <= cell.x1; x++ ) {
+          m_values.push_back( evaluate( x, y ) );
+          grow( box, m_values.back() );
+        }
+      m_cells[index].values = values;
+    }
+
+  public:
+    /// 'tolerance' is in units of the output of reverse(), pixels for
+    /// Map2CamTrans. 'spacing' is the size of the coarse grid cells
+    /// and 'min_size' the size below which cells are evaluated
+    /// exactly.
+    ApproxTransform( TransformT const& tx, double tolerance,
+                     int spacing = 32, int min_size = 4 ) :
+      m_tx(tx), m_tolerance(tolerance), m_spacing(std::max(spacing,2)),
+      m_min_size(std::max(min_size,1)), m_cols(0), m_rows(0),
+      m_num_evaluations(0) {}
+
+    inline vw::Vector2 forward( vw::Vector2 const& p ) const {
+      return m_tx.forward( p );
+    }
+
+    inline vw::Vector2 reverse( vw::Vector2 const& p ) const {
+      if ( m_cells.empty() ||
+           p.x() < m_bbox.min().x() || p.y() < m_bbox.min().y() ||
+           p.x() > m_bbox.max().x() - 1 || p.y() > m_bbox.max().y() - 1 )
+        return m_tx.reverse( p );
+
+      int col = std::min( int( (p.x() - m_bbox.min().x()) / m_spacing ), m_cols - 1 );
+      int row = std::min( int( (p.y() - m_bbox.min().y()) / m_spacing ), m_rows - 1 );
+      Cell const* cell = &m_cells[ row*m_cols + col ];
+      while ( cell->child >= 0 ) {
+        int mx = (cell->x0 + cell->x1) / 2, my = (cell->y0 + cell->y1) / 2;
+        cell = &m_cells[ cell->child + (p.x() >= mx ? 1 : 0) + (p.y() >= my ? 2 : 0) ];
+      }
+      if ( cell->exact ) {
+        int x = int(p.x()), y = int(p.y());
+        if ( x != p.x() || y != p.y() )
+          return m_tx.reverse( p );
+        return m_values[ cell->values + (y - cell->y0)*(cell->x1 - cell->x0 + 1) +
+                         x - cell->x0 ];
+      }
+      return interpolate( *cell, p.x(), p.y() );
+    }
+
+    /// Builds the interpolation grid over 'bbox' and returns the
+    /// input region that reverse() maps the pixels of 'bbox' into.
+    /// With a tolerance of zero there is no grid, and this is the
+    /// reverse_bbox() of the exact transform.
+    vw::BBox2i reverse_bbox( vw::BBox2i const& bbox ) const {
+      m_cells.clear();
+      m_values.clear();
+      m_bbox = bbox;
+      if ( m_tolerance <= 0 )
+        return m_tx.reverse_bbox( bbox );
+      if ( bbox.empty() )
+        return vw::BBox2i();
+
+      m_cols = ( bbox.width()  - 1 + m_spacing - 1 ) / m_spacing;
+      m_rows = ( bbox.height() - 1 + m_spacing - 1 ) / m_spacing;
+      m_cols = std::max( m_cols, 1 );
+      m_rows = std::max( m_rows, 1 );
+
+      // Nodes of the coarse grid, shared by neighboring cells
+      std::vector<int> xs( m_cols+1 ), ys( m_rows+1 );
+      for ( int c = 0; c <= m_cols; c++ )
+        xs[c] = std::min( bbox.min().x() + c*m_spacing, bbox.max().x() - 1 );
+      for ( int r = 0; r <= m_rows; r++ )
+        ys[r] = std::min( bbox.min().y() + r*m_spacing, bbox.max().y() - 1 );
+      std::vector<vw::Vector2> nodes( (m_cols+1)*(m_rows+1) );
+      for ( int r = 0; r <= m_rows; r++ )
+        for ( int c = 0; c <= m_cols; c++ )
+          nodes[ r*(m_cols+1) + c ] = evaluate( xs[c], ys[r] );
+
+      m_cells.reserve( 2*m_cols*m_rows );
+      for ( int r = 0; r < m_rows; r++ )
+        for ( int c = 0; c < m_cols; c++ ) {
+          Cell cell = { xs[c], ys[r], xs[c+1], ys[r+1],
+                        nodes[ r*(m_cols+1) + c ],     nodes[ r*(m_cols+1) + c+1 ],
+                        nodes[ (r+1)*(m_cols+1) + c ], nodes[ (r+1)*(m_cols+1) + c+1 ],
+                        -1, false, -1 };
+          m_cells.push_back( cell );
+        }
+      for ( int k = 0; k < m_cols*m_rows; k++ )
+        refine( k );
+
+      vw::BBox2 box;
+      for ( int k = 0; k < m_cols*m_rows; k++ )
+        collect( k, box );
+      if ( box.min().x() > box.max().x() )
+        return vw::BBox2i(); // Nothing valid
+      // The pixels around each value, as the exact reverse_bbox() gives
+      return vw::BBox2i( vw::Vector2i( std::floor( box.min().x() ), std::floor( box.min().y() ) ),
+                         vw::Vector2i( std::floor( box.max().x() ) + 1,
+                                       std::floor( box.max().y() ) + 1 ) );
+    }
+
+    /// Number of exact evaluations spent building the grids so far
+    size_t num_evaluations() const { return m_num_evaluations; }
+
+    TransformT const& exact_transform() const { return m_tx; }
+  };
+
+  template <class TransformT>
+  ApproxTransform<TransformT> approx_transform( TransformT const& tx, double tolerance,
+                                                int spacing = 32, int min_size = 4 ) {
+    return ApproxTransform<TransformT>( tx, tolerance, spacing, min_size );
+  }
+
+} // namespace asp
+
+#endif//__ASP_CORE_APPROX_TRANSFORM_H__
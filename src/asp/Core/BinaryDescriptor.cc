@@ -0,0 +1,215 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Core/BinaryDescriptor.h>
+#include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+    inline int popcount64( uint64 x ) {
+#if defined(__GNUC__)
+      return __builtin_popcountll( x );
+#else
+      x = x - ((x >> 1) & 0x5555555555555555ULL);
+      x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+      x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+      return int((x * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+  }
+
+  BinaryDescriptorGenerator::BinaryDescriptorGenerator() {
+    // Pixel pairs drawn uniformly from the disk of radius
+    // PATCH_RADIUS, from a fixed integer generator so that the pattern
+    // (and hence descriptors) are the same on every platform.
+    const int r = PATCH_RADIUS;
+    uint64 state = 0x2545F4914F6CDD1DULL;
+    std::vector<Vector2i> samples;
+    while ( int(samples.size()) < 2*NUM_BITS ) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      int x = int((state >> 33) % (2*r + 1)) - r;
+      int y = int((state >> 13) % (2*r + 1)) - r;
+      if ( x*x + y*y > r*r ) continue;
+      samples.push_back( Vector2i(x, y) );
+    }
+    for ( int i = 0; i < NUM_BITS; i++ ) {
+      m_first.push_back ( samples[2*i] );
+      m_second.push_back( samples[2*i+1] );
+    }
+  }
+
+  void BinaryDescriptorGenerator::compute_descriptor( ImageView<float> const& patch,
+                                                      Vector<float>& descriptor ) const {
+    VW_ASSERT( patch.cols() == support_size() && patch.rows() == support_size(),
+               ArgumentErr() << "BinaryDescriptorGenerator: expecting a "
+               << support_size() << "x" << support_size() << " patch.\n" );
+
+    // Integral image of the patch, for the box averages
+    const int n = support_size();
+    std::vector<double> sums( (n+1)*(n+1), 0.0 );
+    for ( int row = 0; row < n; row++ ) {
+      double row_sum = 0;
+      for ( int col = 0; col < n; col++ ) {
+        row_sum += patch(col, row);
+        sums[(row+1)*(n+1) + col+1] = sums[row*(n+1) + col+1] + row_sum;
+      }
+    }
+
+    const int c = n / 2, s = SMOOTH_RADIUS;
+    descriptor.set_size( NUM_BYTES );
+    uint8 byte = 0;
+    for ( int i = 0; i < NUM_BITS; i++ ) {
+      double box[2];
+      for ( int k = 0; k < 2; k++ ) {
+        Vector2i const& p = k == 0 ? m_first[i] : m_second[i];
+        int x0 = c + p.x() - s, y0 = c + p.y() - s;
+        int x1 = c + p.x() + s + 1, y1 = c + p.y() + s + 1;
+        box[k] = sums[y1*(n+1) + x1] - sums[y0*(n+1) + x1]
+          - sums[y1*(n+1) + x0] + sums[y0*(n+1) + x0];
+      }
+      if ( box[0] < box[1] )
+        byte |= uint8(1 << (i % 8));
+      if ( i % 8 == 7 ) {
+        descriptor[i / 8] = byte;
+        byte = 0;
+      }
+    }
+  }
+
+  int hamming_distance( uint64 const* a, uint64 const* b ) {
+    int distance = 0;
+    for ( int w = 0; w < HammingIndex::NUM_WORDS; w++ )
+      distance += popcount64( a[w] ^ b[w] );
+    return distance;
+  }
+
+  void HammingIndex::pack( Vector<float> const& descriptor, uint64* bits ) {
+    VW_ASSERT( int(descriptor.size()) == BinaryDescriptorGenerator::NUM_BYTES,
+               ArgumentErr() << "HammingIndex: not a binary descriptor.\n" );
+    std::fill( bits, bits + NUM_WORDS, uint64(0) );
+    for ( int b = 0; b < BinaryDescriptorGenerator::NUM_BYTES; b++ )
+      bits[b / 8] |= uint64( uint8(descriptor[b]) ) << (8 * (b % 8));
+  }
+
+  void HammingIndex::knn_search( Vector<float> const& query,
+                                 Vector<int>& indices,
+                                 Vector<float>& distances,
+                                 size_t knn ) const {
+    uint64 query_bits[NUM_WORDS];
+    pack( query, query_bits );
+
+    // Keep the best so far sorted by distance, then by index
+    std::vector<std::pair<int,int> > best;
+    best.reserve( knn + 1 );
+    int worst = std::numeric_limits<int>::max();
+    for ( size_t i = 0; i < size(); i++ ) {
+      int distance = hamming_distance( query_bits, &m_bits[i*NUM_WORDS] );
+      if ( best.size() == knn && distance >= worst )
+        continue;
+      std::pair<int,int> entry( distance, int(i) );
+      best.insert( std::upper_bound( best.begin(), best.end(), entry ), entry );
+      if ( best.size() > knn )
+        best.pop_back();
+      if ( best.size() == knn )
+        worst = best.back().first;
+    }
+
+    indices.set_size( knn );
+    distances.set_size( knn );
+    for ( size_t i = 0; i < knn; i++ ) {
+      if ( i < best.size() ) {
+        indices[i]   = best[i].second;
+        distances[i] = best[i].first;
+      } else {
+        indices[i]   = -1;
+        distances[i] = std::numeric_limits<float>::max();
+      }
+    }
+  }
+
+  // Matches a range of the points of the first list
+  class BinaryMatchTask : public Task, private boost::noncopyable {
+    HammingIndex const& m_index;
+    std::vector<ip::InterestPoint> const& m_ip1;
+    size_t m_begin, m_end;
+    double m_threshold;
+    std::vector<int>& m_matches;
+  public:
+    BinaryMatchTask( HammingIndex const& index,
+                     std::vector<ip::InterestPoint> const& ip1,
+                     size_t begin, size_t end, double threshold,
+                     std::vector<int>& matches ) :
+      m_index(index), m_ip1(ip1), m_begin(begin), m_end(end),
+      m_threshold(threshold), m_matches(matches) {}
+
+    void operator()() {
+      Vector<int> indices;
+      Vector<float> distances;
+      for ( size_t i = m_begin; i < m_end; i++ ) {
+        m_index.knn_search( m_ip1[i].descriptor, indices, distances, 2 );
+        if ( indices[0] >= 0 && indices[1] >= 0 &&
+             distances[0] < m_threshold * distances[1] )
+          m_matches[i] = indices[0];
+      }
+    }
+  };
+
+  void match_binary_descriptors( std::vector<ip::InterestPoint> const& ip1,
+                                 std::vector<ip::InterestPoint> const& ip2,
+                                 std::vector<ip::InterestPoint>& matched_ip1,
+                                 std::vector<ip::InterestPoint>& matched_ip2,
+                                 double threshold ) {
+    matched_ip1.clear();
+    matched_ip2.clear();
+    if ( ip1.empty() || ip2.empty() )
+      return;
+
+    HammingIndex index( ip2.begin(), ip2.end() );
+    std::vector<int> matches( ip1.size(), -1 );
+
+    FifoWorkQueue queue;
+    size_t num_jobs = vw_settings().default_num_threads() * 2;
+    size_t job_size = std::max( size_t(1), (ip1.size() + num_jobs - 1) / num_jobs );
+    for ( size_t begin = 0; begin < ip1.size(); begin += job_size ) {
+      boost::shared_ptr<Task>
+        task( new BinaryMatchTask( index, ip1, begin,
+                                   std::min( ip1.size(), begin + job_size ),
+                                   threshold, matches ) );
+      queue.add_task( task );
+    }
+    queue.join_all();
+
+    for ( size_t i = 0; i < ip1.size(); i++ ) {
+      if ( matches[i] < 0 ) continue;
+      matched_ip1.push_back( ip1[i] );
+      matched_ip2.push_back( ip2[matches[i]] );
+    }
+  }
+
+} // namespace asp
@@ -0,0 +1,131 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BinaryDescriptor.h
+///
+/// BRIEF-style binary descriptors for interest points, and matching
+/// of them by Hamming distance, as a faster alternative to the
+/// SGrad descriptors and L2 matching used for image alignment.
+///
+/// A descriptor is the outcome of 256 comparisons between pairs of
+/// box-smoothed pixels, at fixed positions around the interest
+/// point. It is kept in the float descriptor of the interest point
+/// as 32 floats holding a byte each, so that it can be stored in
+/// lists and match files like any other descriptor.
+///
+/// The Hamming distance between two descriptors is the squared L2
+/// distance between their bit vectors, so thresholds meant for
+/// squared L2 distances carry over unchanged.
+
+#ifndef __ASP_CORE_BINARY_DESCRIPTOR_H__
+#define __ASP_CORE_BINARY_DESCRIPTOR_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Math/Vector.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/InterestPoint/InterestData.h>
+
+#include <vector>
+
+namespace asp {
+
+  class BinaryDescriptorGenerator {
+  public:
+    static const int NUM_BITS      = 256;
+    static const int NUM_BYTES     = NUM_BITS / 8;
+    static const int PATCH_RADIUS  = 15; // Comparisons are within a 31x31 patch
+    static const int SMOOTH_RADIUS = 2;  // Pixels are averaged over a 5x5 box
+
+    BinaryDescriptorGenerator();
+
+    // Side of the image patch, centered on an interest point, that a
+    // descriptor is computed from.
+    static int support_size() { return 2*(PATCH_RADIUS + SMOOTH_RADIUS) + 1; }
+
+    // Compute the descriptor of the point at the center of the patch
+    void compute_descriptor( vw::ImageView<float> const& patch,
+                             vw::Vector<float>& descriptor ) const;
+
+    // Describe all interest points in a list. Pixels beyond the image
+    // are taken to be zero.
+    template <class ViewT, class ListT>
+    void operator()( vw::ImageViewBase<ViewT> const& image, ListT& points ) const {
+      using namespace vw;
+      int half = support_size() / 2;
+      for ( typename ListT::iterator ip = points.begin(); ip != points.end(); ++ip ) {
+        BBox2i box( int(round(ip->x)) - half, int(round(ip->y)) - half,
+                    support_size(), support_size() );
+        ImageView<float> patch =
+          crop( edge_extend( image.impl(), ZeroEdgeExtension() ), box );
+        compute_descriptor( patch, ip->descriptor );
+      }
+    }
+
+  private:
+    // Pixel pairs to compare, relative to the patch center
+    std::vector<vw::Vector2i> m_first, m_second;
+  };
+
+  // Hamming distance between packed descriptors
+  int hamming_distance( vw::uint64 const* a, vw::uint64 const* b );
+
+  // Descriptors of a list of interest points packed into bit strings,
+  // searched by brute force, which with hardware popcount is faster
+  // than a kd-tree over float descriptors.
+  class HammingIndex {
+  public:
+    static const int NUM_WORDS = BinaryDescriptorGenerator::NUM_BITS / 64;
+
+    template <class IterT>
+    HammingIndex( IterT begin, IterT end ) {
+      for ( IterT ip = begin; ip != end; ++ip ) {
+        m_bits.resize( m_bits.size() + NUM_WORDS );
+        pack( ip->descriptor, &m_bits[m_bits.size() - NUM_WORDS] );
+      }
+    }
+
+    size_t size() const { return m_bits.size() / NUM_WORDS; }
+
+    // The 'knn' nearest descriptors, closest first, with the same
+    // interface as vw::math::FLANNTree. If there are fewer than 'knn'
+    // descriptors, the remaining indices are set to -1.
+    void knn_search( vw::Vector<float> const& query,
+                     vw::Vector<int>& indices,
+                     vw::Vector<float>& distances,
+                     size_t knn ) const;
+
+    static void pack( vw::Vector<float> const& descriptor, vw::uint64* bits );
+
+  private:
+    std::vector<vw::uint64> m_bits;
+  };
+
+  // Match each point of ip1 to its nearest neighbor in ip2 if that is
+  // closer than 'threshold' times the second nearest, in the same way
+  // as vw::ip::InterestPointMatcher, using all available threads.
+  void match_binary_descriptors( std::vector<vw::ip::InterestPoint> const& ip1,
+                                 std::vector<vw::ip::InterestPoint> const& ip2,
+                                 std::vector<vw::ip::InterestPoint>& matched_ip1,
+                                 std::vector<vw::ip::InterestPoint>& matched_ip2,
+                                 double threshold );
+
+} // namespace asp
+
+#endif//__ASP_CORE_BINARY_DESCRIPTOR_H__
@@ -0,0 +1,477 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BundleAdjustParallel.h
+///
+/// Sparse Levenberg Marquardt bundle adjustment whose residual and
+/// jacobian assembly runs on a thread pool.
+///
+/// The control network is partitioned by point. Each task evaluates
+/// the jacobians and robust weights of the measures of its points
+/// into storage allocated once per adjustment, and accumulates V, W
+/// and epsilon_b, which belong to a single point or measure. U and
+/// epsilon_a are then summed per camera in a second pass partitioned
+/// by camera, so no locking is needed. The reduced camera system is
+/// solved the same way as in vw::ba::AdjustSparse.
+///
+/// The model is evaluated concurrently, so the cameras behind it must
+/// be thread safe. Use a single thread otherwise.
+
+#ifndef __ASP_CORE_BUNDLE_ADJUST_PARALLEL_H__
+#define __ASP_CORE_BUNDLE_ADJUST_PARALLEL_H__
+
+#include <vw/Core/Settings.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/Vector.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/LinearAlgebra.h>
+#include <vw/Math/MatrixSparseSkyline.h>
+#include <vw/BundleAdjustment/BundleAdjustmentBase.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace asp {
+
+  template <class ModelT, class RobustCostT>
+  class AdjustSparseParallel : public vw::ba::BundleAdjustmentBase<ModelT, RobustCostT> {
+  public:
+    typedef ModelT model_type;
+    typedef RobustCostT cost_type;
+
+    static const unsigned camera_params_n = ModelT::camera_params_n;
+    static const unsigned point_params_n  = ModelT::point_params_n;
+
+    typedef vw::Matrix<double,2,camera_params_n> matrix_2_camera;
+    typedef vw::Matrix<double,2,point_params_n> matrix_2_point;
+    typedef vw::Matrix<double,camera_params_n,camera_params_n> matrix_camera_camera;
+    typedef vw::Matrix<double,point_params_n,point_params_n> matrix_point_point;
+    typedef vw::Matrix<double,camera_params_n,point_params_n> matrix_camera_point;
+    typedef vw::Vector<double,camera_params_n> vector_camera;
+    typedef vw::Vector<double,point_params_n> vector_point;
+
+    // Wall clock seconds spent in the phases of the last update()
+    struct Timing {
+      double assembly, solve, update_error;
+      Timing() : assembly(0), solve(0), update_error(0) {}
+    };
+
+  private:
+    typedef void (AdjustSparseParallel::*range_func)( size_t, size_t, double& );
+
+    // Runs one of the range functions below over [begin, end)
+    class RangeTask : public vw::Task, private boost::noncopyable {
+      AdjustSparseParallel& m_parent;
+      range_func m_func;
+      size_t m_begin, m_end;
+      double& m_result;
+    public:
+      RangeTask( AdjustSparseParallel& parent, range_func func,
+                 size_t begin, size_t end, double& result ) :
+        m_parent(parent), m_func(func), m_begin(begin), m_end(end),
+        m_result(result) {}
+      void operator()() { (m_parent.*m_func)( m_begin, m_end, m_result ); }
+    };
+
+    int m_num_threads;
+    Timing m_timing;
+
+    // The measures, flattened. The measures of point i are
+    // [m_point_measures[i], m_point_measures[i+1]), and those of
+    // camera j are listed in m_camera_measures[j].
+    std::vector<size_t> m_point_measures;
+    std::vector<std::vector<size_t> > m_camera_measures;
+    std::vector<unsigned> m_measure_camera;
+    std::vector<vw::Vector2> m_measure_pixel, m_measure_inverse_sigma2;
+
+    // Per measure storage, allocated once
+    std::vector<matrix_2_camera> m_A;
+    std::vector<vw::Vector2> m_epsilon;
+    std::vector<matrix_camera_point> m_W, m_Y;
+
+    // Per camera and per point storage
+    std::vector<matrix_camera_camera> m_U;
+    std::vector<vector_camera> m_epsilon_a, m_new_a;
+    std::vector<matrix_point_point> m_V;
+    std::vector<vector_point> m_epsilon_b, m_new_b;
+
+    std::vector<uint> m_ideal_ordering;
+    vw::Vector<uint> m_ideal_skyline;
+    bool m_found_ideal_ordering;
+
+    // Robust weighted error of a measure, and its error term
+    double weighted_error( size_t m, vw::Vector2 const& projection,
+                           vw::Vector2& epsilon ) const {
+      vw::Vector2 unweighted_error = m_measure_pixel[m] - projection;
+      double mag = norm_2(unweighted_error);
+      double weight = mag > 0 ? sqrt(this->m_robust_cost_func(mag)) / mag : 1.0;
+      epsilon = unweighted_error * weight;
+      return .5 * ( epsilon[0]*epsilon[0]*m_measure_inverse_sigma2[m][0] +
+                    epsilon[1]*epsilon[1]*m_measure_inverse_sigma2[m][1] );
+    }
+
+    // First pass, over points. Jacobians and errors of the measures
+    // of points [begin, end), and the blocks of V, W and epsilon_b.
+    void assemble_points( size_t begin, size_t end, double& error_total ) {
+      for ( size_t i = begin; i < end; i++ ) {
+        vector_point b_i = this->m_model.B_parameters(i);
+        matrix_point_point V;
+        vector_point epsilon_b;
+        for ( size_t m = m_point_measures[i]; m < m_point_measures[i+1]; m++ ) {
+          unsigned j = m_measure_camera[m];
+          vector_camera a_j = this->m_model.A_parameters(j);
+
+          m_A[m] = this->m_model.A_jacobian(i,j,a_j,b_i);
+          matrix_2_point B = this->m_model.B_jacobian(i,j,a_j,b_i);
+          error_total += weighted_error( m, this->m_model(i,j,a_j,b_i),
+                                         m_epsilon[m] );
+
+          // B^T * Sigma^-1, the pixel covariance being diagonal
+          vw::Matrix<double,point_params_n,2> Bt_inv_cov = transpose(B);
+          for ( unsigned r = 0; r < point_params_n; r++ ) {
+            Bt_inv_cov(r,0) *= m_measure_inverse_sigma2[m][0];
+            Bt_inv_cov(r,1) *= m_measure_inverse_sigma2[m][1];
+          }
+
+          V += Bt_inv_cov * B;
+          epsilon_b += Bt_inv_cov * m_epsilon[m];
+          m_W[m] = transpose(Bt_inv_cov * m_A[m]);
+        }
+        m_V[i] = V;
+        m_epsilon_b[i] = epsilon_b;
+      }
+    }
+
+    // Second pass, over cameras. Sums U and epsilon_a from the
+    // jacobians stored by the first pass.
+    void assemble_cameras( size_t begin, size_t end, double& /*unused*/ ) {
+      for ( size_t j = begin; j < end; j++ ) {
+        matrix_camera_camera U;
+        vector_camera epsilon_a;
+        BOOST_FOREACH( size_t m, m_camera_measures[j] ) {
+          vw::Matrix<double,camera_params_n,2> At_inv_cov = transpose(m_A[m]);
+          for ( unsigned r = 0; r < camera_params_n; r++ ) {
+            At_inv_cov(r,0) *= m_measure_inverse_sigma2[m][0];
+            At_inv_cov(r,1) *= m_measure_inverse_sigma2[m][1];
+          }
+          U += At_inv_cov * m_A[m];
+          epsilon_a += At_inv_cov * m_epsilon[m];
+        }
+        m_U[j] = U;
+        m_epsilon_a[j] = epsilon_a;
+      }
+    }
+
+    // Image error of the measures of points [begin, end) for the
+    // proposed parameters m_new_a and m_new_b.
+    void update_error_points( size_t begin, size_t end, double& error_total ) {
+      vw::Vector2 epsilon;
+      for ( size_t i = begin; i < end; i++ )
+        for ( size_t m = m_point_measures[i]; m < m_point_measures[i+1]; m++ ) {
+          unsigned j = m_measure_camera[m];
+          error_total += weighted_error( m, this->m_model(i,j,m_new_a[j],m_new_b[i]),
+                                         epsilon );
+        }
+    }
+
+    // Run 'func' over [0, count) split in a few jobs per thread, and
+    // return the sum of the results of the jobs.
+    double run_parallel( range_func func, size_t count ) {
+      if ( m_num_threads <= 1 || count < 2 ) {
+        double result = 0;
+        (this->*func)( 0, count, result );
+        return result;
+      }
+
+      size_t num_jobs = std::min( count, size_t(m_num_threads) * 4 );
+      std::vector<double> results( num_jobs, 0.0 );
+      vw::FifoWorkQueue queue( m_num_threads );
+      for ( size_t k = 0; k < num_jobs; k++ ) {
+        boost::shared_ptr<vw::Task>
+          task( new RangeTask( *this, func, k*count/num_jobs,
+                               (k+1)*count/num_jobs, results[k] ) );
+        queue.add_task( task );
+      }
+      queue.join_all();
+
+      double result = 0;
+      for ( size_t k = 0; k < num_jobs; k++ )
+        result += results[k];
+      return result;
+    }
+
+  public:
+
+    AdjustSparseParallel( ModelT & model, RobustCostT const& robust_cost_func,
+                          bool use_camera_constraint=true,
+                          bool use_gcp_constraint=true,
+                          int num_threads = vw::vw_settings().default_num_threads() ) :
+      vw::ba::BundleAdjustmentBase<ModelT,RobustCostT>( model, robust_cost_func,
+                                                        use_camera_constraint,
+                                                        use_gcp_constraint ),
+      m_num_threads( num_threads ), m_found_ideal_ordering( false ) {
+
+      size_t num_cameras = this->m_model.num_cameras();
+      size_t num_points  = this->m_model.num_points();
+      m_camera_measures.resize( num_cameras );
+      m_point_measures.reserve( num_points + 1 );
+      m_point_measures.push_back( 0 );
+      for ( size_t i = 0; i < num_points; i++ ) {
+        BOOST_FOREACH( vw::ba::ControlMeasure const& cm, (*this->m_control_net)[i] ) {
+          VW_ASSERT( cm.image_id() >= 0 && size_t(cm.image_id()) < num_cameras,
+                     vw::ArgumentErr() << "AdjustSparseParallel: image index out of bounds." );
+          m_camera_measures[cm.image_id()].push_back( m_measure_camera.size() );
+          m_measure_camera.push_back( cm.image_id() );
+          m_measure_pixel.push_back( cm.dominant() );
+          vw::Vector2 sigma = cm.sigma();
+          m_measure_inverse_sigma2.push_back( vw::Vector2( 1/(sigma[0]*sigma[0]),
+                                                           1/(sigma[1]*sigma[1]) ) );
+        }
+        m_point_measures.push_back( m_measure_camera.size() );
+      }
+
+      size_t num_measures = m_measure_camera.size();
+      m_A.resize( num_measures );
+      m_epsilon.resize( num_measures );
+      m_W.resize( num_measures );
+      m_Y.resize( num_measures );
+      m_U.resize( num_cameras );
+      m_epsilon_a.resize( num_cameras );
+      m_new_a.resize( num_cameras );
+      m_V.resize( num_points );
+      m_epsilon_b.resize( num_points );
+      m_new_b.resize( num_points );
+    }
+
+    int num_threads() const { return m_num_threads; }
+    Timing const& last_timing() const { return m_timing; }
+
+    // UPDATE IMPLEMENTATION
+    //-------------------------------------------------------------
+    // This is the sparse levenberg marquardt update step. Returns
+    // the average improvement in the cost function.
+    double update( double &abs_tol, double &rel_tol ) {
+      ++this->m_iterations;
+      vw::Stopwatch watch;
+
+      unsigned num_cameras = this->m_model.num_cameras();
+      unsigned num_points  = this->m_model.num_points();
+
+      // --- ASSEMBLY -------------------------------------------------
+      watch.start();
+      double error_total =
+        run_parallel( &AdjustSparseParallel::assemble_points, num_points );
+      run_parallel( &AdjustSparseParallel::assemble_cameras, num_cameras );
+      watch.stop();
+      m_timing.assembly = watch.elapsed_seconds();
+
+      watch.reset();
+      watch.start();
+
+      // set initial lambda, and ignore if the user has touched it
+      if ( this->m_iterations == 1 && this->m_lambda == 1e-3 ) {
+        double max = 0.0;
+        for ( unsigned j = 0; j < num_cameras; ++j )
+          for ( unsigned n = 0; n < camera_params_n; ++n )
+            max = std::max( max, fabs(m_U[j](n,n)) );
+        for ( unsigned i = 0; i < num_points; ++i )
+          for ( unsigned n = 0; n < point_params_n; ++n )
+            max = std::max( max, fabs(m_V[i](n,n)) );
+        this->m_lambda = max * 1e-10;
+      }
+
+      // Add in the camera position and pose constraint terms and
+      // covariances.
+      if ( this->m_use_camera_constraint )
+        for ( unsigned j = 0; j < num_cameras; ++j ) {
+          matrix_camera_camera inverse_cov = this->m_model.A_inverse_covariance(j);
+          m_U[j] += inverse_cov;
+          vector_camera eps_a = this->m_model.A_target(j)-this->m_model.A_parameters(j);
+          error_total += .5 * transpose(eps_a) * inverse_cov * eps_a;
+          m_epsilon_a[j] += inverse_cov * eps_a;
+        }
+
+      // Add in the 3D point position constraint terms and
+      // covariances. We only add constraints for Ground Control
+      // Points (GCPs), not for 3D tie points.
+      if ( this->m_use_gcp_constraint )
+        for ( unsigned i = 0; i < num_points; ++i )
+          if ( (*this->m_control_net)[i].type() == vw::ba::ControlPoint::GroundControlPoint ) {
+            matrix_point_point inverse_cov = this->m_model.B_inverse_covariance(i);
+            m_V[i] += inverse_cov;
+            vector_point eps_b = this->m_model.B_target(i)-this->m_model.B_parameters(i);
+            error_total += .5 * transpose(eps_b) * inverse_cov * eps_b;
+            m_epsilon_b[i] += inverse_cov * eps_b;
+          }
+
+      // Flatten both epsilon_a and epsilon_b into g
+      vw::Vector<double> g( num_cameras*camera_params_n + num_points*point_params_n );
+      for ( unsigned j = 0; j < num_cameras; ++j )
+        subvector(g, j*camera_params_n, camera_params_n) = m_epsilon_a[j];
+      for ( unsigned i = 0; i < num_points; ++i )
+        subvector(g, num_cameras*camera_params_n + i*point_params_n, point_params_n) = m_epsilon_b[i];
+
+      // "Augment" the diagonal entries of the U and V matrices with
+      // the parameter lambda.
+      for ( unsigned j = 0; j < num_cameras; ++j )
+        for ( unsigned n = 0; n < camera_params_n; ++n )
+          m_U[j](n,n) += this->m_lambda;
+      for ( unsigned i = 0; i < num_points; ++i )
+        for ( unsigned n = 0; n < point_params_n; ++n )
+          m_V[i](n,n) += this->m_lambda;
+
+      // Create the 'e' vector in S * delta_a = e, and the blocks of Y.
+      vw::Vector<double> e( num_cameras*camera_params_n );
+      for ( unsigned j = 0; j < num_cameras; ++j )
+        subvector(e, j*camera_params_n, camera_params_n) = m_epsilon_a[j];
+      for ( unsigned i = 0; i < num_points; ++i ) {
+        vw::Matrix<double> V_temp = m_V[i];
+        chol_inverse(V_temp);
+        matrix_point_point V_inverse = transpose(V_temp) * V_temp;
+        for ( size_t m = m_point_measures[i]; m < m_point_measures[i+1]; ++m ) {
+          m_Y[m] = m_W[m] * V_inverse;
+          subvector(e, m_measure_camera[m]*camera_params_n, camera_params_n) -=
+            m_Y[m] * m_epsilon_b[i];
+        }
+      }
+
+      // Build the reduced camera system S, with its sparse skyline
+      // structure.
+      vw::math::MatrixSparseSkyline<double> S( num_cameras*camera_params_n,
+                                               num_cameras*camera_params_n );
+      for ( unsigned i = 0; i < num_points; ++i )
+        for ( size_t mj = m_point_measures[i]; mj < m_point_measures[i+1]; ++mj ) {
+          unsigned j = m_measure_camera[mj];
+          for ( size_t mk = m_point_measures[i]; mk < m_point_measures[i+1]; ++mk ) {
+            unsigned k = m_measure_camera[mk];
+            matrix_camera_camera temp = -m_Y[mj] * transpose( m_W[mk] );
+            // Only the lower triangle is stored; the symmetric
+            // entries of the skyline matrix are shallow.
+            for ( unsigned aa = 0; aa < camera_params_n; ++aa )
+              for ( unsigned bb = 0; bb < camera_params_n; ++bb )
+                if ( k*camera_params_n + bb <= j*camera_params_n + aa )
+                  S( j*camera_params_n + aa, k*camera_params_n + bb ) += temp(aa,bb);
+          }
+        }
+      for ( unsigned j = 0; j < num_cameras; ++j )
+        for ( unsigned aa = 0; aa < camera_params_n; ++aa )
+          for ( unsigned bb = 0; bb <= aa; ++bb )
+            S( j*camera_params_n + aa, j*camera_params_n + bb ) += m_U[j](aa,bb);
+
+      if ( !m_found_ideal_ordering ) {
+        m_ideal_ordering = vw::math::cuthill_mckee_ordering( S, camera_params_n );
+        vw::math::MatrixReorganize<vw::math::MatrixSparseSkyline<double> > mod_S( S, m_ideal_ordering );
+        m_ideal_skyline = vw::math::solve_for_skyline( mod_S );
+        m_found_ideal_ordering = true;
+      }
+
+      // Compute the LDL^T decomposition and solve using sparse methods.
+      vw::math::MatrixReorganize<vw::math::MatrixSparseSkyline<double> > modified_S( S, m_ideal_ordering );
+      vw::Vector<double> delta_a = sparse_solve( modified_S,
+                                                 reorganize(e, m_ideal_ordering),
+                                                 m_ideal_skyline );
+      delta_a = reorganize( delta_a, modified_S.inverse() );
+
+      // Back solve for delta_b
+      vw::Vector<double> delta( g.size() );
+      subvector(delta, 0, delta_a.size()) = delta_a;
+      for ( unsigned i = 0; i < num_points; ++i ) {
+        vector_point temp;
+        for ( size_t m = m_point_measures[i]; m < m_point_measures[i+1]; ++m )
+          temp += transpose( m_W[m] ) *
+            subvector( delta_a, m_measure_camera[m]*camera_params_n, camera_params_n );
+        vw::Vector<double> delta_temp = m_epsilon_b[i] - temp;
+        vw::Matrix<double> hessian = m_V[i];
+        solve( delta_temp, hessian );
+        subvector(delta, num_cameras*camera_params_n + i*point_params_n, point_params_n) = delta_temp;
+      }
+      double dS = .5 * transpose(delta) * (this->m_lambda * delta + g);
+      watch.stop();
+      m_timing.solve = watch.elapsed_seconds();
+
+      // --- UPDATE ERROR ----------------------------------------------
+      watch.reset();
+      watch.start();
+      for ( unsigned j = 0; j < num_cameras; ++j )
+        m_new_a[j] = this->m_model.A_parameters(j) +
+          subvector(delta, j*camera_params_n, camera_params_n);
+      for ( unsigned i = 0; i < num_points; ++i )
+        m_new_b[i] = this->m_model.B_parameters(i) +
+          subvector(delta, num_cameras*camera_params_n + i*point_params_n, point_params_n);
+
+      double new_error_total =
+        run_parallel( &AdjustSparseParallel::update_error_points, num_points );
+
+      if ( this->m_use_camera_constraint )
+        for ( unsigned j = 0; j < num_cameras; ++j ) {
+          vector_camera eps_a = this->m_model.A_target(j) - m_new_a[j];
+          new_error_total += .5 * transpose(eps_a) *
+            this->m_model.A_inverse_covariance(j) * eps_a;
+        }
+      if ( this->m_use_gcp_constraint )
+        for ( unsigned i = 0; i < num_points; ++i )
+          if ( (*this->m_control_net)[i].type() == vw::ba::ControlPoint::GroundControlPoint ) {
+            vector_point eps_b = this->m_model.B_target(i) - m_new_b[i];
+            new_error_total += .5 * transpose(eps_b) *
+              this->m_model.B_inverse_covariance(i) * eps_b;
+          }
+      watch.stop();
+      m_timing.update_error = watch.elapsed_seconds();
+
+      // Fletcher modification
+      double R = ( error_total - new_error_total ) / dS;
+      abs_tol = vw::math::max(g) + vw::math::max(-g);
+      rel_tol = transpose(delta)*delta;
+
+      if ( R > 0 ) {
+        for ( unsigned j = 0; j < num_cameras; ++j )
+          this->m_model.set_A_parameters( j, m_new_a[j] );
+        for ( unsigned i = 0; i < num_points; ++i )
+          this->m_model.set_B_parameters( i, m_new_b[i] );
+
+        if ( this->m_control == 0 ) {
+          double temp = 1 - pow((2*R - 1),3);
+          if ( temp < 1.0/3.0 )
+            temp = 1.0/3.0;
+          this->m_lambda *= temp;
+          this->m_nu = 2;
+        } else if ( this->m_control == 1 ) {
+          this->m_lambda /= 10;
+        }
+        return rel_tol;
+      }
+
+      // here we didn't make progress
+      if ( this->m_control == 0 ) {
+        this->m_lambda *= this->m_nu;
+        this->m_nu *= 2;
+      } else if ( this->m_control == 1 ) {
+        this->m_lambda *= 10;
+      }
+      return vw::ScalarTypeLimits<double>::highest();
+    }
+  };
+
+} // namespace asp
+
+#endif//__ASP_CORE_BUNDLE_ADJUST_PARALLEL_H__
@@ -31,6 +31,7 @@
 #include <vw/Math/Vector.h>
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Cartography/GeoReference.h>
+#include <asp/Core/TileScheduler.h>
 #include <map>
 #include <string>
 
@@ -109,6 +110,7 @@ namespace asp {
     vw::uint32 num_threads;
     std::string cache_dir;
     std::string tif_compress;
+    TileSchedulerOptions tile_scheduler; // Used by the block writers if enabled
     static int corr_tile_size() { return 1024; } // Tile size for correlation
     static int rfne_tile_size() { return 256;  } // Tile size for refinement
     static int tri_tile_size()  { return 256;  } // Tile size for tri/point cloud
@@ -141,6 +143,19 @@ namespace asp {
     return new vw::DiskImageResourceGDAL(filename, image.impl().format(), opt.raster_tile_size, opt.gdal_options);
   }
 
+  // Block write image to a resource, with the tile scheduler if it
+  // is enabled in the options, else with the VW thread pool.
+  template <class ImageT>
+  void block_write_rsrc( vw::ImageResource& rsrc,
+                         vw::ImageViewBase<ImageT> const& image,
+                         BaseOptions const& opt,
+                         vw::ProgressCallback const& progress_callback ) {
+    if ( opt.tile_scheduler.enabled )
+      scheduled_block_write_image( rsrc, image.impl(), opt.tile_scheduler, progress_callback );
+    else
+      vw::block_write_image( rsrc, image.impl(), progress_callback );
+  }
+
   // Block write image.
   template <class ImageT>
   void block_write_gdal_image( const std::string &filename,
@@ -148,7 +163,7 @@ namespace asp {
                                BaseOptions const& opt,
                                vw::ProgressCallback const& progress_callback = vw::ProgressCallback::dummy_instance() ) {
     boost::scoped_ptr<vw::DiskImageResourceGDAL> rsrc( build_gdal_rsrc( filename, image, opt ) );
-    vw::block_write_image( *rsrc, image.impl(), progress_callback );
+    block_write_rsrc( *rsrc, image.impl(), opt, progress_callback );
   }
 
   // Block write image with georef and keywords to geoheader.
@@ -167,7 +182,7 @@ namespace asp {
       vw::cartography::write_header_string(*rsrc, i->first, i->second);
     }    
     vw::cartography::write_georeference(*rsrc, georef);
-    vw::block_write_image( *rsrc, image.impl(), progress_callback );
+    block_write_rsrc( *rsrc, image.impl(), opt, progress_callback );
   }
 
   // Block write image with nodata.
@@ -179,7 +194,7 @@ namespace asp {
                                vw::ProgressCallback const& progress_callback = vw::ProgressCallback::dummy_instance() ) {
     boost::scoped_ptr<vw::DiskImageResourceGDAL> rsrc( build_gdal_rsrc( filename, image, opt ) );
     rsrc->set_nodata_write(nodata);
-    vw::block_write_image( *rsrc, image.impl(), progress_callback );
+    block_write_rsrc( *rsrc, image.impl(), opt, progress_callback );
   }
 
   // Block write image with nodata, georef, and keywords to geoheader.
@@ -203,7 +218,7 @@ namespace asp {
     }    
     
     vw::cartography::write_georeference(*rsrc, georef);
-    vw::block_write_image( *rsrc, image.impl(), progress_callback );
+    block_write_rsrc( *rsrc, image.impl(), opt, progress_callback );
   }
 
   // Single-threaded write functions.
@@ -377,16 +392,16 @@ namespace asp {
                                vw::channel_cast<float>(image.impl()),
                                opt));
       vw::cartography::write_header_string(*rsrc, POINT_OFFSET, vec_to_str(shift));
-      vw::block_write_image( *rsrc,
-                             vw::channel_cast<float>
-                             (round_image_pixels(subtract_shift(image.impl(),
-                                                                shift),
-                                                 rounding_error)),
-                             progress_callback );
+      block_write_rsrc( *rsrc,
+                        vw::channel_cast<float>
+                        (round_image_pixels(subtract_shift(image.impl(),
+                                                           shift),
+                                            rounding_error)),
+                        opt, progress_callback );
     }else{
       boost::scoped_ptr<vw::DiskImageResourceGDAL>
         rsrc( build_gdal_rsrc( filename, image, opt ) );
-      vw::block_write_image( *rsrc, image.impl(), progress_callback );
+      block_write_rsrc( *rsrc, image.impl(), opt, progress_callback );
     }
 
   }
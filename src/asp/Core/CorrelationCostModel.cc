@@ -0,0 +1,134 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Core/CorrelationCostModel.h>
+#include <vw/Core/Exception.h>
+#include <vw/Math/LinearAlgebra.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace vw;
+
+namespace asp {
+
+  // Fewer samples than this and the fit is not trusted
+  static const size_t MIN_SAMPLES = 8;
+
+  const size_t CorrelationCostModel::MAX_SAVED_SAMPLES;
+
+  Vector<double,CorrelationCostModel::NUM_TERMS>
+  CorrelationCostModel::terms( CorrelationSample const& s ) {
+    double valid_ops = s.pixels * s.valid_fraction * s.search_area;
+    return Vector3( s.pixels, valid_ops, valid_ops * s.kernel_area );
+  }
+
+  void CorrelationCostModel::add( CorrelationSample const& sample ) {
+    Vector<double,NUM_TERMS> x = terms( sample );
+    Mutex::Lock lock( m_mutex );
+    m_normal += outer_prod( x, x );
+    m_rhs    += x * sample.elapsed;
+    m_num_samples++;
+    m_samples.push_back( sample );
+    if ( m_samples.size() > MAX_SAVED_SAMPLES )
+      m_samples.pop_front();
+  }
+
+  size_t CorrelationCostModel::size() const {
+    Mutex::Lock lock( m_mutex );
+    return m_num_samples;
+  }
+
+  bool CorrelationCostModel::is_ready() const {
+    return size() >= MIN_SAMPLES;
+  }
+
+  Vector<double,CorrelationCostModel::NUM_TERMS>
+  CorrelationCostModel::coefficients() const {
+    Matrix<double,NUM_TERMS,NUM_TERMS> normal;
+    Vector<double,NUM_TERMS> rhs;
+    {
+      Mutex::Lock lock( m_mutex );
+      normal = m_normal;
+      rhs    = m_rhs;
+    }
+
+    // The terms differ by many orders of magnitude, so solve for the
+    // terms scaled to unit norm, with a little damping for the terms
+    // the samples do not tell apart (such as a fixed kernel size).
+    Vector<double,NUM_TERMS> scale;
+    for ( int i = 0; i < NUM_TERMS; i++ )
+      scale[i] = normal(i,i) > 0 ? 1.0 / std::sqrt( normal(i,i) ) : 0.0;
+    for ( int i = 0; i < NUM_TERMS; i++ ) {
+      for ( int j = 0; j < NUM_TERMS; j++ )
+        normal(i,j) *= scale[i] * scale[j];
+      normal(i,i) += 1e-6;
+      rhs[i] *= scale[i];
+    }
+    return elem_prod( scale, Vector<double,NUM_TERMS>( inverse( normal ) * rhs ) );
+  }
+
+  double CorrelationCostModel::predict( CorrelationSample const& sample ) const {
+    if ( !is_ready() )
+      return 0.0;
+    return std::max( 0.0, dot_prod( coefficients(), terms( sample ) ) );
+  }
+
+  int CorrelationCostModel::timeout( CorrelationSample const& sample, int timeout ) const {
+    if ( timeout <= 0 || !is_ready() )
+      return timeout;
+    double budget = 2.0 * predict( sample );
+    budget = std::max( budget, std::ceil( timeout / 4.0 ) );
+    budget = std::min( budget, 4.0 * timeout );
+    return int( std::ceil( budget ) );
+  }
+
+  void CorrelationCostModel::write( std::string const& filename ) const {
+    std::ofstream os( filename.c_str() );
+    if ( !os )
+      vw_throw( IOErr() << "Could not write: " << filename << "\n" );
+    os << "# pixels search_area kernel_area valid_fraction elapsed\n";
+    os.precision( 10 );
+    Mutex::Lock lock( m_mutex );
+    for ( size_t i = 0; i < m_samples.size(); i++ ) {
+      CorrelationSample const& s = m_samples[i];
+      os << s.pixels << " " << s.search_area << " " << s.kernel_area << " "
+         << s.valid_fraction << " " << s.elapsed << "\n";
+    }
+  }
+
+  void CorrelationCostModel::read( std::string const& filename ) {
+    std::ifstream is( filename.c_str() );
+    if ( !is )
+      vw_throw( IOErr() << "Could not read: " << filename << "\n" );
+    std::string line;
+    while ( std::getline( is, line ) ) {
+      if ( line.empty() || line[0] == '#' )
+        continue;
+      std::istringstream ls( line );
+      CorrelationSample s;
+      if ( !( ls >> s.pixels >> s.search_area >> s.kernel_area
+              >> s.valid_fraction >> s.elapsed ) )
+        vw_throw( IOErr() << "Invalid line in " << filename << ": " << line << "\n" );
+      add( s );
+    }
+  }
+
+} // end namespace asp
@@ -0,0 +1,97 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CorrelationCostModel.h
+///
+/// Learns how long the correlation of a tile takes from the tiles
+/// already correlated, to give each tile a time budget suited to its
+/// size and search range rather than one timeout for all.
+///
+
+#ifndef __ASP_CORE_CORRELATION_COST_MODEL_H__
+#define __ASP_CORE_CORRELATION_COST_MODEL_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Math/Vector.h>
+#include <vw/Math/Matrix.h>
+
+#include <deque>
+#include <string>
+
+namespace asp {
+
+  // What is known of a tile before correlating it, and how long it took
+  struct CorrelationSample {
+    double pixels;         // Tile area
+    double search_area;    // Number of disparities searched
+    double kernel_area;
+    double valid_fraction; // Fraction of the tile not masked out
+    double elapsed;        // Seconds
+
+    CorrelationSample() : pixels(0), search_area(0), kernel_area(0),
+                          valid_fraction(0), elapsed(0) {}
+  };
+
+  // Least squares fit of the elapsed time as a linear combination of
+  // the tile area (fixed costs), the number of valid pixel and
+  // disparity pairs (cost computation and the pyramid), and that
+  // number times the kernel area (kernels that are not box filtered).
+  // All methods are thread safe.
+  class CorrelationCostModel {
+  public:
+    static const int NUM_TERMS = 3;
+
+    // Only the latest samples are kept to be written out, so that the
+    // file of timings does not grow from run to run.
+    static const size_t MAX_SAVED_SAMPLES = 2000;
+
+    CorrelationCostModel() : m_normal(), m_rhs(), m_num_samples(0) {}
+
+    void add( CorrelationSample const& sample );
+    size_t size() const;
+
+    // Seconds for a tile, never negative. Zero until there are enough
+    // samples to fit the model.
+    double predict( CorrelationSample const& sample ) const;
+    bool is_ready() const;
+
+    // Time budget for a tile, twice the predicted time, within a
+    // quarter and four times 'timeout'. Returns 'timeout' until the
+    // model is ready.
+    int timeout( CorrelationSample const& sample, int timeout ) const;
+
+    // The latest samples as text, one per line, so that later runs
+    // can start from them. Reading adds to the samples already there.
+    void write( std::string const& filename ) const;
+    void read( std::string const& filename );
+
+    static vw::Vector<double,NUM_TERMS> terms( CorrelationSample const& sample );
+
+  private:
+    vw::Vector<double,NUM_TERMS> coefficients() const;
+
+    mutable vw::Mutex m_mutex;
+    vw::Matrix<double,NUM_TERMS,NUM_TERMS> m_normal; // Normal equations
+    vw::Vector<double,NUM_TERMS> m_rhs;
+    size_t m_num_samples;
+    std::deque<CorrelationSample> m_samples; // At most MAX_SAVED_SAMPLES
+  };
+
+} // end namespace asp
+
+#endif//__ASP_CORE_CORRELATION_COST_MODEL_H__
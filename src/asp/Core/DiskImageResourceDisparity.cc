@@ -0,0 +1,574 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DiskImageResourceDisparity.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypeInfo.h>
+#include <vw/Image/ImageResource.h>
+#include <asp/Core/DiskImageResourceDisparity.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace vw;
+
+namespace {
+
+  // File layout, in the byte order of the machine that wrote it:
+  //   header: magic[8] version byte_order cols rows block_cols
+  //           block_rows fraction_bits index_offset
+  //   tiles, in the order they were written
+  //   index:  offset bytes flags, for each tile in row major order
+  const char   DSP_MAGIC[8]    = {'A','S','P','D','I','S','P','\0'};
+  const uint32 DSP_VERSION     = 1;
+  const uint32 DSP_BYTE_ORDER  = 0x01020304;
+  const size_t DSP_HEADER_SIZE = 8 + 2*sizeof(uint32) + 5*sizeof(int32) + sizeof(uint64);
+  const size_t DSP_ENTRY_SIZE  = sizeof(uint64) + 2*sizeof(uint32);
+
+  const uint32 TILE_EMPTY = 1; // No valid pixels, no data
+  const uint32 TILE_FULL  = 2; // All pixels valid, no run lengths
+
+  const int64 MAX_RUN   = std::numeric_limits<uint16>::max();
+  const int64 MAX_DELTA = std::numeric_limits<uint16>::max();
+
+  template <class T>
+  void put( std::string& bytes, T value ) {
+    bytes.append( reinterpret_cast<const char*>(&value), sizeof(T) );
+  }
+
+  // Reads values from a block of bytes, with bounds checking
+  class ByteReader {
+    const char *m_pos, *m_end;
+  public:
+    ByteReader( const char* data, size_t size ) : m_pos(data), m_end(data + size) {}
+
+    template <class T>
+    T get() {
+      VW_ASSERT( m_pos + sizeof(T) <= m_end,
+                 IOErr() << "DiskImageResourceDisparity: Truncated data." );
+      T value;
+      std::memcpy( &value, m_pos, sizeof(T) );
+      m_pos += sizeof(T);
+      return value;
+    }
+  };
+
+  int fraction_bytes( int fraction_bits ) {
+    return (fraction_bits + 7) / 8;
+  }
+
+  // Integer part, rounded down, of the disparity in units of
+  // 2^-fraction_bits pixels.
+  int64 floor_div( int64 q, int64 scale ) {
+    return q >= 0 ? q / scale : -((-q + scale - 1) / scale);
+  }
+
+  // Run lengths longer than a uint16 are split with runs of length
+  // zero of the other kind in between.
+  void push_run( std::vector<uint16>& runs, int64 run ) {
+    while ( run > MAX_RUN ) {
+      runs.push_back( uint16(MAX_RUN) );
+      runs.push_back( 0 );
+      run -= MAX_RUN;
+    }
+    runs.push_back( uint16(run) );
+  }
+
+  template <class PixelT>
+  void encode_tile( ImageView<PixelT> const& tile, int fraction_bits,
+                    std::string& bytes, uint32& flags ) {
+    bytes.clear();
+    const int64 scale = int64(1) << fraction_bits;
+
+    // Run lengths of the invalid and valid pixels in row major order,
+    // starting with the invalid ones.
+    std::vector<uint16> runs;
+    std::vector<int64>  int_parts, fractions;
+    int64 base[2] = { std::numeric_limits<int64>::max(), std::numeric_limits<int64>::max() };
+    bool in_valid_run = false;
+    int64 run = 0, num_valid = 0;
+    for ( int32 row = 0; row < tile.rows(); row++ ) {
+      for ( int32 col = 0; col < tile.cols(); col++ ) {
+        PixelT const& pix = tile(col, row);
+        bool valid = is_valid(pix);
+        if ( valid != in_valid_run ) {
+          push_run( runs, run );
+          run = 0;
+          in_valid_run = valid;
+        }
+        run++;
+        if ( !valid )
+          continue;
+        num_valid++;
+        for ( int c = 0; c < 2; c++ ) {
+          int64 q = (int64)llround( double(pix.child()[c]) * scale );
+          int64 int_part = floor_div( q, scale );
+          int_parts.push_back( int_part );
+          fractions.push_back( q - int_part*scale );
+          base[c] = std::min( base[c], int_part );
+        }
+      }
+    }
+    push_run( runs, run );
+
+    if ( num_valid == 0 ) {
+      flags = TILE_EMPTY;
+      return;
+    }
+
+    flags = 0;
+    if ( num_valid == int64(tile.cols())*tile.rows() ) {
+      flags = TILE_FULL;
+    } else {
+      put( bytes, uint32(runs.size()) );
+      for ( size_t i = 0; i < runs.size(); i++ )
+        put( bytes, runs[i] );
+    }
+
+    for ( int c = 0; c < 2; c++ ) {
+      VW_ASSERT( base[c] >= std::numeric_limits<int32>::min() &&
+                 base[c] <= std::numeric_limits<int32>::max(),
+                 ArgumentErr() << "DiskImageResourceDisparity: Disparity out of range." );
+      put( bytes, int32(base[c]) );
+    }
+
+    int num_fraction_bytes = fraction_bytes( fraction_bits );
+    for ( size_t i = 0; i < int_parts.size(); i++ ) {
+      int64 delta = int_parts[i] - base[i % 2];
+      VW_ASSERT( delta <= MAX_DELTA,
+                 ArgumentErr() << "DiskImageResourceDisparity: The disparities in a tile span more than "
+                 << MAX_DELTA << " pixels. Use a GDAL image instead." );
+      put( bytes, uint16(delta) );
+      if ( num_fraction_bytes == 1 )
+        put( bytes, uint8(fractions[i]) );
+      else if ( num_fraction_bytes == 2 )
+        put( bytes, uint16(fractions[i]) );
+    }
+  }
+
+  template <class PixelT>
+  void decode_tile( const char* data, size_t size, uint32 flags, int fraction_bits,
+                    ImageView<PixelT>& tile ) {
+    typedef typename CompoundChannelType<PixelT>::type channel_type;
+    const double scale = double( int64(1) << fraction_bits );
+    const int64 num_pixels = int64(tile.cols())*tile.rows();
+    ByteReader reader( data, size );
+
+    std::vector<uint8> valid( num_pixels, (flags & TILE_FULL) ? 1 : 0 );
+    if ( !(flags & TILE_FULL) ) {
+      uint32 num_runs = reader.get<uint32>();
+      int64 pos = 0;
+      for ( uint32 i = 0; i < num_runs; i++ ) {
+        int64 run = reader.get<uint16>();
+        VW_ASSERT( pos + run <= num_pixels,
+                   IOErr() << "DiskImageResourceDisparity: Invalid run length." );
+        if ( i % 2 == 1 )
+          std::fill( valid.begin() + pos, valid.begin() + pos + run, 1 );
+        pos += run;
+      }
+    }
+
+    int64 base[2];
+    base[0] = reader.get<int32>();
+    base[1] = reader.get<int32>();
+
+    int num_fraction_bytes = fraction_bytes( fraction_bits );
+    int64 index = 0;
+    for ( int32 row = 0; row < tile.rows(); row++ ) {
+      for ( int32 col = 0; col < tile.cols(); col++ ) {
+        PixelT& pix = tile(col, row);
+        if ( !valid[index++] ) {
+          pix = PixelT();
+          pix.invalidate();
+          continue;
+        }
+        for ( int c = 0; c < 2; c++ ) {
+          int64 int_part = base[c] + reader.get<uint16>();
+          int64 fraction = 0;
+          if ( num_fraction_bytes == 1 )
+            fraction = reader.get<uint8>();
+          else if ( num_fraction_bytes == 2 )
+            fraction = reader.get<uint16>();
+          pix.child()[c] = channel_type( double(int_part) + double(fraction) / scale );
+        }
+        pix.validate();
+      }
+    }
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  DisparityTileIndex::DisparityTileIndex( Vector2i const& image_size,
+                                          Vector2i const& block_size,
+                                          std::vector<uint8> const& empty_tiles ) :
+    m_image_size(image_size), m_block_size(block_size), m_empty_tiles(empty_tiles) {}
+
+  DisparityTileIndex::DisparityTileIndex( std::string const& filename ) {
+    if ( DiskImageResourceDisparity::is_disparity_file( filename ) )
+      *this = DiskImageResourceDisparity( filename ).tile_index();
+  }
+
+  bool DisparityTileIndex::empty( BBox2i const& bbox ) const {
+    if ( m_empty_tiles.empty() )
+      return false;
+
+    BBox2i region = bbox;
+    region.crop( BBox2i( 0, 0, m_image_size.x(), m_image_size.y() ) );
+    if ( region.empty() )
+      return true;
+
+    int tiles_per_row = (m_image_size.x() + m_block_size.x() - 1) / m_block_size.x();
+    for ( int row = region.min().y() / m_block_size.y();
+          row <= (region.max().y() - 1) / m_block_size.y(); row++ ) {
+      for ( int col = region.min().x() / m_block_size.x();
+            col <= (region.max().x() - 1) / m_block_size.x(); col++ ) {
+        if ( !m_empty_tiles[row*tiles_per_row + col] )
+          return false;
+      }
+    }
+    return true;
+  }
+
+  DiskImageResourceDisparity::~DiskImageResourceDisparity() {
+    if ( !m_writable )
+      return;
+    try {
+      flush();
+    } catch ( const Exception& e ) {
+      vw_out(ErrorMessage) << "DiskImageResourceDisparity: Failed to write the index of "
+                           << m_filename << ": " << e.what() << "\n";
+    }
+  }
+
+  bool DiskImageResourceDisparity::is_disparity_file( std::string const& filename ) {
+    return boost::ends_with( boost::to_lower_copy( filename ), ".dsp" );
+  }
+
+  Vector2i DiskImageResourceDisparity::num_tiles() const {
+    return Vector2i( (m_format.cols + m_block_size.x() - 1) / m_block_size.x(),
+                     (m_format.rows + m_block_size.y() - 1) / m_block_size.y() );
+  }
+
+  BBox2i DiskImageResourceDisparity::tile_bbox( int col, int row ) const {
+    BBox2i bbox( col*m_block_size.x(), row*m_block_size.y(),
+                 m_block_size.x(), m_block_size.y() );
+    bbox.crop( BBox2i( 0, 0, m_format.cols, m_format.rows ) );
+    return bbox;
+  }
+
+  DisparityTileIndex DiskImageResourceDisparity::tile_index() const {
+    std::vector<uint8> empty_tiles( m_tiles.size() );
+    {
+      Mutex::Lock lock( m_file_mutex );
+      for ( size_t i = 0; i < m_tiles.size(); i++ )
+        empty_tiles[i] = ( (m_tiles[i].flags & TILE_EMPTY) || m_tiles[i].bytes == 0 );
+    }
+    return DisparityTileIndex( Vector2i( m_format.cols, m_format.rows ),
+                               m_block_size, empty_tiles );
+  }
+
+  void DiskImageResourceDisparity::open( std::string const& filename ) {
+    m_filename = filename;
+    m_writable = false;
+    m_file.open( filename.c_str(), std::ios::in | std::ios::binary );
+    if ( !m_file )
+      vw_throw( IOErr() << "DiskImageResourceDisparity: Could not open " << filename << "." );
+
+    std::string header( DSP_HEADER_SIZE, '\0' );
+    m_file.read( &header[0], header.size() );
+    VW_ASSERT( m_file.good() && std::memcmp( header.data(), DSP_MAGIC, 8 ) == 0,
+               IOErr() << "DiskImageResourceDisparity: " << filename
+               << " is not an ASP disparity file." );
+
+    ByteReader reader( header.data() + 8, header.size() - 8 );
+    uint32 version    = reader.get<uint32>();
+    uint32 byte_order = reader.get<uint32>();
+    VW_ASSERT( version == DSP_VERSION,
+               IOErr() << "DiskImageResourceDisparity: Unsupported version "
+               << version << " in " << filename << "." );
+    VW_ASSERT( byte_order == DSP_BYTE_ORDER,
+               IOErr() << "DiskImageResourceDisparity: " << filename
+               << " was written on a machine with a different byte order." );
+
+    m_format.cols          = reader.get<int32>();
+    m_format.rows          = reader.get<int32>();
+    m_format.planes        = 1;
+    m_block_size.x()       = reader.get<int32>();
+    m_block_size.y()       = reader.get<int32>();
+    m_fraction_bits        = reader.get<int32>();
+    uint64 index_offset    = reader.get<uint64>();
+    VW_ASSERT( m_format.cols > 0 && m_format.rows > 0 &&
+               m_block_size.x() > 0 && m_block_size.y() > 0 &&
+               m_fraction_bits >= 0 && m_fraction_bits <= 16,
+               IOErr() << "DiskImageResourceDisparity: Invalid header in " << filename << "." );
+    VW_ASSERT( index_offset > 0,
+               IOErr() << "DiskImageResourceDisparity: " << filename
+               << " was not completely written." );
+    if ( m_fraction_bits == 0 ) {
+      m_format.pixel_format = PixelFormatID<PixelMask<Vector2i> >::value;
+      m_format.channel_type = ChannelTypeID<int32>::value;
+    } else {
+      m_format.pixel_format = PixelFormatID<PixelMask<Vector2f> >::value;
+      m_format.channel_type = ChannelTypeID<float32>::value;
+    }
+
+    Vector2i tiles = num_tiles();
+    m_tiles.resize( size_t(tiles.x())*tiles.y() );
+    std::string index( m_tiles.size()*DSP_ENTRY_SIZE, '\0' );
+    m_file.seekg( index_offset );
+    m_file.read( &index[0], index.size() );
+    VW_ASSERT( m_file.good(),
+               IOErr() << "DiskImageResourceDisparity: Could not read the index of "
+               << filename << "." );
+    ByteReader index_reader( index.data(), index.size() );
+    for ( size_t i = 0; i < m_tiles.size(); i++ ) {
+      m_tiles[i].offset = index_reader.get<uint64>();
+      m_tiles[i].bytes  = index_reader.get<uint32>();
+      m_tiles[i].flags  = index_reader.get<uint32>();
+    }
+    m_data_end = index_offset;
+  }
+
+  /// Bind the resource to a file for writing. Any three channel
+  /// pixel type is accepted, the last channel being the mask.
+  void DiskImageResourceDisparity::create( std::string const& filename,
+                                           ImageFormat const& format,
+                                           Vector2i const& block_size,
+                                           int fraction_bits ) {
+    VW_ASSERT( format.planes == 1 && num_channels(format.pixel_format) == 3,
+               NoImplErr() << "DiskImageResourceDisparity: Can only write masked "
+               << "two channel disparities." );
+    VW_ASSERT( block_size.x() > 0 && block_size.y() > 0,
+               ArgumentErr() << "DiskImageResourceDisparity: Invalid block size." );
+
+    bool is_float = ( format.channel_type == VW_CHANNEL_FLOAT32 ||
+                      format.channel_type == VW_CHANNEL_FLOAT64 );
+    if ( fraction_bits < 0 )
+      fraction_bits = is_float ? 8 : 0;
+    VW_ASSERT( is_float ? (fraction_bits >= 1 && fraction_bits <= 16) : fraction_bits == 0,
+               ArgumentErr() << "DiskImageResourceDisparity: Invalid number of fraction bits: "
+               << fraction_bits << "." );
+
+    m_filename      = filename;
+    m_writable      = true;
+    m_block_size    = block_size;
+    m_fraction_bits = fraction_bits;
+    m_format        = format;
+    if ( m_fraction_bits == 0 ) {
+      m_format.pixel_format = PixelFormatID<PixelMask<Vector2i> >::value;
+      m_format.channel_type = ChannelTypeID<int32>::value;
+    } else {
+      m_format.pixel_format = PixelFormatID<PixelMask<Vector2f> >::value;
+      m_format.channel_type = ChannelTypeID<float32>::value;
+    }
+
+    Vector2i tiles = num_tiles();
+    m_tiles.assign( size_t(tiles.x())*tiles.y(), TileEntry() );
+    m_data_end = DSP_HEADER_SIZE;
+
+    m_file.open( filename.c_str(),
+                 std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary );
+    if ( !m_file )
+      vw_throw( IOErr() << "DiskImageResourceDisparity: Could not create " << filename << "." );
+    write_header();
+  }
+
+  // The index offset stays zero until flush() writes the index.
+  void DiskImageResourceDisparity::write_header() {
+    std::string header( DSP_MAGIC, 8 );
+    put( header, DSP_VERSION );
+    put( header, DSP_BYTE_ORDER );
+    put( header, int32(m_format.cols) );
+    put( header, int32(m_format.rows) );
+    put( header, int32(m_block_size.x()) );
+    put( header, int32(m_block_size.y()) );
+    put( header, int32(m_fraction_bits) );
+    put( header, uint64(0) );
+    m_file.seekp( 0 );
+    m_file.write( header.data(), header.size() );
+  }
+
+  void DiskImageResourceDisparity::flush() {
+    if ( !m_writable )
+      return;
+
+    Mutex::Lock lock( m_file_mutex );
+    std::string index;
+    for ( size_t i = 0; i < m_tiles.size(); i++ ) {
+      put( index, m_tiles[i].offset );
+      put( index, m_tiles[i].bytes  );
+      put( index, m_tiles[i].flags  );
+    }
+
+    // The index follows the tiles. Tiles written later overwrite it
+    // and the next flush writes it again after them.
+    m_file.seekp( m_data_end );
+    m_file.write( index.data(), index.size() );
+    uint64 index_offset = m_data_end;
+    m_file.seekp( DSP_HEADER_SIZE - sizeof(uint64) );
+    m_file.write( reinterpret_cast<const char*>(&index_offset), sizeof(index_offset) );
+    m_file.flush();
+    if ( !m_file )
+      vw_throw( IOErr() << "DiskImageResourceDisparity: Failed to write " << m_filename << "." );
+  }
+
+  template <class PixelT>
+  void DiskImageResourceDisparity::read_tiles( ImageBuffer const& dest,
+                                               BBox2i const& bbox ) const {
+    PixelT invalid_pix;
+    invalid_pix.invalidate();
+    ImageView<PixelT> image( bbox.width(), bbox.height() );
+
+    Vector2i tiles = num_tiles();
+    for ( int row = bbox.min().y() / m_block_size.y();
+          row <= (bbox.max().y() - 1) / m_block_size.y(); row++ ) {
+      for ( int col = bbox.min().x() / m_block_size.x();
+            col <= (bbox.max().x() - 1) / m_block_size.x(); col++ ) {
+        BBox2i tile_box = tile_bbox( col, row );
+        BBox2i overlap  = tile_box;
+        overlap.crop( bbox );
+
+        TileEntry entry;
+        std::vector<char> data;
+        {
+          Mutex::Lock lock( m_file_mutex );
+          entry = m_tiles[row*tiles.x() + col];
+          if ( !(entry.flags & TILE_EMPTY) && entry.bytes > 0 ) {
+            data.resize( entry.bytes );
+            m_file.clear();
+            m_file.seekg( entry.offset );
+            m_file.read( &data[0], data.size() );
+            VW_ASSERT( m_file.good(),
+                       IOErr() << "DiskImageResourceDisparity: Failed to read "
+                       << m_filename << "." );
+          }
+        }
+
+        // Empty tiles are never decoded
+        if ( data.empty() ) {
+          for ( int32 r = overlap.min().y(); r < overlap.max().y(); r++ )
+            for ( int32 c = overlap.min().x(); c < overlap.max().x(); c++ )
+              image( c - bbox.min().x(), r - bbox.min().y() ) = invalid_pix;
+          continue;
+        }
+
+        ImageView<PixelT> tile( tile_box.width(), tile_box.height() );
+        decode_tile( &data[0], data.size(), entry.flags, m_fraction_bits, tile );
+        for ( int32 r = overlap.min().y(); r < overlap.max().y(); r++ )
+          for ( int32 c = overlap.min().x(); c < overlap.max().x(); c++ )
+            image( c - bbox.min().x(), r - bbox.min().y() )
+              = tile( c - tile_box.min().x(), r - tile_box.min().y() );
+      }
+    }
+
+    convert( dest, image.buffer() );
+  }
+
+  void DiskImageResourceDisparity::read( ImageBuffer const& dest,
+                                         BBox2i const& bbox ) const {
+    VW_ASSERT( BBox2i( 0, 0, m_format.cols, m_format.rows ).contains( bbox ) && !bbox.empty(),
+               ArgumentErr() << "DiskImageResourceDisparity: Invalid read region " << bbox << "." );
+    if ( m_fraction_bits == 0 )
+      read_tiles<PixelMask<Vector2i> >( dest, bbox );
+    else
+      read_tiles<PixelMask<Vector2f> >( dest, bbox );
+  }
+
+  template <class PixelT>
+  void DiskImageResourceDisparity::write_tiles( ImageBuffer const& src,
+                                                BBox2i const& bbox ) {
+    ImageView<PixelT> image( bbox.width(), bbox.height() );
+    convert( image.buffer(), src );
+
+    Vector2i tiles = num_tiles();
+    for ( int row = bbox.min().y() / m_block_size.y();
+          row <= (bbox.max().y() - 1) / m_block_size.y(); row++ ) {
+      for ( int col = bbox.min().x() / m_block_size.x();
+            col <= (bbox.max().x() - 1) / m_block_size.x(); col++ ) {
+        BBox2i tile_box = tile_bbox( col, row );
+        ImageView<PixelT> tile( tile_box.width(), tile_box.height() );
+        for ( int32 r = 0; r < tile.rows(); r++ )
+          for ( int32 c = 0; c < tile.cols(); c++ )
+            tile( c, r ) = image( c + tile_box.min().x() - bbox.min().x(),
+                                  r + tile_box.min().y() - bbox.min().y() );
+
+        // Encode outside of the lock, so threads only wait for each
+        // other while appending to the file.
+        TileEntry entry;
+        std::string bytes;
+        encode_tile( tile, m_fraction_bits, bytes, entry.flags );
+
+        Mutex::Lock lock( m_file_mutex );
+        if ( !bytes.empty() ) {
+          entry.offset = m_data_end;
+          entry.bytes  = uint32( bytes.size() );
+          m_file.seekp( m_data_end );
+          m_file.write( bytes.data(), bytes.size() );
+          VW_ASSERT( m_file.good(),
+                     IOErr() << "DiskImageResourceDisparity: Failed to write "
+                     << m_filename << "." );
+          m_data_end += bytes.size();
+        }
+        m_tiles[row*tiles.x() + col] = entry;
+      }
+    }
+  }
+
+  void DiskImageResourceDisparity::write( ImageBuffer const& src,
+                                          BBox2i const& bbox ) {
+    VW_ASSERT( m_writable,
+               ArgumentErr() << "DiskImageResourceDisparity: " << m_filename
+               << " was opened for reading." );
+    // Only whole tiles can be written
+    VW_ASSERT( bbox.min().x() % m_block_size.x() == 0 &&
+               bbox.min().y() % m_block_size.y() == 0 &&
+               ( bbox.max().x() % m_block_size.x() == 0 || bbox.max().x() == m_format.cols ) &&
+               ( bbox.max().y() % m_block_size.y() == 0 || bbox.max().y() == m_format.rows ) &&
+               BBox2i( 0, 0, m_format.cols, m_format.rows ).contains( bbox ) && !bbox.empty(),
+               ArgumentErr() << "DiskImageResourceDisparity: The write region " << bbox
+               << " is not made of whole " << m_block_size << " tiles." );
+    if ( m_fraction_bits == 0 )
+      write_tiles<PixelMask<Vector2i> >( src, bbox );
+    else
+      write_tiles<PixelMask<Vector2f> >( src, bbox );
+  }
+
+  DiskImageResource*
+  DiskImageResourceDisparity::construct_open( std::string const& filename ) {
+    return new DiskImageResourceDisparity( filename );
+  }
+
+  DiskImageResource*
+  DiskImageResourceDisparity::construct_create( std::string const& filename,
+                                                ImageFormat const& format ) {
+    int ts = vw_settings().default_tile_size();
+    return new DiskImageResourceDisparity( filename, format, Vector2i( ts, ts ) );
+  }
+
+} // namespace asp
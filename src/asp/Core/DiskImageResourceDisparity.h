@@ -0,0 +1,161 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DiskImageResourceDisparity.h
+///
+/// A compact file format for the PixelMask<Vector2i> and
+/// PixelMask<Vector2f> disparities of the stereo pipeline, with the
+/// .dsp extension.
+///
+/// As a GDAL image a disparity takes three 32-bit channels per pixel,
+/// the last one being the mask. Here the image is cut into tiles,
+/// each of which stores:
+///  - the run lengths of the valid and invalid pixels, unless all the
+///    pixels of the tile are valid,
+///  - a 32-bit base per channel, the smallest integer part of the
+///    valid pixels of the tile,
+///  - for each valid pixel and channel, the 16-bit integer part
+///    relative to the base followed by the fraction, on 8 bits by
+///    default and none for integer disparities.
+/// A tile without valid pixels stores nothing. The index at the end
+/// of the file gives the offset of each tile and whether it is empty,
+/// so empty tiles are read without touching their data.
+///
+/// Floating point disparities are rounded to a multiple of
+/// 2^-fraction_bits pixels, that is to 1/256 pixel by default.
+///
+#ifndef __ASP_CORE_DISK_IMAGE_RESOURCE_DISPARITY_H__
+#define __ASP_CORE_DISK_IMAGE_RESOURCE_DISPARITY_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Math/BBox.h>
+#include <vw/FileIO/DiskImageResource.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  // Which tiles of a .dsp disparity have no valid pixels. A default
+  // constructed index, or one read from a file in another format,
+  // knows of no empty tile.
+  class DisparityTileIndex {
+  public:
+    DisparityTileIndex() {}
+    DisparityTileIndex( vw::Vector2i const& image_size,
+                        vw::Vector2i const& block_size,
+                        std::vector<vw::uint8> const& empty_tiles );
+
+    // Read the index of a disparity file. Only .dsp files are opened.
+    explicit DisparityTileIndex( std::string const& filename );
+
+    // True if no tile overlapping 'bbox' has valid pixels
+    bool empty( vw::BBox2i const& bbox ) const;
+
+  private:
+    vw::Vector2i m_image_size, m_block_size;
+    std::vector<vw::uint8> m_empty_tiles; // Row major, one per tile
+  };
+
+  class DiskImageResourceDisparity : public vw::DiskImageResource {
+  public:
+
+    DiskImageResourceDisparity( std::string const& filename )
+      : vw::DiskImageResource(filename) {
+      open(filename);
+    }
+
+    // A negative 'fraction_bits' gives 0 bits for integer pixels and
+    // 8 bits for floating point ones.
+    DiskImageResourceDisparity( std::string const& filename,
+                                vw::ImageFormat const& format,
+                                vw::Vector2i const& block_size = vw::Vector2i(256, 256),
+                                int fraction_bits = -1 )
+      : vw::DiskImageResource(filename) {
+      create(filename, format, block_size, fraction_bits);
+    }
+
+    virtual ~DiskImageResourceDisparity();
+
+    /// Returns the type of disk image resource.
+    static std::string type_static() { return "ASPDisparity"; }
+    virtual std::string type() { return type_static(); }
+
+    virtual bool has_block_write()  const {return true;}
+    virtual bool has_nodata_write() const {return false;}
+    virtual bool has_block_read()   const {return true;}
+    virtual bool has_nodata_read()  const {return false;}
+
+    virtual vw::Vector2i block_read_size()  const { return m_block_size; }
+    virtual vw::Vector2i block_write_size() const { return m_block_size; }
+
+    virtual void read(vw::ImageBuffer const& dest, vw::BBox2i const& bbox) const;
+
+    // The bbox must be made of whole tiles. Several threads may write
+    // at once.
+    virtual void write(vw::ImageBuffer const& src, vw::BBox2i const& bbox);
+
+    // Write the tile index. Tiles may still be written afterwards.
+    virtual void flush();
+
+    void open(std::string const& filename);
+    void create(std::string const& filename, vw::ImageFormat const& format,
+                vw::Vector2i const& block_size, int fraction_bits);
+    static vw::DiskImageResource* construct_open(std::string const& filename);
+    static vw::DiskImageResource* construct_create(std::string const& filename,
+                                                   vw::ImageFormat const& format);
+
+    // True if the file has the .dsp extension
+    static bool is_disparity_file( std::string const& filename );
+
+    int fraction_bits() const { return m_fraction_bits; }
+    DisparityTileIndex tile_index() const;
+
+  private:
+    struct TileEntry {
+      vw::uint64 offset;
+      vw::uint32 bytes;
+      vw::uint32 flags;
+      TileEntry() : offset(0), bytes(0), flags(0) {}
+    };
+
+    vw::Vector2i num_tiles() const;
+    vw::BBox2i tile_bbox( int col, int row ) const;
+    void write_header();
+
+    template <class PixelT>
+    void read_tiles( vw::ImageBuffer const& dest, vw::BBox2i const& bbox ) const;
+    template <class PixelT>
+    void write_tiles( vw::ImageBuffer const& src, vw::BBox2i const& bbox );
+
+    std::string m_filename;
+    bool m_writable;
+    vw::Vector2i m_block_size;
+    int m_fraction_bits;
+    std::vector<TileEntry> m_tiles; // Row major
+    vw::uint64 m_data_end;          // Where the next tile is appended
+
+    mutable std::fstream m_file;
+    mutable vw::Mutex m_file_mutex;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_DISK_IMAGE_RESOURCE_DISPARITY_H__
@@ -23,6 +23,7 @@
 #define __INPAINTVIEW_H__
 
 // Standard
+#include <list>
 #include <vector>
 
 // VW
@@ -30,123 +31,240 @@
 #include <vw/Core/ThreadPool.h>
 #include <vw/Core/Stopwatch.h>
 #include <vw/Image/Algorithms.h>
+#include <vw/Image/ImageView.h>
 #include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/MaskViews.h>
 
 // ASP
 #include <asp/Core/BlobIndexThreaded.h>
 #include <asp/Core/SparseView.h>
 
-#include <boost/foreach.hpp>
-
 namespace asp {
   namespace inpaint_p {
 
-    // Semi-private tasks that I wouldn't like the user to know about
-    //
-    // This is used for threaded rendering
-    template <class ViewT, class SViewT>
-    class InpaintTask : public vw::Task, boost::noncopyable {
-      ViewT const& m_view;
-      blob::BlobCompressed m_c_blob;
-      bool m_use_grassfire;
-      typename ViewT::pixel_type m_default_inpaint_val;
-      SparseCompositeView<SViewT> & m_patches; // Store our output
-
-    public:
-      InpaintTask( vw::ImageViewBase<ViewT> const& view,
-                   blob::BlobCompressed const& c_blob,
-                   bool use_grassfire,
-                   typename ViewT::pixel_type default_inpaint_val,
-                   SparseCompositeView<SViewT> & sparse ) :
-        m_view(view.impl()), m_c_blob(c_blob),
-        m_use_grassfire(use_grassfire), m_default_inpaint_val(default_inpaint_val),
-        m_patches(sparse) {}
-
-      void operator()() {
-        using namespace vw;
-
-        typedef typename ViewT::pixel_type pixel_type;
-
-        // Gathering information about blob
-        BBox2i bbox = m_c_blob.bounding_box();
-        bbox.expand(1);
-
-        // How do we want to handle spots on the edges?
-        if ( bbox.min().x() < 0 || bbox.min().y() < 0 ||
-             bbox.max().x() >= m_view.impl().cols() ||
-             bbox.max().y() >= m_view.impl().rows() ) {
-          return;
+    // Semi-private helpers that I wouldn't like the user to know about
+
+    // Fill one blob in place in 'work', an image whose origin is at
+    // 'origin' in the coordinates of the full image of size
+    // 'image_size'. The filled pixels are marked in 'filled'. Blobs
+    // touching the image edge are skipped. Since the blobs are 8
+    // connected, the one pixel ring around a blob never belongs to
+    // another blob, so the blobs of a tile can share 'work' and the
+    // result does not depend on the order they are filled in.
+    template <class PixelT>
+    void inpaint_blob( vw::ImageView<PixelT> & work,
+                       vw::Vector2i const& origin,
+                       vw::Vector2i const& image_size,
+                       blob::BlobCompressed const& c_blob,
+                       bool use_grassfire,
+                       PixelT const& default_inpaint_val,
+                       vw::ImageView<vw::uint8> & filled ) {
+      using namespace vw;
+
+      // Gathering information about blob
+      BBox2i bbox = c_blob.bounding_box();
+      bbox.expand(1);
+
+      // How do we want to handle spots on the edges?
+      if ( bbox.min().x() < 0 || bbox.min().y() < 0 ||
+           bbox.max().x() >= image_size.x() ||
+           bbox.max().y() >= image_size.y() ) {
+        return;
+      }
+
+      // Binary image to highlight the hole, in the frame of the blob
+      std::list<vw::Vector2i> blob;
+      c_blob.decompress( blob );
+      ImageView<uint8> mask( bbox.width(), bbox.height() );
+      fill( mask, 0 );
+      for ( std::list<vw::Vector2i>::const_iterator iter = blob.begin();
+            iter != blob.end(); iter++ ) {
+        mask( iter->x() - bbox.min().x(), iter->y() - bbox.min().y() ) = 255;
+        filled( iter->x() - origin.x(), iter->y() - origin.y() ) = 255;
+      }
+
+      // Offset of the blob pixels in the contiguous buffer of 'work'
+      const ptrdiff_t stride = work.cols();
+      PixelT* data = &work( bbox.min().x() - origin.x(), bbox.min().y() - origin.y() );
+
+      if ( !use_grassfire ) {
+        for ( int i = 0; i < bbox.width(); i++ )
+          for ( int j = 0; j < bbox.height(); j++ )
+            if ( mask(i,j) )
+              data[ j*stride + i ] = default_inpaint_val;
+        return;
+      }
+
+      // Working out order of convolution. This is a bucket sort of
+      // the blob pixels by distance to the edge of the hole, stable
+      // in column major order, as processing is in place.
+      ImageView<int32> distance = grassfire(mask);
+      int max_distance = max_pixel_value( distance );
+      std::vector<size_t> bucket_start( max_distance + 2, 0 );
+      for ( int i = 0; i < bbox.width(); i++ )
+        for ( int j = 0; j < bbox.height(); j++ )
+          bucket_start[ distance(i,j) + 1 ]++;
+      for ( int d = 1; d <= max_distance + 1; d++ )
+        bucket_start[d] += bucket_start[d-1];
+      const size_t num_outside = bucket_start[1];
+      std::vector<ptrdiff_t> processing_order( bucket_start[max_distance+1] - num_outside );
+      if ( processing_order.empty() )
+        return;
+      for ( int i = 0; i < bbox.width(); i++ )
+        for ( int j = 0; j < bbox.height(); j++ ) {
+          int d = distance(i,j);
+          if ( d > 0 )
+            processing_order[ bucket_start[d]++ - num_outside ] = j*stride + i;
         }
 
-        std::list<vw::Vector2i> blob;
-        m_c_blob.decompress( blob );
-        for ( std::list<vw::Vector2i>::iterator iter = blob.begin();
-              iter != blob.end(); iter++ )
-          *iter -= bbox.min();
-
-        // Building a cropped copy for my patch
-        ImageView<pixel_type> cropped_copy =
-          crop( m_view, bbox );
-
-        // Creating binary image to highlight hole
-        ImageView<uint8> mask( bbox.width(), bbox.height() );
-        fill( mask, 0 );
-        for ( std::list<vw::Vector2i>::const_iterator iter = blob.begin();
-              iter != blob.end(); iter++ )
-          mask( iter->x(), iter->y() ) = 255;
-
-        if (m_use_grassfire){
-          ImageView<int32> distance = grassfire(mask);
-          int max_distance = max_pixel_value( distance );
-
-          // Working out order of convolution
-          std::list<Vector2i> processing_order;
-          for ( int d = 1; d < max_distance+1; d++ )
-            for ( int i = 0; i < bbox.width(); i++ )
-              for ( int j = 0; j < bbox.height(); j++ )
-                if ( distance(i,j) == d ) {
-                  processing_order.push_back( Vector2i(i,j) );
-                }
-
-          // Iterate and apply convolution seperately to each channel
-          typedef typename CompoundChannelCast<pixel_type,float>::type AccumulatorType;
-          for ( int d = 0; d < 10*max_distance*max_distance; d++ )
-            BOOST_FOREACH( Vector2i const& l, processing_order ) {
-              typename ImageView<pixel_type>::pixel_accessor pit =
-                cropped_copy.origin();
-              pit.advance( l.x() - 1, l.y() - 1 );
-
-              AccumulatorType sum(0);
-              sum += .176765 * (*pit);
-              pit.next_col();
-              sum += .073235 * (*pit);
-              pit.next_col();
-              sum += .176765 * (*pit);
-              pit.advance( -2, 1 );
-              sum += .073235 * (*pit);
-              pit.advance( 2, 0 );
-              sum += .073235 * (*pit);
-              pit.advance( -2, 1 );
-              sum += .176765 * (*pit);
-              pit.next_col();
-              sum += .073235 * (*pit);
-              pit.next_col();
-              sum += .176765 * (*pit);
-
-              sum.validate();
-              cropped_copy(l.x(),l.y()) = sum;
-            }
-        }else{
-          for ( std::list<vw::Vector2i>::const_iterator iter = blob.begin();
-                iter != blob.end(); iter++ )
-            cropped_copy( iter->x(), iter->y() ) = m_default_inpaint_val;
+      // Iterate and apply convolution seperately to each channel
+      typedef typename CompoundChannelCast<PixelT,float>::type AccumulatorType;
+      const ptrdiff_t* order_begin = &processing_order[0];
+      const ptrdiff_t* order_end   = order_begin + processing_order.size();
+      for ( int d = 0; d < 10*max_distance*max_distance; d++ )
+        for ( const ptrdiff_t* l = order_begin; l != order_end; l++ ) {
+          PixelT* p = data + *l;
+          AccumulatorType sum(0);
+          sum += .176765 * p[-stride-1];
+          sum += .073235 * p[-stride];
+          sum += .176765 * p[-stride+1];
+          sum += .073235 * p[-1];
+          sum += .073235 * p[1];
+          sum += .176765 * p[stride-1];
+          sum += .073235 * p[stride];
+          sum += .176765 * p[stride+1];
+
+          sum.validate();
+          *p = sum;
         }
+    }
 
-        // Insert results into sparse view
-        m_patches.absorb(bbox.min(),copy_mask(cropped_copy,create_mask( mask, 0 )));
+    // Fill one blob like inpaint_blob(), from a pyramid of the sums
+    // and counts of the valid pixels around it, not counting those
+    // other blobs were filled with, halved in size until
+    // a level has no hole left. Each hole pixel takes the bilinear
+    // interpolation of the averages of the next coarser level, and
+    // the filled pixels are then smoothed 'num_smooth_iter' times
+    // with a 3x3 Gaussian kernel.
+    template <class PixelT>
+    void inpaint_blob_multiscale( vw::ImageView<PixelT> & work,
+                                  vw::Vector2i const& origin,
+                                  vw::Vector2i const& image_size,
+                                  blob::BlobCompressed const& c_blob,
+                                  int num_smooth_iter,
+                                  vw::ImageView<vw::uint8> & filled ) {
+      using namespace vw;
+      typedef typename CompoundChannelCast<PixelT,double>::type AccumT;
+      typedef typename PixelChannelType<PixelT>::type ChannelT;
+
+      BBox2i bbox = c_blob.bounding_box();
+      bbox.expand(1);
+      if ( bbox.min().x() < 0 || bbox.min().y() < 0 ||
+           bbox.max().x() >= image_size.x() ||
+           bbox.max().y() >= image_size.y() ) {
+        return;
       }
 
-    };
+      std::list<vw::Vector2i> blob;
+      c_blob.decompress( blob );
+      ImageView<uint8> mask( bbox.width(), bbox.height() );
+      fill( mask, 0 );
+      for ( std::list<vw::Vector2i>::const_iterator iter = blob.begin();
+            iter != blob.end(); iter++ )
+        mask( iter->x() - bbox.min().x(), iter->y() - bbox.min().y() ) = 255;
+      Vector2i offset = bbox.min() - origin;
+
+      // Level 0 holds the valid pixels around the hole. The box may
+      // hold other blobs of the tile. Those already filled are
+      // skipped, so the result does not depend on the blob order.
+      AccumT zero; zero.validate();
+      std::vector<ImageView<AccumT> > sums( 1, ImageView<AccumT>( bbox.width(), bbox.height() ) );
+      std::vector<ImageView<double> > counts( 1, ImageView<double>( bbox.width(), bbox.height() ) );
+      for ( int j = 0; j < bbox.height(); j++ )
+        for ( int i = 0; i < bbox.width(); i++ ) {
+          PixelT const& pix = work( offset.x() + i, offset.y() + j );
+          bool use = !mask(i,j) && !filled( offset.x() + i, offset.y() + j ) &&
+            is_valid( pix );
+          sums[0](i,j)   = use ? AccumT( channel_cast<double>( pix ) ) : zero;
+          counts[0](i,j) = use ? 1 : 0;
+        }
+
+      while ( true ) {
+        ImageView<AccumT> const& sum   = sums.back();
+        ImageView<double> const& count = counts.back();
+        bool complete = true;
+        for ( int j = 0; j < count.rows() && complete; j++ )
+          for ( int i = 0; i < count.cols() && complete; i++ )
+            complete = count(i,j) > 0;
+        if ( complete || ( count.cols() == 1 && count.rows() == 1 ) )
+          break;
+        ImageView<AccumT> coarse_sum( (sum.cols()+1)/2, (sum.rows()+1)/2 );
+        ImageView<double> coarse_count( coarse_sum.cols(), coarse_sum.rows() );
+        for ( int j = 0; j < coarse_sum.rows(); j++ )
+          for ( int i = 0; i < coarse_sum.cols(); i++ ) {
+            AccumT s = zero;
+            double c = 0;
+            for ( int y = 2*j; y < std::min( 2*j+2, sum.rows() ); y++ )
+              for ( int x = 2*i; x < std::min( 2*i+2, sum.cols() ); x++ ) {
+                s += sum(x,y);
+                c += count(x,y);
+              }
+            coarse_sum(i,j)   = s;
+            coarse_count(i,j) = c;
+          }
+        sums.push_back( coarse_sum );
+        counts.push_back( coarse_count );
+      }
+
+      // From the coarsest level up, turn the sums into averages,
+      // interpolating the pixels without valid data.
+      ImageView<AccumT> average;
+      for ( size_t level = sums.size(); level-- > 0; ) {
+        ImageView<AccumT> const& sum   = sums[level];
+        ImageView<double> const& count = counts[level];
+        ImageView<AccumT> current( sum.cols(), sum.rows() );
+        for ( int j = 0; j < sum.rows(); j++ )
+          for ( int i = 0; i < sum.cols(); i++ ) {
+            if ( count(i,j) > 0 ) {
+              current(i,j) = sum(i,j) / count(i,j);
+              continue;
+            }
+            if ( average.cols() == 0 )
+              return; // No valid pixel around the hole
+            double cx = 0.5*i - 0.25, cy = 0.5*j - 0.25;
+            int x0 = int( floor(cx) ), y0 = int( floor(cy) );
+            double fx = cx - x0, fy = cy - y0;
+            int xa = std::max( x0, 0 ), xb = std::min( x0+1, average.cols()-1 );
+            int ya = std::max( y0, 0 ), yb = std::min( y0+1, average.rows()-1 );
+            current(i,j) = ( average(xa,ya) * (1-fx) + average(xb,ya) * fx ) * (1-fy) +
+                           ( average(xa,yb) * (1-fx) + average(xb,yb) * fx ) * fy;
+          }
+        average = current;
+      }
+
+      // The ring around the blob is valid, so the kernel of a blob
+      // pixel stays in the box.
+      for ( int iter = 0; iter < num_smooth_iter; iter++ ) {
+        ImageView<AccumT> smoothed = copy( average );
+        for ( int j = 1; j < bbox.height()-1; j++ )
+          for ( int i = 1; i < bbox.width()-1; i++ ) {
+            if ( !mask(i,j) ) continue;
+            AccumT s = average(i,j) * 4.0;
+            s += ( average(i-1,j) + average(i+1,j) + average(i,j-1) + average(i,j+1) ) * 2.0;
+            s += average(i-1,j-1) + average(i+1,j-1) + average(i-1,j+1) + average(i+1,j+1);
+            smoothed(i,j) = s / 16.0;
+          }
+        average = smoothed;
+      }
+
+      for ( int j = 0; j < bbox.height(); j++ )
+        for ( int i = 0; i < bbox.width(); i++ )
+          if ( mask(i,j) ) {
+            work( offset.x() + i, offset.y() + j ) = channel_cast<ChannelT>( average(i,j) );
+            filled( offset.x() + i, offset.y() + j ) = 255;
+          }
+    }
 
   } // end namespace inpaint_p
 
@@ -159,6 +277,7 @@ namespace asp {
     BlobIndexThreaded const& m_bindex;
     bool m_use_grassfire;
     typename ViewT::pixel_type m_default_inpaint_val;
+    int m_max_hole_size, m_num_smooth_iter; // Negative unless multi-scale
 
   public:
     typedef typename vw::UnmaskedPixelType<typename ViewT::pixel_type>::type sparse_type;
@@ -171,7 +290,21 @@ namespace asp {
                  bool use_grassfire,
                  typename ViewT::pixel_type default_inpaint_val):
       m_child(image.impl()), m_bindex(bindex),
-      m_use_grassfire(use_grassfire), m_default_inpaint_val(default_inpaint_val) {}
+      m_use_grassfire(use_grassfire), m_default_inpaint_val(default_inpaint_val),
+      m_max_hole_size(-1), m_num_smooth_iter(-1) {}
+
+    // Fill by multi-scale averaging the blobs no wider or taller
+    // than 'max_hole_size', then smooth them 'num_smooth_iter' times.
+    InpaintView( vw::ImageViewBase<ViewT> const& image,
+                 BlobIndexThreaded const& bindex,
+                 int max_hole_size, int num_smooth_iter ):
+      m_child(image.impl()), m_bindex(bindex),
+      m_use_grassfire(false), m_default_inpaint_val(),
+      m_max_hole_size(max_hole_size), m_num_smooth_iter(num_smooth_iter) {
+      VW_ASSERT( max_hole_size > 0 && num_smooth_iter >= 0,
+                 vw::ArgumentErr() << "InpaintView: expecting a positive hole size "
+                 << "and a non-negative number of smoothing iterations." );
+    }
 
     inline vw::int32 cols  () const { return m_child.cols(); }
     inline vw::int32 rows  () const { return m_child.rows(); }
@@ -194,6 +327,10 @@ namespace asp {
       intersections.reserve(20);
       BBox2i bbox_expanded = bbox;
       for ( size_t i = 0; i < m_bindex.num_blobs(); i++ ) {
+        if ( m_max_hole_size > 0 &&
+             ( m_bindex.blob_bbox(i).width()  > m_max_hole_size ||
+               m_bindex.blob_bbox(i).height() > m_max_hole_size ) )
+          continue;
         if ( m_bindex.blob_bbox(i).intersects( bbox ) && // Early exit option
              m_bindex.compressed_blob(i).intersects( bbox ) ) {
           bbox_expanded.grow( m_bindex.blob_bbox(i) );
@@ -205,20 +342,31 @@ namespace asp {
       bbox_expanded.crop( BBox2i(0,0,cols(),rows()) );
 
       // Generate sparse view that will hold background data and all the patches.
+      ImageView<typename ViewT::pixel_type> background = crop(m_child,bbox_expanded);
       inner_pre_type preraster =
-        crop(ImageView<typename ViewT::pixel_type>(crop(m_child,bbox_expanded)),
-             -bbox_expanded.min().x(), -bbox_expanded.min().y(), cols(), rows());
+        crop(background, -bbox_expanded.min().x(), -bbox_expanded.min().y(), cols(), rows());
       SparseCompositeView<inner_pre_type> patched_view( preraster );
-
-      // Build up the patches that intersect our tile
-      // - For each intersecting blob, use InpaintTask to fill in that blob
-      typedef inpaint_p::InpaintTask<inner_pre_type, inner_pre_type> task_type;
+      if ( intersections.empty() )
+        return patched_view;
+
+      // Fill all the blobs intersecting our tile in one working copy
+      // of the background, then insert them together into the
+      // sparse view.
+      ImageView<typename ViewT::pixel_type> work = copy(background);
+      ImageView<uint8> filled( bbox_expanded.width(), bbox_expanded.height() );
+      fill( filled, 0 );
       for ( std::vector<size_t>::const_iterator it = intersections.begin();
             it != intersections.end(); it++ ) {
-        task_type task( preraster, m_bindex.compressed_blob(*it), m_use_grassfire,
-                        m_default_inpaint_val, patched_view );
-        task();
+        if ( m_num_smooth_iter >= 0 )
+          inpaint_p::inpaint_blob_multiscale( work, bbox_expanded.min(), Vector2i(cols(), rows()),
+                                              m_bindex.compressed_blob(*it), m_num_smooth_iter,
+                                              filled );
+        else
+          inpaint_p::inpaint_blob( work, bbox_expanded.min(), Vector2i(cols(), rows()),
+                                   m_bindex.compressed_blob(*it), m_use_grassfire,
+                                   m_default_inpaint_val, filled );
       }
+      patched_view.absorb( bbox_expanded.min(), copy_mask( work, create_mask( filled, 0 ) ) );
 
       return patched_view;
     }
@@ -236,6 +384,16 @@ namespace asp {
     return InpaintView<SourceT>(src, bindex, use_grassfire, default_inpaint_val);
   }
 
+  // Fill the holes of 'bindex' no wider or taller than
+  // 'max_hole_size' by multi-scale averaging. Larger holes and those
+  // touching the image edge are left alone.
+  template <class SourceT>
+  inline InpaintView<SourceT> inpaint_multiscale( vw::ImageViewBase<SourceT> const& src,
+                                                  BlobIndexThreaded const& bindex,
+                                                  int max_hole_size, int num_smooth_iter ) {
+    return InpaintView<SourceT>(src, bindex, max_hole_size, num_smooth_iter);
+  }
+
 } //end namespace asp
 
 #endif//__INPAINTVIEW_H__
@@ -19,12 +19,19 @@
 #ifndef __ASP_CORE_INTEGRAL_AUTO_GAIN_DETECTOR_H__
 #define __ASP_CORE_INTEGRAL_AUTO_GAIN_DETECTOR_H__
 
+#include <vw/Core/ThreadPool.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/InterestPoint/InterestData.h>
 #include <vw/InterestPoint/IntegralDetector.h>
 #include <vw/InterestPoint/IntegralInterestOperator.h>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <vw/Image/Statistics.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace asp {
 
   class IntegralAutoGainDetector : public vw::ip::InterestDetectorBase<IntegralAutoGainDetector >,
@@ -63,110 +70,225 @@ namespace asp {
         integral_image = ip::IntegralImage( original_image );
       }
 
-      // Creating Scales
-      std::deque<DataT> interest_data;
-      interest_data.push_back( DataT(empty_image, integral_image) );
-      interest_data.push_back( DataT(empty_image, integral_image) );
-
-      // Priming scales
-      vw::ip::InterestPointList new_points;
-      {
-        vw_out(DebugMessage, "interest_point") << "\tScale 0 ... ";
-        Timer t("done, elapsed time", DebugMessage, "interest_point");
-        m_interest( interest_data[0], 0 );
-      }
-      {
-        vw_out(DebugMessage, "interest_point") << "\tScale 1 ... ";
-        Timer t("done, elapsed time", DebugMessage, "interest_point");
-        m_interest( interest_data[1], 1 );
+      // Interest images are computed concurrently, one batch of
+      // scales at a time, all reading the shared integral image. Only
+      // the current batch and the two scales before it are kept in
+      // memory, and the batch is small enough for those to fit in the
+      // system cache size. Once a batch is done, the extrema of every
+      // middle scale whose neighbors are available are found
+      // concurrently as well.
+      int batch_size =
+        scale_batch_size( original_image.cols() * original_image.rows() *
+                          sizeof(typename DataT::interest_type::pixel_type),
+                          vw_settings().default_num_threads(),
+                          vw_settings().system_cache_size() );
+      std::vector<boost::shared_ptr<DataT> > interest_data( m_scales );
+      std::vector<ip::InterestPointList> scale_points( m_scales );
+      std::vector<ScaleStats> scale_stats( m_scales );
+      std::vector<double> scale_seconds( m_scales );
+      for ( int first = 0; first < m_scales; first += batch_size ) {
+        int last = std::min( m_scales, first + batch_size );
+
+        FifoWorkQueue scale_queue( batch_size );
+        for ( int scale = first; scale < last; scale++ ) {
+          interest_data[scale].reset( new DataT(empty_image, integral_image) );
+          scale_queue.add_task( boost::shared_ptr<Task>
+                                ( new ScaleTask<DataT>(*this, *interest_data[scale], scale,
+                                                       scale_seconds[scale]) ) );
+        }
+        scale_queue.join_all();
+        for ( int scale = first; scale < last; scale++ )
+          vw_out(DebugMessage, "interest_point") << "\tScale " << scale
+                                                 << " ... done, elapsed time: "
+                                                 << scale_seconds[scale] << "\n";
+
+        FifoWorkQueue extrema_queue( batch_size );
+        for ( int scale = std::max(1, first - 1); scale < last - 1; scale++ )
+          extrema_queue.add_task( boost::shared_ptr<Task>
+                                  ( new ExtremaTask<DataT>(*this,
+                                                           *interest_data[scale-1],
+                                                           *interest_data[scale],
+                                                           *interest_data[scale+1],
+                                                           scale, scale_points[scale],
+                                                           scale_stats[scale]) ) );
+        extrema_queue.join_all();
+        for ( int scale = std::max(1, first - 1); scale < last - 1; scale++ )
+          vw_out(DebugMessage, "interest_point")
+            << "\tScale " << scale << ": Prior to thresholding there was: "
+            << scale_stats[scale].num_candidates << ", interest threshold: "
+            << scale_stats[scale].threshold << ", after thresholding there was: "
+            << scale_points[scale].size() << "\n";
+
+        // Deleting scales no later batch needs
+        for ( int scale = 0; scale < last - 2; scale++ )
+          interest_data[scale].reset();
       }
 
-      // Finally processing scales
-      for ( int scale = 2; scale < m_scales; scale++ ) {
+      // Appending to the greater set, in order of scale
+      std::vector<ip::InterestPoint> new_points;
+      BOOST_FOREACH( ip::InterestPointList const& points, scale_points )
+        new_points.insert( new_points.end(), points.begin(), points.end() );
 
-        interest_data.push_back( DataT(empty_image, integral_image) );
-        {
-          vw_out(DebugMessage, "interest_point") << "\tScale " << scale << " ... ";
-          Timer t("done, elapsed time", DebugMessage, "interest_point");
-          m_interest( interest_data[2], scale );
-        }
+      // Are all points good?
+      if ( m_max_points < int(new_points.size()) && m_max_points > 0 ) {
+        VW_OUT(DebugMessage, "interest_point") << "\tCulling ...\n";
+        Timer t("elapsed time", DebugMessage, "interest_point");
 
-        ip::InterestPointList scale_points;
-
-        // Detecting interest points in middle
-        int32 cols = original_image.cols() - 2;
-        int32 rows = original_image.rows() - 2;
-        typedef typename DataT::interest_type::pixel_accessor AccessT;
-
-        AccessT l_row = interest_data[0].interest().origin();
-        AccessT m_row = interest_data[1].interest().origin();
-        AccessT h_row = interest_data[2].interest().origin();
-        l_row.advance(1,1); m_row.advance(1,1); h_row.advance(1,1);
-        for ( int32 r=0; r < rows; r++ ) {
-          AccessT l_col = l_row;
-          AccessT m_col = m_row;
-          AccessT h_col = h_row;
-          for ( int32 c=0; c < cols; c++ ) {
-            if ( is_extrema( l_col, m_col, h_col ) ) {
-              scale_points.push_back(ip::InterestPoint(c+1,r+1,
-                                                       m_interest.float_scale(scale-1),
-                                                       *m_col) );
-            }
-            l_col.next_col();
-            m_col.next_col();
-            h_col.next_col();
-          }
-          l_row.next_row();
-          m_row.next_row();
-          h_row.next_row();
-        }
+        int original_num_points = new_points.size();
 
-        VW_OUT(DebugMessage, "interest_point") << "\tPrior to thresholding there was: "
-                                               << scale_points.size() << "\n";
+        // Pull out the top amount of points that the user wants, then
+        // sort just those. Ties are broken by position in the list,
+        // which gives the same points in the same order as a stable
+        // sort of the whole list.
+        std::vector<size_t> order( new_points.size() );
+        for ( size_t i = 0; i < order.size(); i++ )
+          order[i] = i;
+        StableOrder compare( new_points );
+        std::nth_element( order.begin(), order.begin() + (m_max_points - 1),
+                          order.end(), compare );
+        order.resize( m_max_points );
+        std::sort( order.begin(), order.end(), compare );
+
+        ip::InterestPointList best_points;
+        BOOST_FOREACH( size_t i, order )
+          best_points.push_back( new_points[i] );
+
+        VW_OUT(DebugMessage, "interest_point") << "\t     Best IP : " << best_points.front().interest << std::endl;
+        VW_OUT(DebugMessage, "interest_point") << "\t     Worst IP: " << best_points.back().interest << std::endl;
+        VW_OUT(DebugMessage, "interest_point") << "\t     (removed " << original_num_points - best_points.size() << " interest points, " << best_points.size() << " remaining.)\n";
+        return best_points;
+      }
 
-        // Remove all interest points in the bottom 0.1% of our interest point range
-        float imin, imax;
-        min_max_pixel_values( interest_data[1].interest(), imin, imax );
-        float threshold_lvl = imin + 0.001 * ( imax - imin );
-        VW_OUT(DebugMessage, "interest_point") << "\tInterest threshold for scale: " << threshold_lvl << "\n";
+      VW_OUT(DebugMessage, "interest_point") << "\t     Not culling anything.\n";
+      return ip::InterestPointList( new_points.begin(), new_points.end() );
+    }
 
-        // Thresholding (in OBALOG this also does Harris)
-        threshold(scale_points, interest_data[1], scale-1, threshold_lvl);
+    // Number of scales to compute at once, for interest images of
+    // 'scale_bytes' bytes each. Two more scales are kept from the
+    // previous batch, and all of them must fit in 'max_bytes'. At
+    // least one scale is computed at a time.
+    static int scale_batch_size( size_t scale_bytes, size_t num_threads, size_t max_bytes ) {
+      size_t batch = std::max( size_t(1), num_threads );
+      if ( scale_bytes > 0 )
+        batch = std::min( batch, max_bytes / scale_bytes > 2 ? max_bytes / scale_bytes - 2 : 1 );
+      return int( std::max( size_t(1), batch ) );
+    }
 
-        VW_OUT(DebugMessage, "interest_point") << "\tAfter thresholding there was: "
-                                               << scale_points.size() << "\n";
+  protected:
 
-        // Appending to the greater set
-        new_points.insert(new_points.end(),
-                          scale_points.begin(),
-                          scale_points.end());
+    // Orders points as InterestPoint::operator< does, breaking ties by
+    // position in the list.
+    struct StableOrder {
+      std::vector<vw::ip::InterestPoint> const& m_points;
+      StableOrder( std::vector<vw::ip::InterestPoint> const& points ) : m_points(points) {}
+      bool operator()( size_t a, size_t b ) const {
+        if ( m_points[a] < m_points[b] ) return true;
+        if ( m_points[b] < m_points[a] ) return false;
+        return a < b;
+      }
+    };
 
-        // Deleting lowest
-        interest_data.pop_front();
+    // Computes the interest image of one scale. The time taken is
+    // logged by the caller, so the lines of concurrent scales do not
+    // interleave.
+    template <class DataT>
+    class ScaleTask : public vw::Task, private boost::noncopyable {
+      IntegralAutoGainDetector const& m_detector;
+      DataT& m_data;
+      int m_scale;
+      double& m_seconds;
+    public:
+      ScaleTask( IntegralAutoGainDetector const& detector, DataT& data, int scale,
+                 double& seconds ) :
+        m_detector(detector), m_data(data), m_scale(scale), m_seconds(seconds) {}
+      void operator()() {
+        vw::Stopwatch sw;
+        sw.start();
+        m_detector.m_interest( m_data, m_scale );
+        sw.stop();
+        m_seconds = sw.elapsed_seconds();
       }
+    };
 
-      // Are all points good?
-      if ( m_max_points < int(new_points.size()) && m_max_points > 0 ) {
-        VW_OUT(DebugMessage, "interest_point") << "\tCulling ...\n";
-        Timer t("elapsed time", DebugMessage, "interest_point");
+    // What the thresholding of a scale did, logged by the caller
+    struct ScaleStats {
+      size_t num_candidates;
+      float threshold;
+      ScaleStats() : num_candidates(0), threshold(0) {}
+    };
 
-        int original_num_points = new_points.size();
+    // Finds and thresholds the interest points of a middle scale
+    template <class DataT>
+    class ExtremaTask : public vw::Task, private boost::noncopyable {
+      IntegralAutoGainDetector const& m_detector;
+      DataT const &m_low, &m_mid, &m_high;
+      int m_scale;
+      vw::ip::InterestPointList& m_points;
+      ScaleStats& m_stats;
+    public:
+      ExtremaTask( IntegralAutoGainDetector const& detector,
+                   DataT const& low, DataT const& mid, DataT const& high,
+                   int scale, vw::ip::InterestPointList& points, ScaleStats& stats ) :
+        m_detector(detector), m_low(low), m_mid(mid), m_high(high),
+        m_scale(scale), m_points(points), m_stats(stats) {}
+      void operator()() {
+        m_detector.find_scale_points( m_low, m_mid, m_high, m_scale, m_points, m_stats );
+      }
+    };
 
-        // Sort the interest of the points and pull out the top amount that the user wants
-        new_points.sort();
-        VW_OUT(DebugMessage, "interest_point") << "\t     Best IP : " << new_points.front().interest << std::endl;
-        VW_OUT(DebugMessage, "interest_point") << "\t     Worst IP: " << new_points.back().interest << std::endl;
-        new_points.resize( m_max_points );
+    template <class DataT>
+    void find_scale_points( DataT const& low, DataT const& mid, DataT const& high,
+                            int scale, vw::ip::InterestPointList& points,
+                            ScaleStats& stats ) const {
+      using namespace vw;
+      typedef typename DataT::interest_type InterestT;
+      typedef typename InterestT::pixel_type PixelT;
+      typedef typename InterestT::pixel_accessor AccessT;
+
+      InterestT const& mid_image = mid.interest();
+      int32 cols = mid_image.cols();
+      int32 rows = mid_image.rows();
+
+      // Detecting interest points in middle. A pixel can only be an
+      // extremum across scales if it is not below or not above all of
+      // its 8 neighbors in its own scale. That cheap test is done a
+      // row at a time in branch-free loops the compiler vectorizes,
+      // and only the pixels passing it get the full 3x3x3 test.
+      std::vector<PixelT> above_max( cols ), above_min( cols );
+      std::vector<uint8> candidate( cols );
+      for ( int32 r = 1; r < rows - 1; r++ ) {
+        PixelT const* up   = &mid_image( 0, r-1 );
+        PixelT const* row  = &mid_image( 0, r   );
+        PixelT const* down = &mid_image( 0, r+1 );
+        for ( int32 c = 1; c < cols - 1; c++ ) {
+          PixelT hi = std::max( std::max( std::max( up[c-1], up[c] ), std::max( up[c+1], row[c-1] ) ),
+                                std::max( std::max( row[c+1], down[c-1] ), std::max( down[c], down[c+1] ) ) );
+          PixelT lo = std::min( std::min( std::min( up[c-1], up[c] ), std::min( up[c+1], row[c-1] ) ),
+                                std::min( std::min( row[c+1], down[c-1] ), std::min( down[c], down[c+1] ) ) );
+          candidate[c] = uint8( row[c] >= hi ) | uint8( row[c] <= lo );
+        }
 
-        VW_OUT(DebugMessage, "interest_point") << "\t     (removed " << original_num_points - new_points.size() << " interest points, " << new_points.size() << " remaining.)\n";
-      } else {
-        VW_OUT(DebugMessage, "interest_point") << "\t     Not culling anything.\n";
+        for ( int32 c = 1; c < cols - 1; c++ ) {
+          if ( !candidate[c] ) continue;
+          AccessT l_col = low.interest().origin();  l_col.advance( c, r );
+          AccessT m_col = mid_image.origin();       m_col.advance( c, r );
+          AccessT h_col = high.interest().origin(); h_col.advance( c, r );
+          if ( is_extrema( l_col, m_col, h_col ) )
+            points.push_back( ip::InterestPoint( c, r, m_interest.float_scale(scale), row[c] ) );
+        }
       }
 
-      return new_points;
-    }
+      stats.num_candidates = points.size();
 
-  protected:
+      // Remove all interest points in the bottom 0.1% of our interest point range
+      float imin, imax;
+      min_max_pixel_values( mid_image, imin, imax );
+      float threshold_lvl = imin + 0.001 * ( imax - imin );
+      stats.threshold = threshold_lvl;
+
+      // Thresholding (in OBALOG this also does Harris)
+      threshold( points, mid, scale, threshold_lvl );
+    }
 
     template <class DataT>
     inline void threshold( vw::ip::InterestPointList& points,
@@ -22,13 +22,44 @@
 #include <vw/Cartography/CameraBBox.h>
 #include <vw/Stereo/StereoModel.h>
 
+#include <boost/filesystem/path.hpp>
+
 using namespace vw;
 
 namespace asp {
 
+  namespace {
+    // Mark files holding binary descriptors, or matches of them
+    std::string descriptor_filename( std::string const& filename ) {
+      if ( !stereo_settings().binary_ip_descriptors )
+        return filename;
+      boost::filesystem::path path( filename );
+      std::string extension = path.extension().string();
+      return path.replace_extension( ".binary" + extension ).string();
+    }
+  }
+
+  std::string match_filename( std::string const& out_prefix,
+                              std::string const& input_file1,
+                              std::string const& input_file2 ) {
+    return descriptor_filename( ip::match_filename( out_prefix, input_file1, input_file2 ) );
+  }
+
+  void ip_filenames( std::string const& out_prefix,
+                     std::string const& input_file1,
+                     std::string const& input_file2,
+                     std::string& output_ip1,
+                     std::string& output_ip2 ) {
+    ip::ip_filenames( out_prefix, input_file1, input_file2, output_ip1, output_ip2 );
+    output_ip1 = descriptor_filename( output_ip1 );
+    output_ip2 = descriptor_filename( output_ip2 );
+  }
+
   EpipolarLinePointMatcher::EpipolarLinePointMatcher( double threshold, double epipolar_threshold,
-                                                      vw::cartography::Datum const& datum ) :
-    m_threshold(threshold), m_epipolar_threshold(epipolar_threshold), m_datum(datum) {}
+                                                      vw::cartography::Datum const& datum,
+                                                      bool binary_descriptors ) :
+    m_threshold(threshold), m_epipolar_threshold(epipolar_threshold), m_datum(datum),
+    m_binary_descriptors(binary_descriptors) {}
 
   Vector3 EpipolarLinePointMatcher::epipolar_line( Vector2 const& feature,
                                                    cartography::Datum const& datum,
@@ -55,9 +86,11 @@ namespace asp {
       norm_2( subvector( line, 0, 2 ) );
   }
 
+  // TreeT is either a math::FLANNTree<float> or a HammingIndex
+  template <class TreeT>
   class EpipolarLineMatchTask : public Task, private boost::noncopyable {
     typedef ip::InterestPointList::const_iterator IPListIter;
-    math::FLANNTree<float>& m_tree;
+    TreeT& m_tree;
     IPListIter m_start, m_end;
     ip::InterestPointList const& m_ip_other;
     camera::CameraModel *m_cam1, *m_cam2;
@@ -66,7 +99,7 @@ namespace asp {
     Mutex& m_camera_mutex;
     std::vector<size_t>::iterator m_output;
   public:
-    EpipolarLineMatchTask( math::FLANNTree<float>& tree,
+    EpipolarLineMatchTask( TreeT& tree,
                            ip::InterestPointList::const_iterator start,
                            ip::InterestPointList::const_iterator end,
                            ip::InterestPointList const& ip2,
@@ -100,6 +133,7 @@ namespace asp {
         m_tree.knn_search( ip->descriptor, indices, distances, 10 );
 
         for ( size_t i = 0; i < 10; i++ ) {
+          if ( indices[i] < 0 ) break; // Fewer than 10 points to search
           IPListIter ip2_it = m_ip_other.begin();
           std::advance( ip2_it, indices[i] );
           Vector2 ip2_org_coord = m_tx2.reverse( Vector2( ip2_it->x, ip2_it->y ) );
@@ -120,6 +154,48 @@ namespace asp {
     }
   };
 
+  // Split the search of the points of ip1 over a pool of threads
+  template <class TreeT>
+  void epipolar_match_with_tree( TreeT& tree,
+                                 ip::InterestPointList const& ip1,
+                                 ip::InterestPointList const& ip2,
+                                 camera::CameraModel* cam1,
+                                 camera::CameraModel* cam2,
+                                 TransformRef const& tx1,
+                                 TransformRef const& tx2,
+                                 EpipolarLinePointMatcher const& matcher,
+                                 std::vector<size_t>& output_indices ) {
+    typedef ip::InterestPointList::const_iterator IPListIter;
+    typedef EpipolarLineMatchTask<TreeT> TaskT;
+    size_t ip1_size = ip1.size();
+
+    FifoWorkQueue matching_queue;
+    Mutex camera_mutex;
+
+    // Jobs set to 2x the number of cores. This is just incase all jobs are not equal.
+    size_t number_of_jobs = vw_settings().default_num_threads() * 2;
+    IPListIter start_it = ip1.begin();
+    std::vector<size_t>::iterator output_it = output_indices.begin();
+
+    for ( size_t i = 0; i < number_of_jobs - 1; i++ ) {
+      IPListIter end_it = start_it;
+      std::advance( end_it, ip1_size / number_of_jobs );
+      boost::shared_ptr<Task>
+        match_task( new TaskT( tree, start_it, end_it,
+                               ip2, cam1, cam2, tx1, tx2, matcher,
+                               camera_mutex, output_it ) );
+      matching_queue.add_task( match_task );
+      start_it = end_it;
+      std::advance( output_it, ip1_size / number_of_jobs );
+    }
+    boost::shared_ptr<Task>
+      match_task( new TaskT( tree, start_it, ip1.end(),
+                             ip2, cam1, cam2, tx1, tx2, matcher,
+                             camera_mutex, output_it ) );
+    matching_queue.add_task( match_task );
+    matching_queue.join_all();
+  }
+
   void EpipolarLinePointMatcher::operator()( ip::InterestPointList const& ip1,
                                              ip::InterestPointList const& ip2,
                                              camera::CameraModel* cam1,
@@ -127,8 +203,6 @@ namespace asp {
                                              TransformRef const& tx1,
                                              TransformRef const& tx2,
                                              std::vector<size_t>& output_indices ) const {
-    typedef ip::InterestPointList::const_iterator IPListIter;
-
     Timer total_time("Total elapsed time", DebugMessage, "interest_point");
     size_t ip1_size = ip1.size(), ip2_size = ip2.size();
 
@@ -141,6 +215,14 @@ namespace asp {
     // Build the output indices
     output_indices.resize( ip1_size );
 
+    if ( m_binary_descriptors ) {
+      HammingIndex index( ip2.begin(), ip2.end() );
+      vw_out(InfoMessage,"interest_point") << "Hamming index created. Searching...\n";
+      epipolar_match_with_tree( index, ip1, ip2, cam1, cam2, tx1, tx2,
+                                *this, output_indices );
+      return;
+    }
+
     // Make the storage structure required by FLANN. FLANN really only
     // holds a bunch of pointers to this structure. It should be
     // possible to modify FLANN so that it doesn't need a copy.
@@ -151,32 +233,8 @@ namespace asp {
 
     math::FLANNTree<float > kd( ip2_matrix );
     vw_out(InfoMessage,"interest_point") << "FLANN-Tree created. Searching...\n";
-
-    FifoWorkQueue matching_queue;
-    Mutex camera_mutex;
-
-    // Jobs set to 2x the number of cores. This is just incase all jobs are not equal.
-    size_t number_of_jobs = vw_settings().default_num_threads() * 2;
-    IPListIter start_it = ip1.begin();
-    std::vector<size_t>::iterator output_it = output_indices.begin();
-
-    for ( size_t i = 0; i < number_of_jobs - 1; i++ ) {
-      IPListIter end_it = start_it;
-      std::advance( end_it, ip1_size / number_of_jobs );
-      boost::shared_ptr<Task>
-        match_task( new EpipolarLineMatchTask( kd, start_it, end_it,
-                                               ip2, cam1, cam2, tx1, tx2, *this,
-                                               camera_mutex, output_it ) );
-      matching_queue.add_task( match_task );
-      start_it = end_it;
-      std::advance( output_it, ip1_size / number_of_jobs );
-    }
-    boost::shared_ptr<Task>
-      match_task( new EpipolarLineMatchTask( kd, start_it, ip1.end(),
-                                             ip2, cam1, cam2, tx1, tx2, *this,
-                                             camera_mutex, output_it ) );
-    matching_queue.add_task( match_task );
-    matching_queue.join_all();
+    epipolar_match_with_tree( kd, ip1, ip2, cam1, cam2, tx1, tx2,
+                              *this, output_indices );
   }
 
   void check_homography_matrix(Matrix<double>       const& H,
@@ -20,6 +20,8 @@
 #define __ASP_CORE_INTEREST_POINT_MATCHING_H__
 
 #include <asp/Core/IntegralAutoGainDetector.h>
+#include <asp/Core/BinaryDescriptor.h>
+#include <asp/Core/StereoSettings.h>
 
 #include <vw/Core.h>
 #include <vw/Core/Stopwatch.h>
@@ -40,13 +42,19 @@ namespace asp {
   // filters them by whom are closest to the epipolar line via a
   // threshold. The remaining 2 or then selected to be a match if
   // their distance meets the other threshold.
+  //
+  // With 'binary_descriptors' the descriptors are expected to come
+  // from BinaryDescriptorGenerator and are compared by Hamming
+  // distance.
   class EpipolarLinePointMatcher {
     double m_threshold, m_epipolar_threshold;
     vw::cartography::Datum m_datum;
+    bool m_binary_descriptors;
 
   public:
     EpipolarLinePointMatcher( double threshold, double epipolar_threshold,
-                              vw::cartography::Datum const& datum );
+                              vw::cartography::Datum const& datum,
+                              bool binary_descriptors = false );
 
     // This only returns the indicies
     void operator()( vw::ip::InterestPointList const& ip1,
@@ -68,9 +76,23 @@ namespace asp {
     static double distance_point_line( vw::Vector3 const& line,
                                        vw::Vector2 const& point );
 
-    friend class EpipolarLineMatchTask;
+    template <class TreeT> friend class EpipolarLineMatchTask;
   };
 
+  // Names of the cached match and interest point files, as given by
+  // vw::ip::match_filename and vw::ip::ip_filenames, except that with
+  // --binary-ip-descriptors the extension is preceded by ".binary".
+  // Files made with one kind of descriptor are then never read by a
+  // run using the other.
+  std::string match_filename( std::string const& out_prefix,
+                              std::string const& input_file1,
+                              std::string const& input_file2 );
+  void ip_filenames( std::string const& out_prefix,
+                     std::string const& input_file1,
+                     std::string const& input_file2,
+                     std::string& output_ip1,
+                     std::string& output_ip2 );
+
   // Tool to remove points on or within 1 px of nodata pixels.
   // Note: A nodata pixel is one for which pixel <= nodata.
   template <class ImageT>
@@ -188,15 +210,27 @@ namespace asp {
     sw.start();
 
     vw_out() << "\t    Building descriptors" << std::endl;
-    ip::SGradDescriptorGenerator descriptor;
-    if ( boost::math::isnan(nodata1) )
-      describe_interest_points( image1.impl(), descriptor, ip1 );
-    else
-      describe_interest_points( apply_mask(create_mask_less_or_equal(image1.impl(),nodata1)), descriptor, ip1 );
-    if ( boost::math::isnan(nodata2) )
-      describe_interest_points( image2.impl(), descriptor, ip2 );
-    else
-      describe_interest_points( apply_mask(create_mask_less_or_equal(image2.impl(),nodata2)), descriptor, ip2 );
+    if ( stereo_settings().binary_ip_descriptors ) {
+      BinaryDescriptorGenerator descriptor;
+      if ( boost::math::isnan(nodata1) )
+        descriptor( image1.impl(), ip1 );
+      else
+        descriptor( apply_mask(create_mask_less_or_equal(image1.impl(),nodata1)), ip1 );
+      if ( boost::math::isnan(nodata2) )
+        descriptor( image2.impl(), ip2 );
+      else
+        descriptor( apply_mask(create_mask_less_or_equal(image2.impl(),nodata2)), ip2 );
+    } else {
+      ip::SGradDescriptorGenerator descriptor;
+      if ( boost::math::isnan(nodata1) )
+        describe_interest_points( image1.impl(), descriptor, ip1 );
+      else
+        describe_interest_points( apply_mask(create_mask_less_or_equal(image1.impl(),nodata1)), descriptor, ip1 );
+      if ( boost::math::isnan(nodata2) )
+        describe_interest_points( image2.impl(), descriptor, ip2 );
+      else
+        describe_interest_points( apply_mask(create_mask_less_or_equal(image2.impl(),nodata2)), descriptor, ip2 );
+    }
 
     vw_out(DebugMessage,"asp") << "Building descriptors elapsed time: "
                                << sw.elapsed_seconds() << " s." << std::endl;
@@ -224,14 +258,18 @@ namespace asp {
 
     // Match the interset points using the default matcher
     vw_out() << "\t--> Matching interest points\n";
-    ip::InterestPointMatcher<ip::L2NormMetric,ip::NullConstraint> matcher(0.5);
     std::vector<ip::InterestPoint> ip1_copy, ip2_copy;
     ip1_copy.reserve( ip1.size() );
     ip2_copy.reserve( ip2.size() );
     std::copy( ip1.begin(), ip1.end(), std::back_inserter( ip1_copy ) );
     std::copy( ip2.begin(), ip2.end(), std::back_inserter( ip2_copy ) );
-    matcher( ip1_copy, ip2_copy, matched_ip1, matched_ip2,
-             TerminalProgressCallback( "asp", "\t   Matching: " ));
+    if ( stereo_settings().binary_ip_descriptors ) {
+      match_binary_descriptors( ip1_copy, ip2_copy, matched_ip1, matched_ip2, 0.5 );
+    } else {
+      ip::InterestPointMatcher<ip::L2NormMetric,ip::NullConstraint> matcher(0.5);
+      matcher( ip1_copy, ip2_copy, matched_ip1, matched_ip2,
+               TerminalProgressCallback( "asp", "\t   Matching: " ));
+    }
     ip::remove_duplicates( matched_ip1, matched_ip2 );
     vw_out() << "\t    Matched points: " << matched_ip1.size() << std::endl;
   }
@@ -332,7 +370,8 @@ namespace asp {
     // Match interest points forward/backward .. constraining on epipolar line
     std::vector<size_t> forward_match, backward_match;
     vw_out() << "\t--> Matching interest points" << std::endl;
-    EpipolarLinePointMatcher matcher( 0.5, norm_2(Vector2(image1.impl().cols(),image1.impl().rows()))/20, datum );
+    EpipolarLinePointMatcher matcher( 0.5, norm_2(Vector2(image1.impl().cols(),image1.impl().rows()))/20, datum,
+                                      stereo_settings().binary_ip_descriptors );
     vw_out() << "\t    Matching Forward" << std::endl;
     matcher( ip1, ip2, cam1, cam2, left_tx, right_tx, forward_match );
     vw_out() << "\t    Matching Backward" << std::endl;
@@ -497,14 +497,8 @@ namespace vw { namespace cartography {
         min_val = m_default_value;
       }
       
-      std::valarray<float> vertices(10), intensities(5);
-
       if (m_use_surface_sampling){
-        static const int NUM_COLOR_COMPONENTS = 1;  // We only need gray scale
-        static const int NUM_VERTEX_COMPONENTS = 2; // DEMs are 2D
         renderer.Clear(min_val);
-        renderer.SetVertexPointer(NUM_VERTEX_COMPONENTS, &vertices[0]);
-        renderer.SetColorPointer(NUM_COLOR_COMPONENTS, &intensities[0]);
       }else{
         point2grid.Clear(min_val);
       }
@@ -618,69 +612,51 @@ namespace vw { namespace cartography {
         if (m_error_cutoff >= 0.0)
           error_copy = crop(m_error_image, blocks[i] );
         
-        typedef typename ImageView<typename ImageT::pixel_type>::pixel_accessor
-          PointAcc;
-        PointAcc row_acc = point_copy.origin();
-        for ( int32 row = 0; row < point_copy.rows()-d; ++row ) {
-          PointAcc point_ul = row_acc;
-          
-          for ( int32 col = 0; col < point_copy.cols()-d; ++col ) {
-            
-            PointAcc point_ur = point_ul; point_ur.next_col();
-            PointAcc point_ll = point_ul; point_ll.next_row();
-            PointAcc point_lr = point_ul; point_lr.advance(1,1);
-
-            if (m_use_surface_sampling){
-
-              // This loop rasterizes a quad indexed by the upper left.
-              if ( !boost::math::isnan((*point_ul).z()) &&
-                   !boost::math::isnan((*point_lr).z()) ) {
-                
-                vertices[0] = (*point_ul).x(); // UL
-                vertices[1] = (*point_ul).y();
-                vertices[2] = (*point_ll).x(); // LL
-                vertices[3] = (*point_ll).y();
-                vertices[4] = (*point_lr).x(); // LR
-                vertices[5] = (*point_lr).y();
-                vertices[6] = (*point_ur).x(); // UR
-                vertices[7] = (*point_ur).y();
-                vertices[8] = (*point_ul).x(); // UL
-                vertices[9] = (*point_ul).y();
-                
-                intensities[0] = texture_copy(col,  row);
-                intensities[1] = texture_copy(col,row+1);
-                intensities[2] = texture_copy(col+1,  row+1);
-                intensities[3] = texture_copy(col+1,row);
-                intensities[4] = texture_copy(col,row);
-                
-                if ( !boost::math::isnan((*point_ll).z()) ) {
-                  // triangle 1 is: UL LL LR
-                  renderer.DrawPolygon(0, 3);
-                }
-                if ( !boost::math::isnan((*point_ur).z()) ) {
-                  // triangle 2 is: LR, UR, UL
-                  renderer.DrawPolygon(2, 3);
-                }
-              }
-              
-            }else{
-              // The new engine
+        if (m_use_surface_sampling){
 
-              // Skip points above triangulation error
-              if ( m_error_cutoff >= 0.0 && error_copy(col, row) > m_error_cutoff )
+          // Hand the whole block to the renderer at once, with a
+          // bitmask telling which points are valid. Each quad indexed
+          // by its upper-left point is rasterized as the triangles
+          // UL LL LR and LR UR UL.
+          int num_cols = point_copy.cols(), num_rows = point_copy.rows();
+          if (num_cols < 2 || num_rows < 2)
+            continue;
+          int num_words = vw::stereo::SoftwareRenderer::ValidityWordsPerRow(num_cols);
+          std::vector<float> block_vertices(2*num_cols*num_rows);
+          std::vector<vw::uint64> validity(num_words*num_rows, 0);
+          for ( int32 row = 0; row < num_rows; ++row ) {
+            vw::uint64 * row_validity = &validity[row*num_words];
+            for ( int32 col = 0; col < num_cols; ++col ) {
+              typename ImageT::pixel_type const& point = point_copy(col, row);
+              if ( boost::math::isnan(point.z()) )
                 continue;
+              int index = row*num_cols + col;
+              block_vertices[2*index  ] = point.x();
+              block_vertices[2*index+1] = point.y();
+              row_validity[col/64] |= vw::uint64(1) << (col % 64);
+            }
+          }
 
-              if ( !boost::math::isnan(point_copy(col, row).z()) ){
-                point2grid.AddPoint(point_copy(col, row).x(),
-                                    point_copy(col, row).y(),
-                                    texture_copy(col,  row));
-              }
+          renderer.DrawTriangleGrid(num_cols, num_rows, &block_vertices[0],
+                                    &texture_copy(0, 0), &validity[0]);
+          continue;
+        }
+
+        for ( int32 row = 0; row < point_copy.rows(); ++row ) {
+          for ( int32 col = 0; col < point_copy.cols(); ++col ) {
+
+            // Skip points above triangulation error
+            if ( m_error_cutoff >= 0.0 && error_copy(col, row) > m_error_cutoff )
+              continue;
+
+            if ( !boost::math::isnan(point_copy(col, row).z()) ){
+              point2grid.AddPoint(point_copy(col, row).x(),
+                                  point_copy(col, row).y(),
+                                  texture_copy(col,  row));
             }
-            point_ul.next_col();
           }
-          row_acc.next_row();
         }
-        
+
       }
 
       if (!m_use_surface_sampling)
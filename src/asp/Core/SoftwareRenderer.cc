@@ -86,7 +86,7 @@ static const int kVerticesPerTriangle = 3;
 struct Coords
 {
   Coords() {}
-  Coords(float coords[2])
+  Coords(const float coords[2])
   {
     x = coords[0]; y = coords[1]; z = 0.0; w = 1.0;
   }
@@ -98,7 +98,7 @@ struct Color
 {
   Color() {}
   Color(float gray) { r = gray; g = 0.0; b = 0.0; a = 1.0; }
-  Color(float color[], int numComponents)
+  Color(const float color[], int numComponents)
   {
     switch (numComponents)
     {
@@ -190,9 +190,9 @@ struct GraphicsState
 
 struct Vertex
 {
-  Vertex(float initCoords[2], float initGray)
+  Vertex(const float initCoords[2], float initGray)
     : color(initGray), window(initCoords) {}
-  Vertex(float initCoords[2], Color initColor)
+  Vertex(const float initCoords[2], Color initColor)
     : color(initColor), window(initCoords) {}
 
   // Current face color in use.
@@ -308,58 +308,22 @@ SetInitialParameters(GraphicsState *gc, const Vertex *a, RealT dx, RealT dy)
 }
 
 
-static void
-DrawFlatGraySpan(GraphicsState *gc)
+// Fill 'length' pixels of a span with a constant value.
+inline void
+DrawFlatGraySpan(float *span, int length, RealT gray)
 {
-  // Evaluate the clipping in the X direction
-  int length = gc->rasterInfo.length;
-  int x = gc->rasterInfo.frag.x;
-  if ( x < gc->clipX0 ) { // Check to see if the line goes off the left
-    length += x - gc->clipX0;
-    x = gc->clipX0;
-  }
-  if ( x + length > gc->clipX1 ) { // Check to see the line goes off
-                                   // the right
-    length -= x + length - gc->clipX1;
-  }
-
-  // Check to see if we just removed this line
-  if ( length < 1 ) return;
-
-  std::fill_n(&(gc->buffer[gc->rasterInfo.frag.y * gc->width + x]),
-              length, float(gc->rasterInfo.frag.color.r));
+  std::fill_n(span, length, float(gray));
 }
 
-static void
-DrawGraySpan(GraphicsState *gc)
+// Fill 'length' pixels of a span with values linearly interpolated
+// from 'gray' with step 'drdx'. Each value is evaluated directly
+// rather than accumulated from its left neighbor, so the loop has no
+// dependency between iterations and is vectorized by the compiler.
+inline void
+DrawGraySpan(float *span, int length, RealT gray, RealT drdx)
 {
-  RealT gray = gc->rasterInfo.frag.color.r;
-  RealT drdx = gc->rasterInfo.colorIter.drdx;
-
-  // Evaluate the clipping in the X direction
-  int length = gc->rasterInfo.length;
-  int x = gc->rasterInfo.frag.x;
-  if ( x < gc->clipX0 ) { // Check to see if the line goes off the left
-    int difference = gc->clipX0 - x;
-    length -= difference;
-    x = gc->clipX0;
-    gray += RealT(difference) * drdx;
-  }
-  if ( x + length > gc->clipX1 ) { // Check to see the line goes off
-                                   // the right
-    length -= x + length - gc->clipX1;
-  }
-
-  // Check to see if we just removed this line
-  if ( length < 1 ) return;
-
-  float *span =
-    &(gc->buffer[gc->rasterInfo.frag.y * gc->width + x ] );
-
-  for (int i = length; i; --i) {
-    *span++ = float(gray);
-    gray += drdx;
-  }
+  for (int i = 0; i < length; i++)
+    span[i] = float(gray + RealT(i) * drdx);
 }
 
 // In the SnapX* and FillSubTriangle routines, 1s31.1s31 fixed point
@@ -437,48 +401,48 @@ SnapXRight(RasterInfo *rasterInfo, RealT xRight, RealT dxdyRight)
   rasterInfo->dxRightBig = (int) big;
 }
 
+// Walk the left and right edges from row iyBottom up to (but not
+// including) row iyTop and fill the spans in between. The edge and
+// color state lives in locals for the duration of the walk and is
+// written back at the end, as the next sub-triangle may continue
+// along the same left edge.
+template <bool Smooth>
 static void
 FillSubTriangle(GraphicsState *gc,  int iyBottom, int iyTop)
 {
-  int ixLeft, ixRight;
-  int ixLeftFrac, ixRightFrac;
-  int dxLeftFrac, dxRightFrac;
-  int dxLeftLittle, dxRightLittle;
-  int dxLeftBig, dxRightBig;
-  int spanWidth, clipY0, clipY1;
-  unsigned int modeFlags;
-  void (*processSpan)(GraphicsState *);
-
-  ixLeft = gc->rasterInfo.ixLeft;
-  ixLeftFrac = gc->rasterInfo.ixLeftFrac;
-  ixRight = gc->rasterInfo.ixRight;
-  ixRightFrac = gc->rasterInfo.ixRightFrac;
-  clipY0 = gc->clipY0;
-  clipY1 = std::min( gc->clipY1, iyTop );
-  dxLeftFrac = gc->rasterInfo.dxLeftFrac;
-  dxLeftBig = gc->rasterInfo.dxLeftBig;
-  dxLeftLittle = gc->rasterInfo.dxLeftLittle;
-  dxRightFrac = gc->rasterInfo.dxRightFrac;
-  dxRightBig = gc->rasterInfo.dxRightBig;
-  dxRightLittle = gc->rasterInfo.dxRightLittle;
-  modeFlags = gc->rasterInfo.modeFlags;
-  //  gc->rasterInfo.cfb = gc->drawBuffer;
-
-  if (modeFlags & eShadeSmooth)
-    processSpan = DrawGraySpan;
-  else
-    processSpan = DrawFlatGraySpan;
+  RasterInfo &rasterInfo = gc->rasterInfo;
+  int ixLeft = rasterInfo.ixLeft;
+  int ixLeftFrac = rasterInfo.ixLeftFrac;
+  int ixRight = rasterInfo.ixRight;
+  int ixRightFrac = rasterInfo.ixRightFrac;
+  const int dxLeftFrac = rasterInfo.dxLeftFrac;
+  const int dxLeftBig = rasterInfo.dxLeftBig;
+  const int dxLeftLittle = rasterInfo.dxLeftLittle;
+  const int dxRightFrac = rasterInfo.dxRightFrac;
+  const int dxRightBig = rasterInfo.dxRightBig;
+  const int dxRightLittle = rasterInfo.dxRightLittle;
+  const int clipX0 = gc->clipX0, clipX1 = gc->clipX1;
+  const int clipY0 = gc->clipY0;
+  const int clipY1 = std::min( gc->clipY1, iyTop );
+  const RealT drdx = rasterInfo.colorIter.drdx;
+  const RealT rBig = rasterInfo.colorIter.rBig;
+  const RealT rLittle = rasterInfo.colorIter.rLittle;
+  RealT gray = rasterInfo.frag.color.r;
 
   while (iyBottom < clipY1)
   {
-    spanWidth = ixRight - ixLeft;
     // Only render spans that have non-zero width and which are not
-    // scissored out vertically.
-    if ((spanWidth > 0) && (iyBottom >= clipY0) ) {
-      gc->rasterInfo.frag.x = ixLeft;
-      gc->rasterInfo.frag.y = iyBottom;
-      gc->rasterInfo.length = spanWidth;
-      processSpan(gc);
+    // scissored out vertically, after clipping them in x.
+    if ((ixRight > ixLeft) && (iyBottom >= clipY0)) {
+      int x = std::max(ixLeft, clipX0);
+      int length = std::min(ixRight, clipX1) - x;
+      if (length > 0) {
+        float *span = &gc->buffer[iyBottom * gc->width + x];
+        if (Smooth)
+          DrawGraySpan(span, length, gray + RealT(x - ixLeft) * drdx, drdx);
+        else
+          DrawFlatGraySpan(span, length, gray);
+      }
     }
 
     // Advance right edge fixed point, adjusting for carry
@@ -499,21 +463,30 @@ FillSubTriangle(GraphicsState *gc,  int iyBottom, int iyTop)
     {
       ixLeft += dxLeftBig;
       ixLeftFrac &= ~0x80000000;
-
-      if (modeFlags & eShadeSmooth)
-        gc->rasterInfo.frag.color.r += gc->rasterInfo.colorIter.rBig;
+      if (Smooth)
+        gray += rBig;
     }
     else                            // Use small step
     {
       ixLeft += dxLeftLittle;
-      if (modeFlags & eShadeSmooth)
-        gc->rasterInfo.frag.color.r += gc->rasterInfo.colorIter.rLittle;
+      if (Smooth)
+        gray += rLittle;
     }
   }
-  gc->rasterInfo.ixLeft = ixLeft;
-  gc->rasterInfo.ixLeftFrac = ixLeftFrac;
-  gc->rasterInfo.ixRight = ixRight;
-  gc->rasterInfo.ixRightFrac = ixRightFrac;
+  rasterInfo.ixLeft = ixLeft;
+  rasterInfo.ixLeftFrac = ixLeftFrac;
+  rasterInfo.ixRight = ixRight;
+  rasterInfo.ixRightFrac = ixRightFrac;
+  rasterInfo.frag.color.r = gray;
+}
+
+static void
+FillSubTriangle(GraphicsState *gc,  int iyBottom, int iyTop)
+{
+  if (gc->rasterInfo.modeFlags & eShadeSmooth)
+    FillSubTriangle<true>(gc, iyBottom, iyTop);
+  else
+    FillSubTriangle<false>(gc, iyBottom, iyTop);
 }
 
 static void
@@ -630,6 +603,25 @@ FillTriangle(GraphicsState *gc, Vertex *a, Vertex *b, Vertex *c)
   }
 }
 
+// Index of the lowest set bit of a nonzero word
+inline int
+LowestSetBit(vw::uint64 word)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(word);
+#else
+  int bit = 0;
+  while (!(word & 1)) { word >>= 1; bit++; }
+  return bit;
+#endif
+}
+
+inline bool
+IsValid(const vw::uint64 *rowValidity, int col)
+{
+  return (rowValidity[col >> 6] >> (col & 63)) & 1;
+}
+
 inline void
 MapToWindow(Coords &coords,
             const double ndcMap[3][2],
@@ -811,3 +803,65 @@ SoftwareRenderer::DrawPolygon(const int startIndex, const int numVertices)
     colorIndex2 += m_triangleColorStep;
   }
 }
+
+void
+SoftwareRenderer::DrawTriangleGrid(const int cols, const int rows,
+                                   const float * const vertices,
+                                   const float * const colors,
+                                   const vw::uint64 * const validity)
+{
+  if ((colors == 0) && (m_shadeMode != eShadeFlat))
+    return;
+
+  GraphicsState *gc = (GraphicsState *) m_graphicsState;
+  const int numWords = ValidityWordsPerRow(cols);
+  const double width = double(m_bufferWidth), height = double(m_bufferHeight);
+
+  for (int row = 0; row + 1 < rows; row++)
+  {
+    const vw::uint64 *upperValid = &validity[row * numWords];
+    const vw::uint64 *lowerValid = upperValid + numWords;
+
+    for (int w = 0; w < numWords; w++)
+    {
+      // Cells whose UL and LR points are both valid
+      vw::uint64 lrValid = lowerValid[w] >> 1;
+      if (w + 1 < numWords)
+        lrValid |= lowerValid[w + 1] << 63;
+      vw::uint64 cells = upperValid[w] & lrValid;
+
+      while (cells)
+      {
+        const int col = 64 * w + LowestSetBit(cells);
+        cells &= cells - 1;
+        if (col + 1 >= cols)
+          break;
+
+        const int ul = row * cols + col, ur = ul + 1;
+        const int ll = ul + cols, lr = ll + 1;
+
+        Vertex vertexUL(&vertices[2 * ul], colors ? colors[ul] : 0.0f);
+        Vertex vertexLR(&vertices[2 * lr], colors ? colors[lr] : 0.0f);
+        MapToWindow(vertexUL.window, m_transformNDC, 0.0, 0.0, width, height,
+                    vertexUL.window);
+        MapToWindow(vertexLR.window, m_transformNDC, 0.0, 0.0, width, height,
+                    vertexLR.window);
+
+        if (IsValid(lowerValid, col))
+        {
+          Vertex vertexLL(&vertices[2 * ll], colors ? colors[ll] : 0.0f);
+          MapToWindow(vertexLL.window, m_transformNDC, 0.0, 0.0, width, height,
+                      vertexLL.window);
+          FillTriangle(gc, &vertexUL, &vertexLL, &vertexLR);
+        }
+        if (IsValid(upperValid, col + 1))
+        {
+          Vertex vertexUR(&vertices[2 * ur], colors ? colors[ur] : 0.0f);
+          MapToWindow(vertexUR.window, m_transformNDC, 0.0, 0.0, width, height,
+                      vertexUR.window);
+          FillTriangle(gc, &vertexLR, &vertexUR, &vertexUL);
+        }
+      }
+    }
+  }
+}
@@ -22,6 +22,8 @@
 #ifndef __VW_STEREO_SOFTWARE_RENDERER_H__
 #define __VW_STEREO_SOFTWARE_RENDERER_H__
 
+#include <vw/Core/FundamentalTypes.h>
+
 namespace vw {
 namespace stereo {
 
@@ -36,6 +38,24 @@ namespace stereo {
       void SetColorPointer(const int numComponents, float * const colors);
       void DrawPolygon(const int startIndex, const int numVertices);
 
+      // Draw in one call the triangles of a cols x rows grid of
+      // points, such as a block of a point cloud. 'vertices' holds
+      // the x and y of the points in row-major order, and 'colors'
+      // their gray values. Bit (col % 64) of word
+      // validity[row*ValidityWordsPerRow(cols) + col/64] tells if a
+      // point is valid, with the unused bits of each row set to
+      // zero. The cell with upper-left point UL is drawn as the
+      // triangles UL, LL, LR and LR, UR, UL, each only if all its
+      // points are valid, in the same order as calling DrawPolygon
+      // cell by cell. Runs of cells with invalid UL or LR are
+      // skipped a word at a time.
+      void DrawTriangleGrid(const int cols, const int rows,
+                            const float * const vertices,
+                            const float * const colors,
+                            const vw::uint64 * const validity);
+
+      static int ValidityWordsPerRow(const int cols) { return (cols + 63) / 64; }
+
     private:
       int m_numVertexComponents;
       float *m_vertexPointer;
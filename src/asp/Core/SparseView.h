@@ -23,14 +23,22 @@
 #define __SPARSE_IMAGE_VIEW_H__
 
 // Standard
+#include <algorithm>
+#include <map>
 #include <vector>
 
 // VW
 #include <vw/Core/Log.h>
+#include <vw/Core/Thread.h>
 #include <vw/Math/Vector.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
 #include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
 #include <vw/Image/PixelMask.h>
 
+#include <boost/shared_ptr.hpp>
+
 namespace asp {
   // Sparse ImageView
   //////////////////////////////////
@@ -46,29 +54,67 @@ namespace asp {
   // stored. So, be sure to use pixel mask to mark the spots not to be
   // recorded
 
-  // For the time being we do not support overwriting previous data. It
-  // seems non trivial at this hour.
+  // The strips are binned by square tiles of the image, split at tile
+  // boundaries, and each tile keeps them in flat vectors sorted by row
+  // and column. Rasterizing a region copies the underlying image and
+  // then copies over it the strips of the tiles it intersects.
+  // Copies of the view share the strips, and absorb() may be called
+  // from several threads.
+
+  // For the time being we do not support overwriting previous data
+  // unless allow_overlap is set, in which case later data wins.
 
   template <class ImageT>
   class SparseCompositeView : public vw::ImageViewBase< SparseCompositeView<ImageT> > {
-    // The key in our map is the index marking the end of the
-    // vector. This somewhat confusing method is to allow us better use of
-    // the container's search method.
-    typedef std::map<vw::int32,std::vector<typename ImageT::pixel_type > > map_type;
-    std::vector<map_type> m_data; // One map for each row of the image
-    bool   m_allow_overlap;
-    ImageT m_under_image;
-
   public:
     typedef typename ImageT::pixel_type pixel_type;
     typedef pixel_type result_type;
     typedef vw::ProceduralPixelAccessor<SparseCompositeView<ImageT> > pixel_accessor;
 
+  private:
+    // Pixels [begin, end) of 'row', stored at 'offset' in the pixels
+    // of their tile.
+    struct Segment {
+      vw::int32 row, begin, end;
+      size_t offset;
+      bool operator<( Segment const& other ) const {
+        return row < other.row || ( row == other.row && begin < other.begin );
+      }
+    };
+
+    struct Tile {
+      std::vector<Segment>    segments;
+      std::vector<pixel_type> pixels;
+    };
+
+    struct Overlay {
+      vw::int32 tile_size, tiles_x, tiles_y;
+      std::vector<Tile> tiles;
+      vw::Mutex mutex;
+    };
+
+    boost::shared_ptr<Overlay> m_data;
+    bool   m_allow_overlap;
+    ImageT m_under_image;
+
+    Tile const* tile_at( vw::int32 i, vw::int32 j ) const {
+      if ( i < 0 || j < 0 || i >= cols() || j >= rows() )
+        return NULL;
+      return &m_data->tiles[ (j / m_data->tile_size) * m_data->tiles_x +
+                             i / m_data->tile_size ];
+    }
+
+  public:
     // Standard stuff
     SparseCompositeView( vw::ImageViewBase<ImageT> const& under_image,
-                         bool allow_overlap = false ) :
-      m_data(under_image.impl().rows()), m_allow_overlap(allow_overlap),
-      m_under_image(under_image.impl()) {}
+                         bool allow_overlap = false, vw::int32 tile_size = 256 ) :
+      m_data( new Overlay ), m_allow_overlap(allow_overlap),
+      m_under_image(under_image.impl()) {
+      m_data->tile_size = tile_size;
+      m_data->tiles_x   = ( cols() + tile_size - 1 ) / tile_size;
+      m_data->tiles_y   = ( rows() + tile_size - 1 ) / tile_size;
+      m_data->tiles.resize( m_data->tiles_x * m_data->tiles_y );
+    }
 
     inline vw::int32 cols  () const { return m_under_image.cols(); }
     inline vw::int32 rows  () const { return m_under_image.rows(); }
@@ -77,139 +123,191 @@ namespace asp {
     inline pixel_accessor origin() const { return pixel_accessor(*this,0,0); }
 
     inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p=0 ) const {
-
-      // Get next container entry after column 'i'.  Since each container is labeled
-      //   with the last column in that section, this finds the section which might contain 'i'.
-      typename map_type::const_iterator it;
-      it = m_data[j].upper_bound(i);
-
-      if ( it != m_data[j].end() ) { // If a segment possibly containing 'i' was found
-        vw::int32 s_idx = it->first - it->second.size(); // Get the starting index of this section
-        if ( i < s_idx )
-          return m_under_image( i, j, p ); // The segment does not contain the requested pixel, use the underlying image
-        else
-          return it->second[i-s_idx];     // The segment contains the data, return it
+      Tile const* tile = tile_at( i, j );
+      if ( tile && !tile->segments.empty() ) {
+        // Last segment starting at or before (i,j)
+        Segment key = { j, i+1, i+1, 0 };
+        typename std::vector<Segment>::const_iterator it =
+          std::lower_bound( tile->segments.begin(), tile->segments.end(), key );
+        if ( it != tile->segments.begin() ) {
+          --it;
+          if ( it->row == j && i < it->end )
+            return tile->pixels[ it->offset + i - it->begin ];
+        }
       }
       return m_under_image( i, j, p ); // No segment contains the requested pixel, use the underlying image
     }
 
-    typedef SparseCompositeView<ImageT> prerasterize_type;
-    inline prerasterize_type prerasterize( vw::BBox2i const& bbox ) const { return *this; }
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize( vw::BBox2i const& bbox ) const {
+      using namespace vw;
+      ImageView<pixel_type> buffer = crop( m_under_image, bbox );
+
+      BBox2i active = bbox;
+      active.crop( BBox2i( 0, 0, cols(), rows() ) );
+      if ( !active.empty() ) {
+        int32 ts = m_data->tile_size;
+        for ( int32 ty = active.min().y() / ts; ty <= ( active.max().y() - 1 ) / ts; ty++ )
+          for ( int32 tx = active.min().x() / ts; tx <= ( active.max().x() - 1 ) / ts; tx++ ) {
+            Tile const& tile = m_data->tiles[ ty * m_data->tiles_x + tx ];
+            for ( size_t s = 0; s < tile.segments.size(); s++ ) {
+              Segment const& seg = tile.segments[s];
+              if ( seg.row <  active.min().y() ) continue;
+              if ( seg.row >= active.max().y() ) break;
+              int32 begin = std::max( seg.begin, active.min().x() );
+              int32 end   = std::min( seg.end,   active.max().x() );
+              if ( begin >= end ) continue;
+              std::copy( &tile.pixels[ seg.offset + begin - seg.begin ],
+                         &tile.pixels[ seg.offset + end   - seg.begin - 1 ] + 1,
+                         &buffer( begin - bbox.min().x(), seg.row - bbox.min().y() ) );
+            }
+          }
+      }
+      return prerasterize_type( buffer, -bbox.min().x(), -bbox.min().y(),
+                                cols(), rows() );
+    }
     template <class DestT>
     inline void rasterize( DestT const& dest, vw::BBox2i const& bbox ) const {
       vw::rasterize( prerasterize(bbox), dest, bbox );
     }
 
-    // Difficult insertation
+    // Insert the valid pixels of 'image_base', whose origin is at
+    // 'starting_index'. The pixels outside of the underlying image are
+    // dropped.
     template <class InputT>
     void absorb( vw::Vector2i starting_index,
                  vw::ImageViewBase<InputT> const& image_base ) {
       using namespace vw;
-      InputT image = image_base.impl();
-      VW_DEBUG_ASSERT( starting_index[0] >= 0 && starting_index[1] >= 0,
-                       NoImplErr() << "SparseCompositeView doesn't support insertation behind image origin.\n" );
-
-      // Building temporary data structure
-      // - The goal is to record lists of consecutive valid pixels along each row of the input image.
-      std::vector<std::list<int32> > t_row_end(image.rows()); // List of all segment stop points for each row.
-      std::vector<std::list<std::vector<pixel_type> > > t_row_data(image.rows()); // List of pixels for each segment on each row.
-
-      for ( int32 r = 0; r < image.rows(); ++r ) { // For each row in input patch
-        std::vector<pixel_type> temp;
-        bool building_segment = false;
-        for ( int32 c = 0; c < image.cols(); ++c ) { // For each col in input patch
-          if ( is_valid( image(c,r) ) ) {
-            if ( !building_segment ) { // Start building a segment if we are not already then record the pixel
-              building_segment = true;
-              temp.push_back( image(c,r) );
-            } else
-              temp.push_back( image(c,r) );
-          }
-          else if ( building_segment ) { // Input pixel is invalid and building a segment
-            t_row_end[r].push_back(c);        // Record the stopping point along the row
-            building_segment = false;         // Stop building the segment
-            t_row_data[r].push_back( temp );  // Store the list of pixels we collected for this segment
-            temp.clear();
+      ImageView<typename InputT::pixel_type> image = image_base.impl();
+      int32 ts = m_data->tile_size;
+
+      // Record the runs of consecutive valid pixels along each row,
+      // split at tile boundaries, without holding the lock.
+      std::map<size_t, Tile> t_tiles;
+      for ( int32 r = 0; r < image.rows(); ++r ) {
+        int32 row = starting_index[1] + r;
+        if ( row < 0 || row >= rows() ) continue;
+        int32 c = 0;
+        while ( c < image.cols() ) {
+          int32 col = starting_index[0] + c;
+          if ( col < 0 || col >= cols() || !is_valid( image(c,r) ) ) { ++c; continue; }
+          size_t index = ( row / ts ) * m_data->tiles_x + col / ts;
+          int32 tile_end = std::min( ( col / ts + 1 ) * ts, cols() );
+          Tile & tile = t_tiles[index];
+          Segment seg = { row, col, col, tile.pixels.size() };
+          while ( c < image.cols() && seg.end < tile_end && is_valid( image(c,r) ) ) {
+            tile.pixels.push_back( image(c,r) );
+            ++seg.end; ++c;
           }
-        } // End loop through columns
-        if ( building_segment ) { // Finished the row while still building the segment
-                                  // Close out the row the same as if we hit an invalid pixel
-          t_row_end[r].push_back(image.cols());
-          t_row_data[r].push_back(temp);
-          temp.clear();
+          tile.segments.push_back( seg );
         }
-      } // End loop through rows
-
-      // Fix x offset to each segment end value so that it is correct in the global sense
-      for ( uint32 i = 0; i < t_row_end.size(); ++i ) // For each row
-        for ( std::list<int32>::iterator iter = t_row_end[i].begin(); // For each segmment
-              iter != t_row_end[i].end(); ++iter )
-          *iter += starting_index[0];
-
-      // Inserting into global data set
-      if ( int32(m_data.size()) < starting_index[1]+image.rows() )
-        m_data.resize( starting_index[1]+image.rows() ); // Allocate local sparse storage if needed
-
-      // Loop through all rows contained in the input image patch
-      for ( int32 t_i=0, m_i=starting_index[1];
-            t_i < image.rows(); ++t_i, ++m_i ) {
-
-        // Insert a strip at a time
-        std::list<int32>::const_iterator t_e_iter = t_row_end[t_i].begin();
-        typename std::list<std::vector<pixel_type> >::const_iterator t_d_iter = t_row_data[t_i].begin();
-        while ( t_e_iter != t_row_end[t_i].end() ) {
-          typename map_type::iterator it = m_data[m_i].lower_bound( *t_e_iter );
-          if ( it == m_data[m_i].end() ) { // Doesn't appear anything is this far right
-            m_data[m_i][*t_e_iter] = *t_d_iter;
-          } else if ( it == m_data[m_i].begin() ) {
-            // Nothing in front of this point.
-            int32 m_start_idx = it->first - it->second.size();
-            if ( *t_e_iter > m_start_idx )
-              vw_throw( NoImplErr() << "SparseCompositeView at this time doesn't allow insert over existing data.\n");
-            else if ( *t_e_iter == m_start_idx ) // Append to front
-              it->second.insert( it->second.begin(),
-                                 t_d_iter->begin(),
-                                 t_d_iter->end() );
-            else // Whole new key
-              m_data[m_i][*t_e_iter] = *t_d_iter;
-          } else {
-            // Somewhere in the middle
-            typename map_type::const_iterator prev_it = it;
-            prev_it--;
-            int32 t_start_idx = *t_e_iter - t_d_iter->size();
-            int32 m_start_idx = it->first - it->second.size();
-            if ( (t_start_idx < prev_it->first) ||
-                 (*t_e_iter > m_start_idx) )
-              vw_throw( NoImplErr() << "SparseCompositeView at this time doesn't allow insert over existing data.\n");
-            else if ( *t_e_iter == m_start_idx ) // Append to front
-              it->second.insert( it->second.begin(),
-                                 t_d_iter->begin(),
-                                 t_d_iter->end() );
-            else // Whole new key
-              m_data[m_i][*t_e_iter] = *t_d_iter;
-          }
+      }
 
-          ++t_e_iter;
-          ++t_d_iter;
-        }
-      } // End loop through rows contained in image patch
+      // Merge into the shared tiles, keeping each sorted. Without
+      // overlaps nothing is changed if any new segment overlaps.
+      Mutex::Lock lock( m_data->mutex );
+      if ( !m_allow_overlap )
+        for ( typename std::map<size_t, Tile>::const_iterator it = t_tiles.begin();
+              it != t_tiles.end(); it++ )
+          if ( overlaps( m_data->tiles[ it->first ], it->second ) )
+            vw_throw( NoImplErr() << "SparseCompositeView at this time doesn't allow insert over existing data.\n");
+      for ( typename std::map<size_t, Tile>::iterator it = t_tiles.begin();
+            it != t_tiles.end(); it++ )
+        merge_tile( m_data->tiles[ it->first ], it->second );
     } // End of absorb() function
 
+    // Number of pixels held by the tiles, overwritten ones included
+    size_t num_stored_pixels() const {
+      vw::Mutex::Lock lock( m_data->mutex );
+      size_t count = 0;
+      for ( size_t t = 0; t < m_data->tiles.size(); ++t )
+        count += m_data->tiles[t].pixels.size();
+      return count;
+    }
+
     // Debug structure
     void print_structure() const {
       using namespace vw;
       vw_out() << "SparseCompositeView Structure:\n";
-      for ( uint32 i = 0; i < m_data->size(); ++i ) {
-        vw_out() << i << " | ";
-        for ( typename map_type::const_iterator it = (*m_data)[i].begin();
-              it != (*m_data)[i].end(); ++it ) {
-          int32 start = it->first - it->second.size();
-          vw_out() << "(" << start << "->" << it->first << ")";
+      for ( uint32 t = 0; t < m_data->tiles.size(); ++t ) {
+        Tile const& tile = m_data->tiles[t];
+        if ( tile.segments.empty() ) continue;
+        vw_out() << "Tile " << t % m_data->tiles_x << " " << t / m_data->tiles_x << ":\n";
+        for ( size_t s = 0; s < tile.segments.size(); ++s )
+          vw_out() << tile.segments[s].row << " | (" << tile.segments[s].begin
+                   << "->" << tile.segments[s].end << ")\n";
+      }
+    }
+
+  private:
+    // True if a segment of 'src' shares pixels with one of 'dst'
+    static bool overlaps( Tile const& dst, Tile const& src ) {
+      for ( size_t s = 0; s < src.segments.size(); s++ ) {
+        Segment const& seg = src.segments[s];
+        typename std::vector<Segment>::const_iterator it =
+          std::lower_bound( dst.segments.begin(), dst.segments.end(), seg );
+        if ( it != dst.segments.end() && it->row == seg.row && it->begin < seg.end )
+          return true;
+        if ( it != dst.segments.begin() ) {
+          --it;
+          if ( it->row == seg.row && it->end > seg.begin )
+            return true;
         }
-        vw_out() << "\n";
       }
+      return false;
     }
 
+    // Merge the sorted segments of 'src' into those of 'dst' in one
+    // pass, trimming the parts of the 'dst' segments that 'src'
+    // covers. Once more than half of the pixels of the tile are
+    // covered, the pixels are compacted.
+    static void merge_tile( Tile & dst, Tile const& src ) {
+      size_t offset = dst.pixels.size();
+      dst.pixels.insert( dst.pixels.end(), src.pixels.begin(), src.pixels.end() );
+
+      std::vector<Segment> result;
+      result.reserve( dst.segments.size() + src.segments.size() );
+      std::vector<Segment> & old = dst.segments;
+      size_t d = 0, live = 0;
+      for ( size_t s = 0; s < src.segments.size(); s++ ) {
+        Segment seg = src.segments[s];
+        seg.offset += offset;
+        while ( d < old.size() && ( old[d].row < seg.row ||
+                                    ( old[d].row == seg.row && old[d].end <= seg.begin ) ) )
+          result.push_back( old[d++] );
+        while ( d < old.size() && old[d].row == seg.row && old[d].begin < seg.end ) {
+          if ( old[d].begin < seg.begin ) {
+            Segment left = old[d];
+            left.end = seg.begin;
+            result.push_back( left );
+          }
+          if ( old[d].end > seg.end ) {
+            // The rest may be covered by the next segment of 'src'
+            old[d].offset += seg.end - old[d].begin;
+            old[d].begin   = seg.end;
+            break;
+          }
+          d++;
+        }
+        result.push_back( seg );
+      }
+      result.insert( result.end(), old.begin() + d, old.end() );
+      dst.segments.swap( result );
+
+      for ( size_t s = 0; s < dst.segments.size(); s++ )
+        live += dst.segments[s].end - dst.segments[s].begin;
+      if ( 2 * live < dst.pixels.size() ) {
+        std::vector<pixel_type> pixels;
+        pixels.reserve( live );
+        for ( size_t s = 0; s < dst.segments.size(); s++ ) {
+          Segment & seg = dst.segments[s];
+          pixels.insert( pixels.end(), dst.pixels.begin() + seg.offset,
+                         dst.pixels.begin() + seg.offset + ( seg.end - seg.begin ) );
+          seg.offset = pixels.size() - ( seg.end - seg.begin );
+        }
+        dst.pixels.swap( pixels );
+      }
+    }
   };
 
 } // end namespace asp
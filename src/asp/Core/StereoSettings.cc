@@ -50,6 +50,8 @@ namespace asp {
     // Must initialize this variable as it is used in mapproject
     // to get a camera pointer, and there we don't parse stereo.default
     disable_correct_velocity_aberration = false;
+    isis_tabulated_camera    = false;
+    isis_tabulated_tolerance = 0.05;
 
     max_valid_triangulation_error = std::numeric_limits<double>::quiet_NaN();
   }
@@ -75,7 +77,9 @@ namespace asp {
       ("nodata-optimal-threshold-factor", po::value(&global.nodata_optimal_threshold_factor)->default_value(nan),
                                    "Pixels with values less than this factor times the optimal Otsu threshold are treated as no-data. Suggested value: 0.1 to 0.2.")
       ("skip-image-normalization", po::bool_switch(&global.skip_image_normalization)->default_value(false)->implicit_value(true),
-                                   "Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.");
+                                   "Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.")
+      ("binary-ip-descriptors",    po::bool_switch(&global.binary_ip_descriptors)->default_value(false)->implicit_value(true),
+                                   "Match the interest points used for alignment with binary descriptors and Hamming distance. Faster, but may find fewer matches on difficult images.");
   }
 
   CorrelationDescription::CorrelationDescription() : po::options_description("Correlation Options") {
@@ -108,7 +112,15 @@ namespace asp {
       ("use-local-homography",   po::bool_switch(&global.use_local_homography)->default_value(false)->implicit_value(true),
                                  "Apply a local homography in each tile.")
       ("corr-timeout",           po::value(&global.corr_timeout)->default_value(0),
-                                 "Correlation timeout for a tile, in seconds. [default: no timeout]");
+                                 "Correlation timeout for a tile, in seconds. [default: no timeout]")
+      ("adaptive-corr-timeout",  po::bool_switch(&global.adaptive_corr_timeout)->default_value(false)->implicit_value(true),
+                                 "Give each tile a timeout based on the time taken by tiles already correlated, between a quarter and four times corr-timeout.")
+      ("disable-tile-scheduler", po::bool_switch(&global.disable_tile_scheduler)->default_value(false)->implicit_value(true),
+                                 "Write the outputs of correlation, refinement and triangulation with the plain thread pool rather than the tile scheduler.")
+      ("log-tile-timings",       po::bool_switch(&global.log_tile_timings)->default_value(false)->implicit_value(true),
+                                 "Write the time the tile scheduler spends on each tile to <output-prefix>-D-tiles.txt, -RD-tiles.txt and -PC-tiles.txt.")
+      ("compact-disparity",      po::bool_switch(&global.compact_disparity)->default_value(false)->implicit_value(true),
+                                 "Write the D, RD and F disparities in the compact ASP .dsp format rather than as GeoTiff files.");
 
     po::options_description backwards_compat_options("Aliased backwards compatibility options");
     // Do not add default values here. They may override the values set
@@ -220,6 +232,15 @@ namespace asp {
        "Apply the velocity aberration correction for Digital Globe cameras.");
   }
 
+  IsisDescription::IsisDescription() : po::options_description("ISIS Options") {
+    StereoSettings& global = stereo_settings();
+    (*this).add_options()
+      ("isis-tabulated-camera",    po::bool_switch(&global.isis_tabulated_camera)->default_value(false)->implicit_value(true),
+       "Sample ISIS line scan cameras once into a thread-safe table so that triangulation can use multiple threads.")
+      ("isis-tabulated-tolerance", po::value(&global.isis_tabulated_tolerance)->default_value(0.05),
+       "Maximum reprojection error, in pixels, of the tabulated ISIS camera versus the ISIS camera it was sampled from.");
+  }
+
   UndocOptsDescription::UndocOptsDescription() : po::options_description("Undocumented Options") {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
@@ -236,6 +257,7 @@ namespace asp {
     cfg_options.add( FilteringDescription()     );
     cfg_options.add( TriangulationDescription() );
     cfg_options.add( DGDescription()            );
+    cfg_options.add( IsisDescription()          );
     cfg_options.add( UndocOptsDescription()     );
 
     return cfg_options;
@@ -39,6 +39,7 @@ namespace asp {
     // Settings
     std::string stereo_session_string, stereo_default_filename;
     boost::shared_ptr<asp::StereoSession> session; // Used to extract cameras
+    std::string tile_queue;                        // Tiles to process in turn, see run_tile_queue()
     // Note: Below we use BBox2 rather than BBox2i to not choke on float inputs.
     vw::BBox2 left_image_crop_win;                 // For stereo in a region
     // Output
@@ -52,6 +53,7 @@ namespace asp {
   struct FilteringDescription     : public boost::program_options::options_description { FilteringDescription    (); };
   struct TriangulationDescription : public boost::program_options::options_description { TriangulationDescription(); };
   struct DGDescription            : public boost::program_options::options_description { DGDescription           (); };
+  struct IsisDescription          : public boost::program_options::options_description { IsisDescription         (); };
   struct UndocOptsDescription     : public boost::program_options::options_description { UndocOptsDescription    (); };
 
   boost::program_options::options_description
@@ -83,6 +85,7 @@ namespace asp {
     double nodata_optimal_threshold_factor; // Pixels with values less than this factor times the optimal Otsu threshold
                                             // are treated as no-data
     bool   skip_image_normalization;        // Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.
+    bool   binary_ip_descriptors;           // Use binary descriptors and Hamming matching for alignment interest points
     
     // Correlation Options
     float slogW;                      // Preprocessing filter width
@@ -111,6 +114,10 @@ namespace asp {
     double disparity_estimation_dem_error; // Error (in meters) of the disparity estimation DEM
     bool   use_local_homography;      // Apply a local homography in each tile
     int    corr_timeout;              // Correlation timeout for a tile, in seconds
+    bool   adaptive_corr_timeout;     // Scale the timeout of each tile by its predicted cost
+    bool   disable_tile_scheduler;    // Write corr, rfne and tri output with the VW thread pool
+    bool   log_tile_timings;          // Write the tile scheduler timings of each stage
+    bool   compact_disparity;         // Write D, RD and F in the compact .dsp format
 
     // Subpixel Options
     vw::uint16 subpixel_mode;         // 0 = none
@@ -158,6 +165,10 @@ namespace asp {
     // DG Options
     bool disable_correct_velocity_aberration;
 
+    // ISIS Options
+    bool   isis_tabulated_camera;     // Use a thread-safe tabulated snapshot of ISIS line scan cameras
+    double isis_tabulated_tolerance;  // Max reprojection error (pixels) of the snapshot versus ISIS
+
     // Undocumented options
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
 
@@ -0,0 +1,185 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileMesher.h
+///
+/// Triangulation of one tile of a grid of points, as used by
+/// point2mesh. Points equal to (0,0,0) are missing. A cell is drawn
+/// only if at least three of its corners are valid, so holes in the
+/// cloud stay holes in the mesh.
+
+#ifndef __ASP_CORE_TILE_MESHER_H__
+#define __ASP_CORE_TILE_MESHER_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Image/ImageView.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace asp {
+
+  inline bool valid_point( vw::Vector3 const& p ) { return p != vw::Vector3(); }
+
+  /// Mean distance between the valid neighboring points of the cells
+  /// [c0, c0+cols) x [r0, r0+rows) of 'grid', or 0 if there are none.
+  inline double mean_point_spacing( vw::ImageView<vw::Vector3> const& grid,
+                                    int c0, int r0, int cols, int rows ) {
+    double sum = 0;
+    size_t count = 0;
+    for ( int r = r0; r <= r0 + rows; r++ )
+      for ( int c = c0; c <= c0 + cols; c++ ) {
+        if ( !valid_point( grid(c,r) ) ) continue;
+        if ( c < c0 + cols && valid_point( grid(c+1,r) ) ) {
+          sum += norm_2( grid(c+1,r) - grid(c,r) );
+          count++;
+        }
+        if ( r < r0 + rows && valid_point( grid(c,r+1) ) ) {
+          sum += norm_2( grid(c,r+1) - grid(c,r) );
+          count++;
+        }
+      }
+    return count ? sum / count : 0;
+  }
+
+  /// Quadtree simplification of one tile of the vertex grid. A block of
+  /// cells is kept whole if all its vertices are valid and none is
+  /// farther than max_error from the bilinear surface through its
+  /// corners. With a max_error of 0 every cell is kept. Every vertex
+  /// on the tile boundary is kept, so neighboring tiles meet without
+  /// cracks whatever their simplification.
+  class TileMesher {
+    vw::ImageView<vw::Vector3> const& m_grid;
+    int m_c0, m_r0, m_cols, m_rows; // Cells of the tile within m_grid
+    double m_max_error;
+    std::vector<vw::uint8> m_active;    // Vertices used by the leaves
+    std::vector<vw::Vector3i> m_leaves; // Column, row and size of each block
+
+    vw::Vector3 const& point( int c, int r ) const { return m_grid(m_c0 + c, m_r0 + r); }
+    vw::uint8& active( int c, int r ) { return m_active[r*(m_cols+1) + c]; }
+    bool active( int c, int r ) const { return m_active[r*(m_cols+1) + c]; }
+
+    bool is_flat( int c, int r, int size ) const {
+      using namespace vw;
+      Vector3 p00 = point(c,r),      p10 = point(c+size,r),
+              p01 = point(c,r+size), p11 = point(c+size,r+size);
+      for ( int j = 0; j <= size; j++ ) {
+        double v = double(j) / size;
+        for ( int i = 0; i <= size; i++ ) {
+          Vector3 const& p = point(c+i,r+j);
+          if ( !valid_point(p) )
+            return false;
+          double u = double(i) / size;
+          Vector3 surface = (1-v)*((1-u)*p00 + u*p10) + v*((1-u)*p01 + u*p11);
+          if ( norm_2(p - surface) > m_max_error )
+            return false;
+        }
+      }
+      return true;
+    }
+
+    void subdivide( int c, int r, int size ) {
+      if ( c >= m_cols || r >= m_rows )
+        return;
+      if ( size == 1 ||
+           ( m_max_error > 0 && c + size <= m_cols && r + size <= m_rows &&
+             is_flat(c, r, size) ) ) {
+        m_leaves.push_back( vw::Vector3i(c, r, size) );
+        active(c,r) = active(c+size,r) = active(c,r+size) = active(c+size,r+size) = 1;
+        return;
+      }
+      int half = size / 2;
+      subdivide( c,      r,      half );
+      subdivide( c+half, r,      half );
+      subdivide( c,      r+half, half );
+      subdivide( c+half, r+half, half );
+    }
+
+  public:
+    TileMesher( vw::ImageView<vw::Vector3> const& grid, int c0, int r0,
+                int cols, int rows, double max_error ) :
+      m_grid(grid), m_c0(c0), m_r0(r0), m_cols(cols), m_rows(rows),
+      m_max_error(max_error), m_active( (cols+1)*(rows+1), 0 ) {
+      for ( int c = 0; c <= cols; c++ )
+        active(c,0) = active(c,rows) = 1;
+      for ( int r = 0; r <= rows; r++ )
+        active(0,r) = active(cols,r) = 1;
+      int size = 1;
+      while ( size < std::max(cols, rows) )
+        size *= 2;
+      subdivide( 0, 0, size );
+    }
+
+    /// The blocks of cells, as their column, row and size in the tile
+    std::vector<vw::Vector3i> const& leaves() const { return m_leaves; }
+
+    /// Triangles as triplets of vertices, relative to the grid, wound as
+    /// upper left, lower left, lower right in a cell.
+    void triangles( std::vector<vw::Vector2i>& corners ) const {
+      using namespace vw;
+      Vector2i origin( m_c0, m_r0 );
+      for ( size_t l = 0; l < m_leaves.size(); l++ ) {
+        int c = m_leaves[l][0], r = m_leaves[l][1], size = m_leaves[l][2];
+
+        if ( size == 1 ) {
+          // A single cell. Use the valid corners.
+          Vector2i cell[4] = { Vector2i(c,r),   Vector2i(c,r+1),
+                               Vector2i(c+1,r+1), Vector2i(c+1,r) };
+          Vector2i valid[4];
+          int num_valid = 0;
+          for ( int k = 0; k < 4; k++ )
+            if ( valid_point( point(cell[k].x(), cell[k].y()) ) )
+              valid[num_valid++] = cell[k];
+          if ( num_valid == 4 ) {
+            corners.push_back( origin + cell[0] );
+            corners.push_back( origin + cell[1] );
+            corners.push_back( origin + cell[2] );
+            corners.push_back( origin + cell[2] );
+            corners.push_back( origin + cell[3] );
+            corners.push_back( origin + cell[0] );
+          } else if ( num_valid == 3 ) {
+            for ( int k = 0; k < 3; k++ )
+              corners.push_back( origin + valid[k] );
+          }
+          continue;
+        }
+
+        // A flat block. Fan from its center through the vertices on
+        // its sides used by it or its neighbors.
+        std::vector<Vector2i> ring;
+        for ( int j = 0; j < size; j++ )
+          if ( active(c, r+j) ) ring.push_back( Vector2i(c, r+j) );
+        for ( int i = 0; i < size; i++ )
+          if ( active(c+i, r+size) ) ring.push_back( Vector2i(c+i, r+size) );
+        for ( int j = size; j > 0; j-- )
+          if ( active(c+size, r+j) ) ring.push_back( Vector2i(c+size, r+j) );
+        for ( int i = size; i > 0; i-- )
+          if ( active(c+i, r) ) ring.push_back( Vector2i(c+i, r) );
+        Vector2i center( c + size/2, r + size/2 );
+        for ( size_t k = 0; k < ring.size(); k++ ) {
+          corners.push_back( origin + ring[k] );
+          corners.push_back( origin + ring[(k+1) % ring.size()] );
+          corners.push_back( origin + center );
+        }
+      }
+    }
+  };
+
+} // namespace asp
+
+#endif//__ASP_CORE_TILE_MESHER_H__
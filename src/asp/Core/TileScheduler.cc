@@ -0,0 +1,285 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Core/TileScheduler.h>
+#include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+    enum { PENDING = 0, STARTED, DONE, WRITTEN };
+  }
+
+  // Each worker runs the scheduling loop until all tiles are written
+  class TileScheduler::Worker : public Task {
+    TileScheduler& m_scheduler;
+  public:
+    Worker( TileScheduler& scheduler ) : m_scheduler(scheduler) {}
+    virtual void operator()() { m_scheduler.work(); }
+  };
+
+  std::vector<BBox2i> TileScheduler::tiles( Vector2i const& image_size,
+                                            Vector2i const& block_size ) {
+    VW_ASSERT( block_size[0] > 0 && block_size[1] > 0,
+               ArgumentErr() << "TileScheduler: Invalid block size " << block_size << ".\n" );
+    std::vector<BBox2i> result;
+    for ( int y = 0; y < image_size[1]; y += block_size[1] ) {
+      for ( int x = 0; x < image_size[0]; x += block_size[0] ) {
+        result.push_back( BBox2i( x, y,
+                                  std::min( block_size[0], image_size[0] - x ),
+                                  std::min( block_size[1], image_size[1] - y ) ) );
+      }
+    }
+    return result;
+  }
+
+  int TileScheduler::max_buffered_tiles( size_t tile_bytes, int num_threads, size_t max_bytes ) {
+    if ( tile_bytes == 0 )
+      return 4 * std::max( 1, num_threads );
+    size_t count = max_bytes / tile_bytes;
+    if ( count > size_t( std::numeric_limits<int>::max() ) )
+      count = std::numeric_limits<int>::max();
+    return std::max( 1, int( count ) );
+  }
+
+  TileScheduler::TileScheduler( std::vector<BBox2i> const& tiles,
+                                TileSchedulerOptions const& options, size_t tile_bytes ) :
+    m_tiles(tiles), m_options(options), m_next_write(0),
+    m_writing(false), m_failed(false), m_task(0), m_progress(0),
+    m_total_pixels(0), m_written_pixels(0) {
+    m_num_threads = options.num_threads > 0 ? options.num_threads :
+      vw_settings().default_num_threads();
+    m_max_buffered = options.max_buffered_tiles > 0 ? options.max_buffered_tiles :
+      max_buffered_tiles( tile_bytes, m_num_threads,
+                          options.max_buffered_bytes > 0 ? options.max_buffered_bytes :
+                          vw_settings().system_cache_size() );
+  }
+
+  double TileScheduler::now() const {
+    return ( boost::posix_time::microsec_clock::universal_time() -
+             m_start_time ).total_microseconds() / 1e6;
+  }
+
+  void TileScheduler::run( TileTask& task, ProgressCallback const& progress ) {
+    m_task = &task;
+    m_progress = &progress;
+    m_state.assign( m_tiles.size(), TileState() );
+    m_timings.assign( m_tiles.size(), TileTiming() );
+    m_next_write = 0;
+    m_writing = m_failed = false;
+    m_error.clear();
+    m_total_pixels = m_written_pixels = 0;
+    for ( size_t i = 0; i < m_tiles.size(); i++ ) {
+      m_timings[i].bbox = m_tiles[i];
+      if ( m_options.tile_cost )
+        m_timings[i].cost = (*m_options.tile_cost)( m_tiles[i] );
+      m_total_pixels += double( m_tiles[i].width() ) * m_tiles[i].height();
+    }
+    m_start_time = boost::posix_time::microsec_clock::universal_time();
+
+    progress.report_progress( 0 );
+    {
+      FifoWorkQueue queue( m_num_threads );
+      for ( int i = 0; i < m_num_threads; i++ )
+        queue.add_task( boost::shared_ptr<Task>( new Worker( *this ) ) );
+      queue.join_all();
+    }
+    m_task = 0;
+    if ( m_failed )
+      vw_throw( LogicErr() << m_error );
+    progress.report_finished();
+  }
+
+  void TileScheduler::work() {
+    size_t current = m_tiles.size(); // The tile this thread started last
+    try {
+      while ( true ) {
+        size_t tile;
+        BBox2i piece;
+        {
+          Mutex::Lock lock( m_mutex );
+          while ( !m_failed && m_next_write < m_tiles.size() &&
+                  !next_piece( current, tile, piece ) )
+            m_condition.wait( lock );
+          if ( m_failed || m_next_write >= m_tiles.size() )
+            return;
+        }
+
+        boost::posix_time::ptime piece_start =
+          boost::posix_time::microsec_clock::universal_time();
+        m_task->rasterize( tile, piece );
+        double busy = ( boost::posix_time::microsec_clock::universal_time() -
+                        piece_start ).total_microseconds() / 1e6;
+
+        bool write = false;
+        {
+          Mutex::Lock lock( m_mutex );
+          TileState& state = m_state[tile];
+          m_timings[tile].busy += busy;
+          state.outstanding--;
+          if ( state.pieces.empty() && state.outstanding == 0 ) {
+            state.status = DONE;
+            m_timings[tile].finish  = now();
+            m_timings[tile].threads = state.threads.size();
+            if ( !m_writing && m_state[m_next_write].status == DONE ) {
+              m_writing = true;
+              write = true;
+            }
+          }
+        }
+        if ( write )
+          write_tiles();
+      }
+    } catch ( std::exception const& e ) {
+      Mutex::Lock lock( m_mutex );
+      if ( !m_failed )
+        m_error = e.what();
+      m_failed = true;
+      m_condition.notify_all();
+    } catch ( ... ) {
+      Mutex::Lock lock( m_mutex );
+      if ( !m_failed )
+        m_error = "TileScheduler: Unknown error.";
+      m_failed = true;
+      m_condition.notify_all();
+    }
+  }
+
+  // In order of preference: the next piece of the tile this thread
+  // started, a piece of a new tile, or a piece taken from the end of
+  // the earliest tile in progress, which is the next to block the
+  // writes. Called with the lock held.
+  bool TileScheduler::next_piece( size_t& current, size_t& tile, BBox2i& piece ) {
+    if ( current < m_tiles.size() && !m_state[current].pieces.empty() ) {
+      tile  = current;
+      piece = m_state[tile].pieces.front();
+      m_state[tile].pieces.pop_front();
+    } else if ( start_tile( tile ) ) {
+      current = tile;
+      piece = m_state[tile].pieces.front();
+      m_state[tile].pieces.pop_front();
+      if ( !m_state[tile].pieces.empty() )
+        m_condition.notify_all();
+    } else {
+      size_t i = m_next_write;
+      while ( i < m_tiles.size() &&
+              !( m_state[i].status == STARTED && !m_state[i].pieces.empty() ) )
+        i++;
+      if ( i == m_tiles.size() )
+        return false;
+      tile  = i;
+      piece = m_state[tile].pieces.back();
+      m_state[tile].pieces.pop_back();
+    }
+
+    TileState& state = m_state[tile];
+    state.outstanding++;
+    m_timings[tile].pieces++;
+    uint64 id = Thread::id();
+    if ( std::find( state.threads.begin(), state.threads.end(), id ) == state.threads.end() )
+      state.threads.push_back( id );
+    return true;
+  }
+
+  // Start the costliest tile not yet started among the next
+  // m_max_buffered ones to write, or the first of them without cost
+  // estimates. The tile to write next is always among these, so the
+  // writes cannot stall. Called with the lock held.
+  bool TileScheduler::start_tile( size_t& tile ) {
+    size_t end = std::min( m_tiles.size(), m_next_write + m_max_buffered );
+    bool found = false;
+    for ( size_t i = m_next_write; i < end; i++ ) {
+      if ( m_state[i].status != PENDING )
+        continue;
+      if ( !found || m_timings[i].cost > m_timings[tile].cost ) {
+        tile  = i;
+        found = true;
+      }
+      if ( !m_options.tile_cost )
+        break;
+    }
+    if ( !found )
+      return false;
+
+    BBox2i const& bbox = m_tiles[tile];
+    int rows = m_options.split_rows > 0 ? m_options.split_rows : bbox.height();
+    for ( int y = bbox.min().y(); y < bbox.max().y(); y += rows )
+      m_state[tile].pieces.push_back( BBox2i( bbox.min().x(), y, bbox.width(),
+                                              std::min( rows, bbox.max().y() - y ) ) );
+    m_state[tile].status = STARTED;
+    m_timings[tile].start = now();
+    m_task->start( tile );
+    return true;
+  }
+
+  // Write the finished tiles at the head of the buffer. Only one
+  // thread at a time is in here, tracked by m_writing.
+  void TileScheduler::write_tiles() {
+    while ( true ) {
+      size_t tile;
+      {
+        Mutex::Lock lock( m_mutex );
+        if ( m_failed || m_next_write >= m_tiles.size() ||
+             m_state[m_next_write].status != DONE ) {
+          m_writing = false;
+          m_condition.notify_all();
+          return;
+        }
+        tile = m_next_write;
+      }
+
+      m_task->write( tile );
+
+      double fraction;
+      {
+        Mutex::Lock lock( m_mutex );
+        m_state[tile].status = WRITTEN;
+        m_timings[tile].written = now();
+        m_written_pixels += double( m_tiles[tile].width() ) * m_tiles[tile].height();
+        m_next_write++;
+        fraction = m_written_pixels / m_total_pixels;
+        m_condition.notify_all();
+      }
+      m_progress->report_progress( fraction );
+    }
+  }
+
+  void TileScheduler::write_timings( std::string const& filename ) const {
+    std::ofstream os( filename.c_str() );
+    if ( !os )
+      vw_throw( IOErr() << "Could not write: " << filename << "\n" );
+    os << "# col row width height cost pieces threads busy start finish written\n";
+    os.precision( 10 );
+    for ( size_t i = 0; i < m_timings.size(); i++ ) {
+      TileTiming const& t = m_timings[i];
+      os << t.bbox.min().x() << " " << t.bbox.min().y() << " "
+         << t.bbox.width() << " " << t.bbox.height() << " " << t.cost << " "
+         << t.pieces << " " << t.threads << " " << t.busy << " "
+         << t.start << " " << t.finish << " " << t.written << "\n";
+    }
+  }
+
+} // end namespace asp
@@ -0,0 +1,219 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileScheduler.h
+///
+/// Writes an image tile by tile as vw::block_write_image does, but
+/// without the VW thread pool. The pool rasterizes tiles of one size in
+/// raster order, so a few slow tiles at the end of an image keep one
+/// thread busy while the others idle. Here a tile may be rasterized in
+/// pieces of a few rows, which idle threads take from the tiles in
+/// progress, costly tiles can be started first, and finished tiles wait
+/// in a bounded buffer to be written in raster order.
+///
+
+#ifndef __ASP_CORE_TILE_SCHEDULER_H__
+#define __ASP_CORE_TILE_SCHEDULER_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Core/Condition.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageResource.h>
+#include <vw/Image/Manipulation.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  // Estimated cost of a tile, in any unit. Called once per tile
+  // before any tile is started.
+  class TileCostEstimator {
+  public:
+    virtual ~TileCostEstimator() {}
+    virtual double operator()( vw::BBox2i const& tile ) const = 0;
+  };
+
+  struct TileSchedulerOptions {
+    bool enabled;            // Otherwise the writers use vw::block_write_image
+    int  num_threads;        // Zero for the VW default
+    int  split_rows;         // Height of the pieces a tile is rasterized in. Zero
+                             // to never split, as needed when the pixels of a
+                             // tile depend on the extent of the tile.
+    int  max_buffered_tiles; // Tiles started but not yet written. Zero to fit
+                             // them in max_buffered_bytes.
+    size_t max_buffered_bytes; // Zero for the VW system cache size
+    std::string timing_log;  // Where to write the tile timings, if not empty
+    boost::shared_ptr<TileCostEstimator> tile_cost; // If set, costly tiles start first
+
+    TileSchedulerOptions() : enabled(false), num_threads(0), split_rows(0),
+                             max_buffered_tiles(0), max_buffered_bytes(0) {}
+  };
+
+  // How a tile went. Times are seconds since the start of the write.
+  struct TileTiming {
+    vw::BBox2i bbox;
+    double cost;     // Zero without an estimator
+    int    pieces;
+    int    threads;  // Number of threads that rasterized pieces of it
+    double busy;     // Rasterization time, summed over the pieces
+    double start, finish, written;
+
+    TileTiming() : cost(0), pieces(0), threads(0), busy(0),
+                   start(0), finish(0), written(0) {}
+  };
+
+  // What the scheduler does with each tile
+  class TileTask {
+  public:
+    virtual ~TileTask() {}
+    // Called with the scheduler locked when the tile is started, before
+    // any of its pieces are rasterized. Keep it short.
+    virtual void start( size_t tile ) = 0;
+    // Called concurrently, for disjoint pieces.
+    virtual void rasterize( size_t tile, vw::BBox2i const& piece ) = 0;
+    // Called once all pieces of the tile are done, one tile at a time
+    // and in tile order.
+    virtual void write( size_t tile ) = 0;
+  };
+
+  class TileScheduler {
+  public:
+    // 'tile_bytes' is the memory taken by the buffer of a tile, or zero
+    // if not known.
+    TileScheduler( std::vector<vw::BBox2i> const& tiles,
+                   TileSchedulerOptions const& options, size_t tile_bytes = 0 );
+
+    // Process all tiles. Rethrows, as a vw::Exception, the first error
+    // of any thread.
+    void run( TileTask& task,
+              vw::ProgressCallback const& progress = vw::ProgressCallback::dummy_instance() );
+
+    std::vector<TileTiming> const& timings() const { return m_timings; }
+
+    // One line per tile, in tile order
+    void write_timings( std::string const& filename ) const;
+
+    // How many tiles may be started but not yet written: as many as fit
+    // in max_bytes, but at least one, or four per thread if the size of
+    // a tile is not known.
+    static int max_buffered_tiles( size_t tile_bytes, int num_threads, size_t max_bytes );
+
+    // Tiles of 'block_size' covering an image, in raster order
+    static std::vector<vw::BBox2i> tiles( vw::Vector2i const& image_size,
+                                          vw::Vector2i const& block_size );
+
+  private:
+    class Worker;
+
+    struct TileState {
+      int status;
+      std::deque<vw::BBox2i> pieces; // Not taken by any thread yet
+      int outstanding;               // Taken and not finished
+      std::vector<vw::uint64> threads;
+      TileState() : status(0), outstanding(0) {}
+    };
+
+    void work();
+    bool next_piece( size_t& current, size_t& tile, vw::BBox2i& piece );
+    bool start_tile( size_t& tile );
+    void write_tiles();
+    double now() const;
+
+    std::vector<vw::BBox2i> m_tiles;
+    TileSchedulerOptions m_options;
+    int m_num_threads, m_max_buffered;
+
+    // Guarded by m_mutex while running
+    vw::Mutex m_mutex;
+    vw::Condition m_condition;
+    std::vector<TileState> m_state;
+    std::vector<TileTiming> m_timings;
+    size_t m_next_write;
+    bool m_writing, m_failed;
+    std::string m_error;
+
+    TileTask* m_task;
+    vw::ProgressCallback const* m_progress;
+    boost::posix_time::ptime m_start_time;
+    double m_total_pixels, m_written_pixels;
+  };
+
+  // Rasterizes an image into one buffer per tile, written whole to a
+  // resource.
+  template <class ImageT>
+  class BufferedTileTask : public TileTask {
+    typedef typename ImageT::pixel_type pixel_type;
+    vw::ImageResource& m_resource;
+    ImageT const& m_image;
+    std::vector<vw::BBox2i> const& m_tiles;
+    std::vector<vw::ImageView<pixel_type> > m_buffers;
+  public:
+    BufferedTileTask( vw::ImageResource& resource, ImageT const& image,
+                      std::vector<vw::BBox2i> const& tiles ) :
+      m_resource(resource), m_image(image), m_tiles(tiles), m_buffers(tiles.size()) {}
+
+    virtual void start( size_t tile ) {
+      m_buffers[tile].set_size( m_tiles[tile].width(), m_tiles[tile].height(),
+                                m_image.planes() );
+    }
+    virtual void rasterize( size_t tile, vw::BBox2i const& piece ) {
+      m_image.rasterize( vw::crop( m_buffers[tile], piece - m_tiles[tile].min() ), piece );
+    }
+    virtual void write( size_t tile ) {
+      m_resource.write( m_buffers[tile].buffer(), m_tiles[tile] );
+      m_buffers[tile] = vw::ImageView<pixel_type>();
+    }
+  };
+
+  // Write an image to a resource in blocks of the resource's block
+  // write size, with a TileScheduler.
+  template <class ImageT>
+  void scheduled_block_write_image( vw::ImageResource& resource,
+                                    vw::ImageViewBase<ImageT> const& image,
+                                    TileSchedulerOptions const& options,
+                                    vw::ProgressCallback const& progress_callback
+                                    = vw::ProgressCallback::dummy_instance() ) {
+    VW_ASSERT( image.impl().cols() == resource.cols() &&
+               image.impl().rows() == resource.rows(),
+               vw::ArgumentErr() << "scheduled_block_write_image: The image and the resource differ in size.\n" );
+
+    std::vector<vw::BBox2i> tiles =
+      TileScheduler::tiles( vw::Vector2i( image.impl().cols(), image.impl().rows() ),
+                            resource.block_write_size() );
+    vw::Vector2i block_size = resource.block_write_size();
+    size_t tile_bytes = size_t( block_size[0] ) * block_size[1] * image.impl().planes() *
+      sizeof(typename ImageT::pixel_type);
+    BufferedTileTask<ImageT> task( resource, image.impl(), tiles );
+    TileScheduler scheduler( tiles, options, tile_bytes );
+    scheduler.run( task, progress_callback );
+    resource.flush();
+
+    if ( !options.timing_log.empty() )
+      scheduler.write_timings( options.timing_log );
+  }
+
+} // end namespace asp
+
+#endif//__ASP_CORE_TILE_SCHEDULER_H__
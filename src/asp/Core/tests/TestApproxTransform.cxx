@@ -0,0 +1,221 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ApproxTransform.h>
+#include <asp/Core/ApproxGeoTransform.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Cartography/PointImageManipulation.h>
+
+#include <limits>
+
+using namespace vw;
+using namespace asp;
+
+// A smooth, mildly nonlinear mapping, like a camera over gentle terrain
+class SmoothTrans : public TransformBase<SmoothTrans> {
+public:
+  Vector2 forward( Vector2 const& p ) const { return p; }
+  Vector2 reverse( Vector2 const& p ) const {
+    return Vector2( 3 + 1.1*p.x() + 20*sin(p.y()/150.0),
+                    -7 + 0.9*p.y() + 1e-4*p.x()*p.x() );
+  }
+  BBox2i reverse_bbox( BBox2i const& bbox ) const { return bbox; }
+};
+
+// A mapping with a jump, like an occlusion edge in the DEM
+class StepTrans : public TransformBase<StepTrans> {
+public:
+  Vector2 forward( Vector2 const& p ) const { return p; }
+  Vector2 reverse( Vector2 const& p ) const {
+    return Vector2( p.x() + (p.x() > 45.5 ? 10.0 : 0.0), p.y() );
+  }
+  BBox2i reverse_bbox( BBox2i const& bbox ) const { return bbox; }
+};
+
+// Curved enough that even cells of one pixel miss between their corners
+class SquareTrans : public TransformBase<SquareTrans> {
+public:
+  Vector2 forward( Vector2 const& p ) const { return p; }
+  Vector2 reverse( Vector2 const& p ) const { return Vector2( p.x()*p.x(), p.y() ); }
+  BBox2i reverse_bbox( BBox2i const& bbox ) const { return bbox; }
+};
+
+// Like Map2CamTrans, reverse_bbox() projects every pixel of the
+// tile. Calls to reverse() are counted in a shared counter, as copies
+// are made.
+class CountingTrans : public TransformBase<CountingTrans> {
+  SmoothTrans m_tx;
+  size_t* m_count;
+public:
+  CountingTrans( size_t* count ) : m_count(count) {}
+  Vector2 forward( Vector2 const& p ) const { return p; }
+  Vector2 reverse( Vector2 const& p ) const {
+    (*m_count)++;
+    return m_tx.reverse( p );
+  }
+  BBox2i reverse_bbox( BBox2i const& bbox ) const {
+    BBox2 box;
+    for ( int y = bbox.min().y(); y < bbox.max().y(); y++ )
+      for ( int x = bbox.min().x(); x < bbox.max().x(); x++ )
+        box.grow( reverse( Vector2(x,y) ) );
+    return BBox2i( Vector2i( floor( box.min().x() ), floor( box.min().y() ) ),
+                   Vector2i( floor( box.max().x() ) + 1, floor( box.max().y() ) + 1 ) );
+  }
+};
+
+template <class TransformT>
+double max_error( ApproxTransform<TransformT> const& approx, TransformT const& exact,
+                  BBox2i const& bbox ) {
+  double err = 0;
+  for ( int y = bbox.min().y(); y < bbox.max().y(); y++ )
+    for ( int x = bbox.min().x(); x < bbox.max().x(); x++ )
+      err = std::max( err, norm_2( approx.reverse(Vector2(x,y)) -
+                                   exact.reverse(Vector2(x,y)) ) );
+  return err;
+}
+
+TEST(ApproxTransform, smooth) {
+  SmoothTrans exact;
+  ApproxTransform<SmoothTrans> approx( exact, 0.05 );
+  BBox2i tile( 100, 200, 256, 256 );
+  approx.reverse_bbox( tile );
+
+  EXPECT_LT( max_error( approx, exact, tile ), 0.05 );
+  EXPECT_LT( approx.num_evaluations(), size_t(tile.width()*tile.height()/10) );
+
+  // Away from the tile the exact transform is used
+  EXPECT_VECTOR_NEAR( exact.reverse(Vector2(10,10)),
+                      approx.reverse(Vector2(10,10)), 1e-12 );
+}
+
+TEST(ApproxTransform, discontinuity) {
+  StepTrans exact;
+  ApproxTransform<StepTrans> approx( exact, 0.05, 32, 2 );
+  BBox2i tile( 0, 0, 100, 60 );
+  approx.reverse_bbox( tile );
+
+  // The cells straddling the jump fall back to exact evaluation
+  EXPECT_LT( max_error( approx, exact, tile ), 1e-12 );
+  EXPECT_LT( approx.num_evaluations(), size_t(tile.width()*tile.height()/4) );
+}
+
+TEST(ApproxTransform, zero_tolerance) {
+  SmoothTrans exact;
+  ApproxTransform<SmoothTrans> approx( exact, 0 );
+  BBox2i tile( 0, 0, 64, 64 );
+  approx.reverse_bbox( tile );
+  EXPECT_EQ( 0u, approx.num_evaluations() );
+  EXPECT_LT( max_error( approx, exact, tile ), 1e-12 );
+}
+
+TEST(ApproxTransform, reverse_bbox_from_grid) {
+  size_t count = 0;
+  CountingTrans exact( &count );
+  ApproxTransform<CountingTrans> approx( exact, 0.05 );
+  BBox2i tile( 100, 200, 256, 256 );
+
+  // Building the grid and transforming the whole tile
+  BBox2i region = approx.reverse_bbox( tile );
+  for ( int y = tile.min().y(); y < tile.max().y(); y++ )
+    for ( int x = tile.min().x(); x < tile.max().x(); x++ )
+      approx.reverse( Vector2(x,y) );
+  EXPECT_EQ( approx.num_evaluations(), count );
+  EXPECT_LT( count, size_t(tile.width()*tile.height()/10) );
+
+  // The region holds every value, and is about the exact one
+  BBox2i exact_region = exact.reverse_bbox( tile );
+  BBox2 values;
+  for ( int y = tile.min().y(); y < tile.max().y(); y++ )
+    for ( int x = tile.min().x(); x < tile.max().x(); x++ )
+      values.grow( approx.reverse( Vector2(x,y) ) );
+  EXPECT_TRUE( BBox2(region).contains( values ) );
+  EXPECT_VECTOR_NEAR( exact_region.min(), region.min(), 1 );
+  EXPECT_VECTOR_NEAR( exact_region.max(), region.max(), 1 );
+}
+
+TEST(ApproxTransform, fractional_positions) {
+  // As ApproxGeoTransform uses it, with cells down to one pixel and
+  // lookups between pixels.
+  SquareTrans exact;
+  ApproxTransform<SquareTrans> approx( exact, 0.05, 8, 1 );
+  BBox2i tile( 0, 0, 17, 17 );
+  approx.reverse_bbox( tile );
+
+  double err = 0;
+  for ( double y = 0; y <= 16; y += 0.5 )
+    for ( double x = 0; x <= 16; x += 0.5 )
+      err = std::max( err, norm_2( approx.reverse(Vector2(x,y)) -
+                                   exact.reverse(Vector2(x,y)) ) );
+  EXPECT_LE( err, 0.05 );
+}
+
+// Points over a few kilometers in UTM zone 10, some without height
+ImageView<Vector3> lonlat_points() {
+  ImageView<Vector3> points( 150, 100 );
+  for ( int j = 0; j < points.rows(); j++ )
+    for ( int i = 0; i < points.cols(); i++ )
+      points(i,j) = Vector3( -122.5 + 3e-4*i + 1e-5*j, 37.2 + 2e-4*j,
+                             (i + j) % 11 == 0 ? std::numeric_limits<double>::quiet_NaN()
+                                               : 100.0 + i );
+  return points;
+}
+
+cartography::GeoReference utm_georef() {
+  cartography::GeoReference georef;
+  georef.set_well_known_geogcs( "WGS84" );
+  georef.set_UTM( 10 );
+  return georef;
+}
+
+TEST(ApproxGeodeticToPointView, within_tolerance) {
+  ImageView<Vector3> points = lonlat_points();
+  cartography::GeoReference georef = utm_georef();
+  ImageView<Vector3> exact = cartography::geodetic_to_point( points, georef );
+  ImageViewRef<Vector3> ref = approx_geodetic_to_point( points, georef, 0.01 );
+  ImageView<Vector3> approx = block_rasterize( ref, Vector2i(64,64), 1 );
+
+  for ( int j = 0; j < points.rows(); j++ )
+    for ( int i = 0; i < points.cols(); i++ ) {
+      if ( boost::math::isnan( points(i,j)[2] ) ) {
+        EXPECT_TRUE( boost::math::isnan( approx(i,j)[2] ) );
+        continue;
+      }
+      EXPECT_LT( norm_2( subvector( approx(i,j), 0, 2 ) - subvector( exact(i,j), 0, 2 ) ),
+                 0.01 );
+      EXPECT_EQ( exact(i,j)[2], approx(i,j)[2] );
+    }
+}
+
+TEST(ApproxGeodeticToPointView, zero_tolerance_is_exact) {
+  ImageView<Vector3> points = lonlat_points();
+  cartography::GeoReference georef = utm_georef();
+  ImageView<Vector3> exact = cartography::geodetic_to_point( points, georef );
+  ImageViewRef<Vector3> ref = approx_geodetic_to_point( points, georef, 0 );
+  ImageView<Vector3> approx = block_rasterize( ref, Vector2i(64,64), 1 );
+
+  for ( int j = 0; j < points.rows(); j++ )
+    for ( int i = 0; i < points.cols(); i++ )
+      for ( int k = 0; k < 3; k++ ) {
+        if ( boost::math::isnan( points(i,j)[2] ) ) {
+          EXPECT_EQ( boost::math::isnan( exact(i,j)[k] ), boost::math::isnan( approx(i,j)[k] ) );
+          continue;
+        }
+        EXPECT_EQ( exact(i,j)[k], approx(i,j)[k] );
+      }
+}
@@ -0,0 +1,156 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/InterestPoint/InterestData.h>
+#include <asp/Core/BinaryDescriptor.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  // Smoothed noise, so that the box averages of the descriptor differ
+  ImageView<float> textured_image( int cols, int rows ) {
+    ImageView<float> noise( cols + 2, rows + 2 ), image( cols, rows );
+    uint64 state = 42;
+    for ( int row = 0; row < noise.rows(); row++ )
+      for ( int col = 0; col < noise.cols(); col++ ) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        noise(col,row) = float(state >> 40) / float(1 << 24);
+      }
+    for ( int row = 0; row < rows; row++ )
+      for ( int col = 0; col < cols; col++ ) {
+        float sum = 0;
+        for ( int dy = 0; dy < 3; dy++ )
+          for ( int dx = 0; dx < 3; dx++ )
+            sum += noise(col+dx,row+dy);
+        image(col,row) = sum / 9;
+      }
+    return image;
+  }
+
+  // Points on a regular grid, away from the image edges
+  ip::InterestPointList grid_points( int cols, int rows, int step, Vector2i const& offset ) {
+    ip::InterestPointList points;
+    for ( int y = step; y < rows - step; y += step )
+      for ( int x = step; x < cols - step; x += step )
+        points.push_back( ip::InterestPoint( x + offset.x(), y + offset.y() ) );
+    return points;
+  }
+
+  std::vector<ip::InterestPoint> to_vector( ip::InterestPointList const& list ) {
+    return std::vector<ip::InterestPoint>( list.begin(), list.end() );
+  }
+}
+
+TEST( BinaryDescriptor, PackAndHamming ) {
+  Vector<float> a( BinaryDescriptorGenerator::NUM_BYTES ), b( BinaryDescriptorGenerator::NUM_BYTES );
+  for ( int i = 0; i < BinaryDescriptorGenerator::NUM_BYTES; i++ ) {
+    a[i] = 0;
+    b[i] = 255;
+  }
+  a[0] = 1;
+  a[9] = 128;
+
+  uint64 pa[HammingIndex::NUM_WORDS], pb[HammingIndex::NUM_WORDS];
+  HammingIndex::pack( a, pa );
+  HammingIndex::pack( b, pb );
+  EXPECT_EQ( 1u, pa[0] );
+  EXPECT_EQ( uint64(128) << 8, pa[1] );
+  EXPECT_EQ( 0u, pa[2] );
+  EXPECT_EQ( 0, hamming_distance( pa, pa ) );
+  EXPECT_EQ( 254, hamming_distance( pa, pb ) );
+
+  std::vector<ip::InterestPoint> points( 3 );
+  points[0].descriptor = b;
+  points[1].descriptor = a;
+  points[2].descriptor = b;
+  HammingIndex index( points.begin(), points.end() );
+  ASSERT_EQ( 3u, index.size() );
+
+  Vector<int> indices;
+  Vector<float> distances;
+  index.knn_search( a, indices, distances, 4 );
+  EXPECT_EQ( 1, indices[0] );
+  EXPECT_EQ( 0, indices[1] ); // Ties go to the lower index
+  EXPECT_EQ( 2, indices[2] );
+  EXPECT_EQ( -1, indices[3] );
+  EXPECT_EQ( 0, distances[0] );
+  EXPECT_EQ( 254, distances[1] );
+}
+
+TEST( BinaryDescriptor, TranslationInvariant ) {
+  ImageView<float> image = textured_image( 200, 150 );
+  ImageView<float> shifted = crop( image, 7, 3, 190, 140 );
+
+  ip::InterestPointList ip1 = grid_points( 190, 140, 20, Vector2i(7,3) );
+  ip::InterestPointList ip2 = grid_points( 190, 140, 20, Vector2i() );
+  BinaryDescriptorGenerator descriptor;
+  descriptor( image, ip1 );
+  descriptor( shifted, ip2 );
+
+  ip::InterestPointList::const_iterator it1 = ip1.begin(), it2 = ip2.begin();
+  for ( ; it1 != ip1.end(); ++it1, ++it2 ) {
+    ASSERT_EQ( BinaryDescriptorGenerator::NUM_BYTES, int(it1->descriptor.size()) );
+    EXPECT_VECTOR_NEAR( it1->descriptor, it2->descriptor, 1e-6 );
+  }
+
+  // Different places should have very different descriptors
+  uint64 p1[HammingIndex::NUM_WORDS], p2[HammingIndex::NUM_WORDS];
+  HammingIndex::pack( ip1.front().descriptor, p1 );
+  HammingIndex::pack( ip1.back().descriptor, p2 );
+  EXPECT_GT( hamming_distance( p1, p2 ), 64 );
+}
+
+TEST( BinaryDescriptor, MatchShiftedImage ) {
+  ImageView<float> image = textured_image( 300, 300 );
+  ImageView<float> shifted = crop( image, 5, 11, 280, 280 );
+
+  ip::InterestPointList ip1 = grid_points( 280, 280, 10, Vector2i(5,11) );
+  ip::InterestPointList ip2 = grid_points( 280, 280, 10, Vector2i() );
+  BinaryDescriptorGenerator descriptor;
+  descriptor( image, ip1 );
+  descriptor( shifted, ip2 );
+
+  std::vector<ip::InterestPoint> matched1, matched2;
+  match_binary_descriptors( to_vector(ip1), to_vector(ip2), matched1, matched2, 0.5 );
+  ASSERT_EQ( matched1.size(), matched2.size() );
+  EXPECT_EQ( ip1.size(), matched1.size() );
+  for ( size_t i = 0; i < matched1.size(); i++ ) {
+    EXPECT_EQ( matched1[i].x - 5,  matched2[i].x );
+    EXPECT_EQ( matched1[i].y - 11, matched2[i].y );
+  }
+}
+
+// Most points of a textured image are matched to their shifted
+// copies at the ratio used by the stereo tools.
+TEST( BinaryDescriptor, MatchRate ) {
+  ImageView<float> image = textured_image( 1000, 1000 );
+  ImageView<float> shifted = crop( image, 9, 4, 980, 980 );
+  ip::InterestPointList ip1 = grid_points( 980, 980, 12, Vector2i(9,4) );
+  ip::InterestPointList ip2 = grid_points( 980, 980, 12, Vector2i() );
+
+  BinaryDescriptorGenerator descriptor;
+  descriptor( image, ip1 );
+  descriptor( shifted, ip2 );
+  std::vector<ip::InterestPoint> matched1, matched2;
+  match_binary_descriptors( to_vector(ip1), to_vector(ip2), matched1, matched2, 0.5 );
+  EXPECT_GT( matched1.size(), ip1.size() * 9 / 10 );
+}
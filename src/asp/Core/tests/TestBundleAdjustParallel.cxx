@@ -0,0 +1,62 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <test/Helpers.h>
+#include <test/BundleAdjustTestModel.h>
+#include <vw/Core/Settings.h>
+#include <asp/Core/BundleAdjustParallel.h>
+
+using namespace vw;
+using namespace vw::ba;
+using namespace asp;
+using namespace asp::test;
+
+TEST( AdjustSparseParallel, converges ) {
+  std::vector<Vector3> centers;
+  boost::shared_ptr<ControlNetwork> cnet = make_network( centers, 4, 8, 8 );
+  TestModel model( centers, cnet );
+  double start_error = image_error( model );
+  EXPECT_GT( start_error, 0.5 );
+
+  AdjustSparseParallel<TestModel, L2Error> adjuster( model, L2Error(), true, false, 4 );
+  EXPECT_EQ( 4, adjuster.num_threads() );
+  double abs_tol = 1e10, rel_tol = 1e10;
+  for ( int k = 0; k < 20 && abs_tol > 1e-8; k++ )
+    adjuster.update( abs_tol, rel_tol );
+  EXPECT_LT( image_error( model ), 1e-3 );
+  EXPECT_GE( adjuster.last_timing().assembly, 0 );
+}
+
+TEST( AdjustSparseParallel, thread_count_invariant ) {
+  std::vector<Vector3> centers;
+  boost::shared_ptr<ControlNetwork> cnet1 = make_network( centers, 4, 8, 8 );
+  boost::shared_ptr<ControlNetwork> cnet2 = make_network( centers, 4, 8, 8 );
+  TestModel model1( centers, cnet1 ), model2( centers, cnet2 );
+
+  AdjustSparseParallel<TestModel, L2Error> serial( model1, L2Error(), true, false, 1 );
+  AdjustSparseParallel<TestModel, L2Error> parallel( model2, L2Error(), true, false, 8 );
+  for ( int k = 0; k < 5; k++ ) {
+    double abs_tol1, rel_tol1, abs_tol2, rel_tol2;
+    serial.update( abs_tol1, rel_tol1 );
+    parallel.update( abs_tol2, rel_tol2 );
+    EXPECT_NEAR( rel_tol1, rel_tol2, 1e-8*(1+rel_tol1) );
+  }
+  for ( unsigned j = 0; j < model1.num_cameras(); j++ )
+    EXPECT_VECTOR_NEAR( model1.A_parameters(j), model2.A_parameters(j), 1e-8 );
+  for ( unsigned i = 0; i < model1.num_points(); i++ )
+    EXPECT_VECTOR_NEAR( model1.B_parameters(i), model2.B_parameters(i), 1e-6 );
+}
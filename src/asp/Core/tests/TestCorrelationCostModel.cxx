@@ -0,0 +1,113 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/CorrelationCostModel.h>
+
+#include <cstdio>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  CorrelationSample make_sample( double pixels, double search_area,
+                                 double kernel_area, double valid_fraction ) {
+    CorrelationSample s;
+    s.pixels = pixels;
+    s.search_area = search_area;
+    s.kernel_area = kernel_area;
+    s.valid_fraction = valid_fraction;
+    return s;
+  }
+
+  // Made up timings that the model can represent exactly
+  double true_time( CorrelationSample const& s ) {
+    double valid_ops = s.pixels * s.valid_fraction * s.search_area;
+    return 2e-7 * s.pixels + 3e-9 * valid_ops + 1e-12 * valid_ops * s.kernel_area;
+  }
+}
+
+TEST( CorrelationCostModel, FitsTimings ) {
+  CorrelationCostModel model;
+  CorrelationSample probe = make_sample( 1024*1024, 200*40, 25*25, 0.8 );
+  EXPECT_FALSE( model.is_ready() );
+  EXPECT_EQ( 0, model.predict( probe ) );
+  EXPECT_EQ( 30, model.timeout( probe, 30 ) );
+
+  for ( int i = 0; i < 40; i++ ) {
+    CorrelationSample s = make_sample( 1024*1024 - 1000*i, 100 + 300*(i%7),
+                                       (i%3) ? 21*21 : 11*11, 0.2 + 0.02*i );
+    s.elapsed = true_time( s );
+    model.add( s );
+  }
+  ASSERT_TRUE( model.is_ready() );
+  EXPECT_NEAR( true_time( probe ), model.predict( probe ), 1e-3 * true_time( probe ) );
+
+  // Bigger searches take longer
+  CorrelationSample small = make_sample( 1024*1024, 100, 21*21, 1 );
+  CorrelationSample large = make_sample( 1024*1024, 10000, 21*21, 1 );
+  EXPECT_LT( model.predict( small ), model.predict( large ) );
+
+  // Budgets are twice the prediction, within [timeout/4, 4*timeout]
+  double t = model.predict( large );
+  EXPECT_EQ( int(std::ceil(2*t)), model.timeout( large, int(t) ) );
+  EXPECT_EQ( 250, model.timeout( small, 1000 ) );
+  EXPECT_EQ( 4, model.timeout( large, 1 ) );
+  EXPECT_EQ( 0, model.timeout( large, 0 ) );
+}
+
+TEST( CorrelationCostModel, ReadWrite ) {
+  CorrelationCostModel model;
+  for ( int i = 0; i < 10; i++ ) {
+    CorrelationSample s = make_sample( 512*512, 50 + 20*i, 9, 0.5 + 0.05*i );
+    s.elapsed = true_time( s );
+    model.add( s );
+  }
+  std::string file = "TestCorrelationCostModel.txt";
+  model.write( file );
+
+  CorrelationCostModel copy;
+  copy.read( file );
+  EXPECT_EQ( model.size(), copy.size() );
+  CorrelationSample probe = make_sample( 512*512, 120, 9, 0.7 );
+  EXPECT_NEAR( model.predict( probe ), copy.predict( probe ), 1e-6 * model.predict( probe ) );
+  std::remove( file.c_str() );
+}
+
+TEST( CorrelationCostModel, SavedSamplesAreCapped ) {
+  CorrelationCostModel model;
+  size_t num_samples = CorrelationCostModel::MAX_SAVED_SAMPLES + 100;
+  for ( size_t i = 0; i < num_samples; i++ ) {
+    CorrelationSample s = make_sample( 512*512, 50 + i, 9, 0.5 );
+    s.elapsed = true_time( s );
+    model.add( s );
+  }
+  EXPECT_EQ( num_samples, model.size() ); // All samples are in the fit
+
+  UnlinkName file( "TestCorrelationCostModelCapped.txt" );
+  model.write( file );
+  CorrelationCostModel copy;
+  copy.read( file );
+  EXPECT_EQ( CorrelationCostModel::MAX_SAVED_SAMPLES, copy.size() );
+
+  // Writing what was read does not add to the file
+  copy.write( file );
+  CorrelationCostModel copy2;
+  copy2.read( file );
+  EXPECT_EQ( CorrelationCostModel::MAX_SAVED_SAMPLES, copy2.size() );
+}
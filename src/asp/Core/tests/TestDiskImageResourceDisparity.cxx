@@ -0,0 +1,140 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DiskImageResourceDisparity.h>
+#include <asp/Core/Common.h>
+#include <vw/Image/PixelMask.h>
+#include <boost/filesystem/operations.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A disparity whose first 32x32 tile is empty, whose second tile
+  // is all valid, and whose other tiles have holes.
+  template <class PixelT>
+  ImageView<PixelT> make_disparity( double step ) {
+    ImageView<PixelT> disp( 100, 70 );
+    for ( int row = 0; row < disp.rows(); row++ ) {
+      for ( int col = 0; col < disp.cols(); col++ ) {
+        PixelT pix;
+        pix[0] = -5000 + col * step;
+        pix[1] = 12.5  - row * step;
+        if ( (col >= 32 || row >= 32) &&
+             (col < 64 || (col + row) % 5 != 0) )
+          pix.validate();
+        disp( col, row ) = pix;
+      }
+    }
+    return disp;
+  }
+
+}
+
+TEST( DiskImageResourceDisparity, FloatRoundTrip ) {
+  ImageView<PixelMask<Vector2f> > disp = make_disparity<PixelMask<Vector2f> >( 0.37 );
+
+  UnlinkName file( "disparity.dsp" );
+  {
+    DiskImageResourceDisparity rsrc( file, disp.format(), Vector2i( 32, 32 ) );
+    EXPECT_EQ( 8, rsrc.fraction_bits() );
+    block_write_image( rsrc, disp );
+  }
+
+  DiskImageResourceDisparity rsrc( file );
+  ASSERT_EQ( disp.cols(), rsrc.cols() );
+  ASSERT_EQ( disp.rows(), rsrc.rows() );
+
+  // Read a region which does not start on a tile
+  BBox2i bbox( 7, 3, 80, 60 );
+  ImageView<PixelMask<Vector2f> > result( bbox.width(), bbox.height() );
+  rsrc.read( result.buffer(), bbox );
+  for ( int row = 0; row < result.rows(); row++ ) {
+    for ( int col = 0; col < result.cols(); col++ ) {
+      PixelMask<Vector2f> const& expected = disp( col + bbox.min().x(), row + bbox.min().y() );
+      ASSERT_EQ( is_valid( expected ), is_valid( result( col, row ) ) );
+      if ( !is_valid( expected ) )
+        continue;
+      // Rounded to 1/256 pixel
+      EXPECT_NEAR( expected[0], result( col, row )[0], 1.0/512 + 1e-5 );
+      EXPECT_NEAR( expected[1], result( col, row )[1], 1.0/512 + 1e-5 );
+    }
+  }
+}
+
+TEST( DiskImageResourceDisparity, IntegerRoundTrip ) {
+  ImageView<PixelMask<Vector2i> > disp = make_disparity<PixelMask<Vector2i> >( 3 );
+
+  BaseOptions opt;
+  opt.raster_tile_size = Vector2i( 32, 32 );
+  opt.tile_scheduler.enabled     = true;
+  opt.tile_scheduler.num_threads = 3;
+
+  UnlinkName file( "disparity_int.dsp" );
+  {
+    DiskImageResourceDisparity rsrc( file, disp.format(), opt.raster_tile_size );
+    EXPECT_EQ( 0, rsrc.fraction_bits() );
+    block_write_rsrc( rsrc, disp, opt, ProgressCallback::dummy_instance() );
+  }
+
+  DiskImageResourceDisparity rsrc( file );
+  ImageView<PixelMask<Vector2i> > result( disp.cols(), disp.rows() );
+  rsrc.read( result.buffer(), bounding_box( disp ) );
+  for ( int row = 0; row < result.rows(); row++ ) {
+    for ( int col = 0; col < result.cols(); col++ ) {
+      ASSERT_EQ( is_valid( disp( col, row ) ), is_valid( result( col, row ) ) );
+      if ( is_valid( disp( col, row ) ) )
+        EXPECT_VECTOR_NEAR( disp( col, row ).child(), result( col, row ).child(), 0 );
+    }
+  }
+
+  // Half the bytes of the three 32-bit channels of a GDAL disparity
+  EXPECT_LT( boost::filesystem::file_size( std::string( file ) ),
+             uintmax_t( disp.cols() * disp.rows() * 12 / 2 ) );
+}
+
+TEST( DiskImageResourceDisparity, TileIndex ) {
+  ImageView<PixelMask<Vector2f> > disp = make_disparity<PixelMask<Vector2f> >( 0.5 );
+
+  UnlinkName file( "disparity_index.dsp" );
+  {
+    DiskImageResourceDisparity rsrc( file, disp.format(), Vector2i( 32, 32 ) );
+    block_write_image( rsrc, disp );
+  }
+
+  DisparityTileIndex index( file );
+  EXPECT_TRUE ( index.empty( BBox2i( 0, 0, 32, 32 ) ) );
+  EXPECT_TRUE ( index.empty( BBox2i( 5, 5, 10, 10 ) ) );
+  EXPECT_FALSE( index.empty( BBox2i( 20, 20, 20, 10 ) ) );
+  EXPECT_FALSE( index.empty( BBox2i( 0, 32, 32, 32 ) ) );
+  EXPECT_TRUE ( index.empty( BBox2i( 200, 0, 10, 10 ) ) ); // Outside of the image
+
+  // Nothing is known about the tiles of other files
+  DisparityTileIndex tif_index( "disparity.tif" );
+  EXPECT_FALSE( tif_index.empty( BBox2i( 0, 0, 32, 32 ) ) );
+}
+
+TEST( DiskImageResourceDisparity, PartialTileWrite ) {
+  ImageView<PixelMask<Vector2f> > disp( 40, 40 ), part( 16, 16 ), edge( 8, 8 );
+  UnlinkName file( "disparity_partial.dsp" );
+  DiskImageResourceDisparity rsrc( file, disp.format(), Vector2i( 32, 32 ) );
+  EXPECT_THROW( rsrc.write( part.buffer(), BBox2i( 0, 0, 16, 16 ) ), ArgumentErr );
+  EXPECT_NO_THROW( rsrc.write( edge.buffer(), BBox2i( 32, 32, 8, 8 ) ) );
+}
@@ -0,0 +1,145 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+
+#include <vw/Image/ImageViewRef.h>
+#include <asp/Core/InpaintView.h>
+
+using namespace vw;
+using namespace asp;
+
+// A ramp with a 3x3 hole and a single pixel hole
+ImageView<PixelMask<float> > holey_ramp() {
+  ImageView<PixelMask<float> > image(20,20);
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ )
+      image(i,j) = PixelMask<float>( 2*i + j );
+  for ( int j = 5; j < 8; j++ )
+    for ( int i = 5; i < 8; i++ )
+      image(i,j) = PixelMask<float>();
+  image(14,14) = PixelMask<float>();
+  return image;
+}
+
+TEST(InpaintView, grassfire) {
+  ImageView<PixelMask<float> > image = holey_ramp();
+  BlobIndexThreaded bindex( invert_mask( image ), 100 );
+  ASSERT_EQ( 2u, bindex.num_blobs() );
+
+  ImageView<PixelMask<float> > filled =
+    inpaint( image, bindex, true, PixelMask<float>() );
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ ) {
+      ASSERT_TRUE( is_valid( filled(i,j) ) );
+      // The kernel is symmetric, so a ramp is filled with itself
+      EXPECT_NEAR( 2*i + j, filled(i,j).child(), 0.05 );
+    }
+}
+
+TEST(InpaintView, default_value) {
+  ImageView<PixelMask<float> > image = holey_ramp();
+  BlobIndexThreaded bindex( invert_mask( image ), 100 );
+
+  // Small tiles, so the blobs are filled from several of them
+  ImageViewRef<PixelMask<float> > ref =
+    inpaint( image, bindex, false, PixelMask<float>(-1) );
+  ImageView<PixelMask<float> > filled = block_rasterize( ref, Vector2i(4,4), 1 );
+  EXPECT_EQ( -1, filled(6,6).child() );
+  EXPECT_EQ( -1, filled(14,14).child() );
+  EXPECT_EQ( 2*4 + 6, filled(4,6).child() );
+  EXPECT_TRUE( is_valid( filled(5,7) ) );
+}
+
+// A ramp with a 4x3 hole, a 12x12 void, a 12 pixel long crack and a
+// hole on the border
+ImageView<PixelMask<float> > dem_with_voids() {
+  ImageView<PixelMask<float> > image(40,30);
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ )
+      image(i,j) = PixelMask<float>( 2*i + j );
+  for ( int j = 5; j < 8; j++ )
+    for ( int i = 5; i < 9; i++ )
+      image(i,j) = PixelMask<float>();
+  for ( int j = 10; j < 22; j++ )
+    for ( int i = 20; i < 32; i++ )
+      image(i,j) = PixelMask<float>();
+  for ( int i = 2; i < 14; i++ )
+    image(i,25) = PixelMask<float>();
+  for ( int j = 0; j < 2; j++ )
+    for ( int i = 12; i < 14; i++ )
+      image(i,j) = PixelMask<float>();
+  return image;
+}
+
+TEST(InpaintView, multiscale) {
+  ImageView<PixelMask<float> > image = dem_with_voids();
+  int max_hole_size = 8;
+  BlobIndexThreaded bindex( invert_mask( image ), max_hole_size*max_hole_size );
+
+  ImageViewRef<PixelMask<float> > ref = inpaint_multiscale( image, bindex, max_hole_size, 2 );
+  ImageView<PixelMask<float> > filled = block_rasterize( ref, Vector2i(8,8), 1 );
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ ) {
+      if ( is_valid( image(i,j) ) ) {
+        EXPECT_EQ( image(i,j).child(), filled(i,j).child() );
+        continue;
+      }
+      bool small_hole = i >= 5 && i < 9 && j >= 5 && j < 8;
+      EXPECT_EQ( small_hole, is_valid( filled(i,j) ) );
+      // Within the range of the ring around the hole
+      if ( small_hole ) {
+        EXPECT_GE( filled(i,j).child(), 2*4 + 4 );
+        EXPECT_LE( filled(i,j).child(), 2*9 + 8 );
+      }
+    }
+}
+
+TEST(InpaintView, multiscale_blob_order) {
+  // An L shaped hole around a square one, so the box of the first
+  // holds the second.
+  ImageView<PixelMask<float> > image(20,20);
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ )
+      image(i,j) = PixelMask<float>( 0.1*i*j + i );
+  for ( int k = 5; k < 10; k++ )
+    image(k,5) = image(5,k) = PixelMask<float>();
+  for ( int j = 7; j < 9; j++ )
+    for ( int i = 7; i < 9; i++ )
+      image(i,j) = PixelMask<float>();
+  BlobIndexThreaded bindex( invert_mask( image ), 100 );
+  ASSERT_EQ( 2u, bindex.num_blobs() );
+
+  ImageView<PixelMask<float> > work[2];
+  for ( int order = 0; order < 2; order++ ) {
+    work[order] = copy( image );
+    ImageView<uint8> filled( image.cols(), image.rows() );
+    fill( filled, 0 );
+    for ( size_t k = 0; k < 2; k++ )
+      inpaint_p::inpaint_blob_multiscale( work[order], Vector2i(0,0),
+                                          Vector2i(image.cols(), image.rows()),
+                                          bindex.compressed_blob( order ? 1-k : k ),
+                                          2, filled );
+  }
+  for ( int j = 0; j < image.rows(); j++ )
+    for ( int i = 0; i < image.cols(); i++ ) {
+      ASSERT_TRUE( is_valid( work[0](i,j) ) );
+      ASSERT_TRUE( is_valid( work[1](i,j) ) );
+      EXPECT_EQ( work[0](i,j).child(), work[1](i,j).child() );
+    }
+}
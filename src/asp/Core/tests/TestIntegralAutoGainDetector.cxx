@@ -76,3 +76,13 @@ TEST( IntegralAutoGainDetector, VerifyMaxima ) {
   ASSERT_EQ( typeid(detector),
              typeid(detector.impl()) );
 }
+
+TEST( IntegralAutoGainDetector, ScaleBatchSize ) {
+  // Limited by the threads when memory is plenty
+  EXPECT_EQ( 4, IntegralAutoGainDetector::scale_batch_size( 100, 4, 100000 ) );
+  // The batch and the two previous scales fit in memory
+  EXPECT_EQ( 3, IntegralAutoGainDetector::scale_batch_size( 100, 8, 500 ) );
+  // Always at least one scale
+  EXPECT_EQ( 1, IntegralAutoGainDetector::scale_batch_size( 100, 8, 150 ) );
+  EXPECT_EQ( 1, IntegralAutoGainDetector::scale_batch_size( 100, 0, 100000 ) );
+}
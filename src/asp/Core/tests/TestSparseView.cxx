@@ -0,0 +1,105 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+
+#include <asp/Core/SparseView.h>
+
+using namespace vw;
+using namespace asp;
+
+// A patch crossing tile boundaries, with gaps every 7 pixels
+ImageView<PixelMask<float> > gappy_patch( int cols, int rows ) {
+  ImageView<PixelMask<float> > patch( cols, rows );
+  for ( int j = 0; j < rows; j++ )
+    for ( int i = 0; i < cols; i++ )
+      if ( i % 7 != 3 )
+        patch(i,j) = PixelMask<float>( 1000*j + i + 1 );
+  return patch;
+}
+
+TEST(SparseView, tiled_overlay) {
+  ImageView<PixelMask<float> > under( 300, 100 );
+  fill( under, PixelMask<float>(0) );
+  SparseCompositeView<ImageView<PixelMask<float> > > view( under, false, 32 );
+  view.absorb( Vector2i(20,30), gappy_patch(200,3) );
+
+  ImageView<PixelMask<float> > full = view;
+  ImageView<PixelMask<float> > part = crop( view, BBox2i(45,28,100,7) );
+  for ( int j = 0; j < under.rows(); j++ )
+    for ( int i = 0; i < under.cols(); i++ ) {
+      float expected = 0;
+      if ( j >= 30 && j < 33 && i >= 20 && i < 220 && (i-20) % 7 != 3 )
+        expected = 1000*(j-30) + (i-20) + 1;
+      EXPECT_EQ( expected, view(i,j).child() );
+      EXPECT_EQ( expected, full(i,j).child() );
+      if ( i >= 45 && i < 145 && j >= 28 && j < 35 )
+        EXPECT_EQ( expected, part(i-45,j-28).child() );
+    }
+
+  // Overwriting is not allowed by default
+  EXPECT_THROW( view.absorb( Vector2i(25,31), gappy_patch(3,1) ), NoImplErr );
+}
+
+TEST(SparseView, overlap) {
+  ImageView<PixelMask<float> > under( 100, 10 );
+  fill( under, PixelMask<float>(0) );
+  SparseCompositeView<ImageView<PixelMask<float> > > view( under, true, 32 );
+  view.absorb( Vector2i(0,0), gappy_patch(100,2) );
+  ImageView<PixelMask<float> > top( 3, 1 );
+  fill( top, PixelMask<float>(-1) );
+  view.absorb( Vector2i(31,1), top );
+
+  EXPECT_EQ( 1031, view(30,1).child() );
+  EXPECT_EQ( -1,   view(31,1).child() );
+  EXPECT_EQ( -1,   view(33,1).child() );
+  EXPECT_EQ( 1035, view(34,1).child() );
+  ImageView<PixelMask<float> > full = view;
+  EXPECT_EQ( -1,   full(32,1).child() );
+}
+
+TEST(SparseView, rejected_absorb_changes_nothing) {
+  ImageView<PixelMask<float> > under( 100, 64 );
+  fill( under, PixelMask<float>(0) );
+  SparseCompositeView<ImageView<PixelMask<float> > > view( under, false, 32 );
+  view.absorb( Vector2i(20,30), gappy_patch(40,3) );
+  size_t stored = view.num_stored_pixels();
+
+  // Row 29 is free, in the same tile as the overlap on row 30, and
+  // the patch also reaches the next tile.
+  EXPECT_THROW( view.absorb( Vector2i(0,29), gappy_patch(40,2) ), NoImplErr );
+  EXPECT_EQ( stored, view.num_stored_pixels() );
+  EXPECT_EQ( 0, view(5,29).child() );
+  EXPECT_EQ( 0, view(35,29).child() );
+  EXPECT_EQ( 1, view(20,30).child() );
+}
+
+TEST(SparseView, overwritten_pixels_are_reclaimed) {
+  ImageView<PixelMask<float> > under( 100, 10 );
+  fill( under, PixelMask<float>(0) );
+  SparseCompositeView<ImageView<PixelMask<float> > > view( under, true, 32 );
+  ImageView<PixelMask<float> > patch = gappy_patch(100,5);
+  for ( int k = 0; k < 10; k++ )
+    view.absorb( Vector2i(0,0), patch );
+
+  // At most twice the 86 valid pixels of each of the 5 rows
+  EXPECT_LE( view.num_stored_pixels(), size_t( 2 * 5 * 86 ) );
+  EXPECT_EQ( 2001, view(0,2).child() );
+  EXPECT_EQ( 0,    view(3,2).child() );
+  EXPECT_EQ( 4100, view(99,4).child() );
+}
@@ -0,0 +1,168 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/TileMesher.h>
+#include <map>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A tilted plane with points 2 apart, away from the origin so that
+  // no point reads as missing.
+  ImageView<Vector3> make_plane( int cols, int rows ) {
+    ImageView<Vector3> grid( cols, rows );
+    for ( int r = 0; r < rows; r++ )
+      for ( int c = 0; c < cols; c++ )
+        grid(c,r) = Vector3( 2*c + 1, 2*r + 1, 10 + 0.5*c + 0.25*r );
+    return grid;
+  }
+
+  typedef std::pair<std::pair<int,int>, std::pair<int,int> > Edge;
+
+  Edge make_edge( Vector2i const& a, Vector2i const& b ) {
+    return Edge( std::make_pair( a.x(), a.y() ), std::make_pair( b.x(), b.y() ) );
+  }
+
+  // Count the directed edges of the triangles
+  void count_edges( std::vector<Vector2i> const& corners, std::map<Edge,int>& edges ) {
+    for ( size_t t = 0; t < corners.size(); t += 3 )
+      for ( int k = 0; k < 3; k++ )
+        edges[ make_edge( corners[t+k], corners[t+(k+1)%3] ) ]++;
+  }
+
+  // Every edge inside the cells [c0, c1) x [r0, r1) must be used once
+  // in each direction, else there is a crack or a T-junction.
+  void expect_watertight( std::map<Edge,int> const& edges,
+                          int c0, int r0, int c1, int r1 ) {
+    for ( std::map<Edge,int>::const_iterator it = edges.begin(); it != edges.end(); ++it ) {
+      Edge const& e = it->first;
+      EXPECT_EQ( 1, it->second );
+      bool on_boundary =
+        ( e.first.first  == c0 && e.second.first  == c0 ) ||
+        ( e.first.first  == c1 && e.second.first  == c1 ) ||
+        ( e.first.second == r0 && e.second.second == r0 ) ||
+        ( e.first.second == r1 && e.second.second == r1 );
+      if ( on_boundary )
+        continue;
+      std::map<Edge,int>::const_iterator rev =
+        edges.find( Edge( e.second, e.first ) );
+      ASSERT_TRUE( rev != edges.end() )
+        << "(" << e.first.first << "," << e.first.second << ") -> ("
+        << e.second.first << "," << e.second.second << ")";
+      EXPECT_EQ( 1, rev->second );
+    }
+  }
+
+}
+
+TEST( TileMesher, MeanPointSpacing ) {
+  ImageView<Vector3> grid( 4, 4 );
+  for ( int r = 0; r < 4; r++ )
+    for ( int c = 0; c < 4; c++ )
+      grid(c,r) = Vector3( 2*c + 1, 2*r + 1, 10 );
+  EXPECT_NEAR( 2.0, mean_point_spacing( grid, 0, 0, 3, 3 ), 1e-12 );
+  grid(1,1) = Vector3();
+  EXPECT_NEAR( 2.0, mean_point_spacing( grid, 0, 0, 3, 3 ), 1e-12 );
+  ImageView<Vector3> empty( 4, 4 );
+  EXPECT_EQ( 0, mean_point_spacing( empty, 0, 0, 3, 3 ) );
+}
+
+TEST( TileMesher, PlaneIsOneBlock ) {
+  ImageView<Vector3> grid = make_plane( 9, 9 );
+  TileMesher mesher( grid, 0, 0, 8, 8, 1e-6 );
+  ASSERT_EQ( 1u, mesher.leaves().size() );
+  EXPECT_EQ( Vector3i( 0, 0, 8 ), mesher.leaves()[0] );
+
+  // A fan through the 32 vertices of the tile boundary
+  std::vector<Vector2i> corners;
+  mesher.triangles( corners );
+  EXPECT_EQ( 3u*32, corners.size() );
+  std::map<Edge,int> edges;
+  count_edges( corners, edges );
+  expect_watertight( edges, 0, 0, 8, 8 );
+
+  // Without simplification every cell has its two triangles
+  corners.clear();
+  TileMesher( grid, 0, 0, 8, 8, 0 ).triangles( corners );
+  EXPECT_EQ( 3u*2*64, corners.size() );
+}
+
+TEST( TileMesher, BumpIsSubdivided ) {
+  ImageView<Vector3> grid = make_plane( 9, 9 );
+  grid(5,5).z() += 1;
+  double max_error = 0.1;
+  TileMesher mesher( grid, 0, 0, 8, 8, max_error );
+  EXPECT_GT( mesher.leaves().size(), 1u );
+
+  // Each merged block is within the error of its bilinear surface
+  for ( size_t l = 0; l < mesher.leaves().size(); l++ ) {
+    int c = mesher.leaves()[l][0], r = mesher.leaves()[l][1], size = mesher.leaves()[l][2];
+    for ( int j = 0; j <= size; j++ )
+      for ( int i = 0; i <= size; i++ ) {
+        double u = double(i) / size, v = double(j) / size;
+        Vector3 surface = (1-v)*((1-u)*grid(c,r)      + u*grid(c+size,r)) +
+                             v *((1-u)*grid(c,r+size) + u*grid(c+size,r+size));
+        EXPECT_LE( norm_2( grid(c+i,r+j) - surface ), max_error );
+      }
+  }
+
+  std::vector<Vector2i> corners;
+  mesher.triangles( corners );
+  std::map<Edge,int> edges;
+  count_edges( corners, edges );
+  expect_watertight( edges, 0, 0, 8, 8 );
+}
+
+TEST( TileMesher, NeighborTilesMeet ) {
+  // Two tiles side by side with different simplification, and a tile
+  // which is not a power of two in size.
+  ImageView<Vector3> grid = make_plane( 23, 9 );
+  grid(10,3).z() += 1;
+  grid(19,6).z() -= 2;
+
+  std::vector<Vector2i> corners;
+  TileMesher( grid, 0,  0, 8, 8, 0.1 ).triangles( corners );
+  TileMesher( grid, 8,  0, 8, 8, 0.1 ).triangles( corners );
+  TileMesher( grid, 16, 0, 6, 8, 0.1 ).triangles( corners );
+  std::map<Edge,int> edges;
+  count_edges( corners, edges );
+  expect_watertight( edges, 0, 0, 22, 8 );
+}
+
+TEST( TileMesher, HolesAreNotBridged ) {
+  ImageView<Vector3> grid = make_plane( 9, 9 );
+  grid(3,3) = Vector3();
+  grid(6,1) = Vector3();
+  grid(6,2) = Vector3();
+
+  std::vector<Vector2i> corners;
+  TileMesher( grid, 0, 0, 8, 8, 0.1 ).triangles( corners );
+  for ( size_t k = 0; k < corners.size(); k++ )
+    EXPECT_TRUE( valid_point( grid( corners[k].x(), corners[k].y() ) ) );
+
+  // The cells around a single missing point keep one triangle each
+  std::map<Edge,int> edges;
+  count_edges( corners, edges );
+  EXPECT_EQ( 1u, edges.count( make_edge( Vector2i(2,3), Vector2i(3,4) ) ) +
+                 edges.count( make_edge( Vector2i(3,4), Vector2i(2,3) ) ) );
+  EXPECT_EQ( 1u, edges.count( make_edge( Vector2i(3,2), Vector2i(4,3) ) ) +
+                 edges.count( make_edge( Vector2i(4,3), Vector2i(3,2) ) ) );
+}
@@ -0,0 +1,190 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/TileScheduler.h>
+#include <asp/Core/Common.h>
+#include <vw/Image/ImageMath.h>
+#include <vw/Image/Statistics.h>
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Records what the scheduler asks for, counting how many times each
+  // pixel is rasterized.
+  class RecordingTask : public TileTask {
+  public:
+    std::vector<BBox2i> m_tiles;
+    ImageView<int> m_count;
+    std::vector<size_t> m_started, m_written;
+    size_t m_max_buffered, m_slow_tile, m_bad_tile;
+    Mutex m_mutex;
+
+    RecordingTask( std::vector<BBox2i> const& tiles, Vector2i const& size ) :
+      m_tiles(tiles), m_count(size[0], size[1]), m_max_buffered(0),
+      m_slow_tile(tiles.size()), m_bad_tile(tiles.size()) {}
+
+    virtual void start( size_t tile ) {
+      Mutex::Lock lock( m_mutex );
+      m_started.push_back( tile );
+      m_max_buffered = std::max( m_max_buffered, m_started.size() - m_written.size() );
+    }
+    virtual void rasterize( size_t tile, BBox2i const& piece ) {
+      if ( tile == m_bad_tile )
+        vw_throw( IOErr() << "Bad tile" );
+      if ( tile == m_slow_tile )
+        Thread::sleep_ms( 50 );
+      EXPECT_TRUE( m_tiles[tile].contains( piece ) );
+      Mutex::Lock lock( m_mutex );
+      for ( int row = piece.min().y(); row < piece.max().y(); row++ )
+        for ( int col = piece.min().x(); col < piece.max().x(); col++ )
+          m_count( col, row )++;
+    }
+    virtual void write( size_t tile ) {
+      Mutex::Lock lock( m_mutex );
+      m_written.push_back( tile );
+    }
+  };
+
+  class IndexCost : public TileCostEstimator {
+  public:
+    virtual double operator()( BBox2i const& tile ) const {
+      return tile.min().x() + 1000 * tile.min().y();
+    }
+  };
+}
+
+TEST( TileScheduler, Tiles ) {
+  std::vector<BBox2i> tiles = TileScheduler::tiles( Vector2i(10, 7), Vector2i(4, 4) );
+  ASSERT_EQ( 6u, tiles.size() );
+  EXPECT_EQ( BBox2i(0, 0, 4, 4), tiles[0] );
+  EXPECT_EQ( BBox2i(4, 0, 4, 4), tiles[1] );
+  EXPECT_EQ( BBox2i(8, 4, 2, 3), tiles[5] );
+}
+
+TEST( TileScheduler, SplitsAndWritesInOrder ) {
+  Vector2i size( 100, 96 );
+  std::vector<BBox2i> tiles = TileScheduler::tiles( size, Vector2i(16, 16) );
+  RecordingTask task( tiles, size );
+  task.m_slow_tile = tiles.size() - 1;
+
+  TileSchedulerOptions options;
+  options.num_threads        = 4;
+  options.split_rows         = 4;
+  options.max_buffered_tiles = 6;
+  TileScheduler scheduler( tiles, options );
+  scheduler.run( task );
+
+  // Every pixel once, every tile written once and in order
+  EXPECT_EQ( 1, min_pixel_value( task.m_count ) );
+  EXPECT_EQ( 1, max_pixel_value( task.m_count ) );
+  ASSERT_EQ( tiles.size(), task.m_written.size() );
+  for ( size_t i = 0; i < tiles.size(); i++ )
+    EXPECT_EQ( i, task.m_written[i] );
+  EXPECT_LE( task.m_max_buffered, 6u );
+
+  // The slow tile is last, so idle threads help with it
+  TileTiming const& slow = scheduler.timings().back();
+  EXPECT_EQ( 4, slow.pieces );
+  EXPECT_GT( slow.threads, 1 );
+  EXPECT_LE( slow.start, slow.finish );
+  EXPECT_LE( slow.finish, slow.written );
+}
+
+TEST( TileScheduler, MaxBufferedTiles ) {
+  EXPECT_EQ( 10, TileScheduler::max_buffered_tiles( 100, 4, 1000 ) );
+  EXPECT_EQ( 10, TileScheduler::max_buffered_tiles( 100, 4, 1099 ) );
+  EXPECT_EQ( 1,  TileScheduler::max_buffered_tiles( 5000, 4, 1000 ) ); // Always one
+  EXPECT_EQ( 16, TileScheduler::max_buffered_tiles( 0, 4, 1000 ) );    // Size unknown
+
+  // The bytes bound the tiles in flight when their count is not given
+  Vector2i size( 64, 64 );
+  std::vector<BBox2i> tiles = TileScheduler::tiles( size, Vector2i(16, 16) );
+  RecordingTask task( tiles, size );
+  TileSchedulerOptions options;
+  options.num_threads        = 4;
+  options.max_buffered_bytes = 3 * 16 * 16 * sizeof(float);
+  TileScheduler scheduler( tiles, options, 16 * 16 * sizeof(float) );
+  scheduler.run( task );
+  EXPECT_LE( task.m_max_buffered, 3u );
+  EXPECT_EQ( 1, max_pixel_value( task.m_count ) );
+}
+
+TEST( TileScheduler, CostlyFirst ) {
+  Vector2i size( 64, 64 );
+  std::vector<BBox2i> tiles = TileScheduler::tiles( size, Vector2i(16, 16) );
+  RecordingTask task( tiles, size );
+
+  TileSchedulerOptions options;
+  options.num_threads        = 1;
+  options.max_buffered_tiles = tiles.size();
+  options.tile_cost.reset( new IndexCost() );
+  TileScheduler scheduler( tiles, options );
+  scheduler.run( task );
+
+  // Started from the last tile, still written from the first
+  ASSERT_EQ( tiles.size(), task.m_started.size() );
+  for ( size_t i = 0; i < tiles.size(); i++ ) {
+    EXPECT_EQ( tiles.size() - 1 - i, task.m_started[i] );
+    EXPECT_EQ( i, task.m_written[i] );
+  }
+  EXPECT_EQ( 1, max_pixel_value( task.m_count ) );
+}
+
+TEST( TileScheduler, Errors ) {
+  Vector2i size( 64, 64 );
+  std::vector<BBox2i> tiles = TileScheduler::tiles( size, Vector2i(16, 16) );
+  RecordingTask task( tiles, size );
+  task.m_bad_tile = 5;
+
+  TileSchedulerOptions options;
+  options.num_threads = 3;
+  TileScheduler scheduler( tiles, options );
+  EXPECT_THROW( scheduler.run( task ), vw::Exception );
+  EXPECT_GT( tiles.size(), task.m_written.size() );
+}
+
+TEST( TileScheduler, BlockWriteGdal ) {
+  ImageView<float> image( 150, 70 );
+  for ( int row = 0; row < image.rows(); row++ )
+    for ( int col = 0; col < image.cols(); col++ )
+      image( col, row ) = col + 1000 * row;
+
+  BaseOptions opt;
+  opt.raster_tile_size = Vector2i( 32, 32 );
+  opt.tile_scheduler.enabled     = true;
+  opt.tile_scheduler.num_threads = 3;
+  opt.tile_scheduler.split_rows  = 5;
+
+  UnlinkName file( "tile_scheduler.tif" );
+  UnlinkName log ( "tile_scheduler-tiles.txt" );
+  opt.tile_scheduler.timing_log = log;
+  block_write_gdal_image( file, image, opt );
+
+  DiskImageView<float> result( file );
+  ASSERT_EQ( image.cols(), result.cols() );
+  ASSERT_EQ( image.rows(), result.rows() );
+  ImageView<float> copy = result;
+  EXPECT_EQ( 0, max_pixel_value( abs( copy - image ) ) );
+  EXPECT_TRUE( boost::filesystem::exists( std::string( log ) ) );
+}
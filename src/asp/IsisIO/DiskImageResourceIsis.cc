@@ -25,16 +25,20 @@
 #endif
 
 #include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
 #include <vw/Math/BBox.h>
 #include <vw/Math/Vector.h>
 #include <vw/Image/ImageResource.h>
 #include <vw/Image/PixelTypeInfo.h>
 #include <asp/IsisIO/DiskImageResourceIsis.h>
 
+#include <algorithm>
 #include <string>
 
 #include <Cube.h>
 #include <Portal.h>
+#include <Pvl.h>
+#include <PvlObject.h>
 #include <SpecialPixel.h>
 
 using namespace std;
@@ -43,21 +47,74 @@ using namespace boost;
 namespace vw {
 
 
-  // We use a fixed tile size of 2048x2048 pixels here.  Although this
-  // may not be the native tile size of the ISIS cube, it seems to be
-  // much faster to let the ISIS driver aggregate smaller blocks by
-  // making a larger request rather than caching those blocks
-  // ourselves.
+  // Reading one native tile per call has a large overhead in ISIS, so
+  // we read blocks of about 2048x2048 pixels. These are made of whole
+  // native tiles (or whole lines for BSQ cubes), so no native tile is
+  // ever split between two reads and decoded twice.
   Vector2i DiskImageResourceIsis::block_read_size() const
   {
-    return Vector2i(2048,2048);
+    const int target = 2048;
+    Vector2i size;
+    size.x() = std::max( 1, target / m_native_block_size.x() ) * m_native_block_size.x();
+    int lines = target;
+    if ( !m_is_tiled ) // Keep the number of pixels of a full-width strip close to target^2
+      lines = std::max( 1, target * target / m_native_block_size.x() );
+    size.y() = std::max( 1, lines / m_native_block_size.y() ) * m_native_block_size.y();
+    return Vector2i( std::min( size.x(), m_format.cols ),
+                     std::min( size.y(), m_format.rows ) );
   }
 
-  /// Bind the resource to a file for writing.
-  void DiskImageResourceIsis::create(std::string const& /*filename*/,
-                                     ImageFormat const& /*format*/)
+  /// Bind the resource to a file for writing. ISIS cubes can only
+  /// store a few pixel types, other types are converted to the
+  /// closest one that can hold them.
+  void DiskImageResourceIsis::create(std::string const& filename,
+                                     ImageFormat const& format)
   {
-    throw NoImplErr() << "The Isis driver does not yet support creation of Isis files";
+    VW_ASSERT( num_channels(format.pixel_format) == 1,
+               NoImplErr() << "DiskImageResourceIsis: Can only write single channel pixels, "
+               << "use planes for multiple bands." );
+
+    m_filename = filename;
+    m_format   = format;
+
+    Isis::PixelType isis_ptype;
+    switch (format.channel_type) {
+    case VW_CHANNEL_UINT8:
+      isis_ptype = Isis::UnsignedByte;
+      m_bytes_per_pixel = 1;
+      break;
+    case VW_CHANNEL_INT8:
+    case VW_CHANNEL_INT16:
+      isis_ptype = Isis::SignedWord;
+      m_bytes_per_pixel = 2;
+      m_format.channel_type = VW_CHANNEL_INT16;
+      break;
+    case VW_CHANNEL_UINT16:
+      isis_ptype = Isis::UnsignedWord;
+      m_bytes_per_pixel = 2;
+      break;
+    case VW_CHANNEL_FLOAT32:
+    case VW_CHANNEL_FLOAT64:
+      // Cubes of doubles are written as single precision Real
+      isis_ptype = Isis::Real;
+      m_bytes_per_pixel = 4;
+      m_format.channel_type = VW_CHANNEL_FLOAT32;
+      break;
+    default:
+      // Real would silently lose the precision of large integers
+      vw_throw( NoImplErr() << "DiskImageResourceIsis: Cannot write pixels of channel type "
+                << channel_type_name( format.channel_type ) << "." );
+    }
+
+    m_cube = boost::shared_ptr<Isis::Cube>( new Isis::Cube() );
+    m_cube->setDimensions( format.cols, format.rows, format.planes );
+    m_cube->setPixelType( isis_ptype );
+    m_cube->setFormat( Isis::Cube::Tile );
+    m_cube->create( QString::fromStdString(m_filename) );
+    VW_ASSERT( m_cube->isOpen(),
+               IOErr() << "DiskImageResourceIsis: Could not create cube file: \"" << filename << "\"." );
+
+    read_native_layout();
   }
 
   /// Bind the resource to a file for reading.  Confirm that we can open
@@ -113,40 +170,136 @@ namespace vw {
     default:
       vw_throw(IOErr() << "DiskImageResourceIsis: Unknown pixel type.");
     }
+
+    read_native_layout();
+  }
+
+  // Find out how the pixels are laid out in the cube file
+  void DiskImageResourceIsis::read_native_layout() {
+    m_is_tiled = false;
+    m_native_block_size = Vector2i( m_format.cols, 1 );
+
+    if ( m_cube->format() != Isis::Cube::Tile )
+      return;
+
+    Isis::PvlObject& core =
+      m_cube->label()->findObject("IsisCube").findObject("Core");
+    if ( core.hasKeyword("TileSamples") && core.hasKeyword("TileLines") ) {
+      m_is_tiled = true;
+      m_native_block_size = Vector2i( int(core["TileSamples"]),
+                                      int(core["TileLines"]) );
+    }
+  }
+
+  boost::shared_ptr<Isis::Portal>
+  DiskImageResourceIsis::acquire_portal( Vector2i const& size ) const {
+    {
+      Mutex::Lock lock( m_portal_mutex );
+      for ( size_t i = 0; i < m_portals.size(); i++ ) {
+        if ( m_portals[i]->SampleDimension() == size.x() &&
+             m_portals[i]->LineDimension()   == size.y() ) {
+          boost::shared_ptr<Isis::Portal> portal = m_portals[i];
+          m_portals.erase( m_portals.begin() + i );
+          return portal;
+        }
+      }
+    }
+    return boost::shared_ptr<Isis::Portal>
+      ( new Isis::Portal( size.x(), size.y(), m_cube->pixelType() ) );
+  }
+
+  void DiskImageResourceIsis::release_portal( boost::shared_ptr<Isis::Portal> const& portal ) const {
+    // Keep at most a few portals per thread around
+    const size_t max_portals = 2 * vw_settings().default_num_threads();
+    Mutex::Lock lock( m_portal_mutex );
+    if ( m_portals.size() < max_portals )
+      m_portals.push_back( portal );
   }
 
   /// Read the disk image into the given buffer.
   void DiskImageResourceIsis::read(ImageBuffer const& dest, BBox2i const& bbox) const
   {
-    VW_ASSERT(bbox.max().x() <= m_cube->sampleCount() ||
+    VW_ASSERT(bbox.max().x() <= m_cube->sampleCount() &&
               bbox.max().y() <= m_cube->lineCount(),
               IOErr() << "DiskImageResourceIsis: requested bbox " << bbox
               << " exceeds image dimensions [" << m_cube->sampleCount()
               << " " << m_cube->lineCount() << "]");
+    VW_ASSERT(dest.format.planes <= m_format.planes,
+              IOErr() << "DiskImageResourceIsis: requested " << dest.format.planes
+              << " planes from a cube with " << m_format.planes << " bands.");
+
+    boost::shared_ptr<Isis::Portal> buffer = acquire_portal( bbox.size() );
+
+    for ( int p = 0; p < dest.format.planes; p++ ) {
+      // Read in the requested tile from the cube file.  Note that ISIS
+      // cube pixel indices appear to be 1-based.
+      buffer->SetPosition(bbox.min().x()+1, bbox.min().y()+1, p+1);
+      {
+        Mutex::Lock lock( m_cube_mutex );
+        m_cube->read(*buffer);
+      }
 
-    // Read in the requested tile from the cube file.  Note that ISIS
-    // cube pixel indices appear to be 1-based.
-    Isis::Portal buffer( bbox.width(), bbox.height(),
-                         m_cube->pixelType() );
-    buffer.SetPosition(bbox.min().x()+1, bbox.min().y()+1, 1);
-    m_cube->read(buffer);
-
-    // Create generic image buffer from the Isis data.
-    ImageBuffer src;
-    src.data = buffer.RawBuffer();
-    src.format = m_format;
-    src.format.cols = bbox.width();
-    src.format.rows = bbox.height();
-    src.cstride = m_bytes_per_pixel;
-    src.rstride = m_bytes_per_pixel * bbox.width();
-    src.pstride = m_bytes_per_pixel * bbox.width() * bbox.height();
-    convert(dest, src);
+      // Create generic image buffer from the Isis data. The conversion
+      // happens outside of the lock.
+      ImageBuffer src;
+      src.data = buffer->RawBuffer();
+      src.format = m_format;
+      src.format.cols = bbox.width();
+      src.format.rows = bbox.height();
+      src.format.planes = 1;
+      src.cstride = m_bytes_per_pixel;
+      src.rstride = m_bytes_per_pixel * bbox.width();
+      src.pstride = m_bytes_per_pixel * bbox.width() * bbox.height();
+
+      ImageBuffer dest_plane = dest;
+      dest_plane.data = (uint8*)dest.data + p * dest.pstride;
+      dest_plane.format.planes = 1;
+      convert(dest_plane, src);
+    }
+
+    release_portal( buffer );
   }
 
   // Write the given buffer into the disk image.
-  void DiskImageResourceIsis::write(ImageBuffer const& /*src*/, BBox2i const& /*bbox*/) {
-    vw_throw ( NoImplErr() <<
-               "The Isis driver does not yet support creation of Isis files" );
+  void DiskImageResourceIsis::write(ImageBuffer const& src, BBox2i const& bbox) {
+    VW_ASSERT( !m_cube->isReadOnly(),
+               IOErr() << "DiskImageResourceIsis: " << m_filename << " is open read-only." );
+    VW_ASSERT(bbox.max().x() <= m_cube->sampleCount() &&
+              bbox.max().y() <= m_cube->lineCount(),
+              IOErr() << "DiskImageResourceIsis: bbox " << bbox
+              << " to write exceeds image dimensions [" << m_cube->sampleCount()
+              << " " << m_cube->lineCount() << "]");
+    VW_ASSERT(src.format.planes == m_format.planes,
+              IOErr() << "DiskImageResourceIsis: cannot write " << src.format.planes
+              << " planes to a cube with " << m_format.planes << " bands.");
+
+    boost::shared_ptr<Isis::Portal> buffer = acquire_portal( bbox.size() );
+
+    for ( int p = 0; p < m_format.planes; p++ ) {
+      // ISIS converts to the pixel type of the cube from the double
+      // buffer of the portal.
+      ImageBuffer dest;
+      dest.data = buffer->DoubleBuffer();
+      dest.format = m_format;
+      dest.format.cols = bbox.width();
+      dest.format.rows = bbox.height();
+      dest.format.planes = 1;
+      dest.format.channel_type = VW_CHANNEL_FLOAT64;
+      dest.cstride = sizeof(double);
+      dest.rstride = sizeof(double) * bbox.width();
+      dest.pstride = sizeof(double) * bbox.width() * bbox.height();
+
+      ImageBuffer src_plane = src;
+      src_plane.data = (uint8*)src.data + p * src.pstride;
+      src_plane.format.planes = 1;
+      convert(dest, src_plane);
+
+      buffer->SetPosition(bbox.min().x()+1, bbox.min().y()+1, p+1);
+      Mutex::Lock lock( m_cube_mutex );
+      m_cube->write(*buffer);
+    }
+
+    release_portal( buffer );
   }
 
   // A FileIO hook to open a file for reading
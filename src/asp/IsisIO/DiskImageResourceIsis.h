@@ -24,11 +24,15 @@
 #ifndef __VW_FILEIO_DISK_IMAGE_RESOUCE_ISIS_H__
 #define __VW_FILEIO_DISK_IMAGE_RESOUCE_ISIS_H__
 
+#include <vw/Core/Thread.h>
 #include <vw/Image/PixelTypes.h>
 #include <vw/FileIO/DiskImageResource.h>
 
+#include <vector>
+
 namespace Isis {
   class Cube;
+  class Portal;
 }
 
 namespace vw {
@@ -51,12 +55,13 @@ namespace vw {
     static std::string type_static() { return "ISIS"; }
     virtual std::string type() { return type_static(); }
 
-    virtual bool has_block_write()  const {return false;}
+    virtual bool has_block_write()  const {return true;}
     virtual bool has_nodata_write() const {return false;}
     virtual bool has_block_read()   const {return true;}
     virtual bool has_nodata_read()  const {return true;}
 
     virtual Vector2i block_read_size() const;
+    virtual Vector2i block_write_size() const { return block_read_size(); }
 
     virtual void read(ImageBuffer const& dest, BBox2i const& bbox) const;
     virtual void write(ImageBuffer const& dest, BBox2i const& bbox);
@@ -80,11 +85,30 @@ namespace vw {
     // Additional cube informat
     bool is_map_projected() const;
 
+    // Layout of the pixels on disk. Tiled cubes store native tiles,
+    // BSQ cubes store one line of one band after another, which we
+    // report as a native block of one full line.
+    bool is_tiled() const { return m_is_tiled; }
+    Vector2i native_block_size() const { return m_native_block_size; }
+
   private:
+    void read_native_layout();
+
+    // Portals are reused between reads and writes of the same size
+    // instead of allocating new ones each time. Each caller gets its
+    // own portal, so several threads can use the resource at once.
+    boost::shared_ptr<Isis::Portal> acquire_portal( Vector2i const& size ) const;
+    void release_portal( boost::shared_ptr<Isis::Portal> const& portal ) const;
+
     boost::shared_ptr<Isis::Cube> m_cube;
     std::string m_filename;
     int m_bytes_per_pixel;
+    bool m_is_tiled;
     Vector2i m_native_block_size;
+
+    mutable Mutex m_cube_mutex;   // ISIS cube IO is not reentrant
+    mutable Mutex m_portal_mutex;
+    mutable std::vector<boost::shared_ptr<Isis::Portal> > m_portals;
   };
 
 } // namespace vw
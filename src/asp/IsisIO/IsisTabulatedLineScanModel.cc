@@ -0,0 +1,467 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/LevenbergMarquardt.h>
+#include <asp/IsisIO/IsisTabulatedLineScanModel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <limits>
+
+#include <FileName.h>
+#include <CameraFactory.h>
+#include <Cube.h>
+#include <Distance.h>
+#include <SerialNumber.h>
+#include <iTime.h>
+#include <AlphaCube.h>
+#include <Camera.h>
+#include <CameraDetectorMap.h>
+#include <CameraDistortionMap.h>
+#include <CameraFocalPlaneMap.h>
+#include <Pvl.h>
+#include <SpiceRotation.h>
+
+#include <boost/scoped_ptr.hpp>
+
+using namespace vw;
+using namespace vw::camera;
+
+namespace {
+
+  // Linear interpolation (or extrapolation) of a tabulated quantity
+  template <class T>
+  T lerp( std::vector<T> const& table, size_t index, double alpha ) {
+    return (1.0 - alpha) * table[index] + alpha * table[index+1];
+  }
+
+  // Position of 'x' in a table sampled at the integers 0, 1, ...
+  void integer_knot( double x, size_t table_size, size_t& index, double& alpha ) {
+    double i = std::floor( x );
+    i = std::max( 0.0, std::min( i, double(table_size) - 2.0 ) );
+    index = size_t(i);
+    alpha = x - i;
+  }
+
+  double quat_dot( Quat const& a, Quat const& b ) {
+    return a.w()*b.w() + a.x()*b.x() + a.y()*b.y() + a.z()*b.z();
+  }
+
+  // Normalized linear interpolation between two neighboring poses.
+  // The rotation between two consecutive lines is tiny, so this
+  // agrees with SLERP to within machine precision.
+  Quat nlerp( Quat const& a, Quat const& b, double alpha ) {
+    double w = (1.0 - alpha) * a.w() + alpha * b.w();
+    double x = (1.0 - alpha) * a.x() + alpha * b.x();
+    double y = (1.0 - alpha) * a.y() + alpha * b.y();
+    double z = (1.0 - alpha) * a.z() + alpha * b.z();
+    double n = std::sqrt( w*w + x*x + y*y + z*z );
+    return Quat( w/n, x/n, y/n, z/n );
+  }
+}
+
+//-------------------------------------------------------------------------
+//  Constructor: sample the ISIS camera
+//-------------------------------------------------------------------------
+
+IsisTabulatedLineScanModel::IsisTabulatedLineScanModel( std::string const& cube_filename,
+                                                        double line_step ) {
+
+  VW_ASSERT( line_step > 0,
+             ArgumentErr() << "IsisTabulatedLineScanModel: The line step must be positive." );
+
+  // Opening labels and camera
+  Isis::FileName cubefile( QString::fromStdString(cube_filename) );
+  Isis::Pvl label;
+  label.read( cubefile.expanded() );
+  Isis::Cube cube( cubefile.expanded() );
+  boost::scoped_ptr<Isis::Camera> camera( Isis::CameraFactory::Create( cube ) );
+
+  if ( camera->GetCameraType() != 2 || camera->HasProjection() )
+    vw_throw( NoImplErr() << "IsisTabulatedLineScanModel: " << cube_filename
+              << " is not an unprojected line scan image." );
+
+  // Gutting Isis::Camera
+  Isis::AlphaCube alphacube( cube );
+  Isis::CameraDistortionMap *distortmap = camera->DistortionMap();
+  Isis::CameraFocalPlaneMap *focalmap   = camera->FocalPlaneMap();
+  Isis::CameraDetectorMap   *detectmap  = camera->DetectorMap();
+
+  m_lines         = camera->Lines();
+  m_samples       = camera->Samples();
+  m_serial_number = Isis::SerialNumber::Compose( label, true ).toStdString();
+  Isis::Distance radii[3];
+  camera->radii( radii );
+  m_target_radii = Vector3( radii[0].meters(), radii[1].meters(), radii[2].meters() );
+
+  // Sample position, pose, time and sun position along the image. We
+  // always want a knot on the last line, and at least two knots.
+  double last_line = std::max( m_lines - 1, 1 );
+  for ( double line = 0; ; line += line_step ) {
+    line = std::min( line, last_line );
+    detectmap->SetParent( alphacube.AlphaSample(1),
+                          alphacube.AlphaLine(line + 1) );
+
+    Vector3 center;
+    camera->instrumentPosition( &center[0] );
+    center *= 1000; // Spice gives in km
+
+    std::vector<double> rot_inst = camera->instrumentRotation()->Matrix();
+    std::vector<double> rot_body = camera->bodyRotation()->Matrix();
+    MatrixProxy<double,3,3> R_inst(&(rot_inst[0]));
+    MatrixProxy<double,3,3> R_body(&(rot_body[0]));
+    Quat pose( R_body*transpose(R_inst) );
+    // Keep consecutive quaternions in the same hemisphere so that
+    // they can be interpolated.
+    if ( !m_poses.empty() && quat_dot( m_poses.back(), pose ) < 0 )
+      pose = Quat( -pose.w(), -pose.x(), -pose.y(), -pose.z() );
+
+    Vector3 sun;
+    camera->sunPosition( &sun[0] );
+
+    m_knot_lines.push_back( line );
+    m_centers.push_back( center );
+    m_poses.push_back( pose );
+    m_times.push_back( camera->time().Et() );
+    m_sun_positions.push_back( sun * 1000 );
+
+    if ( line >= last_line )
+      break;
+  }
+
+  // Sample the look direction of every detector, with the distortion
+  // removed. These don't depend on time for a line scan camera.
+  double middle = alphacube.AlphaLine( m_lines / 2.0 + 1 );
+  for ( int s = 0; s <= m_samples; s++ ) {
+    detectmap->SetParent( alphacube.AlphaSample(s + 1), middle );
+    focalmap->SetDetector( detectmap->DetectorSample(),
+                           detectmap->DetectorLine() );
+    distortmap->SetFocalPlane( focalmap->FocalPlaneX(),
+                               focalmap->FocalPlaneY() );
+    Vector3 look( distortmap->UndistortedFocalPlaneX(),
+                  distortmap->UndistortedFocalPlaneY(),
+                  distortmap->UndistortedFocalPlaneZ() );
+    look = normalize( look );
+    m_looks.push_back( look );
+    m_along.push_back( look[0] / look[2] );
+    m_cross.push_back( look[1] / look[2] );
+  }
+
+  // The detector normally runs along the focal plane X axis but
+  // nothing in ISIS guarantees it. Pick the axis that changes most.
+  double dx = m_along.back() - m_along.front();
+  double dy = m_cross.back() - m_cross.front();
+  m_along_axis = 0;
+  if ( std::abs(dy) > std::abs(dx) ) {
+    m_along_axis = 1;
+    std::swap( m_along, m_cross );
+    std::swap( dx, dy );
+  }
+  VW_ASSERT( dx != 0,
+             NoImplErr() << "IsisTabulatedLineScanModel: Degenerate detector in "
+             << cube_filename << "." );
+  m_along_increasing = dx > 0;
+  m_pixels_per_along = m_samples / std::abs( dx );
+}
+
+IsisTabulatedLineScanModel::IsisTabulatedLineScanModel() :
+  m_along_axis(0), m_along_increasing(true), m_pixels_per_along(0),
+  m_lines(0), m_samples(0) {}
+
+//-------------------------------------------------------------------------
+//  Table lookups
+//-------------------------------------------------------------------------
+
+void IsisTabulatedLineScanModel::line_knot( double line, size_t& index,
+                                            double& alpha ) const {
+  // All intervals have the same length except possibly the last one
+  size_t n = m_knot_lines.size();
+  double step = m_knot_lines[1] - m_knot_lines[0];
+  double i = std::floor( line / step );
+  i = std::max( 0.0, std::min( i, double(n) - 2.0 ) );
+  index = size_t(i);
+  alpha = ( line - m_knot_lines[index] ) /
+    ( m_knot_lines[index+1] - m_knot_lines[index] );
+}
+
+double IsisTabulatedLineScanModel::sample_from_along( double along ) const {
+  // Binary search in the monotonic table. Outside of it we
+  // extrapolate using the end intervals.
+  size_t n = m_along.size();
+  size_t index;
+  if ( m_along_increasing )
+    index = std::upper_bound( m_along.begin(), m_along.end(), along )
+      - m_along.begin();
+  else
+    index = std::upper_bound( m_along.begin(), m_along.end(), along,
+                              std::greater<double>() ) - m_along.begin();
+  if ( index > 0 )
+    index--;
+  index = std::min( index, n - 2 );
+
+  return index + ( along - m_along[index] ) /
+    ( m_along[index+1] - m_along[index] );
+}
+
+double IsisTabulatedLineScanModel::cross_at_sample( double sample ) const {
+  size_t index;
+  double alpha;
+  integer_knot( sample, m_cross.size(), index, alpha );
+  return lerp( m_cross, index, alpha );
+}
+
+//-------------------------------------------------------------------------
+//  Traditional Camera Routines
+//-------------------------------------------------------------------------
+
+IsisTabulatedLineScanModel::LineLMA::result_type
+IsisTabulatedLineScanModel::LineLMA::operator()( domain_type const& line ) const {
+  Vector2 pix( 0, line[0] );
+
+  // Rotate the point into the camera frame and project it on the
+  // focal plane.
+  Vector3 pt = inverse( m_model->camera_pose(pix) ).rotate
+    ( m_point - m_model->camera_center(pix) );
+  double along = pt[m_model->m_along_axis]   / pt[2];
+  double cross = pt[1-m_model->m_along_axis] / pt[2];
+
+  // Error against the location of the detector
+  double sample = m_model->sample_from_along( along );
+  result_type result(1);
+  result[0] = ( cross - m_model->cross_at_sample( sample ) ) *
+    m_model->m_pixels_per_along;
+  return result;
+}
+
+Vector2
+IsisTabulatedLineScanModel::point_to_pixel( Vector3 const& point ) const {
+
+  // Solve for the line, seeding with the middle of the image
+  LineLMA model( this, point );
+  int status;
+  Vector<double> objective(1), start(1);
+  start[0] = m_lines / 2;
+  Vector<double> solution =
+    math::levenberg_marquardt( model, start, objective, status,
+                               1e-4, 1e-10, 100 );
+  // Solve to 1e-4 pixels, give up with a relative change of 1e-10
+  // or after 100 iterations.
+
+  VW_ASSERT( status > 0,
+             PointToPixelErr() << "Unable to project point into IsisTabulatedLineScan model" );
+
+  // Solve for sample location
+  Vector2 pix( 0, solution[0] );
+  Vector3 pt = inverse( camera_pose(pix) ).rotate( point - camera_center(pix) );
+  pix[0] = sample_from_along( pt[m_along_axis] / pt[2] );
+  return pix;
+}
+
+Vector3
+IsisTabulatedLineScanModel::pixel_to_vector( Vector2 const& pix ) const {
+  size_t index;
+  double alpha;
+  integer_knot( pix[0], m_looks.size(), index, alpha );
+  Vector3 look = normalize( lerp( m_looks, index, alpha ) );
+  return camera_pose( pix ).rotate( look );
+}
+
+Vector3
+IsisTabulatedLineScanModel::camera_center( Vector2 const& pix ) const {
+  size_t index;
+  double alpha;
+  line_knot( pix[1], index, alpha );
+  return lerp( m_centers, index, alpha );
+}
+
+Quat
+IsisTabulatedLineScanModel::camera_pose( Vector2 const& pix ) const {
+  size_t index;
+  double alpha;
+  line_knot( pix[1], index, alpha );
+  return nlerp( m_poses[index], m_poses[index+1], alpha );
+}
+
+double
+IsisTabulatedLineScanModel::ephemeris_time( Vector2 const& pix ) const {
+  size_t index;
+  double alpha;
+  line_knot( pix[1], index, alpha );
+  return lerp( m_times, index, alpha );
+}
+
+Vector3
+IsisTabulatedLineScanModel::sun_position( Vector2 const& pix ) const {
+  size_t index;
+  double alpha;
+  line_knot( pix[1], index, alpha );
+  return lerp( m_sun_positions, index, alpha );
+}
+
+//-------------------------------------------------------------------------
+//  Validation
+//-------------------------------------------------------------------------
+
+IsisTabulatedLineScanModel::ValidationReport
+IsisTabulatedLineScanModel::validate( CameraModel const& reference,
+                                      int grid_size ) const {
+  VW_ASSERT( grid_size >= 2,
+             ArgumentErr() << "IsisTabulatedLineScanModel: Need at least a 2x2 validation grid." );
+
+  ValidationReport report;
+  double radius = ( m_target_radii[0] + m_target_radii[1] + m_target_radii[2] ) / 3.0;
+  double sum = 0;
+
+  for ( int j = 0; j < grid_size; j++ ) {
+    for ( int i = 0; i < grid_size; i++ ) {
+      Vector2 pix( (m_samples - 1) * i / double(grid_size - 1),
+                   (m_lines   - 1) * j / double(grid_size - 1) );
+
+      Vector3 ref_center = reference.camera_center( pix );
+      Vector3 ref_dir    = reference.pixel_to_vector( pix );
+      double cos_angle = dot_prod( ref_dir, pixel_to_vector( pix ) );
+      cos_angle = std::max( -1.0, std::min( 1.0, cos_angle ) );
+      report.max_angle_error  = std::max( report.max_angle_error, std::acos( cos_angle ) );
+      report.max_center_error = std::max( report.max_center_error,
+                                          norm_2( ref_center - camera_center( pix ) ) );
+
+      // Intersect the reference ray with the mean sphere of the
+      // target. Skip rays that look off the body.
+      double b    = dot_prod( ref_center, ref_dir );
+      double disc = b*b - ( dot_prod( ref_center, ref_center ) - radius*radius );
+      if ( disc < 0 )
+        continue;
+      double dist = -b - std::sqrt( disc );
+      if ( dist <= 0 )
+        continue;
+      Vector3 ground = ref_center + dist * ref_dir;
+
+      double err;
+      try {
+        err = norm_2( point_to_pixel( ground ) - pix );
+      } catch ( const vw::Exception& ) {
+        err = std::numeric_limits<double>::infinity();
+      }
+      report.max_pixel_error = std::max( report.max_pixel_error, err );
+      sum += err;
+      report.num_points++;
+    }
+  }
+
+  if ( report.num_points > 0 )
+    report.mean_pixel_error = sum / report.num_points;
+
+  return report;
+}
+
+//-------------------------------------------------------------------------
+//  Saving and loading
+//-------------------------------------------------------------------------
+
+namespace {
+  const char* tabulated_magic = "IsisTabulatedLineScanModel";
+  const int tabulated_version = 1;
+}
+
+void IsisTabulatedLineScanModel::write( std::string const& filename,
+                                        ValidationReport const& report ) const {
+  std::ofstream out( filename.c_str() );
+  if ( !out )
+    vw_throw( IOErr() << "IsisTabulatedLineScanModel: Cannot write " << filename << "." );
+  out.precision(17);
+
+  out << tabulated_magic << " " << tabulated_version << "\n";
+  out << m_serial_number << "\n";
+  out << m_lines << " " << m_samples << "\n";
+  out << m_target_radii[0] << " " << m_target_radii[1] << " " << m_target_radii[2] << "\n";
+  out << m_along_axis << " " << m_along_increasing << " " << m_pixels_per_along << "\n";
+  out << report.num_points << " " << report.max_pixel_error << " "
+      << report.mean_pixel_error << " " << report.max_angle_error << " "
+      << report.max_center_error << "\n";
+
+  out << m_knot_lines.size() << "\n";
+  for ( size_t k = 0; k < m_knot_lines.size(); k++ ) {
+    Quat const& q = m_poses[k];
+    out << m_knot_lines[k] << " " << m_times[k] << " "
+        << m_centers[k][0] << " " << m_centers[k][1] << " " << m_centers[k][2] << " "
+        << q.w() << " " << q.x() << " " << q.y() << " " << q.z() << " "
+        << m_sun_positions[k][0] << " " << m_sun_positions[k][1] << " "
+        << m_sun_positions[k][2] << "\n";
+  }
+
+  out << m_looks.size() << "\n";
+  for ( size_t s = 0; s < m_looks.size(); s++ )
+    out << m_looks[s][0] << " " << m_looks[s][1] << " " << m_looks[s][2] << " "
+        << m_along[s] << " " << m_cross[s] << "\n";
+
+  if ( !out )
+    vw_throw( IOErr() << "IsisTabulatedLineScanModel: Failed writing " << filename << "." );
+}
+
+IsisTabulatedLineScanModel::ValidationReport
+IsisTabulatedLineScanModel::read( std::string const& filename ) {
+  std::ifstream in( filename.c_str() );
+  std::string magic;
+  int version = 0;
+  in >> magic >> version;
+  if ( !in || magic != tabulated_magic || version != tabulated_version )
+    vw_throw( IOErr() << "IsisTabulatedLineScanModel: " << filename
+              << " is not a tabulated camera file." );
+  in >> std::ws;
+  std::getline( in, m_serial_number );
+
+  ValidationReport report;
+  in >> m_lines >> m_samples
+     >> m_target_radii[0] >> m_target_radii[1] >> m_target_radii[2]
+     >> m_along_axis >> m_along_increasing >> m_pixels_per_along
+     >> report.num_points >> report.max_pixel_error >> report.mean_pixel_error
+     >> report.max_angle_error >> report.max_center_error;
+
+  size_t num_knots = 0;
+  in >> num_knots;
+  m_knot_lines.resize( num_knots );
+  m_times.resize( num_knots );
+  m_centers.resize( num_knots );
+  m_poses.resize( num_knots );
+  m_sun_positions.resize( num_knots );
+  for ( size_t k = 0; k < num_knots && in; k++ ) {
+    double w, x, y, z;
+    in >> m_knot_lines[k] >> m_times[k]
+       >> m_centers[k][0] >> m_centers[k][1] >> m_centers[k][2]
+       >> w >> x >> y >> z
+       >> m_sun_positions[k][0] >> m_sun_positions[k][1] >> m_sun_positions[k][2];
+    m_poses[k] = Quat( w, x, y, z );
+  }
+
+  size_t num_looks = 0;
+  in >> num_looks;
+  m_looks.resize( num_looks );
+  m_along.resize( num_looks );
+  m_cross.resize( num_looks );
+  for ( size_t s = 0; s < num_looks && in; s++ )
+    in >> m_looks[s][0] >> m_looks[s][1] >> m_looks[s][2] >> m_along[s] >> m_cross[s];
+
+  if ( !in || num_knots < 2 || num_looks < 2 )
+    vw_throw( IOErr() << "IsisTabulatedLineScanModel: Failed reading " << filename << "." );
+
+  return report;
+}
@@ -0,0 +1,171 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file IsisTabulatedLineScanModel.h
+///
+/// An immutable snapshot of an ISIS line scan camera.
+///
+/// The ISIS camera classes keep their state (current time, current
+/// detector location) inside the Isis::Camera object, so even the
+/// const methods of IsisCameraModel modify it and the model cannot
+/// be shared between threads. This model samples the ISIS ephemeris,
+/// pose and the detector look directions once at construction and
+/// afterwards never touches ISIS again. All methods are then
+/// reentrant and the model can be used by the multi-threaded writers
+/// in stereo_tri and mapproject, in the spirit of LinescanDGModel.
+///
+#ifndef __VW_CAMERAMODEL_ISIS_TABULATED_LINESCAN_H__
+#define __VW_CAMERAMODEL_ISIS_TABULATED_LINESCAN_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/Quaternion.h>
+#include <vw/Math/LevenbergMarquardt.h>
+#include <vw/Camera/CameraModel.h>
+
+#include <string>
+#include <vector>
+
+namespace vw {
+namespace camera {
+
+  class IsisTabulatedLineScanModel : public CameraModel {
+
+  public:
+    //------------------------------------------------------------------
+    // Constructors / Destructors
+    //------------------------------------------------------------------
+
+    // Sample the camera in the given cube every 'line_step' lines.
+    // Throws NoImplErr if the cube is not an unprojected line scan
+    // image.
+    IsisTabulatedLineScanModel( std::string const& cube_filename,
+                                double line_step = 1.0 );
+
+    // An empty model, to be filled by read()
+    IsisTabulatedLineScanModel();
+
+    virtual ~IsisTabulatedLineScanModel() {}
+    virtual std::string type() const { return "IsisTabulatedLineScan"; }
+
+    //------------------------------------------------------------------
+    // Methods
+    //------------------------------------------------------------------
+    virtual Vector2 point_to_pixel ( Vector3 const& point ) const;
+    virtual Vector3 pixel_to_vector( Vector2 const& pix   ) const;
+    virtual Vector3 camera_center  ( Vector2 const& pix = Vector2() ) const;
+    virtual Quat    camera_pose    ( Vector2 const& pix = Vector2() ) const;
+
+    // Same accessors as IsisCameraModel
+    int lines()   const { return m_lines;   }
+    int samples() const { return m_samples; }
+    std::string serial_number() const { return m_serial_number; }
+    double ephemeris_time( Vector2 const& pix = Vector2() ) const;
+    Vector3 sun_position ( Vector2 const& pix = Vector2() ) const;
+    Vector3 target_radii() const { return m_target_radii; }
+
+    // Accuracy of this snapshot versus the camera it was sampled
+    // from. The angle error is in radians, the center error in meters
+    // and the pixel error is the distance between a grid pixel and
+    // the reprojection by this model of the ground point seen by the
+    // reference camera at that pixel.
+    struct ValidationReport {
+      int    num_points;
+      double max_pixel_error, mean_pixel_error;
+      double max_angle_error, max_center_error;
+      ValidationReport() : num_points(0), max_pixel_error(0), mean_pixel_error(0),
+                           max_angle_error(0), max_center_error(0) {}
+    };
+
+    // Compare against 'reference' on a grid_size x grid_size pixel
+    // grid. The reference camera is only used from the calling thread.
+    ValidationReport validate( CameraModel const& reference,
+                               int grid_size = 10 ) const;
+
+    // Save the tables together with their validation, so that other
+    // processes can use this model without sampling and validating
+    // the ISIS camera again.
+    void write( std::string const& filename,
+                ValidationReport const& report ) const;
+
+    // Load the tables saved by write() and return their validation.
+    // Throws IOErr if the file cannot be parsed.
+    ValidationReport read( std::string const& filename );
+
+  protected:
+
+    // Position in the table of knots for line 'line'. Lines outside
+    // of the image get the end interval and an alpha outside [0, 1].
+    void line_knot( double line, size_t& index, double& alpha ) const;
+
+    // Detector sample whose look direction has the given focal plane
+    // coordinate along the detector.
+    double sample_from_along( double along ) const;
+
+    // Cross-detector focal plane coordinate of the detector at a
+    // fractional sample.
+    double cross_at_sample( double sample ) const;
+
+    // Per line data
+    std::vector<double>  m_knot_lines;  // 0-based line of each knot
+    std::vector<Vector3> m_centers;     // meters, body fixed
+    std::vector<Quat>    m_poses;       // camera to body fixed
+    std::vector<double>  m_times;       // ephemeris time
+    std::vector<Vector3> m_sun_positions;
+
+    // Per sample data. The look directions are in the camera frame,
+    // with distortion removed, and tabulated at integer samples.
+    std::vector<Vector3> m_looks;
+    std::vector<double>  m_along, m_cross; // Focal plane coordinates of m_looks
+    int    m_along_axis;                   // 0 or 1, focal plane axis along the detector
+    bool   m_along_increasing;
+    double m_pixels_per_along;             // Detector pixels per unit of m_along
+
+    int m_lines, m_samples;
+    std::string m_serial_number;
+    Vector3 m_target_radii;
+
+    // Levenberg Marquardt solver for the line in which a point is
+    // seen. The error is the cross-detector distance, in pixels,
+    // between the point and the detector.
+    class LineLMA : public math::LeastSquaresModelBase<LineLMA> {
+      const IsisTabulatedLineScanModel* m_model;
+      Vector3 m_point;
+    public:
+      typedef Vector<double> result_type;
+      typedef Vector<double> domain_type;
+      typedef Matrix<double> jacobian_type;
+
+      LineLMA( const IsisTabulatedLineScanModel* model, Vector3 const& point ) :
+        m_model(model), m_point(point) {}
+
+      result_type operator()( domain_type const& line ) const;
+    };
+  };
+
+  // IOstream interface
+  // ---------------------------------------------
+  inline std::ostream& operator<<( std::ostream& os,
+                                   IsisTabulatedLineScanModel const& i ) {
+    os << "IsisTabulatedLineScanModel" << i.lines() << "x" << i.samples()
+       << "( Serial=" << i.serial_number() << " )";
+    return os;
+  }
+
+}}
+
+#endif//__VW_CAMERAMODEL_ISIS_TABULATED_LINESCAN_H__
@@ -0,0 +1,88 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+
+#include <vw/Image/ImageView.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <asp/IsisIO/DiskImageResourceIsis.h>
+
+using namespace vw;
+
+TEST(DiskImageResourceIsis, native_layout) {
+  DiskImageResourceIsis rsrc("E1701676.reduce.cub");
+
+  Vector2i native = rsrc.native_block_size();
+  Vector2i block  = rsrc.block_read_size();
+  EXPECT_GT( native.x(), 0 );
+  EXPECT_GT( native.y(), 0 );
+  if ( rsrc.is_tiled() ) {
+    // Blocks are made of whole native tiles, except at the image edge
+    EXPECT_TRUE( block.x() % native.x() == 0 || block.x() == rsrc.cols() );
+    EXPECT_TRUE( block.y() % native.y() == 0 || block.y() == rsrc.rows() );
+  } else {
+    EXPECT_EQ( rsrc.cols(), native.x() );
+    EXPECT_EQ( 1, native.y() );
+    EXPECT_EQ( rsrc.cols(), block.x() );
+  }
+}
+
+TEST(DiskImageResourceIsis, write_and_read) {
+  UnlinkName filename( "TestDiskImageResourceIsis.cub" );
+
+  ImageView<float> image(300, 200, 2);
+  for ( int p = 0; p < image.planes(); p++ )
+    for ( int r = 0; r < image.rows(); r++ )
+      for ( int c = 0; c < image.cols(); c++ )
+        image(c,r,p) = c + 0.5*r + 1000*p;
+
+  {
+    DiskImageResourceIsis rsrc( filename, image.format() );
+    EXPECT_TRUE( rsrc.is_tiled() );
+    write_image( rsrc, image );
+  }
+
+  DiskImageResourceIsis rsrc( filename );
+  EXPECT_EQ( 300, rsrc.cols()   );
+  EXPECT_EQ( 200, rsrc.rows()   );
+  EXPECT_EQ( 2,   rsrc.planes() );
+  EXPECT_EQ( VW_CHANNEL_FLOAT32, rsrc.channel_type() );
+
+  ImageView<float> result;
+  read_image( result, rsrc );
+  ASSERT_EQ( image.planes(), result.planes() );
+  for ( int p = 0; p < image.planes(); p++ )
+    for ( int r = 0; r < image.rows(); r++ )
+      for ( int c = 0; c < image.cols(); c++ )
+        EXPECT_EQ( image(c,r,p), result(c,r,p) );
+
+  // Reading of a sub-block, through a reused portal
+  ImageView<float> sub(50, 40, 2);
+  rsrc.read( sub.buffer(), BBox2i(10, 20, 50, 40) );
+  rsrc.read( sub.buffer(), BBox2i(10, 20, 50, 40) );
+  EXPECT_EQ( image(10,20,1), sub(0,0,1) );
+  EXPECT_EQ( image(59,59,0), sub(49,39,0) );
+}
+
+TEST(DiskImageResourceIsis, reject_32_bit_integers) {
+  UnlinkName filename( "TestDiskImageResourceIsisInt.cub" );
+  EXPECT_THROW( DiskImageResourceIsis( filename, ImageView<uint32>(10, 10).format() ),
+                NoImplErr );
+  EXPECT_THROW( DiskImageResourceIsis( filename, ImageView<int32>(10, 10).format() ),
+                NoImplErr );
+}
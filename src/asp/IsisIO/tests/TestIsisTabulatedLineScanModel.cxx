@@ -0,0 +1,109 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+
+#include <vw/Math/Vector.h>
+#include <asp/IsisIO/IsisCameraModel.h>
+#include <asp/IsisIO/IsisTabulatedLineScanModel.h>
+
+using namespace vw;
+using namespace vw::camera;
+
+Vector2 generate_random( int const& xsize,
+                         int const& ysize ) {
+  Vector2 pixel;
+  pixel[0] = rand() % ( 10 * xsize - 10 ) + 10;
+  pixel[0] /= 10.0;
+  pixel[1] = rand() % ( 10 * ysize - 10 ) + 10;
+  pixel[1] /= 10.0;
+  return pixel;
+}
+
+TEST(IsisTabulatedLineScanModel, matches_isis) {
+  std::string cube("E1701676.reduce.cub"); // Linescan
+  IsisCameraModel isis_cam( cube );
+  IsisTabulatedLineScanModel tab_cam( cube );
+
+  EXPECT_EQ( isis_cam.lines(),   tab_cam.lines()   );
+  EXPECT_EQ( isis_cam.samples(), tab_cam.samples() );
+  EXPECT_EQ( isis_cam.serial_number(), tab_cam.serial_number() );
+  EXPECT_VECTOR_NEAR( isis_cam.target_radii(), tab_cam.target_radii(), 1e-6 );
+
+  srand( 42 );
+  for ( size_t i = 0; i < 20; i++ ) {
+    Vector2 pixel = generate_random( isis_cam.samples(),
+                                     isis_cam.lines() );
+    EXPECT_VECTOR_NEAR( isis_cam.camera_center( pixel ),
+                        tab_cam.camera_center( pixel ), 1e-2 );
+    EXPECT_VECTOR_NEAR( isis_cam.pixel_to_vector( pixel ),
+                        tab_cam.pixel_to_vector( pixel ), 1e-6 );
+
+    // Circle check through the tabulated model only
+    Vector3 point = tab_cam.camera_center( pixel ) +
+      70000 * tab_cam.pixel_to_vector( pixel );
+    EXPECT_VECTOR_NEAR( pixel, tab_cam.point_to_pixel( point ), 1e-2 );
+
+    // And against the point seen by ISIS
+    point = isis_cam.camera_center( pixel ) +
+      70000 * isis_cam.pixel_to_vector( pixel );
+    EXPECT_VECTOR_NEAR( isis_cam.point_to_pixel( point ),
+                        tab_cam.point_to_pixel( point ), 2e-2 );
+  }
+
+  IsisTabulatedLineScanModel::ValidationReport report =
+    tab_cam.validate( isis_cam );
+  EXPECT_GT( report.num_points, 0 );
+  EXPECT_LT( report.max_pixel_error, 2e-2 );
+  EXPECT_LT( report.max_angle_error, 1e-6 );
+}
+
+TEST(IsisTabulatedLineScanModel, rejects_frame) {
+  EXPECT_THROW( IsisTabulatedLineScanModel( "5165r.cub" ), NoImplErr );
+}
+
+TEST(IsisTabulatedLineScanModel, write_read) {
+  std::string cube("E1701676.reduce.cub");
+  IsisCameraModel isis_cam( cube );
+  IsisTabulatedLineScanModel tab_cam( cube );
+  IsisTabulatedLineScanModel::ValidationReport report = tab_cam.validate( isis_cam );
+
+  UnlinkName file( "E1701676.reduce.tabcam" );
+  tab_cam.write( file, report );
+  IsisTabulatedLineScanModel loaded;
+  IsisTabulatedLineScanModel::ValidationReport loaded_report = loaded.read( file );
+
+  EXPECT_EQ( report.num_points, loaded_report.num_points );
+  EXPECT_EQ( report.max_pixel_error, loaded_report.max_pixel_error );
+  EXPECT_EQ( tab_cam.lines(),   loaded.lines()   );
+  EXPECT_EQ( tab_cam.samples(), loaded.samples() );
+  EXPECT_EQ( tab_cam.serial_number(), loaded.serial_number() );
+
+  srand( 7 );
+  for ( size_t i = 0; i < 10; i++ ) {
+    Vector2 pixel = generate_random( tab_cam.samples(), tab_cam.lines() );
+    EXPECT_VECTOR_NEAR( tab_cam.camera_center( pixel ),
+                        loaded.camera_center( pixel ), 1e-6 );
+    EXPECT_VECTOR_NEAR( tab_cam.pixel_to_vector( pixel ),
+                        loaded.pixel_to_vector( pixel ), 1e-12 );
+    Vector3 point = tab_cam.camera_center( pixel ) +
+      70000 * tab_cam.pixel_to_vector( pixel );
+    EXPECT_VECTOR_NEAR( tab_cam.point_to_pixel( point ),
+                        loaded.point_to_pixel( point ), 1e-6 );
+  }
+}
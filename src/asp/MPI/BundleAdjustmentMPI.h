@@ -18,37 +18,145 @@
 
 /// \file BundleAdjustmentMPI.h
 ///
-/// Header to define MPI interactions
+/// Header to define MPI interactions. The equations each process
+/// computes are in BundleAdjustmentMPIRank.h, and the messages that
+/// solve them in BundleAdjustmentMPIProtocol.h.
 
 #ifndef __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_H__
 #define __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_H__
 
-#include <boost/mpi.hpp>
 #include <iostream>
-#include <boost/serialization/string.hpp>
-namespace mpi = boost::mpi;
-#include <boost/foreach.hpp>
+#include <boost/filesystem/path.hpp>
 
 #include <asp/IsisIO/IsisAdjustCameraModel.h>
+#include <asp/IsisIO/PolyEquation.h>
+#include <asp/IsisIO/Equation.h>
+#include <asp/MPI/BundleAdjustmentMPIProtocol.h>
 
-enum MPISlaveTask {
-  LoadCameraModels,
-  LoadControlNetwork,
-  SolveJacobian,
-  SolveUpdateError,
-  Finish
+#include <exception>
+#include <fstream>
+
+// What a camera proxy of the master asks the slave owning the camera
+enum MPICameraRequest {
+  MPIPointToPixel,
+  MPIPixelToVector,
+  MPICameraCenter
 };
 
 namespace vw {
 namespace camera {
 
-  class MPISlave {
+  // Tag of the point to point messages of the camera requests
+  const int MPI_CAMERA_REQUEST_TAG = 1;
+
+  class MPISlave : public MPIProjection {
     mpi::communicator & m_world;
-    std::vector<boost::shared_ptr<CameraModel> > m_cameras;
-    unsigned m_camera_start;
+    std::vector<std::string> m_camera_files;
+    std::vector<boost::shared_ptr<IsisAdjustCameraModel> > m_cameras;
+    unsigned m_camera_start, m_camera_end;
+    size_t m_num_cameras;
+    MPIEquationSlave m_equations;
+
+    static double& camera_parameter( IsisAdjustCameraModel & cam, unsigned n ) {
+      size_t pos_size = cam.position_func()->size();
+      if ( n < pos_size )
+        return (*cam.position_func())[n];
+      return (*cam.pose_func())[n-pos_size];
+    }
+
+    IsisAdjustCameraModel & camera( unsigned j ) {
+      VW_ASSERT( j >= m_camera_start && j < m_camera_end,
+                 LogicErr() << "MPISlave: camera " << j << " is not owned by slave "
+                 << m_world.rank() << "." );
+      return *m_cameras[j-m_camera_start];
+    }
+
+    void load_camera_models() {
+      broadcast(m_world, m_camera_files, 0);
+      m_num_cameras = m_camera_files.size();
+      m_equations.set_num_cameras( m_num_cameras );
+      mpi_camera_range( m_world.rank(), m_world.size(), m_num_cameras,
+                        m_camera_start, m_camera_end );
+      m_cameras.clear();
+      std::vector<std::string> serials;
+      std::vector<double> a;
+      for ( unsigned i = m_camera_start; i < m_camera_end; i++ ) {
+        vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
+                                         << " : Loading "
+                                         << m_camera_files[i] << "\n";
+        boost::shared_ptr<asp::BaseEquation> posF( new asp::PolyEquation(0) );
+        boost::shared_ptr<asp::BaseEquation> poseF( new asp::PolyEquation(0) );
+        m_cameras.push_back( boost::shared_ptr<IsisAdjustCameraModel>( new IsisAdjustCameraModel( m_camera_files[i],
+                                                                                                  posF, poseF )));
+        serials.push_back( m_cameras.back()->serial_number() );
+        for ( unsigned n = 0; n < MPI_CAMERA_PARAMS; n++ )
+          a.push_back( camera_parameter( *m_cameras.back(), n ) );
+      }
+      mpi::gather( m_world, serials, 0 );
+      mpi::gather( m_world, a, 0 );
+    }
+
+    // Answer the camera requests of the master until it sends an
+    // empty one. A request that fails gets an empty reply.
+    void serve_camera_requests() {
+      std::vector<double> request, reply;
+      while ( true ) {
+        m_world.recv( 0, MPI_CAMERA_REQUEST_TAG, request );
+        if ( request.empty() )
+          break;
+        reply.clear();
+        try {
+          IsisAdjustCameraModel & cam = camera( unsigned(request[1]) );
+          if ( int(request[0]) == MPIPointToPixel ) {
+            Vector2 pixel = cam.point_to_pixel( Vector3( request[2], request[3], request[4] ) );
+            reply.assign( pixel.begin(), pixel.end() );
+          } else {
+            Vector2 pixel( request[2], request[3] );
+            Vector3 result = int(request[0]) == MPICameraCenter ?
+              cam.camera_center( pixel ) : cam.pixel_to_vector( pixel );
+            reply.assign( result.begin(), result.end() );
+          }
+        } catch ( const Exception& e ) {
+          VW_OUT(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
+                                           << " : Camera request failed: " << e.what() << "\n";
+          reply.clear();
+        }
+        m_world.send( 0, MPI_CAMERA_REQUEST_TAG, reply );
+      }
+    }
+
+    // Each slave writes the .isis_adjust files of its cameras
+    void write_adjustments() {
+      std::vector<double> a;
+      broadcast(m_world, a, 0);
+      for ( unsigned j = m_camera_start; j < m_camera_end; j++ ) {
+        IsisAdjustCameraModel & cam = camera( j );
+        for ( unsigned n = 0; n < MPI_CAMERA_PARAMS; n++ )
+          camera_parameter( cam, n ) = a[j*MPI_CAMERA_PARAMS+n];
+        std::string filename =
+          boost::filesystem::path( m_camera_files[j] ).replace_extension("isis_adjust").string();
+        std::ofstream ostr( filename.c_str() );
+        asp::write_equation( ostr, cam.position_func() );
+        asp::write_equation( ostr, cam.pose_func() );
+      }
+    }
 
   public:
-    MPISlave( mpi::communicator & world) : m_world(world) {
+    // Projection by one of our cameras, with its position and pose
+    // equations set to 'a_j'
+    Vector2 operator()( unsigned j, Vector<double,MPI_CAMERA_PARAMS> const& a_j,
+                        Vector<double,MPI_POINT_PARAMS> const& b_i ) {
+      IsisAdjustCameraModel & cam = camera( j );
+      for ( unsigned n = 0; n < MPI_CAMERA_PARAMS; n++ )
+        camera_parameter( cam, n ) = a_j[n];
+      return cam.point_to_pixel( b_i );
+    }
+
+    // Serves the master until it sends Finish. An exception leaves
+    // the master waiting, so the caller must abort the communicator.
+    MPISlave( mpi::communicator & world) : m_world(world), m_camera_start(0),
+                                           m_camera_end(0), m_num_cameras(0),
+                                           m_equations(world) {
       vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
                                        << " : Starting\n";
       int task;
@@ -57,38 +165,170 @@ namespace camera {
         if ( task == LoadCameraModels ) {
           vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
                                            << " : Loading Camera Models\n";
-          m_cameras.resize(0);
-          std::vector<std::string> camera_files;
-          broadcast(m_world, camera_files, 0);
-          m_camera_start = (m_world.rank()-1)*float(camera_files.size())/float(m_world.size()-1);
-          unsigned cam_e = m_world.rank()*float(camera_files.size())/float(m_world.size()-1);
-          for ( unsigned i = m_camera_start; i < cam_e; i++ ) {
-            vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
-                                             << " : Loading "
-                                             << camera_files[i] << "\n";
-            boost::shared_ptr<asp::BaseEquation> posF( new asp::PolyEquation(0) );
-            boost::shared_ptr<asp::BaseEquation> poseF( new asp::PolyEquation(0) );
-            m_cameras.push_back( boost::shared_ptr<IsisAdjustCameraModel>( new IsisAdjustCameraModel( camera_files[i],
-                                                                                                      posF, poseF )));
-          }
-        } else if ( task == LoadControlNetwork ) {
-          vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
-                                           << " : Loading Control Network\n";
-        } else if ( task == SolveJacobian ) {
-          vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
-                                           << " : Solving Jacobian\n";
-        } else if ( task == SolveUpdateError ) {
-          vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
-                                           << " : Solving Update Error\n";
+          load_camera_models();
+        } else if ( task == ServeCameraRequests ) {
+          serve_camera_requests();
+        } else if ( task == WriteAdjustments ) {
+          write_adjustments();
         } else if ( task == Finish ) {
           vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
                                            << " : Finished\n";
           break;
+        } else {
+          m_equations.handle( task, *this );
         }
       }
     }
   };
 
+  class MPIMaster;
+
+  // A camera of a slave, as seen by the master while the slaves
+  // serve camera requests. Each call is a round trip to the slave.
+  class MPICameraProxy : public CameraModel {
+    MPIMaster & m_master;
+    unsigned m_camera;
+  public:
+    MPICameraProxy( MPIMaster & master, unsigned camera ) :
+      m_master(master), m_camera(camera) {}
+    virtual ~MPICameraProxy() {}
+    virtual std::string type() const { return "MPIProxy"; }
+
+    virtual Vector2 point_to_pixel( Vector3 const& point ) const;
+    virtual Vector3 pixel_to_vector( Vector2 const& pix ) const;
+    virtual Vector3 camera_center( Vector2 const& pix = Vector2() ) const;
+  };
+
+  // The master side of the protocol spoken by MPISlave, adding the
+  // camera tasks to those of the equations. Every method is collective
+  // with the slaves. The master holds no camera.
+  class MPIMaster : public MPIEquationMaster {
+    std::vector<int> m_camera_owner;
+    bool m_serving;
+
+  public:
+    MPIMaster( mpi::communicator & world ) : MPIEquationMaster(world), m_serving(false) {}
+
+    // Lets the slaves return, unless an exception unwinds us, when
+    // they may be in the middle of a task. The caller must then abort
+    // the communicator.
+    ~MPIMaster() {
+      if ( !std::uncaught_exception() )
+        finish();
+    }
+
+    // Each slave loads its share of the cameras. Returns the serial
+    // numbers and the starting parameters of all the cameras.
+    void load_camera_models( std::vector<std::string> const& camera_files,
+                             std::vector<std::string> & serials,
+                             std::vector<double> & a ) {
+      send_task( LoadCameraModels );
+      std::vector<std::string> files = camera_files;
+      broadcast(m_world, files, 0);
+      m_num_cameras = files.size();
+
+      m_camera_owner.assign( m_num_cameras, 0 );
+      for ( int rank = 1; rank < m_world.size(); rank++ ) {
+        unsigned begin, end;
+        mpi_camera_range( rank, m_world.size(), m_num_cameras, begin, end );
+        for ( unsigned j = begin; j < end; j++ )
+          m_camera_owner[j] = rank;
+      }
+
+      std::vector<std::vector<std::string> > all_serials;
+      std::vector<std::vector<double> > all_a;
+      mpi::gather( m_world, std::vector<std::string>(), all_serials, 0 );
+      mpi::gather( m_world, std::vector<double>(), all_a, 0 );
+      serials.clear();
+      a.clear();
+      for ( int rank = 1; rank < m_world.size(); rank++ ) {
+        serials.insert( serials.end(), all_serials[rank].begin(), all_serials[rank].end() );
+        a.insert( a.end(), all_a[rank].begin(), all_a[rank].end() );
+      }
+      VW_ASSERT( serials.size() == m_num_cameras &&
+                 a.size() == m_num_cameras*MPI_CAMERA_PARAMS,
+                 LogicErr() << "MPIMaster: the slaves did not load every camera." );
+    }
+
+    // Cameras that forward their calls to the slaves, for building
+    // and triangulating the control network. They only work between
+    // start_camera_requests() and finish_camera_requests().
+    std::vector<boost::shared_ptr<CameraModel> > camera_proxies() {
+      std::vector<boost::shared_ptr<CameraModel> > cameras;
+      for ( unsigned j = 0; j < m_num_cameras; j++ )
+        cameras.push_back( boost::shared_ptr<CameraModel>( new MPICameraProxy( *this, j ) ) );
+      return cameras;
+    }
+
+    void start_camera_requests() {
+      send_task( ServeCameraRequests );
+      m_serving = true;
+    }
+
+    void finish_camera_requests() {
+      if ( !m_serving )
+        return;
+      for ( int rank = 1; rank < m_world.size(); rank++ )
+        m_world.send( rank, MPI_CAMERA_REQUEST_TAG, std::vector<double>() );
+      m_serving = false;
+    }
+
+    // One of MPICameraRequest for camera j. Returns an empty vector
+    // if the slave failed.
+    std::vector<double> camera_request( int kind, unsigned j, Vector3 const& input ) {
+      VW_ASSERT( m_serving,
+                 LogicErr() << "MPIMaster: camera request outside of start_camera_requests()." );
+      VW_ASSERT( j < m_num_cameras, ArgumentErr() << "MPIMaster: unknown camera " << j << "." );
+      std::vector<double> request( 5 ), reply;
+      request[0] = kind;
+      request[1] = j;
+      std::copy( input.begin(), input.end(), request.begin() + 2 );
+      m_world.send( m_camera_owner[j], MPI_CAMERA_REQUEST_TAG, request );
+      m_world.recv( m_camera_owner[j], MPI_CAMERA_REQUEST_TAG, reply );
+      return reply;
+    }
+
+    // The slaves write the .isis_adjust file of each of their
+    // cameras, next to the camera, with parameters 'a'.
+    void write_adjustments( std::vector<double> const& a ) {
+      VW_ASSERT( a.size() == m_num_cameras*MPI_CAMERA_PARAMS,
+                 ArgumentErr() << "MPIMaster: wrong number of parameters." );
+      send_task( WriteAdjustments );
+      std::vector<double> a_copy = a;
+      broadcast(m_world, a_copy, 0);
+    }
+
+    void finish() {
+      if ( m_finished )
+        return;
+      finish_camera_requests();
+      MPIEquationMaster::finish();
+    }
+  };
+
+  inline Vector2 MPICameraProxy::point_to_pixel( Vector3 const& point ) const {
+    std::vector<double> reply = m_master.camera_request( MPIPointToPixel, m_camera, point );
+    if ( reply.size() != 2 )
+      vw_throw( PointToPixelErr() << "MPICameraProxy: point_to_pixel failed on the slave." );
+    return Vector2( reply[0], reply[1] );
+  }
+
+  inline Vector3 MPICameraProxy::pixel_to_vector( Vector2 const& pix ) const {
+    std::vector<double> reply =
+      m_master.camera_request( MPIPixelToVector, m_camera, Vector3( pix[0], pix[1], 0 ) );
+    if ( reply.size() != 3 )
+      vw_throw( PixelToRayErr() << "MPICameraProxy: pixel_to_vector failed on the slave." );
+    return Vector3( reply[0], reply[1], reply[2] );
+  }
+
+  inline Vector3 MPICameraProxy::camera_center( Vector2 const& pix ) const {
+    std::vector<double> reply =
+      m_master.camera_request( MPICameraCenter, m_camera, Vector3( pix[0], pix[1], 0 ) );
+    if ( reply.size() != 3 )
+      vw_throw( PixelToRayErr() << "MPICameraProxy: camera_center failed on the slave." );
+    return Vector3( reply[0], reply[1], reply[2] );
+  }
+
 }}
 
 #endif//__ASP_MPI_BUNDLE_ADJUSTMENT_MPI_H__
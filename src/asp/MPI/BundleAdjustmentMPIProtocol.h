@@ -0,0 +1,301 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BundleAdjustmentMPIProtocol.h
+///
+/// The messages by which the master and the slaves of an MPI bundle
+/// adjustment solve the normal equations, independent of the cameras.
+/// BundleAdjustmentMPI.h adds the loading of ISIS cameras on top.
+
+#ifndef __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_PROTOCOL_H__
+#define __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_PROTOCOL_H__
+
+#include <boost/mpi.hpp>
+#include <functional>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+namespace mpi = boost::mpi;
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
+#include <asp/MPI/BundleAdjustmentMPIRank.h>
+
+enum MPISlaveTask {
+  LoadCameraModels,
+  LoadControlNetwork,
+  ServeCameraRequests,
+  SolveJacobian,
+  SolveSchur,
+  SolvePoints,
+  SolveUpdateError,
+  WriteAdjustments,
+  Finish
+};
+
+namespace vw {
+namespace camera {
+
+  // The slave side of the equation tasks. The cameras are seen
+  // through the projection given to handle().
+  class MPIEquationSlave {
+    mpi::communicator & m_world;
+    size_t m_num_cameras;
+    boost::scoped_ptr<MPIRankEquations> m_equations;
+
+    void load_control_network() {
+      int cost;
+      double threshold;
+      std::vector<MPIMeasure> measures;
+      broadcast(m_world, cost, 0);
+      broadcast(m_world, threshold, 0);
+      mpi::scatter( m_world, measures, 0 );
+      m_equations.reset( new MPIRankEquations( m_world.rank(), m_world.size(),
+                                               m_num_cameras, measures,
+                                               cost, threshold ) );
+      vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
+                                       << " : Owns " << m_equations->num_camera_measures()
+                                       << " measures and " << m_equations->num_points()
+                                       << " points\n";
+    }
+
+    // Residuals and jacobians of the measures of our cameras. The
+    // terms of the points go to their owners, U and epsilon_a of our
+    // cameras to the master.
+    void solve_jacobian( MPIProjection & project ) {
+      std::vector<double> a, b;
+      broadcast(m_world, a, 0);
+      broadcast(m_world, b, 0);
+
+      std::vector<double> camera_terms;
+      std::vector<std::vector<double> > sent, received;
+      double error_total = m_equations->jacobian( project, a, b, camera_terms, sent );
+      mpi::all_to_all( m_world, sent, received );
+      double max_point_diagonal = m_equations->receive_point_terms( received );
+
+      mpi::gather( m_world, camera_terms, 0 );
+      mpi::reduce( m_world, error_total, std::plus<double>(), 0 );
+      mpi::reduce( m_world, max_point_diagonal, mpi::maximum<double>(), 0 );
+    }
+
+    void solve_schur() {
+      double lambda;
+      std::vector<MPIPointConstraint> constraints;
+      broadcast(m_world, lambda, 0);
+      broadcast(m_world, constraints, 0);
+      MPISchurTerms result;
+      m_equations->schur( lambda, constraints, result );
+      mpi::gather( m_world, result, 0 );
+    }
+
+    void solve_points() {
+      std::vector<double> delta_a;
+      broadcast(m_world, delta_a, 0);
+      MPIPointUpdate result;
+      m_equations->back_substitute( delta_a, result );
+      mpi::gather( m_world, result, 0 );
+    }
+
+    // Image error for a proposed set of parameters
+    void solve_update_error( MPIProjection & project ) {
+      std::vector<double> a, b;
+      broadcast(m_world, a, 0);
+      broadcast(m_world, b, 0);
+      double error_total = m_equations->error( project, a, b );
+      mpi::reduce( m_world, error_total, std::plus<double>(), 0 );
+    }
+
+  public:
+    MPIEquationSlave( mpi::communicator & world, size_t num_cameras = 0 ) :
+      m_world(world), m_num_cameras(num_cameras) {}
+
+    void set_num_cameras( size_t num_cameras ) { m_num_cameras = num_cameras; }
+
+    // Carry out 'task' if it is one of the equation tasks. Returns
+    // false for the other tasks.
+    bool handle( int task, MPIProjection & project ) {
+      if ( task == LoadControlNetwork ) {
+        vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
+                                         << " : Loading Control Network\n";
+        load_control_network();
+      } else if ( task == SolveJacobian ) {
+        vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
+                                         << " : Solving Jacobian\n";
+        solve_jacobian( project );
+      } else if ( task == SolveSchur ) {
+        solve_schur();
+      } else if ( task == SolvePoints ) {
+        solve_points();
+      } else if ( task == SolveUpdateError ) {
+        vw_out(DebugMessage,"mpi_slave") << "\tSlave " << m_world.rank()
+                                         << " : Solving Update Error\n";
+        solve_update_error( project );
+      } else {
+        return false;
+      }
+      return true;
+    }
+
+    // Serve the equation tasks of the master until it sends Finish
+    void run( MPIProjection & project ) {
+      int task;
+      while ( true ) {
+        broadcast(m_world, task, 0);
+        if ( task == Finish )
+          break;
+        if ( !handle( task, project ) )
+          vw_throw( LogicErr() << "MPIEquationSlave: unexpected task " << task << "." );
+      }
+    }
+  };
+
+  // The master side of the equation tasks. Every method is
+  // collective with the slaves. The master only receives the terms of
+  // the reduced camera system.
+  class MPIEquationMaster : public MPIRanks {
+  protected:
+    mpi::communicator & m_world;
+    size_t m_num_cameras, m_num_points;
+    bool m_finished;
+
+    void send_task( int task ) { broadcast(m_world, task, 0); }
+
+  public:
+    MPIEquationMaster( mpi::communicator & world, size_t num_cameras = 0 ) :
+      m_world(world), m_num_cameras(num_cameras), m_num_points(0), m_finished(false) {
+      VW_ASSERT( m_world.rank() == 0,
+                 LogicErr() << "The MPI master must run on rank 0." );
+      VW_ASSERT( m_world.size() > 1,
+                 ArgumentErr() << "At least one MPI slave process is required." );
+    }
+
+    virtual ~MPIEquationMaster() {}
+
+    // Measures are numbered in the order of iteration over the
+    // control network. Pixel sigmas must be non-zero. Each slave only
+    // receives the measures of its cameras and points.
+    void load_control_network( ba::ControlNetwork const& cnet,
+                               int cost, double threshold ) {
+      std::vector<MPIMeasure> measures;
+      for ( size_t i = 0; i < cnet.size(); i++ ) {
+        BOOST_FOREACH( ba::ControlMeasure const& cm, cnet[i] ) {
+          VW_ASSERT( cm.image_id() >= 0 && size_t(cm.image_id()) < m_num_cameras,
+                     ArgumentErr() << "Control measure refers to an unknown camera." );
+          MPIMeasure m;
+          m.point = i;
+          m.camera = cm.image_id();
+          m.px = cm.dominant()[0];
+          m.py = cm.dominant()[1];
+          m.sigma_x = cm.sigma()[0];
+          m.sigma_y = cm.sigma()[1];
+          measures.push_back( m );
+        }
+      }
+      m_num_points = cnet.size();
+      std::vector<std::vector<MPIMeasure> > partition =
+        mpi_partition_measures( measures, m_world.size(), m_num_cameras );
+      measures.clear();
+
+      send_task( LoadControlNetwork );
+      broadcast(m_world, cost, 0);
+      broadcast(m_world, threshold, 0);
+      std::vector<MPIMeasure> mine;
+      mpi::scatter( m_world, partition, mine, 0 );
+    }
+
+    virtual double solve_jacobian( std::vector<double> const& a,
+                                   std::vector<double> const& b,
+                                   std::vector<double> & camera_terms,
+                                   double & max_point_diagonal ) {
+      VW_ASSERT( a.size() == m_num_cameras*MPI_CAMERA_PARAMS &&
+                 b.size() == m_num_points*MPI_POINT_PARAMS,
+                 ArgumentErr() << "MPIMaster: wrong number of parameters." );
+      send_task( SolveJacobian );
+      std::vector<double> a_copy = a, b_copy = b;
+      broadcast(m_world, a_copy, 0);
+      broadcast(m_world, b_copy, 0);
+
+      // The master owns no point, but takes part in the exchange
+      std::vector<std::vector<double> > sent( m_world.size() ), received;
+      mpi::all_to_all( m_world, sent, received );
+
+      std::vector<std::vector<double> > all_terms;
+      mpi::gather( m_world, std::vector<double>(), all_terms, 0 );
+      camera_terms.clear();
+      for ( int rank = 1; rank < m_world.size(); rank++ )
+        camera_terms.insert( camera_terms.end(), all_terms[rank].begin(),
+                             all_terms[rank].end() );
+
+      double error_total = 0;
+      max_point_diagonal = 0;
+      mpi::reduce( m_world, 0.0, error_total, std::plus<double>(), 0 );
+      mpi::reduce( m_world, 0.0, max_point_diagonal, mpi::maximum<double>(), 0 );
+      return error_total;
+    }
+
+    virtual void solve_schur( double lambda,
+                              std::vector<MPIPointConstraint> const& constraints,
+                              MPISchurTerms & result ) {
+      send_task( SolveSchur );
+      std::vector<MPIPointConstraint> constraints_copy = constraints;
+      broadcast(m_world, lambda, 0);
+      broadcast(m_world, constraints_copy, 0);
+      std::vector<MPISchurTerms> all_terms;
+      mpi::gather( m_world, MPISchurTerms(), all_terms, 0 );
+      result = MPISchurTerms();
+      BOOST_FOREACH( MPISchurTerms const& terms, all_terms )
+        result.append( terms );
+    }
+
+    virtual void solve_points( std::vector<double> const& delta_a,
+                               MPIPointUpdate & result ) {
+      send_task( SolvePoints );
+      std::vector<double> delta_a_copy = delta_a;
+      broadcast(m_world, delta_a_copy, 0);
+      std::vector<MPIPointUpdate> all_updates;
+      mpi::gather( m_world, MPIPointUpdate(), all_updates, 0 );
+      result = MPIPointUpdate();
+      BOOST_FOREACH( MPIPointUpdate const& update, all_updates )
+        result.append( update );
+    }
+
+    virtual double solve_update_error( std::vector<double> const& a,
+                                       std::vector<double> const& b ) {
+      send_task( SolveUpdateError );
+      std::vector<double> a_copy = a, b_copy = b;
+      broadcast(m_world, a_copy, 0);
+      broadcast(m_world, b_copy, 0);
+      double local = 0, total = 0;
+      mpi::reduce( m_world, local, total, std::plus<double>(), 0 );
+      return total;
+    }
+
+    // Let the slaves return
+    void finish() {
+      if ( m_finished )
+        return;
+      send_task( Finish );
+      m_finished = true;
+    }
+  };
+
+}}
+
+#endif//__ASP_MPI_BUNDLE_ADJUSTMENT_MPI_PROTOCOL_H__
@@ -0,0 +1,562 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BundleAdjustmentMPIRank.h
+///
+/// The share of the normal equations of the bundle adjustment that
+/// one MPI process computes, independent of how the processes talk
+/// to each other.
+///
+/// Slave r owns the cameras given by mpi_camera_range() and the
+/// points whose first measure is seen by one of them. For each
+/// measure of its cameras it evaluates the residual and the
+/// jacobians, keeps U and epsilon_a of the camera, and sends W and
+/// the measure's share of V and epsilon_b to the owner of the
+/// point. The owner of a point reduces these to blocks of the Schur
+/// complement S and of its right hand side e, which is all that the
+/// master needs to solve for the camera update, and then back
+/// substitutes the update of the point.
+
+#ifndef __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_RANK_H__
+#define __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_RANK_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/LinearAlgebra.h>
+#include <vw/BundleAdjustment/BundleAdjustmentBase.h>
+
+#include <boost/foreach.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <vector>
+
+// Robust cost functions the slaves know how to apply. These mirror
+// the choices of isis_adjust.
+enum MPIRobustCost {
+  MPIL2Cost,
+  MPIL1Cost,
+  MPIHuberCost,
+  MPIPseudoHuberCost,
+  MPICauchyCost
+};
+
+namespace vw {
+namespace camera {
+
+  // The slaves adjust cameras with PolyEquation(0) position and pose
+  // functions, so each camera has 3 position and 3 pose offsets.
+  const unsigned MPI_CAMERA_PARAMS = 6;
+  const unsigned MPI_POINT_PARAMS = 3;
+
+  // One measure of the control network, flattened so that it can be
+  // sent to the slaves, with the processes owning its camera and its
+  // point.
+  struct MPIMeasure {
+    unsigned index, point, camera;
+    int camera_owner, point_owner;
+    double px, py, sigma_x, sigma_y;
+
+    MPIMeasure() : index(0), point(0), camera(0), camera_owner(0), point_owner(0),
+                   px(0), py(0), sigma_x(1), sigma_y(1) {}
+
+    template <class ArchiveT>
+    void serialize( ArchiveT& ar, const unsigned int /*version*/ ) {
+      ar & index & point & camera & camera_owner & point_owner
+         & px & py & sigma_x & sigma_y;
+    }
+  };
+
+  // Cameras [begin, end) are owned by slave 'rank'. The master is
+  // rank 0 and owns no cameras.
+  inline void mpi_camera_range( int rank, int size, size_t num_cameras,
+                                unsigned& begin, unsigned& end ) {
+    if ( rank == 0 || size < 2 ) {
+      begin = end = 0;
+      return;
+    }
+    begin = unsigned( (rank-1)*float(num_cameras)/float(size-1) );
+    end   = unsigned( rank*float(num_cameras)/float(size-1) );
+    if ( rank == size-1 )
+      end = num_cameras;
+  }
+
+  // Weight to apply to a residual of magnitude 'mag', so that the
+  // squared weighted residual is the robust cost.
+  inline double mpi_robust_weight( int cost, double threshold, double mag ) {
+    if ( mag == 0 )
+      return 1;
+    double robust = mag*mag;
+    switch ( cost ) {
+    case MPIL1Cost:          robust = ba::L1Error()(mag); break;
+    case MPIHuberCost:       robust = ba::HuberError(threshold)(mag); break;
+    case MPIPseudoHuberCost: robust = ba::PseudoHuberError(threshold)(mag); break;
+    case MPICauchyCost:      robust = ba::CauchyError(threshold)(mag); break;
+    default: break;
+    }
+    return sqrt(robust) / mag;
+  }
+
+  // Numbers the measures, which must be ordered by point, sets their
+  // owners and returns the measures each of 'num_ranks' processes
+  // needs: those of its cameras and those of its points.
+  inline std::vector<std::vector<MPIMeasure> >
+  mpi_partition_measures( std::vector<MPIMeasure> & measures, int num_ranks,
+                          size_t num_cameras ) {
+    std::vector<int> camera_owner( num_cameras, 0 );
+    for ( int rank = 1; rank < num_ranks; rank++ ) {
+      unsigned begin, end;
+      mpi_camera_range( rank, num_ranks, num_cameras, begin, end );
+      for ( unsigned j = begin; j < end; j++ )
+        camera_owner[j] = rank;
+    }
+
+    std::vector<std::vector<MPIMeasure> > result( num_ranks );
+    for ( size_t k = 0; k < measures.size(); k++ ) {
+      MPIMeasure & m = measures[k];
+      VW_ASSERT( m.camera < num_cameras,
+                 ArgumentErr() << "Control measure refers to an unknown camera." );
+      VW_ASSERT( k == 0 || measures[k-1].point <= m.point,
+                 ArgumentErr() << "MPI measures must be ordered by point." );
+      m.index = k;
+      m.camera_owner = camera_owner[m.camera];
+      if ( k == 0 || measures[k-1].point != m.point )
+        m.point_owner = m.camera_owner;
+      else
+        m.point_owner = measures[k-1].point_owner;
+      result[m.camera_owner].push_back( m );
+      if ( m.point_owner != m.camera_owner )
+        result[m.point_owner].push_back( m );
+    }
+    return result;
+  }
+
+  // Projection of a point by one of the cameras of a process, for
+  // the given camera parameters.
+  class MPIProjection {
+  public:
+    virtual ~MPIProjection() {}
+    virtual Vector2 operator()( unsigned camera,
+                                Vector<double,MPI_CAMERA_PARAMS> const& a_j,
+                                Vector<double,MPI_POINT_PARAMS> const& b_i ) = 0;
+  };
+
+  // Constraint of a ground control point, added to V and epsilon_b
+  // by the owner of the point.
+  struct MPIPointConstraint {
+    unsigned point;
+    std::vector<double> inverse_cov; // Row major
+    std::vector<double> epsilon;     // Target minus parameters
+
+    MPIPointConstraint() : point(0) {}
+
+    template <class ArchiveT>
+    void serialize( ArchiveT& ar, const unsigned int /*version*/ ) {
+      ar & point & inverse_cov & epsilon;
+    }
+  };
+
+  // What the owners of the points contribute to the reduced camera
+  // system: blocks of S on or below the diagonal and terms of e, the
+  // same block or term possibly several times, in which case they
+  // add up. Also the extremes of epsilon_b for the tolerances.
+  struct MPISchurTerms {
+    std::vector<unsigned> block_cameras; // (j,k) pairs, j >= k
+    std::vector<double> blocks;          // Row major
+    std::vector<unsigned> rhs_cameras;
+    std::vector<double> rhs;
+    double max_g, max_minus_g;
+
+    MPISchurTerms() : max_g( -std::numeric_limits<double>::max() ),
+                      max_minus_g( -std::numeric_limits<double>::max() ) {}
+
+    void append( MPISchurTerms const& other ) {
+      block_cameras.insert( block_cameras.end(), other.block_cameras.begin(),
+                            other.block_cameras.end() );
+      blocks.insert( blocks.end(), other.blocks.begin(), other.blocks.end() );
+      rhs_cameras.insert( rhs_cameras.end(), other.rhs_cameras.begin(),
+                          other.rhs_cameras.end() );
+      rhs.insert( rhs.end(), other.rhs.begin(), other.rhs.end() );
+      max_g = std::max( max_g, other.max_g );
+      max_minus_g = std::max( max_minus_g, other.max_minus_g );
+    }
+
+    template <class ArchiveT>
+    void serialize( ArchiveT& ar, const unsigned int /*version*/ ) {
+      ar & block_cameras & blocks & rhs_cameras & rhs & max_g & max_minus_g;
+    }
+  };
+
+  // Point updates back substituted by the owners of the points, with
+  // their share of |delta|^2 and delta^T g.
+  struct MPIPointUpdate {
+    std::vector<unsigned> points;
+    std::vector<double> delta_b;
+    double delta_b_norm2, delta_b_dot_g;
+
+    MPIPointUpdate() : delta_b_norm2(0), delta_b_dot_g(0) {}
+
+    void append( MPIPointUpdate const& other ) {
+      points.insert( points.end(), other.points.begin(), other.points.end() );
+      delta_b.insert( delta_b.end(), other.delta_b.begin(), other.delta_b.end() );
+      delta_b_norm2 += other.delta_b_norm2;
+      delta_b_dot_g += other.delta_b_dot_g;
+    }
+
+    template <class ArchiveT>
+    void serialize( ArchiveT& ar, const unsigned int /*version*/ ) {
+      ar & points & delta_b & delta_b_norm2 & delta_b_dot_g;
+    }
+  };
+
+  // The processes holding the cameras and the points, as seen from
+  // the master. Every call is collective with them.
+  class MPIRanks {
+  public:
+    virtual ~MPIRanks() {}
+
+    // Image error for parameters 'a' and 'b', which hold
+    // MPI_CAMERA_PARAMS values per camera and MPI_POINT_PARAMS values
+    // per point. 'camera_terms' gets U and epsilon_a of each camera,
+    // row major, and 'max_point_diagonal' the largest diagonal entry
+    // of V.
+    virtual double solve_jacobian( std::vector<double> const& a,
+                                   std::vector<double> const& b,
+                                   std::vector<double> & camera_terms,
+                                   double & max_point_diagonal ) = 0;
+
+    // Terms of the reduced camera system for a damping 'lambda'
+    virtual void solve_schur( double lambda,
+                              std::vector<MPIPointConstraint> const& constraints,
+                              MPISchurTerms & result ) = 0;
+
+    // Point updates for the camera update 'delta_a'
+    virtual void solve_points( std::vector<double> const& delta_a,
+                               MPIPointUpdate & result ) = 0;
+
+    // Image error for the given parameters
+    virtual double solve_update_error( std::vector<double> const& a,
+                                       std::vector<double> const& b ) = 0;
+  };
+
+  // The equations of one process. Calls go in the order jacobian(),
+  // receive_point_terms(), schur() and back_substitute(), as the
+  // later ones use what the earlier ones keep.
+  class MPIRankEquations {
+    typedef Vector<double,MPI_CAMERA_PARAMS> vector_camera;
+    typedef Vector<double,MPI_POINT_PARAMS> vector_point;
+    typedef Matrix<double,MPI_CAMERA_PARAMS,MPI_CAMERA_PARAMS> matrix_camera_camera;
+    typedef Matrix<double,MPI_POINT_PARAMS,MPI_POINT_PARAMS> matrix_point_point;
+    typedef Matrix<double,MPI_CAMERA_PARAMS,MPI_POINT_PARAMS> matrix_camera_point;
+
+    int m_rank, m_num_ranks;
+    unsigned m_camera_begin, m_camera_end;
+    int m_cost;
+    double m_threshold;
+
+    // Measures of our cameras
+    std::vector<MPIMeasure> m_camera_measures;
+
+    // Our points, the measures of point p being
+    // [m_point_measures[p], m_point_measures[p+1]) in m_measures.
+    std::vector<unsigned> m_points;
+    std::vector<size_t> m_point_measures;
+    std::vector<MPIMeasure> m_measures;
+    std::vector<matrix_camera_point> m_W, m_Y;
+    std::vector<matrix_point_point> m_V;
+    std::vector<vector_point> m_epsilon_b;
+
+    static vector_camera camera_parameters( std::vector<double> const& a, unsigned j ) {
+      vector_camera a_j;
+      for ( unsigned n = 0; n < MPI_CAMERA_PARAMS; n++ )
+        a_j[n] = a[j*MPI_CAMERA_PARAMS+n];
+      return a_j;
+    }
+
+    static vector_point point_parameters( std::vector<double> const& b, unsigned i ) {
+      vector_point b_i;
+      for ( unsigned n = 0; n < MPI_POINT_PARAMS; n++ )
+        b_i[n] = b[i*MPI_POINT_PARAMS+n];
+      return b_i;
+    }
+
+    // Weighted residual and inverse pixel covariance of a measure
+    // whose point projects to 'pixel'. Returns its error term.
+    double weighted_error( MPIMeasure const& m, Vector2 const& pixel,
+                           Vector2 & epsilon, Vector2 & inverse_cov ) const {
+      Vector2 unweighted_error = Vector2(m.px,m.py) - pixel;
+      epsilon = unweighted_error *
+        mpi_robust_weight( m_cost, m_threshold, norm_2(unweighted_error) );
+      inverse_cov = Vector2( 1/(m.sigma_x*m.sigma_x), 1/(m.sigma_y*m.sigma_y) );
+      return .5 * ( epsilon[0]*epsilon[0]*inverse_cov[0] +
+                    epsilon[1]*epsilon[1]*inverse_cov[1] );
+    }
+
+  public:
+    // Values sent per measure to the owner of its point: W, and the
+    // measure's share of V and of epsilon_b.
+    static const size_t POINT_TERMS = MPI_CAMERA_PARAMS*MPI_POINT_PARAMS +
+      MPI_POINT_PARAMS*MPI_POINT_PARAMS + MPI_POINT_PARAMS;
+    static const size_t CAMERA_TERMS = MPI_CAMERA_PARAMS*MPI_CAMERA_PARAMS +
+      MPI_CAMERA_PARAMS;
+
+    // 'measures' are those given to 'rank' by mpi_partition_measures()
+    MPIRankEquations( int rank, int num_ranks, size_t num_cameras,
+                      std::vector<MPIMeasure> const& measures,
+                      int cost, double threshold ) :
+      m_rank(rank), m_num_ranks(num_ranks), m_cost(cost), m_threshold(threshold) {
+      mpi_camera_range( rank, num_ranks, num_cameras, m_camera_begin, m_camera_end );
+      BOOST_FOREACH( MPIMeasure const& m, measures ) {
+        if ( m.camera_owner == rank )
+          m_camera_measures.push_back( m );
+        if ( m.point_owner == rank ) {
+          if ( m_points.empty() || m_points.back() != m.point ) {
+            m_points.push_back( m.point );
+            m_point_measures.push_back( m_measures.size() );
+          }
+          m_measures.push_back( m );
+        }
+      }
+      m_point_measures.push_back( m_measures.size() );
+      m_W.resize( m_measures.size() );
+      m_Y.resize( m_measures.size() );
+      m_V.resize( m_points.size() );
+      m_epsilon_b.resize( m_points.size() );
+    }
+
+    size_t num_camera_measures() const { return m_camera_measures.size(); }
+    size_t num_points() const { return m_points.size(); }
+
+    // Residuals and jacobians of the measures of our cameras, the
+    // jacobians being forward differences of the projection. Returns
+    // their image error. 'camera_terms' gets U and epsilon_a of each
+    // of our cameras and 'point_terms[r]' the terms for the points
+    // owned by process r, in the order of the measures.
+    double jacobian( MPIProjection & project,
+                     std::vector<double> const& a, std::vector<double> const& b,
+                     std::vector<double> & camera_terms,
+                     std::vector<std::vector<double> > & point_terms ) const {
+      const unsigned nc = MPI_CAMERA_PARAMS, np = MPI_POINT_PARAMS;
+      camera_terms.assign( (m_camera_end-m_camera_begin)*CAMERA_TERMS, 0.0 );
+      point_terms.assign( m_num_ranks, std::vector<double>() );
+      double error_total = 0;
+      Matrix<double,2,MPI_CAMERA_PARAMS> A;
+      Matrix<double,2,MPI_POINT_PARAMS> B;
+
+      BOOST_FOREACH( MPIMeasure const& m, m_camera_measures ) {
+        vector_camera a_j = camera_parameters( a, m.camera );
+        vector_point b_i = point_parameters( b, m.point );
+        Vector2 pixel = project( m.camera, a_j, b_i );
+
+        for ( unsigned n = 0; n < nc; n++ ) {
+          vector_camera moved = a_j;
+          double h = 1e-6*std::max(1.0, fabs(a_j[n]));
+          moved[n] += h;
+          select_col(A,n) = ( project( m.camera, moved, b_i ) - pixel ) / h;
+        }
+        for ( unsigned n = 0; n < np; n++ ) {
+          vector_point moved = b_i;
+          double h = 1e-7*std::max(1.0, fabs(b_i[n]));
+          moved[n] += h;
+          select_col(B,n) = ( project( m.camera, a_j, moved ) - pixel ) / h;
+        }
+
+        Vector2 epsilon, inverse_cov;
+        error_total += weighted_error( m, pixel, epsilon, inverse_cov );
+
+        double* U   = &camera_terms[(m.camera-m_camera_begin)*CAMERA_TERMS];
+        double* e_a = U + nc*nc;
+        std::vector<double> & terms = point_terms[m.point_owner];
+        size_t start = terms.size();
+        terms.resize( start + POINT_TERMS, 0.0 );
+        double* W   = &terms[start];
+        double* V   = W + nc*np;
+        double* e_b = V + np*np;
+        for ( unsigned r = 0; r < 2; r++ ) {
+          for ( unsigned p = 0; p < nc; p++ ) {
+            double a_w = A(r,p) * inverse_cov[r];
+            for ( unsigned q = 0; q < nc; q++ )
+              U[p*nc+q] += a_w * A(r,q);
+            for ( unsigned q = 0; q < np; q++ )
+              W[p*np+q] += a_w * B(r,q);
+            e_a[p] += a_w * epsilon[r];
+          }
+          for ( unsigned p = 0; p < np; p++ ) {
+            double b_w = B(r,p) * inverse_cov[r];
+            for ( unsigned q = 0; q < np; q++ )
+              V[p*np+q] += b_w * B(r,q);
+            e_b[p] += b_w * epsilon[r];
+          }
+        }
+      }
+      return error_total;
+    }
+
+    // Sums the terms that each process r sent in 'point_terms[r]' for
+    // the measures of our points. Returns the largest diagonal entry
+    // of V.
+    double receive_point_terms( std::vector<std::vector<double> > const& point_terms ) {
+      const unsigned nc = MPI_CAMERA_PARAMS, np = MPI_POINT_PARAMS;
+      VW_ASSERT( point_terms.size() == size_t(m_num_ranks),
+                 LogicErr() << "MPIRankEquations: point terms of the wrong number of processes." );
+      std::vector<size_t> position( m_num_ranks, 0 );
+      double max_diagonal = 0;
+      for ( size_t p = 0; p < m_points.size(); p++ ) {
+        matrix_point_point V;
+        vector_point epsilon_b;
+        for ( size_t k = m_point_measures[p]; k < m_point_measures[p+1]; k++ ) {
+          int sender = m_measures[k].camera_owner;
+          VW_ASSERT( position[sender] + POINT_TERMS <= point_terms[sender].size(),
+                     LogicErr() << "MPIRankEquations: missing point terms." );
+          const double* terms = &point_terms[sender][position[sender]];
+          position[sender] += POINT_TERMS;
+          std::copy( terms, terms + nc*np, m_W[k].begin() );
+          terms += nc*np;
+          for ( unsigned r = 0; r < np; r++ )
+            for ( unsigned c = 0; c < np; c++ )
+              V(r,c) += terms[r*np+c];
+          terms += np*np;
+          for ( unsigned r = 0; r < np; r++ )
+            epsilon_b[r] += terms[r];
+        }
+        m_V[p] = V;
+        m_epsilon_b[p] = epsilon_b;
+        for ( unsigned n = 0; n < np; n++ )
+          max_diagonal = std::max( max_diagonal, fabs(V(n,n)) );
+      }
+      return max_diagonal;
+    }
+
+    // Adds the constraints of our ground control points and 'lambda'
+    // to V, and reduces our points to terms of S and e.
+    void schur( double lambda, std::vector<MPIPointConstraint> const& constraints,
+                MPISchurTerms & result ) {
+      const unsigned nc = MPI_CAMERA_PARAMS, np = MPI_POINT_PARAMS;
+      result = MPISchurTerms();
+
+      std::map<unsigned, MPIPointConstraint const*> point_constraint;
+      BOOST_FOREACH( MPIPointConstraint const& c, constraints )
+        point_constraint[c.point] = &c;
+
+      // Where each block and term of e is in 'result'
+      std::map<std::pair<unsigned,unsigned>, size_t> block_index;
+      std::map<unsigned, size_t> rhs_index;
+
+      for ( size_t p = 0; p < m_points.size(); p++ ) {
+        matrix_point_point & V = m_V[p];
+        vector_point & epsilon_b = m_epsilon_b[p];
+        std::map<unsigned, MPIPointConstraint const*>::const_iterator it =
+          point_constraint.find( m_points[p] );
+        if ( it != point_constraint.end() ) {
+          MPIPointConstraint const& c = *it->second;
+          for ( unsigned r = 0; r < np; r++ )
+            for ( unsigned q = 0; q < np; q++ ) {
+              V(r,q) += c.inverse_cov[r*np+q];
+              epsilon_b[r] += c.inverse_cov[r*np+q] * c.epsilon[q];
+            }
+        }
+        for ( unsigned n = 0; n < np; n++ ) {
+          result.max_g = std::max( result.max_g, epsilon_b[n] );
+          result.max_minus_g = std::max( result.max_minus_g, -epsilon_b[n] );
+          V(n,n) += lambda;
+        }
+
+        Matrix<double> V_temp = V;
+        chol_inverse(V_temp);
+        matrix_point_point V_inverse = transpose(V_temp) * V_temp;
+
+        size_t begin = m_point_measures[p], end = m_point_measures[p+1];
+        for ( size_t mj = begin; mj < end; mj++ ) {
+          unsigned j = m_measures[mj].camera;
+          m_Y[mj] = m_W[mj] * V_inverse;
+
+          vector_camera e_j = -m_Y[mj] * epsilon_b;
+          if ( rhs_index.find( j ) == rhs_index.end() ) {
+            rhs_index[j] = result.rhs_cameras.size();
+            result.rhs_cameras.push_back( j );
+            result.rhs.resize( result.rhs.size() + nc, 0.0 );
+          }
+          double* rhs = &result.rhs[rhs_index[j]*nc];
+          for ( unsigned n = 0; n < nc; n++ )
+            rhs[n] += e_j[n];
+        }
+
+        for ( size_t mj = begin; mj < end; mj++ ) {
+          unsigned j = m_measures[mj].camera;
+          for ( size_t mk = begin; mk < end; mk++ ) {
+            unsigned k = m_measures[mk].camera;
+            if ( k > j )
+              continue; // Only the lower triangle of S is stored
+            matrix_camera_camera block = -m_Y[mj] * transpose( m_W[mk] );
+            std::pair<unsigned,unsigned> key( j, k );
+            if ( block_index.find( key ) == block_index.end() ) {
+              block_index[key] = result.block_cameras.size() / 2;
+              result.block_cameras.push_back( j );
+              result.block_cameras.push_back( k );
+              result.blocks.resize( result.blocks.size() + nc*nc, 0.0 );
+            }
+            double* dest = &result.blocks[block_index[key]*nc*nc];
+            for ( unsigned r = 0; r < nc; r++ )
+              for ( unsigned q = 0; q < nc; q++ )
+                dest[r*nc+q] += block(r,q);
+          }
+        }
+      }
+    }
+
+    // Updates of our points for the camera update 'delta_a'
+    void back_substitute( std::vector<double> const& delta_a,
+                          MPIPointUpdate & result ) const {
+      result = MPIPointUpdate();
+      for ( size_t p = 0; p < m_points.size(); p++ ) {
+        vector_point temp;
+        for ( size_t k = m_point_measures[p]; k < m_point_measures[p+1]; k++ )
+          temp += transpose( m_W[k] ) *
+            camera_parameters( delta_a, m_measures[k].camera );
+
+        Vector<double> delta_temp = m_epsilon_b[p] - temp;
+        Matrix<double> hessian = m_V[p];
+        solve( delta_temp, hessian );
+
+        result.points.push_back( m_points[p] );
+        for ( unsigned n = 0; n < MPI_POINT_PARAMS; n++ )
+          result.delta_b.push_back( delta_temp[n] );
+        result.delta_b_norm2 += dot_prod( delta_temp, delta_temp );
+        result.delta_b_dot_g += dot_prod( delta_temp, m_epsilon_b[p] );
+      }
+    }
+
+    // Image error of the measures of our cameras
+    double error( MPIProjection & project, std::vector<double> const& a,
+                  std::vector<double> const& b ) const {
+      double error_total = 0;
+      BOOST_FOREACH( MPIMeasure const& m, m_camera_measures ) {
+        Vector2 epsilon, inverse_cov;
+        Vector2 pixel = project( m.camera, camera_parameters( a, m.camera ),
+                                 point_parameters( b, m.point ) );
+        error_total += weighted_error( m, pixel, epsilon, inverse_cov );
+      }
+      return error_total;
+    }
+  };
+
+}}
+
+#endif//__ASP_MPI_BUNDLE_ADJUSTMENT_MPI_RANK_H__
@@ -18,21 +18,32 @@
 
 /// \file BundleAdjustmentMPISparse.h
 ///
-/// Sparse implementation of bundle adjustment. Faster yo!
+/// Sparse implementation of bundle adjustment. Faster yo! The image
+/// error, jacobians and the reduction of the points to the camera
+/// system are computed by the MPI slaves, each for the cameras and
+/// points it owns, see BundleAdjustmentMPIRank.h. The master only
+/// assembles and solves the reduced camera system.
 
 #ifndef __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_SPARSE_H__
 #define __ASP_MPI_BUNDLE_ADJUSTMENT_MPI_SPARSE_H__
 
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
 // Vision Workbench
-#include <vw/Camera/BundleAdjustmentBase.h>
+#include <vw/BundleAdjustment/BundleAdjustmentBase.h>
 #include <vw/Math/MatrixSparseSkyline.h>
 #include <vw/Core/Debugging.h>
 
 // Boost
+#include <boost/static_assert.hpp>
 #include <boost/numeric/ublas/matrix_sparse.hpp>
 #include <boost/numeric/ublas/vector_sparse.hpp>
 #include <boost/numeric/ublas/io.hpp>
 #include <boost/version.hpp>
+
+#include <asp/MPI/BundleAdjustmentMPIRank.h>
 #if BOOST_VERSION<=103200
 // Mapped matrix doesn't exist in 1.32, but Sparse Matrix does
 //
@@ -48,9 +59,146 @@
 namespace vw {
 namespace camera {
 
+  // Selected inverse of a symmetric positive definite matrix, given
+  // by its lower triangle. The matrix is factored as L*D*L^T within
+  // its envelope, row i starting at column first_column[i], and the
+  // inverse Z is then found for the same envelope with the Takahashi
+  // recurrence
+  //
+  //   Z(i,j) = -sum_k Z(i,k) L(k,j)                 i > j
+  //   Z(j,j) = 1/D(j) - sum_k Z(j,k) L(k,j)
+  //
+  // with k running over the rows below j in column j of L. This
+  // never needs more than the envelope, unlike a dense inverse.
+  class EnvelopeSelectedInverse {
+    std::vector<size_t> m_first, m_offset;
+    std::vector<double> m_lower, m_diagonal; // L and D, then Z
+
+    double& lower( size_t i, size_t j ) {
+      return m_lower[m_offset[i] + j - m_first[i]];
+    }
+
+  public:
+    template <class MatrixT>
+    EnvelopeSelectedInverse( MatrixT & A, std::vector<size_t> const& first_column ) :
+      m_first( first_column ), m_offset( first_column.size() ),
+      m_diagonal( first_column.size() ) {
+      size_t n = m_first.size(), size = 0;
+      for ( size_t i = 0; i < n; i++ ) {
+        VW_ASSERT( m_first[i] <= i, ArgumentErr() << "Envelope must include the diagonal." );
+        m_offset[i] = size;
+        size += i - m_first[i];
+      }
+      m_lower.resize( size );
+
+      // Envelope LDL^T factorization
+      for ( size_t i = 0; i < n; i++ ) {
+        for ( size_t j = m_first[i]; j < i; j++ ) {
+          double sum = A(i,j);
+          for ( size_t k = std::max( m_first[i], m_first[j] ); k < j; k++ )
+            sum -= lower(i,k) * m_diagonal[k] * lower(j,k);
+          lower(i,j) = sum / m_diagonal[j];
+        }
+        double d = A(i,i);
+        for ( size_t k = m_first[i]; k < i; k++ )
+          d -= lower(i,k) * lower(i,k) * m_diagonal[k];
+        VW_ASSERT( d > 0, MathErr() << "EnvelopeSelectedInverse: matrix is not positive definite." );
+        m_diagonal[i] = d;
+      }
+
+      // Rows below the diagonal in each column of the envelope
+      std::vector<std::vector<size_t> > columns( n );
+      for ( size_t i = 0; i < n; i++ )
+        for ( size_t j = m_first[i]; j < i; j++ )
+          columns[j].push_back( i );
+
+      // Takahashi recurrence, last column first. Z overwrites L one
+      // column at a time, so the column of L is saved first.
+      std::vector<double> l_column;
+      for ( size_t j = n; j-- > 0; ) {
+        std::vector<size_t> const& rows = columns[j];
+        l_column.resize( rows.size() );
+        for ( size_t r = 0; r < rows.size(); r++ )
+          l_column[r] = lower( rows[r], j );
+
+        for ( size_t r = 0; r < rows.size(); r++ ) {
+          double sum = 0;
+          for ( size_t q = 0; q < rows.size(); q++ )
+            sum -= (*this)( rows[r], rows[q] ) * l_column[q];
+          lower( rows[r], j ) = sum;
+        }
+        double d = 1 / m_diagonal[j];
+        for ( size_t r = 0; r < rows.size(); r++ )
+          d -= lower( rows[r], j ) * l_column[r];
+        m_diagonal[j] = d;
+      }
+    }
+
+    bool in_envelope( size_t i, size_t j ) const {
+      return i >= j ? j >= m_first[i] : i >= m_first[j];
+    }
+
+    // Entry of the inverse. (i,j) must be in the envelope.
+    double operator()( size_t i, size_t j ) const {
+      if ( i == j )
+        return m_diagonal[i];
+      if ( i < j )
+        std::swap( i, j );
+      VW_DEBUG_ASSERT( j >= m_first[i], ArgumentErr() << "EnvelopeSelectedInverse: entry outside the envelope." );
+      return m_lower[m_offset[i] + j - m_first[i]];
+    }
+  };
+
+  // Diagonal blocks of size N of the inverse of the symmetric
+  // positive definite matrix S, given by its lower triangle, from a
+  // selected inverse over the envelope of S in 'ordering'. 'skyline'
+  // is the skyline of the reordered S, as from solve_for_skyline().
+  template <int N>
+  std::vector< Matrix<double,N,N> >
+  inverse_diagonal_blocks( math::MatrixSparseSkyline<double> const& S,
+                           std::vector<uint> const& ordering,
+                           Vector<uint> const& skyline ) {
+    size_t size = S.rows();
+    VW_ASSERT( size % N == 0 && ordering.size() == size && skyline.size() == size,
+               ArgumentErr() << "inverse_diagonal_blocks: mismatched sizes." );
+    size_t num_blocks = size / N;
+
+    // Position of each original row in the reordered matrix
+    std::vector<size_t> position( size );
+    for ( size_t p = 0; p < size; p++ )
+      position[ ordering[p] ] = p;
+
+    // Envelope of the reordered S, widened so that it covers every
+    // diagonal block.
+    std::vector<size_t> first( size );
+    for ( size_t p = 0; p < size; p++ )
+      first[p] = std::min( size_t(skyline[p]), p );
+    for ( size_t c = 0; c < num_blocks; c++ ) {
+      size_t block_first = size;
+      for ( int a = 0; a < N; a++ )
+        block_first = std::min( block_first, position[c*N+a] );
+      for ( int a = 0; a < N; a++ ) {
+        size_t p = position[c*N+a];
+        first[p] = std::min( first[p], block_first );
+      }
+    }
+
+    math::MatrixSparseSkyline<double> S_copy = S;
+    math::MatrixReorganize<math::MatrixSparseSkyline<double> > modified_S( S_copy, ordering );
+    EnvelopeSelectedInverse inverse( modified_S, first );
+
+    std::vector< Matrix<double,N,N> > result( num_blocks );
+    for ( size_t c = 0; c < num_blocks; c++ )
+      for ( int a = 0; a < N; a++ )
+        for ( int b = 0; b < N; b++ )
+          result[c](a,b) = inverse( position[c*N+a], position[c*N+b] );
+    return result;
+  }
+
   template <class BundleAdjustModelT, class RobustCostT>
-  class BundleAdjustmentMPISparse : public BundleAdjustmentBase<BundleAdjustModelT, RobustCostT> {
+  class BundleAdjustmentMPISparse : public ba::BundleAdjustmentBase<BundleAdjustModelT, RobustCostT> {
 
+    MPIRanks & m_ranks;
     math::MatrixSparseSkyline<double> m_S;
     std::vector<uint> m_ideal_ordering;
     Vector<uint> m_ideal_skyline;
@@ -58,13 +206,19 @@ namespace camera {
 
   public:
 
+    // The slaves must already have loaded the camera models and the
+    // control network of 'model'.
     BundleAdjustmentMPISparse( BundleAdjustModelT & model,
                                RobustCostT const& robust_cost_func,
+                               MPIRanks & ranks,
                                bool use_camera_constraint=true,
                                bool use_gcp_constraint=true) :
-    BundleAdjustmentMPIBase<BundleAdjustModelT,RobustCostT>( model, robust_cost_func,
-                                                             use_camera_constraint,
-                                                             use_gcp_constraint ) {
+    ba::BundleAdjustmentBase<BundleAdjustModelT,RobustCostT>( model, robust_cost_func,
+                                                              use_camera_constraint,
+                                                              use_gcp_constraint ),
+      m_ranks( ranks ) {
+      BOOST_STATIC_ASSERT( BundleAdjustModelT::camera_params_n == MPI_CAMERA_PARAMS );
+      BOOST_STATIC_ASSERT( BundleAdjustModelT::point_params_n == MPI_POINT_PARAMS );
       m_found_ideal_ordering = false;
     }
 
@@ -72,32 +226,44 @@ namespace camera {
 
     // Covariance Calculator
     // ___________________________________________________________
-    // This routine inverts a sparse matrix S, and prints the individual
-    // covariance matrices for each camera
-    void covCalc(){
-      // camera params
-      unsigned num_cam_params = BundleAdjustModelT::camera_params_n;
-      unsigned num_cameras = this->m_model.num_cameras();
-
-      unsigned inverse_size = num_cam_params * num_cameras;
+    // The covariance of each camera is its diagonal block of S^-1.
+    // Only these blocks are computed, with a selected inverse over
+    // the envelope of S in the ordering used by update(), so memory
+    // stays proportional to the envelope instead of the square of
+    // the number of camera parameters.
+    std::vector< Matrix<double, BundleAdjustModelT::camera_params_n, BundleAdjustModelT::camera_params_n> >
+    camera_covariances() const {
+      VW_ASSERT( m_found_ideal_ordering,
+                 LogicErr() << "camera_covariances() requires a call to update() first." );
+      return inverse_diagonal_blocks<BundleAdjustModelT::camera_params_n>
+        ( m_S, m_ideal_ordering, m_ideal_skyline );
+    }
 
+    // Prints the covariance matrices of each camera, or writes them
+    // to 'filename' if given, one camera index followed by its rows.
+    void covCalc( std::string const& filename = "" ) {
       typedef Matrix<double, BundleAdjustModelT::camera_params_n, BundleAdjustModelT::camera_params_n> matrix_camera_camera;
+      std::vector<matrix_camera_camera> sparse_cov = camera_covariances();
+
+      if ( filename.empty() ) {
+        std::cout << "Covariance matrices for cameras are:\n";
+        for ( size_t c = 0; c < sparse_cov.size(); c++ )
+          std::cout << c << " : " << sparse_cov[c] << "\n";
+        std::cout << "\n";
+        return;
+      }
 
-      // final vector of camera covariance matrices
-      vw::Vector< matrix_camera_camera > sparse_cov(num_cameras);
-
-      // Get the S matrix from the model
-      math::MatrixSparseSkyline<double> S = this->S();  // Make copy as solve is destructive
-      Matrix<double> Id(inverse_size, inverse_size);
-      Id.set_identity();
-      Matrix<double> Cov = multi_sparse_solve(S, Id);
-
-      //pick out covariances of individual cameras
-      for ( unsigned i = 0; i < num_cameras; i++ )
-        sparse_cov(i) = submatrix(Cov, i*num_cam_params, i*num_cam_params, num_cam_params, num_cam_params);
-
-      std::cout << "Covariance matrices for cameras are:"
-                << sparse_cov << "\n\n";
+      std::ofstream ostr( filename.c_str() );
+      if ( !ostr.good() )
+        vw_throw( IOErr() << "Unable to open covariance file: " << filename );
+      ostr << std::setprecision(17);
+      for ( size_t c = 0; c < sparse_cov.size(); c++ ) {
+        ostr << c << "\n";
+        for ( unsigned a = 0; a < BundleAdjustModelT::camera_params_n; a++ ) {
+          for ( unsigned b = 0; b < BundleAdjustModelT::camera_params_n; b++ )
+            ostr << sparse_cov[c](a,b) << ( b+1 < BundleAdjustModelT::camera_params_n ? " " : "\n" );
+        }
+      }
     }
 
     // UPDATE IMPLEMENTATION
@@ -110,114 +276,57 @@ namespace camera {
 
       VW_DEBUG_ASSERT(this->m_control_net->size() == this->m_model.num_points(), LogicErr() << "BundleAdjustment::update() : Number of bundles does not match the number of points in the bundle adjustment model.");
 
-      // Jacobian Matrices and error values
-      typedef Matrix<double, 2, BundleAdjustModelT::camera_params_n> matrix_2_camera;
-      typedef Matrix<double, 2, BundleAdjustModelT::point_params_n> matrix_2_point;
-      boost_sparse_matrix< matrix_2_camera  > A(this->m_model.num_points(), this->m_model.num_cameras());
-      boost_sparse_matrix< matrix_2_point > B(this->m_model.num_points(), this->m_model.num_cameras());
-      boost_sparse_matrix<Vector2> epsilon(this->m_model.num_points(), this->m_model.num_cameras());
-      boost_sparse_matrix<Vector2> new_epsilon(this->m_model.num_points(), this->m_model.num_cameras());
-
       // Intermediate Matrices and vectors
       typedef Matrix<double,BundleAdjustModelT::camera_params_n,BundleAdjustModelT::camera_params_n> matrix_camera_camera;
       typedef Matrix<double,BundleAdjustModelT::point_params_n,BundleAdjustModelT::point_params_n> matrix_point_point;
-      typedef Matrix<double,BundleAdjustModelT::camera_params_n,BundleAdjustModelT::point_params_n> matrix_camera_point;
-      boost_sparse_vector< matrix_camera_camera > U(this->m_model.num_cameras());
-      boost_sparse_vector< matrix_point_point > V(this->m_model.num_points());
-      boost_sparse_matrix< matrix_camera_point > W(this->m_model.num_cameras(), this->m_model.num_points());
-
-      // Copies of Intermediate Marices
       typedef Vector<double,BundleAdjustModelT::camera_params_n> vector_camera;
       typedef Vector<double,BundleAdjustModelT::point_params_n> vector_point;
-      boost_sparse_vector< vector_camera > epsilon_a(this->m_model.num_cameras());
-      boost_sparse_vector< vector_point > epsilon_b(this->m_model.num_points());
-      boost_sparse_matrix< matrix_camera_point > Y(this->m_model.num_cameras(), this->m_model.num_points());
 
       unsigned num_cam_params = BundleAdjustModelT::camera_params_n;
       unsigned num_pt_params = BundleAdjustModelT::point_params_n;
+      unsigned num_cameras = this->m_model.num_cameras();
+      unsigned num_points = this->m_model.num_points();
 
-      unsigned delta_length = U.size() * num_cam_params + V.size() * num_pt_params;
-
-      Vector<double> g(delta_length);
-      unsigned current_g_length = 0;
-
-      Vector<double> delta(delta_length);
-      unsigned current_delta_length = 0;
+      std::vector< matrix_camera_camera > U(num_cameras);
+      std::vector< vector_camera > epsilon_a(num_cameras);
 
-      // Fletcher LM parameteres
-      double dS = 0; //Predicted improvement for Fletcher modification
+      // Flatten the current parameters for the slaves
+      std::vector<double> a(num_cameras*num_cam_params), b(num_points*num_pt_params);
+      for (unsigned j = 0; j < num_cameras; ++j) {
+        vector_camera a_j = this->m_model.A_parameters(j);
+        std::copy( a_j.begin(), a_j.end(), a.begin() + j*num_cam_params );
+      }
+      for (unsigned i = 0; i < num_points; ++i) {
+        vector_point b_i = this->m_model.B_parameters(i);
+        std::copy( b_i.begin(), b_i.end(), b.begin() + i*num_pt_params );
+      }
 
-      // Populate the Jacobian, which is broken into two sparse
-      // matrices A & B, as well as the error matrix and the W
-      // matrix.
+      // The slaves evaluate the image error and the jacobians A & B.
+      // They keep V, W and epsilon_b with the owners of the points,
+      // and only send U and epsilon_a here.
       time = new Timer("Solve for Image Error, Jacobian, U, V, and W:", DebugMessage, "bundle_adjust");
-      unsigned i = 0;
-      double error_total = 0; // assume this is r^T\Sigma^{-1}r
-
-      for (typename ControlNetwork::const_iterator iter = this->m_control_net->begin();
-           iter != this->m_control_net->end(); ++iter) {
-        for (typename ControlPoint::const_iterator measure_iter = iter->begin();
-             measure_iter != iter->end(); ++measure_iter) {
-
-          unsigned j = measure_iter->image_id();
-
-          VW_DEBUG_ASSERT( j >=0 && j < this->m_model.num_cameras(),
-                           ArgumentErr() << "BundleAdjustment::update() : image index out of bounds.");
-
-          // Store jacobian values
-          A(i,j) = this->m_model.A_jacobian(i,j,this->m_model.A_parameters(j),
-                                            this->m_model.B_parameters(i));
-          B(i,j) = this->m_model.B_jacobian(i,j,this->m_model.A_parameters(j),
-                                            this->m_model.B_parameters(i));
-
-          // Apply robust cost function weighting
-          Vector2 unweighted_error = measure_iter->dominant() -
-            this->m_model(i,j,this->m_model.A_parameters(j),this->m_model.B_parameters(i));
-
-          double mag = norm_2(unweighted_error);
-          double weight = sqrt(this->m_robust_cost_func(mag)) / mag;
-          epsilon(i,j) = unweighted_error * weight;
-
-          Matrix2x2 inverse_cov;
-          Vector2 pixel_sigma = measure_iter->sigma();
-          Vector2 epsilon_inst = epsilon(i,j);
-          inverse_cov(0,0) = 1/(pixel_sigma(0)*pixel_sigma(0));
-          inverse_cov(1,1) = 1/(pixel_sigma(1)*pixel_sigma(1));
-          error_total += .5 * transpose(epsilon_inst) *
-            inverse_cov * epsilon_inst;
-
-          // Store intermediate values
-          U(j) += transpose(static_cast< matrix_2_camera >(A(i,j))) *
-            inverse_cov * static_cast< matrix_2_camera >(A(i,j));
-          V(i) += transpose(static_cast< matrix_2_point >(B(i,j))) *
-            inverse_cov * static_cast< matrix_2_point >(B(i,j));
-          W(j,i) = transpose(static_cast< matrix_2_camera >(A(i,j))) *
-            inverse_cov * static_cast< matrix_2_point >(B(i,j));
-
-          epsilon_a(j) += transpose(static_cast< matrix_2_camera >(A(i,j))) *
-            inverse_cov * epsilon_inst;
-          epsilon_b(i) += transpose(static_cast< matrix_2_point >(B(i,j))) *
-            inverse_cov * epsilon_inst;
-
-        }
-        ++i;
+      std::vector<double> camera_terms;
+      double max_point_diagonal = 0;
+      double error_total = m_ranks.solve_jacobian( a, b, camera_terms, max_point_diagonal ); // assume this is r^T\Sigma^{-1}r
+      VW_ASSERT( camera_terms.size() == num_cameras*MPIRankEquations::CAMERA_TERMS,
+                 LogicErr() << "BundleAdjustmentMPISparse: missing camera terms." );
+      for (unsigned j = 0; j < num_cameras; ++j) {
+        std::vector<double>::const_iterator terms =
+          camera_terms.begin() + j*MPIRankEquations::CAMERA_TERMS;
+        std::copy( terms, terms + num_cam_params*num_cam_params, U[j].begin() );
+        std::copy( terms + num_cam_params*num_cam_params,
+                   terms + MPIRankEquations::CAMERA_TERMS, epsilon_a[j].begin() );
       }
-
       delete time;
 
       // set initial lambda, and ignore if the user has touched it
       if ( this->m_iterations == 1 && this->m_lambda == 1e-3 ) {
         time = new Timer("Solving for Lambda:", DebugMessage, "bundle_adjust");
-        double max = 0.0;
+        double max = max_point_diagonal;
         for (unsigned i = 0; i < U.size(); ++i)
           for (unsigned j = 0; j < BundleAdjustModelT::camera_params_n; ++j){
-            if (fabs(static_cast<matrix_camera_camera>(U(i))(j,j)) > max)
-              max = fabs(static_cast<matrix_camera_camera>(U(i))(j,j));
-          }
-        for (unsigned i = 0; i < V.size(); ++i)
-          for (unsigned j = 0; j < BundleAdjustModelT::point_params_n; ++j) {
-            if ( fabs(static_cast<matrix_point_point>(V(i))(j,j)) > max)
-              max = fabs(static_cast<matrix_point_point>(V(i))(j,j));
+            if (fabs(U[i](j,j)) > max)
+              max = fabs(U[i](j,j));
           }
         this->m_lambda = max * 1e-10;
         delete time;
@@ -231,90 +340,57 @@ namespace camera {
           inverse_cov = this->m_model.A_inverse_covariance(j);
           matrix_camera_camera C;
           C.set_identity();
-          U(j) += transpose(C) * inverse_cov * C;
-          vector_camera eps_a = this->m_model.A_initial(j)-this->m_model.A_parameters(j);
+          U[j] += transpose(C) * inverse_cov * C;
+          vector_camera eps_a = this->m_model.A_target(j)-this->m_model.A_parameters(j);
           error_total += .5  * transpose(eps_a) * inverse_cov * eps_a;
-          epsilon_a(j) += transpose(C) * inverse_cov * eps_a;
+          epsilon_a[j] += transpose(C) * inverse_cov * eps_a;
         }
 
-      // Add in the 3D point position constraint terms and
-      // covariances. We only add constraints for Ground Control
-      // Points (GCPs), not for 3D tie points.
+      // The 3D point position constraint terms and covariances. We
+      // only add constraints for Ground Control Points (GCPs), not
+      // for 3D tie points. The owners of the points add them to V
+      // and epsilon_b.
+      std::vector<MPIPointConstraint> constraints;
       if (this->m_use_gcp_constraint)
-        for ( unsigned i = 0; i < V.size(); ++i )
-          if ((*this->m_control_net)[i].type() == ControlPoint::GroundControlPoint) {
+        for ( unsigned i = 0; i < num_points; ++i )
+          if ((*this->m_control_net)[i].type() == ba::ControlPoint::GroundControlPoint) {
             matrix_point_point inverse_cov;
             inverse_cov = this->m_model.B_inverse_covariance(i);
-            matrix_point_point D;
-            D.set_identity();
-            V(i) +=  transpose(D) * inverse_cov * D;
-            vector_point eps_b = this->m_model.B_initial(i)-this->m_model.B_parameters(i);
+            vector_point eps_b = this->m_model.B_target(i)-this->m_model.B_parameters(i);
             error_total += .5 * transpose(eps_b) * inverse_cov * eps_b;
-            epsilon_b(i) += transpose(D) * inverse_cov * eps_b;
+            MPIPointConstraint constraint;
+            constraint.point = i;
+            constraint.inverse_cov.assign( inverse_cov.begin(), inverse_cov.end() );
+            constraint.epsilon.assign( eps_b.begin(), eps_b.end() );
+            constraints.push_back( constraint );
           }
       delete time;
 
-      // flatten both epsilon_b and epsilon_a into a vector
-      time = new Timer("Flatten eps_a, eps_b, and augmenting with lambda",DebugMessage,"bundle_adjust");
-      for (unsigned j = 0; j < U.size(); j++){
-        subvector(g, current_g_length, num_cam_params) = static_cast<vector_camera>(epsilon_a(j));
-        current_g_length += num_cam_params;
-      }
-      for (unsigned i = 0; i < V.size(); i++){
-        subvector(g, current_g_length, num_pt_params) = static_cast<vector_point>(epsilon_b(i));
-        current_g_length += num_pt_params;
-      }
-
-      //e at this point should be -g_a
+      // The camera part of g. The point part stays with the slaves.
+      Vector<double> g_a(num_cameras*num_cam_params);
+      for (unsigned j = 0; j < epsilon_a.size(); ++j)
+        subvector(g_a, j*num_cam_params, num_cam_params) = epsilon_a[j];
 
-      // "Augment" the diagonal entries of the U and V matrices with
-      // the parameter lambda.
+      // "Augment" the diagonal entries of the U matrices with the
+      // parameter lambda. The slaves do the same for V.
       {
         matrix_camera_camera u_lambda;
         u_lambda.set_identity();
         u_lambda *= this->m_lambda;
-        for ( i = 0; i < U.size(); ++i )
-          U(i) += u_lambda;
+        for ( unsigned i = 0; i < U.size(); ++i )
+          U[i] += u_lambda;
       }
 
-      {
-        matrix_point_point v_lambda;
-        v_lambda.set_identity();
-        v_lambda *= this->m_lambda;
-        for ( i = 0; i < V.size(); ++i )
-          V(i) += v_lambda;
-      }
-      delete time;
+      // The slaves reduce their points to blocks of S and terms of
+      // the 'e' vector in S * delta_a = e.
+      time = new Timer("Solve for the Schur complement", DebugMessage, "bundle_adjust");
+      MPISchurTerms schur;
+      m_ranks.solve_schur( this->m_lambda, constraints, schur );
 
-      // Create the 'e' vector in S * delta_a = e.  The first step is
-      // to "flatten" our block structure to a vector that contains
-      // scalar entries.
-      time = new Timer("Create special e vector", DebugMessage, "bundle_adjust");
-      Vector<double> e(this->m_model.num_cameras() * BundleAdjustModelT::camera_params_n);
-      for (unsigned j = 0; j < epsilon_a.size(); ++j) {
-        subvector(e, j*BundleAdjustModelT::camera_params_n, BundleAdjustModelT::camera_params_n) =
-          static_cast<vector_camera>(epsilon_a(j));
-      }
-
-      //Second Pass.  Compute Y and finish constructing e.
-      i = 0;
-      for (typename ControlNetwork::const_iterator iter = this->m_control_net->begin();
-           iter != this->m_control_net->end(); ++iter) {
-        for (typename ControlPoint::const_iterator measure_iter = (*iter).begin();
-             measure_iter != (*iter).end(); ++measure_iter) {
-          unsigned j = measure_iter->image_id();
-
-          // Compute the blocks of Y
-          Matrix<double> V_temp = static_cast<matrix_point_point>(V(i));
-          chol_inverse(V_temp);
-          Y(j,i) = static_cast<matrix_camera_point>(W(j,i)) * transpose(V_temp) * V_temp;
-
-          // "Flatten the block structure to compute 'e'.
-          vector_camera temp = static_cast<matrix_camera_point>(Y(j,i))*static_cast<vector_point>(epsilon_b(i));
-          subvector(e, j*num_cam_params, num_cam_params) -= temp;
-        }
-        ++i;
-      }
+      Vector<double> e = g_a;
+      for (size_t r = 0; r < schur.rhs_cameras.size(); ++r)
+        for (unsigned aa = 0; aa < num_cam_params; ++aa)
+          e[schur.rhs_cameras[r]*num_cam_params + aa] += schur.rhs[r*num_cam_params + aa];
       delete time;
 
       // --- BUILD SPARSE, SOLVE A'S UPDATE STEP -------------------------
@@ -325,50 +401,11 @@ namespace camera {
       // skyline structure, which makes it more efficient to solve
       // through L*D*L^T decomposition and forward/back substitution
       // below.
-      math::MatrixSparseSkyline<double> S(this->m_model.num_cameras()*num_cam_params,
-                                          this->m_model.num_cameras()*num_cam_params);
-      i = 0;
-      for (typename ControlNetwork::const_iterator iter = this->m_control_net->begin();
-           iter != this->m_control_net->end(); ++iter) {
-        for (typename ControlPoint::const_iterator j_measure_iter = (*iter).begin();
-             j_measure_iter != (*iter).end(); ++j_measure_iter) {
-          unsigned j = j_measure_iter->image_id();
-
-          for (typename ControlPoint::const_iterator k_measure_iter = (*iter).begin();
-               k_measure_iter != (*iter).end(); ++k_measure_iter) {
-            unsigned k = k_measure_iter->image_id();
-
-            // Compute the block entry...
-            matrix_camera_camera temp = -static_cast< matrix_camera_point >(Y(j,i)) *
-              transpose( static_cast<matrix_camera_point>(W(k,i)) );
-            // ... and "flatten" this matrix into the scalar entries of S
-            for (unsigned aa = 0; aa < num_cam_params; ++aa) {
-              for (unsigned bb = 0; bb < num_cam_params; ++bb) {
-                // FIXME: This if clause is required at the moment to
-                // ensure that we do not use the += on the symmetric
-                // entries of the SparseSkylineMatrix.  These
-                // symmetric entries are shallow, hence this code
-                // would add the value twice if we're not careful
-                // here.
-                if (k*num_cam_params + bb <=
-                    j*num_cam_params + aa) {
-                  S(j*num_cam_params + aa,
-                    k*num_cam_params + bb) += temp(aa,bb);
-
-                  //  S_old(j*BundleAdjustModelT::camera_params_n + aa,
-                  //  k*BundleAdjustModelT::camera_params_n + bb) += temp_old(aa,bb);
-
-                }
-              }
-            }
-          }
-        }
-        ++i;
-      }
-
-      // Augment the diagonal entries S(i,i) with U(i)
-      for (unsigned i = 0; i < this->m_model.num_cameras(); ++i) {
-        // ... and "flatten" this matrix into the scalar entries of S
+      math::MatrixSparseSkyline<double> S(num_cameras*num_cam_params,
+                                          num_cameras*num_cam_params);
+      for (size_t s = 0; s < schur.block_cameras.size() / 2; ++s) {
+        unsigned j = schur.block_cameras[2*s], k = schur.block_cameras[2*s+1];
+        const double* block = &schur.blocks[s*num_cam_params*num_cam_params];
         for (unsigned aa = 0; aa < num_cam_params; ++aa) {
           for (unsigned bb = 0; bb < num_cam_params; ++bb) {
             // FIXME: This if clause is required at the moment to
@@ -377,15 +414,26 @@ namespace camera {
             // symmetric entries are shallow, hence this code
             // would add the value twice if we're not careful
             // here.
-            if (i*num_cam_params + bb <=
-                i*num_cam_params + aa) {
-              S(i*num_cam_params + aa,
-                i*num_cam_params + bb) += static_cast<matrix_camera_camera>(U(i))(aa,bb);
+            if (k*num_cam_params + bb <=
+                j*num_cam_params + aa) {
+              S(j*num_cam_params + aa,
+                k*num_cam_params + bb) += block[aa*num_cam_params + bb];
             }
           }
         }
       }
 
+      // Augment the diagonal entries S(i,i) with U(i)
+      for (unsigned i = 0; i < this->m_model.num_cameras(); ++i) {
+        // ... and "flatten" this matrix into the scalar entries of S
+        for (unsigned aa = 0; aa < num_cam_params; ++aa) {
+          for (unsigned bb = 0; bb <= aa; ++bb) {
+            S(i*num_cam_params + aa,
+              i*num_cam_params + bb) += U[i](aa,bb);
+          }
+        }
+      }
+
       m_S = S; // S is modified in sparse solve. Keeping a copy.
       delete time;
 
@@ -410,90 +458,45 @@ namespace camera {
       delta_a = reorganize(delta_a, modified_S.inverse());
       delete time;
 
-      // Save S; used for covariance calculations
-      subvector(delta, current_delta_length, e.size()) = delta_a;
-      current_delta_length += e.size();
       // --- SOLVE B'S UPDATE STEP ---------------------------------
 
-      // Back Solving for Delta B
+      // Back Solving for Delta B, by the owners of the points
       time = new Timer("Solve Delta B", DebugMessage, "bundle_adjust");
-      boost_sparse_vector<vector_point > delta_b(this->m_model.num_points());
-
-      i = 0;
-      for (typename ControlNetwork::const_iterator iter = this->m_control_net->begin();
-           iter != this->m_control_net->end(); ++iter) {
-
-        vector_point temp;
-        for (typename ControlPoint::const_iterator j_measure_iter = (*iter).begin();
-             j_measure_iter != (*iter).end(); ++j_measure_iter) {
-          unsigned j = j_measure_iter->image_id();
-
-          temp += transpose( static_cast<matrix_camera_point>(W(j,i)) ) *
-            subvector( delta_a, j*num_cam_params, num_cam_params );
-        }
-
-        Vector<double> delta_temp = static_cast<vector_point>(epsilon_b(i)) - temp;
-
-        Matrix<double> hessian = static_cast<matrix_point_point>(V(i));
-        solve(delta_temp, hessian);
-        delta_b(i) = delta_temp;
-
-        subvector(delta, current_delta_length, num_pt_params) = delta_temp;
-        current_delta_length += num_pt_params;
-
-        ++i;
-      }
+      MPIPointUpdate point_update;
+      m_ranks.solve_points( std::vector<double>( delta_a.begin(), delta_a.end() ),
+                            point_update );
+      VW_ASSERT( point_update.points.size() == num_points,
+                 LogicErr() << "BundleAdjustmentMPISparse: missing point updates." );
+      std::vector<vector_point> delta_b(num_points);
+      for (size_t p = 0; p < point_update.points.size(); ++p)
+        for (unsigned n = 0; n < num_pt_params; ++n)
+          delta_b[point_update.points[p]][n] = point_update.delta_b[p*num_pt_params + n];
       delete time;
 
-      dS = .5 * transpose(delta) *(this->m_lambda * delta + g);
+      // With delta and g split between the cameras and the points
+      double delta_norm2 = dot_prod(delta_a, delta_a) + point_update.delta_b_norm2;
+      double dS = .5 * ( this->m_lambda * delta_norm2 +
+                         dot_prod(delta_a, g_a) + point_update.delta_b_dot_g );
 
       // -------------------------------
       // Compute the update error vector and predicted change
       // -------------------------------
       time = new Timer("Solve for Updated Error", DebugMessage, "bundle_adjust");
-      i = 0;
-      double new_error_total = 0;
-      for (typename ControlNetwork::const_iterator iter = this->m_control_net->begin();
-           iter != this->m_control_net->end(); ++iter) {
-        for (typename ControlPoint::const_iterator measure_iter = (*iter).begin();
-             measure_iter != (*iter).end(); ++measure_iter) {
-
-          unsigned j = measure_iter->image_id();
-
-          // Compute error vector
-          vector_camera new_a = this->m_model.A_parameters(j) +
-            subvector(delta_a, num_cam_params*j, num_cam_params);
-          Vector<double> del_a = subvector(delta_a, num_cam_params*j, num_cam_params);
-
-          vector_point new_b = this->m_model.B_parameters(i) +
-            static_cast<vector_point>(delta_b(i));
-
-          // Apply robust cost function weighting
-          Vector2 unweighted_error = measure_iter->dominant() -
-            this->m_model(i,j,new_a,new_b);
-          double mag = norm_2(unweighted_error);
-          double weight = sqrt(this->m_robust_cost_func(mag)) / mag;
-          new_epsilon(i,j) = weight * unweighted_error;
-
-          Matrix2x2 inverse_cov;
-          Vector2 pixel_sigma = measure_iter->sigma();
-          Vector2 epsilon_inst = new_epsilon(i,j);
-          inverse_cov(0,0) = 1/(pixel_sigma(0)*pixel_sigma(0));
-          inverse_cov(1,1) = 1/(pixel_sigma(1)*pixel_sigma(1));
-
-          new_error_total += .5 * transpose(epsilon_inst) *
-            inverse_cov * epsilon_inst;
-        }
-        ++i;
-      }
+      std::vector<double> new_a(a), new_b(b);
+      for (unsigned n = 0; n < new_a.size(); ++n)
+        new_a[n] += delta_a[n];
+      for (unsigned i = 0; i < num_points; ++i)
+        for (unsigned n = 0; n < num_pt_params; ++n)
+          new_b[i*num_pt_params+n] += delta_b[i][n];
+      double new_error_total = m_ranks.solve_update_error( new_a, new_b );
 
       // Camera Constraints
       if ( this->m_use_camera_constraint )
         for (unsigned j = 0; j < U.size(); ++j) {
 
-          vector_camera new_a = this->m_model.A_parameters(j) +
+          vector_camera a_j = this->m_model.A_parameters(j) +
             subvector(delta_a, num_cam_params*j, num_cam_params);
-          vector_camera eps_a = this->m_model.A_initial(j)-new_a;
+          vector_camera eps_a = this->m_model.A_target(j)-a_j;
 
           matrix_camera_camera inverse_cov;
           inverse_cov = this->m_model.A_inverse_covariance(j);
@@ -502,13 +505,13 @@ namespace camera {
 
       // GCP Error
       if ( this->m_use_gcp_constraint )
-        for ( unsigned i = 0; i < V.size(); ++i )
+        for ( unsigned i = 0; i < num_points; ++i )
           if ( (*this->m_control_net)[i].type() ==
-               ControlPoint::GroundControlPoint) {
+               ba::ControlPoint::GroundControlPoint) {
 
-            vector_point new_b = this->m_model.B_parameters(i) +
-              static_cast<vector_point>(delta_b(i));
-            vector_point eps_b = this->m_model.B_initial(i)-new_b;
+            vector_point b_i = this->m_model.B_parameters(i) +
+              delta_b[i];
+            vector_point eps_b = this->m_model.B_target(i)-b_i;
             matrix_point_point inverse_cov;
             inverse_cov = this->m_model.B_inverse_covariance(i);
             new_error_total += .5 * transpose(eps_b) * inverse_cov * eps_b;
@@ -520,6 +523,11 @@ namespace camera {
       double SS = error_total;            //Compute old objective
       double R = (SS - Splus)/dS;         // Compute ratio
 
+      // Summarize the stats from this step in the iteration
+      abs_tol = std::max( vw::math::max(g_a), schur.max_g ) +
+        std::max( vw::math::max(-g_a), schur.max_minus_g );
+      rel_tol = delta_norm2;
+
       if ( R > 0 ) {
 
         time = new Timer("Setting Parameters",DebugMessage,"bundle_adjust");
@@ -528,13 +536,9 @@ namespace camera {
                                          subvector(delta_a, num_cam_params*j,num_cam_params));
         for (unsigned i=0; i<this->m_model.num_points(); ++i)
           this->m_model.set_B_parameters(i, this->m_model.B_parameters(i) +
-                                         static_cast<vector_point>(delta_b(i)));
+                                         delta_b[i]);
         delete time;
 
-        // Summarize the stats from this step in the iteration
-        abs_tol = vw::math::max(g) + vw::math::max(-g);
-        rel_tol = transpose(delta)*delta;
-
         if ( this->m_control == 0 ) {
           double temp = 1 - pow((2*R - 1),3);
           if (temp < 1.0/3.0)
@@ -550,9 +554,6 @@ namespace camera {
 
       } else { // here we didn't make progress
 
-        abs_tol = vw::math::max(g) + vw::math::max(-g);
-        rel_tol = transpose(delta)*delta;
-
         if ( this->m_control == 0 ) {
           this->m_lambda *= this->m_nu;
           this->m_nu*=2;
@@ -23,7 +23,11 @@ using namespace vw;
 namespace po = boost::program_options;
 
 #include <vw/BundleAdjustment/ControlNetworkLoader.h>
+#include <asp/Tools/isis_adjust.h>
 #include <asp/MPI/BundleAdjustmentMPI.h>
+#include <asp/MPI/BundleAdjustmentMPISparse.h>
+
+namespace fs = boost::filesystem;
 
 // This sifts out from a vector of strings, a listing of GCPs.  This
 // should be useful for those programs who accept their data in a mass
@@ -43,22 +47,119 @@ sort_out_gcps( std::vector<std::string>& image_files ) {
   return gcp_files;
 }
 
+struct Options {
+  std::string cnet_file, cost_function, covariance_file;
+  std::vector<std::string> directory_names;
+  double cam_position_sigma, cam_pose_sigma, gcp_scalar, robust_threshold;
+  int max_iterations, min_matches;
+};
+
+// Run the sparse bundle adjustment on the master, with the image
+// error, the jacobians and the reduction of the points done by the
+// slaves. 'initial_a' holds the starting parameters of every camera.
+template <class CostT>
+void do_mpi_ba( CostT const& cost_function, camera::MPIMaster & master,
+                std::vector<double> const& initial_a,
+                boost::shared_ptr<ba::ControlNetwork> cnet,
+                std::vector<std::string> const& input_names, Options const& opt ) {
+  typedef IsisBundleAdjustmentModel<3,3> ModelType;
+  std::vector<Vector<double,camera::MPI_CAMERA_PARAMS> >
+    camera_parameters( input_names.size() );
+  for ( size_t j = 0; j < camera_parameters.size(); ++j )
+    for ( unsigned n = 0; n < camera::MPI_CAMERA_PARAMS; ++n )
+      camera_parameters[j][n] = initial_a[j*camera::MPI_CAMERA_PARAMS+n];
+  ModelType ba_model( camera_parameters, cnet, input_names,
+                      opt.cam_position_sigma, opt.cam_pose_sigma,
+                      opt.gcp_scalar );
+  camera::BundleAdjustmentMPISparse<ModelType, CostT>
+    bundle_adjuster( ba_model, cost_function, master );
+  if ( cost_function.name_tag() != "L2Error" )
+    bundle_adjuster.set_control( 1 ); // Shutting off fast Fletcher-style control
+
+  double abs_tol = 1e10, rel_tol = 1e10;
+  int no_improvement_count = 0;
+  while ( true ) {
+    if ( bundle_adjuster.iterations() >= opt.max_iterations ) {
+      vw_out() << "Triggered 'Max Iterations'\n";
+      break;
+    } else if ( abs_tol < 0.01 ) {
+      vw_out() << "Triggered 'Abs Tol " << abs_tol << " < 0.01'\n";
+      break;
+    } else if ( rel_tol < 1e-6 ) {
+      vw_out() << "Triggered 'Rel Tol " << rel_tol << " < 1e-10'\n";
+      break;
+    } else if ( no_improvement_count > 4 ) {
+      vw_out() << "Triggered break, unable to improve after "
+               << no_improvement_count << " iterations\n";
+      break;
+    }
+
+    double overall_delta = bundle_adjuster.update( abs_tol, rel_tol );
+    vw_out() << "Iteration " << bundle_adjuster.iterations()
+             << " : Abs Tol " << abs_tol << " Rel Tol " << rel_tol
+             << "\n";
+
+    if ( overall_delta == 0 ||
+         overall_delta == ScalarTypeLimits<double>::highest() )
+      no_improvement_count++;
+    else
+      no_improvement_count = 0;
+  }
+
+  if ( !opt.covariance_file.empty() && bundle_adjuster.iterations() > 0 ) {
+    vw_out() << "Writing camera covariances to " << opt.covariance_file << "\n";
+    bundle_adjuster.covCalc( opt.covariance_file );
+  }
+
+  std::vector<double> final_a;
+  for ( size_t j = 0; j < ba_model.num_cameras(); ++j ) {
+    Vector<double,camera::MPI_CAMERA_PARAMS> a_j = ba_model.A_parameters( j );
+    final_a.insert( final_a.end(), a_j.begin(), a_j.end() );
+  }
+  master.write_adjustments( final_a );
+}
+
 int main ( int argc, char* argv[] ) {
   mpi::environment env(argc,argv);
   mpi::communicator world;
   std::vector<std::string> input_file_names;
   std::vector<std::string> gcp_file_names;
+  Options opt;
 
-  // All MPI's slave work is in
-  // BundleAdjustmentMPI.
+  // All MPI's slave work is in BundleAdjustmentMPI. A slave that
+  // fails would leave the others waiting on it, so it takes them all
+  // down.
   if (world.rank() > 0) {
-    camera::MPISlave slave(world);
+    try {
+      camera::MPISlave slave(world);
+    } catch ( const std::exception& e ) {
+      vw_out(ErrorMessage) << "Slave " << world.rank() << ": Error: " << e.what() << "\n";
+      world.abort(1);
+    }
     return 0;
   }
 
   // Main starts here
   po::options_description general_options("Options");
   general_options.add_options()
+    ("cnet,c", po::value(&opt.cnet_file), "Load a control network from a file")
+    ("covariance-file", po::value(&opt.covariance_file),
+     "Write the covariance of the parameters of each camera to this file.")
+    ("cost-function", po::value(&opt.cost_function)->default_value("L2"),
+     "Choose a robust cost function from [PseudoHuber, Huber, L1, L2, Cauchy]")
+    ("directory,d", po::value(&opt.directory_names),
+     "Directory(-ies) to search for match files. Defaults with current directory.")
+    ("gcp-scalar", po::value(&opt.gcp_scalar)->default_value(1.0),
+     "Sets a scalar to multiply to the sigmas (uncertainty) defined for the gcps.")
+    ("min-matches", po::value(&opt.min_matches)->default_value(5),
+     "Set the minimum number of matches between images that will be considered.")
+    ("max-iterations", po::value(&opt.max_iterations)->default_value(25), "Set the maximum number of iterations.")
+    ("position-sigma", po::value(&opt.cam_position_sigma)->default_value(100.0),
+     "Set the sigma (uncertainty) of the spacecraft position. (meters)")
+    ("pose-sigma", po::value(&opt.cam_pose_sigma)->default_value(0.1),
+     "Set the sigma (uncertainty) of the spacecraft pose. (radians)")
+    ("robust-threshold", po::value(&opt.robust_threshold)->default_value(10.0),
+     "Set the threshold for robust cost functions.")
     ("help,h", "Display this help message.");
 
   po::options_description hidden_options("");
@@ -72,7 +173,7 @@ int main ( int argc, char* argv[] ) {
   p.add("input-files", -1);
 
   std::ostringstream usage;
-  usage << "Usage: " << argv[0] << " [options] <filenames>..." << std::endl << std::endl;
+  usage << "Usage: mpirun -np <N> " << argv[0] << " [options] <filenames>..." << std::endl << std::endl;
   usage << general_options << std::endl;
 
   po::variables_map vm;
@@ -88,6 +189,14 @@ int main ( int argc, char* argv[] ) {
     return 1;
   }
 
+  boost::to_lower( opt.cost_function );
+  int cost = -1;
+  if      ( opt.cost_function == "l2" )          cost = MPIL2Cost;
+  else if ( opt.cost_function == "l1" )          cost = MPIL1Cost;
+  else if ( opt.cost_function == "huber" )       cost = MPIHuberCost;
+  else if ( opt.cost_function == "pseudohuber" ) cost = MPIPseudoHuberCost;
+  else if ( opt.cost_function == "cauchy" )      cost = MPICauchyCost;
+
   if ( vm.count("help") ) {
     vw_out() << usage.str();
     int task = Finish;
@@ -99,44 +208,85 @@ int main ( int argc, char* argv[] ) {
     int task = Finish;
     broadcast(world, task, 0);
     return 1;
-  }
-
-  // Loading camera models
-  gcp_file_names = sort_out_gcps( input_file_names );
-  {
-    int task = LoadCameraModels;
+  } else if ( cost < 0 ) {
+    vw_out() << "Unknown robust cost function: " << opt.cost_function
+             << ". Options are : [ PseudoHuber, Huber, L1, L2, Cauchy]\n";
+    int task = Finish;
     broadcast(world, task, 0);
-    broadcast(world, input_file_names, 0);
+    return 1;
+  } else if ( world.size() < 2 ) {
+    vw_out() << "At least 2 MPI processes are required, the master and a slave.\n";
+    vw_out() << usage.str();
+    return 1;
   }
+  if ( opt.directory_names.empty() )
+    opt.directory_names.push_back( std::string(".") );
 
-  // Building control network & saving control network
+  try {
+    // The master sends the Finish task on destruction, but not when
+    // an exception unwinds us in the middle of a task.
+    camera::MPIMaster master( world );
 
-  // Telling slaves to load control network and to load up their
-  // respective camera models.
+    // Loading camera models. Each slave loads its share, and the
+    // master only sees them through proxies while building the
+    // control network.
+    gcp_file_names = sort_out_gcps( input_file_names );
+    std::vector<std::string> camera_serials;
+    std::vector<double> initial_a;
+    master.load_camera_models( input_file_names, camera_serials, initial_a );
+    std::vector< boost::shared_ptr<camera::CameraModel> > camera_models =
+      master.camera_proxies();
+    master.start_camera_requests();
 
-  // Performing task
-  int task;
-  for (uint i = 0; i < 3; i++ ) {
-    task = SolveJacobian;
-    Thread::sleep_ms(500);
-    broadcast(world, task, 0);
-    std::vector<std::vector<int> > all_data;
-    std::vector<int> my_data;
-    my_data.push_back(0);
-    my_data.push_back(12);
-    //gather(world, my_data, all_data, 0);
-    for ( uint i = 0; i < all_data.size(); i++ ) {
-      vw_out() << "Job " << i << " : produced " << all_data[i].size() << "\n";
+    // Building control network
+    boost::shared_ptr<ba::ControlNetwork> cnet( new ba::ControlNetwork("IsisMPIAdjust") );
+    if ( !opt.cnet_file.empty() ) {
+      if ( boost::iends_with( opt.cnet_file, ".net" ) )
+        cnet->read_isis( opt.cnet_file );
+      else
+        cnet->read_binary( opt.cnet_file );
+      BOOST_FOREACH( ba::ControlPoint & cp, *cnet ) {
+        BOOST_FOREACH( ba::ControlMeasure & cm, cp ) {
+          std::vector<std::string>::const_iterator it =
+            std::find( camera_serials.begin(), camera_serials.end(), cm.serial() );
+          if ( it == camera_serials.end() )
+            vw_throw( InputErr() << "No camera for serial, \"" << cm.serial()
+                      << "\", found in loaded Control Network" );
+          cm.set_image_id( it - camera_serials.begin() );
+        }
+        if ( cp.position() == Vector3() )
+          ba::triangulate_control_point( cp, camera_models,
+                                         8.726646E-2 ); // require 5 degrees
+      }
+    } else {
+      ba::build_control_network( *cnet, camera_models,
+                                 input_file_names, opt.min_matches,
+                                 opt.directory_names );
     }
-    vw_out() << "\n";
+    ba::add_ground_control_points( *cnet, input_file_names,
+                                   gcp_file_names.begin(), gcp_file_names.end() );
+    master.finish_camera_requests();
+    if ( cnet->size() == 0 )
+      vw_throw( ArgumentErr() << "Control network is empty.\n" );
 
-    Thread::sleep_ms(500);
-    task = SolveUpdateError;
-    broadcast(world, task, 0);
+    master.load_control_network( *cnet, cost, opt.robust_threshold );
+
+    if ( cost == MPIL2Cost )
+      do_mpi_ba( ba::L2Error(), master, initial_a, cnet, input_file_names, opt );
+    else if ( cost == MPIL1Cost )
+      do_mpi_ba( ba::L1Error(), master, initial_a, cnet, input_file_names, opt );
+    else if ( cost == MPIHuberCost )
+      do_mpi_ba( ba::HuberError(opt.robust_threshold), master, initial_a, cnet, input_file_names, opt );
+    else if ( cost == MPIPseudoHuberCost )
+      do_mpi_ba( ba::PseudoHuberError(opt.robust_threshold), master, initial_a, cnet, input_file_names, opt );
+    else
+      do_mpi_ba( ba::CauchyError(opt.robust_threshold), master, initial_a, cnet, input_file_names, opt );
+
+    master.finish();
+  } catch ( const std::exception& e ) {
+    vw_out() << "Error: " << e.what() << "\n";
+    world.abort(1);
   }
-  Thread::sleep_ms(500);
-  task = Finish;
-  broadcast(world, task, 0);
 
   return 0;
 }
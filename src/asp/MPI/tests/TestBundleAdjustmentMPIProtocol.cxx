@@ -0,0 +1,103 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+// Run under mpirun with at least 2 processes, as done by "make check",
+// so that the equations are solved through the messages of
+// MPIEquationMaster and MPIEquationSlave. With one process there is
+// nothing to test.
+
+#include <test/Helpers.h>
+#include <test/BundleAdjustTestModel.h>
+#include <vw/BundleAdjustment/AdjustSparse.h>
+#include <asp/MPI/BundleAdjustmentMPIProtocol.h>
+#include <asp/MPI/BundleAdjustmentMPISparse.h>
+
+using namespace vw;
+using namespace vw::ba;
+using namespace vw::camera;
+using asp::test::TestModel;
+
+namespace {
+
+  mpi::communicator& world() {
+    static mpi::environment env;
+    static mpi::communicator comm;
+    return comm;
+  }
+
+  // The cameras of a slave
+  class ModelProjection : public MPIProjection {
+    TestModel const& m_model;
+  public:
+    ModelProjection( TestModel const& model ) : m_model(model) {}
+    Vector2 operator()( unsigned camera, Vector<double,6> const& a_j,
+                        Vector<double,3> const& b_i ) {
+      return m_model( 0, camera, a_j, b_i );
+    }
+  };
+
+  boost::shared_ptr<ControlNetwork> make_network( std::vector<Vector3>& centers ) {
+    return asp::test::make_network( centers, 5, 10, 6, 25, true );
+  }
+}
+
+TEST( BundleAdjustmentMPIProtocol, matches_AdjustSparse ) {
+  mpi::communicator& comm = world();
+  if ( comm.size() < 2 )
+    return;
+
+  std::vector<Vector3> centers;
+  boost::shared_ptr<ControlNetwork> cnet1 = make_network( centers );
+  TestModel model1( centers, cnet1 );
+
+  if ( comm.rank() > 0 ) {
+    // A failure here would leave the master waiting
+    try {
+      ModelProjection project( model1 );
+      MPIEquationSlave slave( comm, model1.num_cameras() );
+      slave.run( project );
+    } catch ( std::exception const& e ) {
+      ADD_FAILURE() << "Slave " << comm.rank() << ": " << e.what();
+      comm.abort(1);
+    }
+    return;
+  }
+
+  boost::shared_ptr<ControlNetwork> cnet2 = make_network( centers );
+  TestModel model2( centers, cnet2 );
+  AdjustSparse<TestModel, L2Error> reference( model2, L2Error(), true, true );
+  try {
+    MPIEquationMaster master( comm, model1.num_cameras() );
+    master.load_control_network( *cnet1, MPIL2Cost, 0 );
+    BundleAdjustmentMPISparse<TestModel, L2Error> mpi( model1, L2Error(), master, true, true );
+    for ( int k = 0; k < 10; k++ ) {
+      double abs_tol1, rel_tol1, abs_tol2, rel_tol2;
+      mpi.update( abs_tol1, rel_tol1 );
+      reference.update( abs_tol2, rel_tol2 );
+    }
+    master.finish();
+  } catch ( std::exception const& e ) {
+    ADD_FAILURE() << "Master: " << e.what();
+    comm.abort(1);
+  }
+
+  for ( unsigned j = 0; j < model1.num_cameras(); j++ )
+    EXPECT_VECTOR_NEAR( model2.A_parameters(j), model1.A_parameters(j), 1e-5 );
+  for ( unsigned i = 0; i < model1.num_points(); i++ )
+    EXPECT_VECTOR_NEAR( model2.B_parameters(i), model1.B_parameters(i), 1e-4 );
+}
@@ -0,0 +1,294 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <test/BundleAdjustTestModel.h>
+#include <vw/BundleAdjustment/AdjustSparse.h>
+#include <asp/MPI/BundleAdjustmentMPISparse.h>
+
+using namespace vw;
+using namespace vw::ba;
+using namespace vw::camera;
+using asp::test::TestModel;
+
+// Each point is seen by the cameras within 25 of it, so that the
+// points of a camera are shared with different neighbors.
+boost::shared_ptr<ControlNetwork>
+make_network( std::vector<Vector3>& centers ) {
+  return asp::test::make_network( centers, 5, 10, 6, 25, true );
+}
+
+std::vector<MPIMeasure> make_measures( ControlNetwork const& cnet ) {
+  std::vector<MPIMeasure> measures;
+  for ( unsigned i = 0; i < cnet.size(); i++ )
+    BOOST_FOREACH( ControlMeasure const& cm, cnet[i] ) {
+      MPIMeasure m;
+      m.point = i;
+      m.camera = cm.image_id();
+      m.px = cm.dominant()[0];
+      m.py = cm.dominant()[1];
+      m.sigma_x = cm.sigma()[0];
+      m.sigma_y = cm.sigma()[1];
+      measures.push_back( m );
+    }
+  return measures;
+}
+
+// The master and the slaves in one process, passing what MPIMaster
+// and MPISlave would send each other by hand.
+class LocalRanks : public MPIRanks, public MPIProjection {
+  TestModel const& m_model;
+  std::vector<boost::shared_ptr<MPIRankEquations> > m_ranks;
+
+public:
+  LocalRanks( TestModel const& model, int num_ranks ) : m_model(model) {
+    std::vector<MPIMeasure> measures = make_measures( *model.control_network() );
+    std::vector<std::vector<MPIMeasure> > partition =
+      mpi_partition_measures( measures, num_ranks, model.num_cameras() );
+    for ( int rank = 0; rank < num_ranks; rank++ )
+      m_ranks.push_back( boost::shared_ptr<MPIRankEquations>
+                         ( new MPIRankEquations( rank, num_ranks, model.num_cameras(),
+                                                 partition[rank], MPIL2Cost, 0 ) ) );
+  }
+
+  MPIRankEquations const& rank( int r ) const { return *m_ranks[r]; }
+
+  Vector2 operator()( unsigned camera, Vector<double,6> const& a_j,
+                      Vector<double,3> const& b_i ) {
+    return m_model( 0, camera, a_j, b_i );
+  }
+
+  double solve_jacobian( std::vector<double> const& a, std::vector<double> const& b,
+                         std::vector<double> & camera_terms,
+                         double & max_point_diagonal ) {
+    size_t num_ranks = m_ranks.size();
+    std::vector<std::vector<std::vector<double> > > sent( num_ranks );
+    double error_total = 0;
+    camera_terms.clear();
+    for ( size_t r = 0; r < num_ranks; r++ ) {
+      std::vector<double> terms;
+      error_total += m_ranks[r]->jacobian( *this, a, b, terms, sent[r] );
+      camera_terms.insert( camera_terms.end(), terms.begin(), terms.end() );
+    }
+    max_point_diagonal = 0;
+    for ( size_t r = 0; r < num_ranks; r++ ) {
+      std::vector<std::vector<double> > received( num_ranks );
+      for ( size_t s = 0; s < num_ranks; s++ )
+        received[s] = sent[s][r];
+      max_point_diagonal = std::max( max_point_diagonal,
+                                     m_ranks[r]->receive_point_terms( received ) );
+    }
+    return error_total;
+  }
+
+  void solve_schur( double lambda, std::vector<MPIPointConstraint> const& constraints,
+                    MPISchurTerms & result ) {
+    result = MPISchurTerms();
+    for ( size_t r = 0; r < m_ranks.size(); r++ ) {
+      MPISchurTerms terms;
+      m_ranks[r]->schur( lambda, constraints, terms );
+      result.append( terms );
+    }
+  }
+
+  void solve_points( std::vector<double> const& delta_a, MPIPointUpdate & result ) {
+    result = MPIPointUpdate();
+    for ( size_t r = 0; r < m_ranks.size(); r++ ) {
+      MPIPointUpdate update;
+      m_ranks[r]->back_substitute( delta_a, update );
+      result.append( update );
+    }
+  }
+
+  double solve_update_error( std::vector<double> const& a, std::vector<double> const& b ) {
+    double error_total = 0;
+    for ( size_t r = 0; r < m_ranks.size(); r++ )
+      error_total += m_ranks[r]->error( *this, a, b );
+    return error_total;
+  }
+};
+
+TEST( BundleAdjustmentMPI, partition ) {
+  std::vector<Vector3> centers;
+  boost::shared_ptr<ControlNetwork> cnet = make_network( centers );
+  std::vector<MPIMeasure> measures = make_measures( *cnet );
+  int num_ranks = 3;
+  std::vector<std::vector<MPIMeasure> > partition =
+    mpi_partition_measures( measures, num_ranks, centers.size() );
+  ASSERT_EQ( size_t(num_ranks), partition.size() );
+  EXPECT_TRUE( partition[0].empty() ); // The master owns nothing
+
+  // Each process only gets the measures of its cameras and points,
+  // and a point belongs to the owner of the camera of its first
+  // measure.
+  size_t num_camera_measures = 0;
+  for ( int rank = 1; rank < num_ranks; rank++ ) {
+    unsigned begin, end;
+    mpi_camera_range( rank, num_ranks, centers.size(), begin, end );
+    BOOST_FOREACH( MPIMeasure const& m, partition[rank] ) {
+      EXPECT_TRUE( m.camera_owner == rank || m.point_owner == rank );
+      EXPECT_EQ( m.camera_owner, int( m.camera >= begin && m.camera < end ? rank : 3-rank ) );
+      if ( m.camera_owner == rank )
+        num_camera_measures++;
+    }
+  }
+  EXPECT_EQ( measures.size(), num_camera_measures );
+  for ( size_t k = 1; k < measures.size(); k++ )
+    if ( measures[k].point == measures[k-1].point )
+      EXPECT_EQ( measures[k-1].point_owner, measures[k].point_owner );
+}
+
+TEST( BundleAdjustmentMPISparse, matches_AdjustSparse ) {
+  std::vector<Vector3> centers;
+  boost::shared_ptr<ControlNetwork> cnet1 = make_network( centers );
+  boost::shared_ptr<ControlNetwork> cnet2 = make_network( centers );
+  TestModel model1( centers, cnet1 ), model2( centers, cnet2 );
+
+  AdjustSparse<TestModel, L2Error> reference( model1, L2Error(), true, true );
+  LocalRanks ranks( model2, 3 );
+  BundleAdjustmentMPISparse<TestModel, L2Error> mpi( model2, L2Error(), ranks, true, true );
+
+  // Both take the same steps, but for their finite differences
+  for ( int k = 0; k < 10; k++ ) {
+    double abs_tol1, rel_tol1, abs_tol2, rel_tol2;
+    reference.update( abs_tol1, rel_tol1 );
+    mpi.update( abs_tol2, rel_tol2 );
+    if ( k == 0 ) {
+      EXPECT_NEAR( rel_tol1, rel_tol2, 1e-4*rel_tol1 );
+      EXPECT_NEAR( abs_tol1, abs_tol2, 1e-4*abs_tol1 );
+    }
+  }
+  for ( unsigned j = 0; j < model1.num_cameras(); j++ )
+    EXPECT_VECTOR_NEAR( model1.A_parameters(j), model2.A_parameters(j), 1e-5 );
+  for ( unsigned i = 0; i < model1.num_points(); i++ )
+    EXPECT_VECTOR_NEAR( model1.B_parameters(i), model2.B_parameters(i), 1e-4 );
+}
+
+TEST( BundleAdjustmentMPISparse, process_count_invariant ) {
+  std::vector<Vector3> centers;
+  boost::shared_ptr<ControlNetwork> cnet1 = make_network( centers );
+  boost::shared_ptr<ControlNetwork> cnet2 = make_network( centers );
+  TestModel model1( centers, cnet1 ), model2( centers, cnet2 );
+
+  // Two slaves, and one slave per camera
+  LocalRanks ranks1( model1, 3 ), ranks2( model2, 6 );
+  EXPECT_EQ( 0u, ranks2.rank(0).num_points() );
+  BundleAdjustmentMPISparse<TestModel, L2Error> mpi1( model1, L2Error(), ranks1, true, true );
+  BundleAdjustmentMPISparse<TestModel, L2Error> mpi2( model2, L2Error(), ranks2, true, true );
+  for ( int k = 0; k < 5; k++ ) {
+    double abs_tol1, rel_tol1, abs_tol2, rel_tol2;
+    mpi1.update( abs_tol1, rel_tol1 );
+    mpi2.update( abs_tol2, rel_tol2 );
+    EXPECT_NEAR( rel_tol1, rel_tol2, 1e-8*(1+rel_tol1) );
+  }
+  for ( unsigned j = 0; j < model1.num_cameras(); j++ )
+    EXPECT_VECTOR_NEAR( model1.A_parameters(j), model2.A_parameters(j), 1e-8 );
+  for ( unsigned i = 0; i < model1.num_points(); i++ )
+    EXPECT_VECTOR_NEAR( model1.B_parameters(i), model2.B_parameters(i), 1e-6 );
+}
+
+// A random symmetric positive definite matrix made of 6x6 blocks,
+// the off diagonal blocks coupling a few cameras far apart in their
+// numbering, so that Cuthill-McKee reorders them.
+math::MatrixSparseSkyline<double> make_skyline_matrix() {
+  const int nc = 6, num_cameras = 6;
+  const int couplings[][2] = { {3,0}, {5,0}, {4,1}, {5,2}, {2,1} };
+  math::MatrixSparseSkyline<double> S( nc*num_cameras, nc*num_cameras );
+  std::vector<double> row_sum( nc*num_cameras, 0.0 );
+  srand( 42 );
+  for ( int k = 0; k < 5; k++ ) {
+    int c1 = couplings[k][0], c2 = couplings[k][1];
+    for ( int aa = 0; aa < nc; aa++ )
+      for ( int bb = 0; bb < nc; bb++ ) {
+        double value = double( rand() ) / RAND_MAX - 0.5;
+        S( c1*nc+aa, c2*nc+bb ) = value;
+        row_sum[c1*nc+aa] += fabs( value );
+        row_sum[c2*nc+bb] += fabs( value );
+      }
+  }
+  for ( int c = 0; c < num_cameras; c++ )
+    for ( int aa = 0; aa < nc; aa++ )
+      for ( int bb = 0; bb < aa; bb++ ) {
+        double value = double( rand() ) / RAND_MAX - 0.5;
+        S( c*nc+aa, c*nc+bb ) = value;
+        row_sum[c*nc+aa] += fabs( value );
+        row_sum[c*nc+bb] += fabs( value );
+      }
+  // Diagonally dominant, hence positive definite
+  for ( int i = 0; i < nc*num_cameras; i++ )
+    S( i, i ) = row_sum[i] + 1;
+  return S;
+}
+
+void expect_inverse_blocks( math::MatrixSparseSkyline<double> const& S,
+                            std::vector<uint> const& ordering ) {
+  math::MatrixSparseSkyline<double> S_copy = S;
+  math::MatrixReorganize<math::MatrixSparseSkyline<double> > mod_S( S_copy, ordering );
+  Vector<uint> skyline = math::solve_for_skyline( mod_S );
+  std::vector<Matrix<double,6,6> > blocks =
+    inverse_diagonal_blocks<6>( S, ordering, skyline );
+
+  math::MatrixSparseSkyline<double> S_solve = S; // The solve is destructive
+  Matrix<double> Id( S.rows(), S.cols() );
+  Id.set_identity();
+  Matrix<double> inverse = math::multi_sparse_solve( S_solve, Id );
+
+  ASSERT_EQ( S.rows()/6, blocks.size() );
+  for ( size_t c = 0; c < blocks.size(); c++ )
+    EXPECT_MATRIX_NEAR( submatrix( inverse, c*6, c*6, 6, 6 ), blocks[c], 1e-12 );
+}
+
+TEST( BundleAdjustmentMPISparse, inverse_diagonal_blocks ) {
+  math::MatrixSparseSkyline<double> S = make_skyline_matrix();
+  std::vector<uint> identity( S.rows() );
+  for ( size_t i = 0; i < identity.size(); i++ )
+    identity[i] = i;
+  expect_inverse_blocks( S, identity );
+}
+
+TEST( BundleAdjustmentMPISparse, inverse_diagonal_blocks_reordered ) {
+  math::MatrixSparseSkyline<double> S = make_skyline_matrix();
+  std::vector<uint> ordering = math::cuthill_mckee_ordering( S, 6 );
+  bool reordered = false;
+  for ( size_t i = 0; i < ordering.size(); i++ )
+    reordered = reordered || ordering[i] != i;
+  EXPECT_TRUE( reordered );
+  expect_inverse_blocks( S, ordering );
+}
+
+TEST( BundleAdjustmentMPISparse, camera_covariances ) {
+  std::vector<Vector3> centers;
+  boost::shared_ptr<ControlNetwork> cnet = make_network( centers );
+  TestModel model( centers, cnet );
+  LocalRanks ranks( model, 3 );
+  BundleAdjustmentMPISparse<TestModel, L2Error> mpi( model, L2Error(), ranks, true, true );
+  EXPECT_THROW( mpi.camera_covariances(), LogicErr );
+
+  double abs_tol, rel_tol;
+  mpi.update( abs_tol, rel_tol );
+  std::vector<Matrix<double,6,6> > covariances = mpi.camera_covariances();
+
+  // S is the last reduced camera system, with lambda on its diagonal
+  math::MatrixSparseSkyline<double> S = mpi.S();
+  Matrix<double> Id( S.rows(), S.cols() );
+  Id.set_identity();
+  Matrix<double> inverse = math::multi_sparse_solve( S, Id );
+  ASSERT_EQ( model.num_cameras(), covariances.size() );
+  for ( size_t c = 0; c < covariances.size(); c++ )
+    EXPECT_MATRIX_NEAR( submatrix( inverse, c*6, c*6, 6, 6 ), covariances[c], 1e-10 );
+}
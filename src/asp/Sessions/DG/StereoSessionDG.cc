@@ -34,6 +34,7 @@
 #include <asp/Sessions/DG/StereoSessionDG.h>
 #include <asp/Sessions/RPC/RPCModel.h>
 #include <asp/Sessions/DG/XML.h>
+#include <asp/Sessions/DG/XMLCache.h>
 
 #include <iostream>
 #include <string>
@@ -98,12 +99,13 @@ namespace asp {
   StereoSessionDG::camera_model( std::string const& /*image_file*/,
                                  std::string const& camera_file ) {
 
+    // Parsed once per XML file, then read from a binary cache, kept
+    // with the output prefix, by all later stages and tile processes.
     GeometricXML geo;
     AttitudeXML att;
     EphemerisXML eph;
     ImageXML img;
-    RPCXML rpc;
-    read_xml( camera_file, geo, att, eph, img, rpc );
+    read_xml_cached( camera_file, m_out_prefix, geo, att, eph, img );
 
     // Convert measurements in millimeters to pixels.
     geo.principal_distance /= geo.detector_pixel_pitch;
@@ -270,7 +272,7 @@ namespace asp {
     if ( stereo_settings().alignment_method == "homography" ||
          stereo_settings().alignment_method == "affineepipolar" ) {
       std::string match_filename
-        = ip::match_filename(m_out_prefix, left_input_file, right_input_file);
+        = asp::match_filename(m_out_prefix, left_input_file, right_input_file);
 
       if (!fs::exists(match_filename)) {
         // This is calling an internal virtualized method.
@@ -0,0 +1,309 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <asp/Sessions/DG/XMLCache.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace vw;
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+  const char   CACHE_MAGIC[8]  = {'A','S','P','D','G','X','M','L'};
+  const uint32 CACHE_VERSION   = 1;
+  const uint64 MAX_CACHE_COUNT = 1 << 26; // Guards against damaged files
+
+  // Raw, native byte order, I/O. A cache written on a machine of the
+  // other byte order fails the version check and is rebuilt.
+  template <class T>
+  void write_raw( std::ostream& os, T const& value ) {
+    os.write( reinterpret_cast<const char*>(&value), sizeof(T) );
+  }
+
+  template <class T>
+  bool read_raw( std::istream& is, T& value ) {
+    is.read( reinterpret_cast<char*>(&value), sizeof(T) );
+    return bool(is);
+  }
+
+  void write_string( std::ostream& os, std::string const& str ) {
+    write_raw( os, uint64(str.size()) );
+    os.write( str.data(), str.size() );
+  }
+
+  bool read_string( std::istream& is, std::string& str ) {
+    uint64 size;
+    if ( !read_raw( is, size ) || size > MAX_CACHE_COUNT )
+      return false;
+    str.resize( size );
+    if ( size > 0 )
+      is.read( &str[0], size );
+    return bool(is);
+  }
+
+  template <class VectorT>
+  void write_vector( std::ostream& os, VectorT const& vec ) {
+    for ( size_t i = 0; i < vec.size(); i++ )
+      write_raw( os, double(vec[i]) );
+  }
+
+  template <class VectorT>
+  bool read_vector( std::istream& is, VectorT& vec ) {
+    for ( size_t i = 0; i < vec.size(); i++ ) {
+      double value;
+      if ( !read_raw( is, value ) )
+        return false;
+      vec[i] = value;
+    }
+    return true;
+  }
+
+  void write_quat( std::ostream& os, Quat const& q ) {
+    write_raw( os, q.w() );
+    write_raw( os, q.x() );
+    write_raw( os, q.y() );
+    write_raw( os, q.z() );
+  }
+
+  bool read_quat( std::istream& is, Quat& q ) {
+    double w, x, y, z;
+    if ( !read_raw( is, w ) || !read_raw( is, x ) ||
+         !read_raw( is, y ) || !read_raw( is, z ) )
+      return false;
+    q = Quat( w, x, y, z );
+    return true;
+  }
+
+  bool read_count( std::istream& is, uint64& count ) {
+    return read_raw( is, count ) && count <= MAX_CACHE_COUNT;
+  }
+
+  // True if 'path' is a regular file of the current user. The tiles
+  // of parallel_stereo reach the cache through a link.
+  bool owned_regular_file( std::string const& path ) {
+    struct stat st;
+    return stat( path.c_str(), &st ) == 0 && S_ISREG( st.st_mode ) &&
+      st.st_uid == geteuid();
+  }
+}
+
+uint64 asp::file_checksum( std::string const& filename ) {
+  std::ifstream file( filename.c_str(), std::ios::binary );
+  if ( !file )
+    vw_throw( IOErr() << "Could not open: " << filename << "\n" );
+
+  // 64 bit FNV-1a
+  uint64 hash = 14695981039346656037ULL;
+  char buffer[1<<16];
+  while ( file ) {
+    file.read( buffer, sizeof(buffer) );
+    std::streamsize count = file.gcount();
+    for ( std::streamsize i = 0; i < count; i++ ) {
+      hash ^= uint8(buffer[i]);
+      hash *= 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+std::string asp::xml_cache_filename( std::string const& out_prefix,
+                                     uint64 checksum ) {
+  if ( out_prefix.empty() )
+    return "";
+  std::ostringstream name;
+  name << out_prefix << "-camera-" << std::hex << checksum << ".dgcache";
+  return name.str();
+}
+
+bool asp::read_xml_cache( std::string const& cache_file,
+                          uint64 checksum,
+                          GeometricXML& geo,
+                          AttitudeXML& att,
+                          EphemerisXML& eph,
+                          ImageXML& img ) {
+  if ( !owned_regular_file( cache_file ) )
+    return false;
+  std::ifstream is( cache_file.c_str(), std::ios::binary );
+  if ( !is )
+    return false;
+
+  char magic[8];
+  uint32 version;
+  uint64 file_checksum;
+  is.read( magic, sizeof(magic) );
+  if ( !is || std::memcmp( magic, CACHE_MAGIC, sizeof(magic) ) != 0 ||
+       !read_raw( is, version ) || version != CACHE_VERSION ||
+       !read_raw( is, file_checksum ) || file_checksum != checksum )
+    return false;
+
+  // Geometry
+  if ( !read_raw( is, geo.principal_distance ) ||
+       !read_raw( is, geo.optical_polyorder ) ||
+       !read_vector( is, geo.perspective_center ) ||
+       !read_quat( is, geo.camera_attitude ) ||
+       !read_vector( is, geo.detector_origin ) ||
+       !read_raw( is, geo.detector_rotation ) ||
+       !read_raw( is, geo.detector_pixel_pitch ) )
+    return false;
+
+  // Attitude
+  uint64 count;
+  if ( !read_string( is, att.start_time ) ||
+       !read_raw( is, att.time_interval ) ||
+       !read_count( is, count ) )
+    return false;
+  att.quat_vec.resize( count );
+  for ( size_t i = 0; i < count; i++ )
+    if ( !read_quat( is, att.quat_vec[i] ) )
+      return false;
+
+  // Ephemeris
+  if ( !read_string( is, eph.start_time ) ||
+       !read_raw( is, eph.time_interval ) ||
+       !read_count( is, count ) )
+    return false;
+  eph.position_vec.resize( count );
+  eph.velocity_vec.resize( count );
+  for ( size_t i = 0; i < count; i++ )
+    if ( !read_vector( is, eph.position_vec[i] ) ||
+         !read_vector( is, eph.velocity_vec[i] ) )
+      return false;
+
+  // Image
+  if ( !read_string( is, img.tlc_start_time ) ||
+       !read_string( is, img.first_line_start_time ) ||
+       !read_string( is, img.sat_id ) ||
+       !read_string( is, img.scan_direction ) ||
+       !read_raw( is, img.tdi ) ||
+       !read_raw( is, img.avg_line_rate ) ||
+       !read_raw( is, img.image_size[0] ) ||
+       !read_raw( is, img.image_size[1] ) ||
+       !read_count( is, count ) )
+    return false;
+  img.tlc_vec.resize( count );
+  for ( size_t i = 0; i < count; i++ )
+    if ( !read_raw( is, img.tlc_vec[i].first ) ||
+         !read_raw( is, img.tlc_vec[i].second ) )
+      return false;
+
+  return true;
+}
+
+bool asp::write_xml_cache( std::string const& cache_file,
+                           uint64 checksum,
+                           GeometricXML const& geo,
+                           AttitudeXML const& att,
+                           EphemerisXML const& eph,
+                           ImageXML const& img ) {
+  try {
+    fs::path tmp_file = fs::unique_path( cache_file + ".%%%%-%%%%" );
+    {
+      std::ofstream os( tmp_file.string().c_str(), std::ios::binary );
+      if ( !os )
+        return false;
+
+      os.write( CACHE_MAGIC, sizeof(CACHE_MAGIC) );
+      write_raw( os, CACHE_VERSION );
+      write_raw( os, checksum );
+
+      write_raw( os, geo.principal_distance );
+      write_raw( os, geo.optical_polyorder );
+      write_vector( os, geo.perspective_center );
+      write_quat( os, geo.camera_attitude );
+      write_vector( os, geo.detector_origin );
+      write_raw( os, geo.detector_rotation );
+      write_raw( os, geo.detector_pixel_pitch );
+
+      write_string( os, att.start_time );
+      write_raw( os, att.time_interval );
+      write_raw( os, uint64(att.quat_vec.size()) );
+      for ( size_t i = 0; i < att.quat_vec.size(); i++ )
+        write_quat( os, att.quat_vec[i] );
+
+      write_string( os, eph.start_time );
+      write_raw( os, eph.time_interval );
+      write_raw( os, uint64(eph.position_vec.size()) );
+      for ( size_t i = 0; i < eph.position_vec.size(); i++ ) {
+        write_vector( os, eph.position_vec[i] );
+        write_vector( os, eph.velocity_vec[i] );
+      }
+
+      write_string( os, img.tlc_start_time );
+      write_string( os, img.first_line_start_time );
+      write_string( os, img.sat_id );
+      write_string( os, img.scan_direction );
+      write_raw( os, img.tdi );
+      write_raw( os, img.avg_line_rate );
+      write_raw( os, img.image_size[0] );
+      write_raw( os, img.image_size[1] );
+      write_raw( os, uint64(img.tlc_vec.size()) );
+      for ( size_t i = 0; i < img.tlc_vec.size(); i++ ) {
+        write_raw( os, img.tlc_vec[i].first );
+        write_raw( os, img.tlc_vec[i].second );
+      }
+
+      if ( !os ) {
+        os.close();
+        fs::remove( tmp_file );
+        return false;
+      }
+    }
+    fs::rename( tmp_file, cache_file );
+  } catch ( fs::filesystem_error const& e ) {
+    vw_out(DebugMessage,"asp") << "Could not write camera cache "
+                               << cache_file << ": " << e.what() << "\n";
+    return false;
+  }
+  return true;
+}
+
+void asp::read_xml_cached( std::string const& filename,
+                           std::string const& out_prefix,
+                           GeometricXML& geo,
+                           AttitudeXML& att,
+                           EphemerisXML& eph,
+                           ImageXML& img ) {
+  uint64 checksum = file_checksum( filename );
+  std::string cache_file = xml_cache_filename( out_prefix, checksum );
+  if ( cache_file.empty() ) {
+    RPCXML rpc;
+    read_xml( filename, geo, att, eph, img, rpc );
+    return;
+  }
+
+  if ( read_xml_cache( cache_file, checksum, geo, att, eph, img ) ) {
+    vw_out(DebugMessage,"asp") << "Read camera of " << filename
+                               << " from cache " << cache_file << "\n";
+    return;
+  }
+
+  RPCXML rpc;
+  read_xml( filename, geo, att, eph, img, rpc );
+  write_xml_cache( cache_file, checksum, geo, att, eph, img );
+}
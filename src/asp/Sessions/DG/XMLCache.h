@@ -0,0 +1,84 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file XMLCache.h
+///
+/// A binary cache of the parts of a DigitalGlobe XML file needed to
+/// build a camera model. Parsing the XML with Xerces takes a large
+/// fraction of a second for a long image, and parallel_stereo builds
+/// the cameras again in every stage of every tile process. The cache
+/// is written once, next to the other files with the output prefix,
+/// and is keyed by a checksum of the XML contents so that it is never
+/// stale. It is named <output prefix>-camera-<checksum>.dgcache and,
+/// like the other outputs, is left for the user to remove. Without an
+/// output prefix there is no cache.
+///
+/// Only the geometry, attitude, ephemeris and image blocks are
+/// cached, without the covariances, which the camera model does not
+/// use. The RPC block is still read from the XML when needed.
+
+#ifndef __STEREO_SESSION_DG_XMLCACHE_H__
+#define __STEREO_SESSION_DG_XMLCACHE_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <asp/Sessions/DG/XML.h>
+
+#include <string>
+
+namespace asp {
+
+  // Checksum of the contents of a file
+  vw::uint64 file_checksum( std::string const& filename );
+
+  // The cache file for XML contents with the given checksum, or an
+  // empty string for an empty 'out_prefix'.
+  std::string xml_cache_filename( std::string const& out_prefix,
+                                  vw::uint64 checksum );
+
+  // Returns false, leaving the outputs in an unspecified state, if the
+  // cache file does not exist, is not a regular file owned by the
+  // current user, is damaged or has a different checksum.
+  bool read_xml_cache( std::string const& cache_file,
+                       vw::uint64 checksum,
+                       GeometricXML& geo,
+                       AttitudeXML& att,
+                       EphemerisXML& eph,
+                       ImageXML& img );
+
+  // Writes to a temporary file that is then renamed, so that
+  // processes racing to create the same cache never see a partial
+  // file. Returns false on failure.
+  bool write_xml_cache( std::string const& cache_file,
+                        vw::uint64 checksum,
+                        GeometricXML const& geo,
+                        AttitudeXML const& att,
+                        EphemerisXML const& eph,
+                        ImageXML const& img );
+
+  // Same as read_xml without the RPC model, going through the cache
+  // for the given output prefix. Xerces must have been initialized.
+  void read_xml_cached( std::string const& filename,
+                        std::string const& out_prefix,
+                        GeometricXML& geo,
+                        AttitudeXML& att,
+                        EphemerisXML& eph,
+                        ImageXML& img );
+
+} //end namespace asp
+
+#endif//__STEREO_SESSION_DG_XMLCACHE_H__
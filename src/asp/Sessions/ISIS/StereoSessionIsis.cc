@@ -49,6 +49,7 @@
 #include <asp/Sessions/ISIS/StereoSessionIsis.h>
 #include <asp/IsisIO/IsisCameraModel.h>
 #include <asp/IsisIO/IsisAdjustCameraModel.h>
+#include <asp/IsisIO/IsisTabulatedLineScanModel.h>
 #include <asp/IsisIO/DiskImageResourceIsis.h>
 #include <asp/IsisIO/Equation.h>
 #include <asp/Sessions/ISIS/PhotometricOutlier.h>
@@ -229,6 +230,15 @@ asp::StereoSessionIsis::pre_preprocessing_hook(std::string const& left_input_fil
   left_output_file = m_out_prefix + "-L.tif";
   right_output_file = m_out_prefix + "-R.tif";
 
+  // Sample and validate the tabulated cameras once here. The later
+  // stages, and the tiles of parallel_stereo, read them back.
+  if ( stereo_settings().isis_tabulated_camera ) {
+    if ( !boost::ends_with(boost::to_lower_copy(m_left_camera_file), ".isis_adjust") )
+      tabulated_camera_model( m_left_image_file, true );
+    if ( !boost::ends_with(boost::to_lower_copy(m_right_camera_file), ".isis_adjust") )
+      tabulated_camera_model( m_right_image_file, true );
+  }
+
   if ( fs::exists(left_output_file) && fs::exists(right_output_file) ) {
     try {
       vw_log().console_log().rule_set().add_rule(-1,"fileio");
@@ -285,17 +295,23 @@ asp::StereoSessionIsis::pre_preprocessing_hook(std::string const& left_input_fil
   if ( stereo_settings().alignment_method == "homography" ||
        stereo_settings().alignment_method == "affineepipolar" ) {
     std::string match_filename
-      = ip::match_filename(m_out_prefix, left_input_file, right_input_file);
+      = asp::match_filename(m_out_prefix, left_input_file, right_input_file);
 
     if (!fs::exists(match_filename)) {
       boost::shared_ptr<camera::CameraModel> left_cam, right_cam;
       camera_models( left_cam, right_cam );
 
+      Vector3 radii;
       boost::shared_ptr<IsisCameraModel> isis_cam =
         boost::dynamic_pointer_cast<IsisCameraModel>(left_cam);
-      VW_ASSERT( isis_cam.get() != NULL,
-               ArgumentErr() << "StereoSessionISIS: Invalid left camera.\n" );
-      Vector3 radii = isis_cam->target_radii();
+      boost::shared_ptr<IsisTabulatedLineScanModel> tab_cam =
+        boost::dynamic_pointer_cast<IsisTabulatedLineScanModel>(left_cam);
+      if ( isis_cam.get() != NULL )
+        radii = isis_cam->target_radii();
+      else if ( tab_cam.get() != NULL )
+        radii = tab_cam->target_radii();
+      else
+        vw_throw( ArgumentErr() << "StereoSessionISIS: Invalid left camera.\n" );
       cartography::Datum datum("","","", (radii[0] + radii[1]) / 2, radii[2], 0);
 
       bool inlier =
@@ -464,10 +480,76 @@ asp::StereoSessionIsis::camera_model(std::string const& image_file,
     // Finally creating camera model
     return boost::shared_ptr<camera::CameraModel>(new IsisAdjustCameraModel( image_file, posF, poseF ));
 
+  } else if ( stereo_settings().isis_tabulated_camera ) {
+    return tabulated_camera_model( image_file, false );
+
   } else {
     return boost::shared_ptr<camera::CameraModel>(new IsisCameraModel(image_file));
   }
 
 }
 
+std::string
+asp::StereoSessionIsis::tabulated_camera_file(std::string const& image_file) const {
+  if ( m_out_prefix.empty() )
+    return "";
+  if ( image_file == m_left_image_file )
+    return m_out_prefix + "-L.tabcam";
+  if ( image_file == m_right_image_file )
+    return m_out_prefix + "-R.tabcam";
+  return "";
+}
+
+boost::shared_ptr<vw::camera::CameraModel>
+asp::StereoSessionIsis::tabulated_camera_model(std::string const& image_file,
+                                               bool save) {
+
+  double tolerance = stereo_settings().isis_tabulated_tolerance;
+  std::string tab_file = tabulated_camera_file( image_file );
+
+  // Use the saved camera if it is newer than the cube and was
+  // validated to the current tolerance.
+  if ( !save && !tab_file.empty() && fs::exists( tab_file ) &&
+       fs::last_write_time( tab_file ) >= fs::last_write_time( image_file ) ) {
+    try {
+      boost::shared_ptr<IsisTabulatedLineScanModel> tab_cam( new IsisTabulatedLineScanModel );
+      IsisTabulatedLineScanModel::ValidationReport report = tab_cam->read( tab_file );
+      if ( report.num_points > 0 && report.max_pixel_error <= tolerance ) {
+        vw_out(DebugMessage,"asp") << "Using tabulated camera " << tab_file << "\n";
+        return tab_cam;
+      }
+    } catch ( const IOErr& e ) {
+      vw_out(WarningMessage) << e.what() << " Sampling the camera again.\n";
+    }
+  }
+
+  // Only unprojected line scan images can be tabulated
+  boost::shared_ptr<IsisTabulatedLineScanModel> tab_cam;
+  try {
+    tab_cam.reset( new IsisTabulatedLineScanModel( image_file ) );
+  } catch ( const NoImplErr& e ) {
+    vw_out(WarningMessage) << e.what()
+                           << " Using the ISIS camera, which is single-threaded.\n";
+    return boost::shared_ptr<camera::CameraModel>(new IsisCameraModel(image_file));
+  }
+
+  // Since the callers will use the tabulated camera from many
+  // threads, refuse to fall back silently to the ISIS camera if it is
+  // not accurate enough.
+  IsisCameraModel isis_cam( image_file );
+  IsisTabulatedLineScanModel::ValidationReport report = tab_cam->validate( isis_cam );
+  vw_out() << "\t--> Tabulated ISIS camera for " << image_file
+           << ": max pixel error " << report.max_pixel_error
+           << ", mean pixel error " << report.mean_pixel_error
+           << ", max angle error " << report.max_angle_error << " rad.\n";
+  if ( report.num_points == 0 || !(report.max_pixel_error <= tolerance) )
+    vw_throw( ArgumentErr() << "The tabulated camera for " << image_file
+              << " does not agree with ISIS to within " << tolerance
+              << " pixels. Run without --isis-tabulated-camera.\n" );
+
+  if ( save && !tab_file.empty() )
+    tab_cam->write( tab_file, report );
+  return tab_cam;
+}
+
 #endif  // ASP_HAVE_PKG_ISISIO
@@ -176,6 +176,18 @@ namespace asp {
     pre_pointcloud_hook(std::string const& input_file);
 
     static StereoSession* construct() { return new StereoSessionIsis; }
+
+  private:
+    // File in which preprocessing saves the tabulated camera of the
+    // left or right image. Empty for other images.
+    std::string tabulated_camera_file(std::string const& image_file) const;
+
+    // The tabulated camera of an image, read back from its file if
+    // that is still valid and else sampled from ISIS, validated and,
+    // if 'save' is set, written to the file. Images which are not
+    // unprojected line scan ones get the ISIS camera.
+    boost::shared_ptr<vw::camera::CameraModel>
+    tabulated_camera_model(std::string const& image_file, bool save);
   };
 
 } // end namespace asp
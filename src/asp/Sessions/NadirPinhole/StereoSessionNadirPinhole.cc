@@ -132,7 +132,7 @@ void asp::StereoSessionNadirPinhole::pre_preprocessing_hook(
       right_size = file_image_size( right_input_file );
 
     std::string match_filename
-      = ip::match_filename(m_out_prefix, left_input_file, right_input_file);
+      = asp::match_filename(m_out_prefix, left_input_file, right_input_file);
 
     if (!fs::exists(match_filename)) {
       boost::shared_ptr<camera::CameraModel> left_cam, right_cam;
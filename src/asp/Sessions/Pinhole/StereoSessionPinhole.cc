@@ -68,7 +68,7 @@ determine_image_align( std::string const& out_prefix,
   ImageT2 const& image2 = input2.impl();
   std::vector<ip::InterestPoint> matched_ip1, matched_ip2;
   std::string match_filename
-    = ip::match_filename(out_prefix, input_file1, input_file2);
+    = asp::match_filename(out_prefix, input_file1, input_file2);
 
   if ( fs::exists( match_filename ) ) {
     // Is there a match file linking these 2 image?
@@ -94,7 +94,7 @@ determine_image_align( std::string const& out_prefix,
     // Next best thing.. VWIPs?
     std::vector<ip::InterestPoint> ip1_copy, ip2_copy;
     std::string ip1_filename, ip2_filename;
-    ip::ip_filenames(out_prefix, input_file1, input_file2,
+    asp::ip_filenames(out_prefix, input_file1, input_file2,
                      ip1_filename, ip2_filename);
     if ( fs::exists( ip1_filename ) &&
          fs::exists( ip2_filename ) ) {
@@ -133,11 +133,16 @@ determine_image_align( std::string const& out_prefix,
     }
 
     vw_out() << "\t--> Matching interest points\n";
-    ip::InterestPointMatcher<ip::L2NormMetric,ip::NullConstraint> matcher(0.5);
-
-    matcher(ip1_copy, ip2_copy,
-            matched_ip1, matched_ip2,
-            TerminalProgressCallback( "asp", "\t    Matching: "));
+    if ( stereo_settings().binary_ip_descriptors ) {
+      // asp::detect_ip made binary descriptors
+      asp::match_binary_descriptors( ip1_copy, ip2_copy,
+                                     matched_ip1, matched_ip2, 0.5 );
+    } else {
+      ip::InterestPointMatcher<ip::L2NormMetric,ip::NullConstraint> matcher(0.5);
+      matcher(ip1_copy, ip2_copy,
+              matched_ip1, matched_ip2,
+              TerminalProgressCallback( "asp", "\t    Matching: "));
+    }
 
   } // End matching
 
@@ -37,6 +37,10 @@
 #include <asp/Sessions/Pinhole/StereoSessionPinhole.h>
 #include <asp/Sessions/RPC/StereoSessionRPC.h>
 #include <asp/Sessions/StereoSession.h>
+#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
+#include <asp/IsisIO/IsisCameraModel.h>
+#include <asp/IsisIO/IsisAdjustCameraModel.h>
+#endif
 
 #include <map>
 #include <utility>
@@ -197,8 +201,12 @@ namespace asp {
   // perform anything, they're just place holders.
   void StereoSession::camera_models(boost::shared_ptr<vw::camera::CameraModel> &cam1,
                                     boost::shared_ptr<vw::camera::CameraModel> &cam2) {
-    cam1 = camera_model(m_left_image_file, m_left_camera_file);
-    cam2 = camera_model(m_right_image_file, m_right_camera_file);
+    if ( !m_left_camera )
+      m_left_camera = camera_model(m_left_image_file, m_left_camera_file);
+    if ( !m_right_camera )
+      m_right_camera = camera_model(m_right_image_file, m_right_camera_file);
+    cam1 = m_left_camera;
+    cam2 = m_right_camera;
   }
 
   // Processing Hooks. The default is to do nothing.
@@ -277,4 +285,13 @@ namespace asp {
     return;
   }
 
+  bool camera_thread_safe(vw::camera::CameraModel const& camera) {
+#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
+    if ( dynamic_cast<vw::camera::IsisCameraModel const*>(&camera) ||
+         dynamic_cast<vw::camera::IsisAdjustCameraModel const*>(&camera) )
+      return false;
+#endif
+    return true;
+  }
+
 }
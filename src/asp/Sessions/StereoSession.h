@@ -126,6 +126,10 @@ namespace asp {
     std::string m_input_dem, m_extra_argument1,
       m_extra_argument2, m_extra_argument3;
 
+    // Cameras of the images, loaded on first use and then kept for
+    // the life of the session
+    boost::shared_ptr<vw::camera::CameraModel> m_left_camera, m_right_camera;
+
     virtual void initialize (BaseOptions const& options,
                              std::string const& left_image_file,
                              std::string const& right_image_file,
@@ -155,7 +159,8 @@ namespace asp {
     typedef StereoSession* (*construct_func)();
     static void register_session_type( std::string const& id, construct_func func);
 
-    // Helper function that retrieves both cameras.
+    // Helper function that retrieves both cameras. They are loaded
+    // only once per session.
     virtual void camera_models(boost::shared_ptr<vw::camera::CameraModel> &cam1,
                                boost::shared_ptr<vw::camera::CameraModel> &cam2);
 
@@ -215,6 +220,11 @@ namespace asp {
                            float & right_nodata_value);
   };
 
+  // Whether the methods of a camera may be called from several
+  // threads at once. The ISIS cameras keep their state in the
+  // Isis::Camera object and may not.
+  bool camera_thread_safe(vw::camera::CameraModel const& camera);
+
 } // end namespace asp
 
 #endif // __STEREO_SESSION_H__
@@ -18,8 +18,11 @@
 
 #include <asp/Sessions/DG/StereoSessionDG.h>
 #include <asp/Sessions/DG/XML.h>
+#include <asp/Sessions/DG/XMLCache.h>
 #include <asp/Sessions/RPC/RPCModel.h>
 #include <boost/scoped_ptr.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <test/Helpers.h>
 
 #include <vw/Stereo/StereoModel.h>
@@ -146,6 +149,80 @@ TEST(StereoSessionDG, CreateCamera) {
   EXPECT_NO_THROW( boost::shared_ptr<camera::CameraModel> cam3( session.camera_model("", "dg_example3.xml") ) );
 }
 
+TEST(StereoSessionDG, XMLCache) {
+  XMLPlatformUtils::Initialize();
+
+  GeometricXML geo;
+  AttitudeXML att;
+  EphemerisXML eph;
+  ImageXML img;
+  RPCXML rpc;
+  read_xml( "dg_example1.xml", geo, att, eph, img, rpc );
+
+  uint64 checksum = file_checksum( "dg_example1.xml" );
+  EXPECT_EQ( checksum, file_checksum( "dg_example1.xml" ) );
+  EXPECT_NE( checksum, file_checksum( "dg_example2.xml" ) );
+
+  // The cache goes next to the outputs, and there is none without an
+  // output prefix
+  EXPECT_EQ( "", xml_cache_filename( "", checksum ) );
+  std::string cache_name = xml_cache_filename( "out", checksum );
+  EXPECT_TRUE( boost::starts_with( cache_name, "out-camera-" ) );
+  UnlinkName cache_file( cache_name );
+  ASSERT_TRUE( write_xml_cache( cache_file, checksum, geo, att, eph, img ) );
+
+  GeometricXML geo2;
+  AttitudeXML att2;
+  EphemerisXML eph2;
+  ImageXML img2;
+  EXPECT_FALSE( read_xml_cache( cache_file, checksum + 1, geo2, att2, eph2, img2 ) );
+  ASSERT_TRUE( read_xml_cache( cache_file, checksum, geo2, att2, eph2, img2 ) );
+
+  // The cache holds exact copies of the parsed values
+  EXPECT_EQ( geo.principal_distance, geo2.principal_distance );
+  EXPECT_EQ( geo.optical_polyorder, geo2.optical_polyorder );
+  EXPECT_VECTOR_NEAR( geo.perspective_center, geo2.perspective_center, 0 );
+  EXPECT_EQ( geo.camera_attitude.w(), geo2.camera_attitude.w() );
+  EXPECT_VECTOR_NEAR( geo.detector_origin, geo2.detector_origin, 0 );
+  EXPECT_EQ( geo.detector_rotation, geo2.detector_rotation );
+  EXPECT_EQ( geo.detector_pixel_pitch, geo2.detector_pixel_pitch );
+
+  EXPECT_EQ( att.start_time, att2.start_time );
+  EXPECT_EQ( att.time_interval, att2.time_interval );
+  ASSERT_EQ( att.quat_vec.size(), att2.quat_vec.size() );
+  for ( size_t i = 0; i < att.quat_vec.size(); i++ ) {
+    EXPECT_EQ( att.quat_vec[i].w(), att2.quat_vec[i].w() );
+    EXPECT_EQ( att.quat_vec[i].x(), att2.quat_vec[i].x() );
+    EXPECT_EQ( att.quat_vec[i].y(), att2.quat_vec[i].y() );
+    EXPECT_EQ( att.quat_vec[i].z(), att2.quat_vec[i].z() );
+  }
+
+  EXPECT_EQ( eph.start_time, eph2.start_time );
+  EXPECT_EQ( eph.time_interval, eph2.time_interval );
+  ASSERT_EQ( eph.position_vec.size(), eph2.position_vec.size() );
+  for ( size_t i = 0; i < eph.position_vec.size(); i++ ) {
+    EXPECT_VECTOR_NEAR( eph.position_vec[i], eph2.position_vec[i], 0 );
+    EXPECT_VECTOR_NEAR( eph.velocity_vec[i], eph2.velocity_vec[i], 0 );
+  }
+
+  EXPECT_EQ( img.tlc_start_time, img2.tlc_start_time );
+  EXPECT_EQ( img.first_line_start_time, img2.first_line_start_time );
+  EXPECT_EQ( img.scan_direction, img2.scan_direction );
+  EXPECT_EQ( img.avg_line_rate, img2.avg_line_rate );
+  EXPECT_EQ( img.image_size, img2.image_size );
+  ASSERT_EQ( img.tlc_vec.size(), img2.tlc_vec.size() );
+  for ( size_t i = 0; i < img.tlc_vec.size(); i++ ) {
+    EXPECT_EQ( img.tlc_vec[i].first,  img2.tlc_vec[i].first );
+    EXPECT_EQ( img.tlc_vec[i].second, img2.tlc_vec[i].second );
+  }
+
+  // A cut file is rejected
+  boost::filesystem::resize_file( cache_file, boost::filesystem::file_size( cache_file ) / 2 );
+  EXPECT_FALSE( read_xml_cache( cache_file, checksum, geo2, att2, eph2, img2 ) );
+
+  XMLPlatformUtils::Terminate();
+}
+
 TEST(StereoSessionDG, ReadRPC) {
   XMLPlatformUtils::Initialize();
 
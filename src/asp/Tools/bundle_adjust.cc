@@ -64,11 +64,55 @@ struct Options : public asp::BaseOptions {
   std::vector<boost::shared_ptr<CameraModel> > camera_models;
 };
 
+// Per iteration timing for the report. The parallel adjuster also
+// breaks it down by phase.
+template <class StreamT, class AdjusterT>
+void report_timing( StreamT& os, AdjusterT const& adjuster, double seconds ) {
+  os << "Iteration " << adjuster.iterations() << " took " << seconds << " s\n";
+}
+
+template <class StreamT, class ModelT, class CostT>
+void report_timing( StreamT& os, asp::AdjustSparseParallel<ModelT,CostT> const& adjuster,
+                    double seconds ) {
+  typename asp::AdjustSparseParallel<ModelT,CostT>::Timing const& t = adjuster.last_timing();
+  os << "Iteration " << adjuster.iterations() << " took " << seconds << " s ("
+     << adjuster.num_threads() << " threads): assembly " << t.assembly
+     << " s, solve " << t.solve << " s, update error " << t.update_error << " s\n";
+}
+
+// Create the adjuster. Only the parallel adjuster takes a number of
+// threads.
+template <class AdjusterT>
+struct AdjusterFactory {
+  static AdjusterT* create( BundleAdjustmentModel& ba_model,
+                            typename AdjusterT::cost_type const& cost_function,
+                            int /*num_threads*/ ) {
+    return new AdjusterT(ba_model, cost_function, false, false);
+  }
+};
+
+template <class ModelT, class CostT>
+struct AdjusterFactory<asp::AdjustSparseParallel<ModelT,CostT> > {
+  typedef asp::AdjustSparseParallel<ModelT,CostT> AdjusterT;
+  static AdjusterT* create( ModelT& ba_model, CostT const& cost_function,
+                            int num_threads ) {
+    return new AdjusterT(ba_model, cost_function, false, false, num_threads);
+  }
+};
+
 template <class AdjusterT>
 void do_ba( typename  AdjusterT::cost_type const& cost_function,
             Options const& opt ) {
   BundleAdjustmentModel ba_model(opt.camera_models, opt.cnet);
-  AdjusterT bundle_adjuster(ba_model, cost_function, false, false);
+
+  int num_threads = vw_settings().default_num_threads();
+  if ( num_threads > 1 && !ba_model.cameras_thread_safe() ) {
+    vw_out() << "\t--> The camera models are not thread safe. Using a single thread.\n";
+    num_threads = 1;
+  }
+  boost::scoped_ptr<AdjusterT>
+    adjuster_ptr( AdjusterFactory<AdjusterT>::create(ba_model, cost_function, num_threads) );
+  AdjusterT& bundle_adjuster = *adjuster_ptr;
 
   if ( opt.lambda > 0 )
     bundle_adjuster.set_lambda( opt.lambda );
@@ -107,8 +151,12 @@ void do_ba( typename  AdjusterT::cost_type const& cost_function,
       break;
     }
 
+    Stopwatch watch;
+    watch.start();
     overall_delta = bundle_adjuster.update( abs_tol, rel_tol );
+    watch.stop();
     reporter.loop_tie_in();
+    report_timing( reporter(), bundle_adjuster, watch.elapsed_seconds() );
 
     // Writing Current Camera Parameters to file for later reading
     if (opt.save_iteration) {
@@ -132,7 +180,7 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("cnet,c", po::value(&opt.cnet_file),
      "Load a control network from a file")
     ("bundle-adjuster", po::value(&opt.ba_type)->default_value("RobustSparse"),
-     "Choose a robust cost function from [PseudoHuber, Huber, L1, L2, Cauchy]")
+     "Choose a bundle adjustment version from [Ref, Sparse, RobustRef, RobustSparse, ParallelSparse]. ParallelSparse assembles the jacobians on --threads threads.")
     ("session-type,t", po::value(&opt.stereosession_type)->default_value("isis"),
      "Select the stereo session type to use for processing.")
     ("lambda,l", po::value(&opt.lambda)->default_value(-1),
@@ -169,9 +217,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if ( !( opt.ba_type == "ref" ||
           opt.ba_type == "sparse" ||
           opt.ba_type == "robustref" ||
-          opt.ba_type == "robustsparse" ) )
+          opt.ba_type == "robustsparse" ||
+          opt.ba_type == "parallelsparse" ) )
     vw_throw( ArgumentErr() << "Unknown bundle adjustment version: " << opt.ba_type
-              << ". Options are : [Ref, Sparse, RobustRef, RobustSparse]\n" );
+              << ". Options are : [Ref, Sparse, RobustRef, RobustSparse, ParallelSparse]\n" );
 }
 
 int main(int argc, char* argv[]) {
@@ -251,6 +300,8 @@ int main(int argc, char* argv[]) {
         do_ba<AdjustRobustRef< ModelType,L2Error> >( L2Error(), opt );
       } else if ( opt.ba_type == "robustsparse" ) {
         do_ba<AdjustRobustSparse< ModelType,L2Error> >( L2Error(), opt );
+      } else if ( opt.ba_type == "parallelsparse" ) {
+        do_ba<asp::AdjustSparseParallel< ModelType,L2Error> >( L2Error(), opt );
       }
     }
 
@@ -33,6 +33,7 @@
 
 #include <asp/Sessions.h>
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Core/BundleAdjustParallel.h>
 #include <asp/Core/StereoSettings.h>
 
 // Bundle adjustment functor
@@ -87,6 +88,14 @@ public:
   unsigned num_points() const { return b.size(); }
   unsigned num_pixel_observations() const { return m_num_pixel_observations; }
 
+  // Whether operator() may be called from several threads at once
+  bool cameras_thread_safe() const {
+    for (unsigned j = 0; j < m_cameras.size(); ++j)
+      if (!asp::camera_thread_safe(*m_cameras[j]))
+        return false;
+    return true;
+  }
+
   // Return the covariance of the camera parameters for camera j.
   inline vw::Matrix<double,camera_params_n,camera_params_n>
   A_inverse_covariance ( unsigned /*j*/ ) const {
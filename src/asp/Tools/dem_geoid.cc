@@ -25,6 +25,7 @@
 #include <vw/Math.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/ApproxTransform.h>
 
 #include <boost/filesystem.hpp>
 namespace po = boost::program_options;
@@ -35,13 +36,60 @@ using std::string;
 using namespace vw;
 using namespace vw::cartography;
 
+// Maps a pixel in the DEM to the pixel in the geoid at the same
+// longitude and latitude.
+class DemToGeoidTrans : public TransformBase<DemToGeoidTrans> {
+  GeoReference m_georef, m_geoid_georef;
+public:
+  DemToGeoidTrans( GeoReference const& georef, GeoReference const& geoid_georef ):
+    m_georef(georef), m_geoid_georef(geoid_georef) {}
+
+  inline Vector2 reverse( Vector2 const& p ) const {
+
+    Vector2 lonlat = m_georef.pixel_to_lonlat(p);
+
+    // For testing (see the link to the reference web form belows).
+    //lonlat[0] = -121;   lonlat[1] = 37;   // mainland US
+    //lonlat[0] = -152;   lonlat[1] = 66;   // Alaska
+    //lonlat[0] = -155.5; lonlat[1] = 19.5; // Hawaii
+
+    // Need to carefully wrap lonlat to the [0, 360) x [-90, 90) box.
+    // Note that lon = 25, lat = 91 is the same as lon = 180 + 25, lat = 89
+    // as we go through the North pole and show up on the other side.
+    while ( std::abs(lonlat[1]) > 90.0 ){
+      if ( lonlat[1] > 90.0 ){
+        lonlat[1] = 180.0 - lonlat[1];
+        lonlat[0] += 180.0;
+      }
+      if ( lonlat[1] < -90.0 ){
+        lonlat[1] = -180.0 - lonlat[1];
+        lonlat[0] += 180.0;
+      }
+    }
+    while( lonlat[0] <   0.0  ) lonlat[0] += 360.0;
+    while( lonlat[0] >= 360.0 ) lonlat[0] -= 360.0;
+
+    return m_geoid_georef.lonlat_to_pixel(lonlat);
+  }
+
+  inline Vector2 forward( Vector2 const& p ) const {
+    return m_georef.lonlat_to_pixel( m_geoid_georef.pixel_to_lonlat(p) );
+  }
+
+  // The geoid is kept in memory, so the region of it that is needed
+  // does not matter.
+  inline BBox2i reverse_bbox( BBox2i const& bbox ) const { return bbox; }
+};
+
+// The DEM to geoid transform is interpolated on a grid over each tile,
+// within a tolerance in geoid pixels. A tolerance of 0 makes it exact.
 template <class ImageT>
 class DemGeoidView : public ImageViewBase<DemGeoidView<ImageT> >
 {
+  typedef asp::ApproxTransform<DemToGeoidTrans> TransT;
   ImageT m_img;
-  GeoReference const& m_georef;
+  TransT m_trans;
   ImageViewRef<PixelMask<double> > const& m_geoid;
-  GeoReference const& m_geoid_georef;
   bool m_reverse_adjustment;
   double m_correction;
   double m_nodata_val;
@@ -52,11 +100,11 @@ public:
   typedef double result_type;
   typedef ProceduralPixelAccessor<DemGeoidView> pixel_accessor;
 
-  DemGeoidView(ImageT const& img, GeoReference const& georef,
+  DemGeoidView(ImageT const& img, TransT const& trans,
                ImageViewRef<PixelMask<double> > const& geoid,
-               GeoReference const& geoid_georef, bool reverse_adjustment, double correction, double nodata_val):
-    m_img(img), m_georef(georef),
-    m_geoid(geoid), m_geoid_georef(geoid_georef),
+               bool reverse_adjustment, double correction, double nodata_val):
+    m_img(img), m_trans(trans),
+    m_geoid(geoid),
     m_reverse_adjustment(reverse_adjustment),
     m_correction(correction),
     m_nodata_val(nodata_val){}
@@ -71,31 +119,8 @@ public:
 
     if ( m_img(col, row, p) == m_nodata_val ) return m_nodata_val;
 
-    Vector2 lonlat = m_georef.pixel_to_lonlat(Vector2(col, row));
-
-    // For testing (see the link to the reference web form belows).
-    //lonlat[0] = -121;   lonlat[1] = 37;   // mainland US
-    //lonlat[0] = -152;   lonlat[1] = 66;   // Alaska
-    //lonlat[0] = -155.5; lonlat[1] = 19.5; // Hawaii
-
-    // Need to carefully wrap lonlat to the [0, 360) x [-90, 90) box.
-    // Note that lon = 25, lat = 91 is the same as lon = 180 + 25, lat = 89
-    // as we go through the North pole and show up on the other side.
-    while ( std::abs(lonlat[1]) > 90.0 ){
-      if ( lonlat[1] > 90.0 ){
-        lonlat[1] = 180.0 - lonlat[1];
-        lonlat[0] += 180.0;
-      }
-      if ( lonlat[1] < -90.0 ){
-        lonlat[1] = -180.0 - lonlat[1];
-        lonlat[0] += 180.0;
-      }
-    }
-    while( lonlat[0] <   0.0  ) lonlat[0] += 360.0;
-    while( lonlat[0] >= 360.0 ) lonlat[0] -= 360.0;
-
     result_type       geoid_height           = 0.0;
-    Vector2           pix                    = m_geoid_georef.lonlat_to_pixel(lonlat);
+    Vector2           pix                    = m_trans.reverse(Vector2(col, row));
     PixelMask<double> interp_val             = m_geoid(pix[0], pix[1]);
     if (!is_valid(interp_val)) return m_nodata_val;
     geoid_height                             = interp_val.child() + m_correction;
@@ -110,8 +135,11 @@ public:
   /// \cond INTERNAL
   typedef DemGeoidView<typename ImageT::prerasterize_type> prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return prerasterize_type( m_img.prerasterize(bbox), m_georef,
-                              m_geoid, m_geoid_georef, m_reverse_adjustment, m_correction, m_nodata_val );
+    // Each tile gets its own interpolation grid
+    TransT trans = m_trans;
+    trans.reverse_bbox(bbox);
+    return prerasterize_type( m_img.prerasterize(bbox), trans,
+                              m_geoid, m_reverse_adjustment, m_correction, m_nodata_val );
   }
   template <class DestT> inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
     vw::rasterize( prerasterize(bbox), dest, bbox );
@@ -123,9 +151,12 @@ template <class ImageT>
 DemGeoidView<ImageT>
 dem_geoid( ImageViewBase<ImageT> const& img, GeoReference const& georef,
            ImageViewRef<PixelMask<double> > const& geoid,
-           GeoReference const& geoid_georef, bool reverse_adjustment, double correction, double nodata_val) {
-  return DemGeoidView<ImageT>( img.impl(), georef, geoid, geoid_georef,
-                               reverse_adjustment, correction, nodata_val );
+           GeoReference const& geoid_georef, bool reverse_adjustment, double correction,
+           double nodata_val, double approx_tolerance) {
+  return DemGeoidView<ImageT>( img.impl(),
+                               asp::approx_transform( DemToGeoidTrans( georef, geoid_georef ),
+                                                      approx_tolerance ),
+                               geoid, reverse_adjustment, correction, nodata_val );
 }
 
 struct Options : asp::BaseOptions {
@@ -133,6 +164,7 @@ struct Options : asp::BaseOptions {
   double nodata_value;
   bool use_double;
   bool reverse_adjustment;
+  double approx_tolerance;
 };
 
 std::string get_geoid_full_path(std::string geoid_file){
@@ -173,7 +205,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ){
      "Output using double precision (64 bit) instead of float (32 bit).")
     ("reverse-adjustment",
      po::bool_switch(&opt.reverse_adjustment)->default_value(false)->implicit_value(true),
-     "Go from DEM relative to the geoid to DEM relative to the ellipsoid.");
+     "Go from DEM relative to the geoid to DEM relative to the ellipsoid.")
+    ("approximate-tolerance", po::value(&opt.approx_tolerance)->default_value(0.0),
+     "Interpolate the location in the geoid of the DEM pixels instead of computing it for each pixel, keeping the error below this many geoid pixels (e.g., 0.01). Use 0 to compute it for each pixel.");
 
   general_options.add( asp::BaseOptionsDescription(opt) );
 
@@ -193,6 +227,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ){
     vw_throw( ArgumentErr() << "Requires <dem> in order to proceed.\n\n"
               << usage << general_options );
 
+  if ( opt.approx_tolerance < 0 )
+    vw_throw( ArgumentErr() << "The approximation tolerance must not be negative.\n" );
+
   if ( opt.out_prefix.empty() )
     opt.out_prefix = fs::path(opt.dem_name).stem().string();
   
@@ -315,7 +352,8 @@ int main( int argc, char *argv[] ) {
                     BicubicInterpolation(), ZeroEdgeExtension());
 
     ImageViewRef<double> adj_dem = dem_geoid(dem_img, dem_georef, geoid, geoid_georef,
-                                             reverse_adjustment, major_correction, dem_nodata_val);
+                                             reverse_adjustment, major_correction, dem_nodata_val,
+                                             opt.approx_tolerance);
 
     std::string adj_dem_file = opt.out_prefix + "-adj.tif";
     vw_out() << "Writing adjusted DEM: " << adj_dem_file << std::endl;
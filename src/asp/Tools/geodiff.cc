@@ -29,6 +29,7 @@ using namespace vw::cartography;
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/ApproxTransform.h>
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
@@ -45,7 +46,7 @@ public:
 
 struct Options : asp::BaseOptions {
   string dem1_name, dem2_name, output_prefix;
-  double nodata_value;
+  double nodata_value, approx_tolerance;
 
   bool use_float, use_absolute;
 };
@@ -56,7 +57,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("nodata_value",    po::value(&opt.nodata_value)->default_value(-32768),      "The value of missing pixels in the first dem")
     ("output-prefix,o", po::value(&opt.output_prefix),                            "Specify the output prefix.")
     ("float",           po::bool_switch(&opt.use_float)->default_value(false),    "Output using float (32 bit) instead of using doubles (64 bit).")
-    ("absolute",        po::bool_switch(&opt.use_absolute)->default_value(false), "Output the absolute difference as opposed to just the difference.");
+    ("absolute",        po::bool_switch(&opt.use_absolute)->default_value(false), "Output the absolute difference as opposed to just the difference.")
+    ("approximate-tolerance", po::value(&opt.approx_tolerance)->default_value(0.0), "Interpolate the reprojection of the second DEM onto the first one instead of reprojecting each pixel, keeping the error below this many pixels (e.g., 0.05). Use 0 to reproject every pixel.");
   general_options.add( asp::BaseOptionsDescription(opt) );
 
   po::options_description positional("");
@@ -76,6 +78,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if ( opt.dem1_name.empty() || opt.dem2_name.empty() )
     vw_throw( ArgumentErr() << "Requires <dem1> and <dem2> in order to proceed.\n\n" << usage << general_options );
 
+  if ( opt.approx_tolerance < 0 )
+    vw_throw( ArgumentErr() << "The approximation tolerance must not be negative.\n" );
+
   if ( opt.output_prefix.empty() ) {
     opt.output_prefix =
       fs::basename(opt.dem1_name) + "__" + fs::basename(opt.dem2_name);
@@ -118,13 +123,25 @@ int main( int argc, char *argv[] ) {
     BBox2 union_bbox = bounding_box( dem1_dmg );
     union_bbox.crop(bounding_box( dem2_dmg ));
 
-    ImageViewRef<PixelMask<double> > dem2_trans =
-      crop(geo_transform( per_pixel_filter(dem_to_geodetic( create_mask(dem2_dmg, dem2_nodata),
-                                                            dem2_georef),
-                                           MGeodeticToMAltitude()),
-                          dem2_georef, dem1_georef,
-                          ValueEdgeExtension<PixelMask<double> >(PixelMask<double>()) ),
-           union_bbox );
+    ImageViewRef<PixelMask<double> > dem2_heights =
+      per_pixel_filter(dem_to_geodetic( create_mask(dem2_dmg, dem2_nodata), dem2_georef),
+                       MGeodeticToMAltitude());
+    ValueEdgeExtension<PixelMask<double> > dem2_edge( (PixelMask<double>()) );
+    ImageViewRef<PixelMask<double> > dem2_trans;
+    if ( opt.approx_tolerance > 0 ) {
+      // Same as geo_transform(), with the reprojection interpolated
+      // on a grid over each tile.
+      dem2_trans =
+        crop(transform( dem2_heights,
+                        asp::approx_transform( GeoTransform(dem2_georef, dem1_georef),
+                                               opt.approx_tolerance ),
+                        dem2_edge, BilinearInterpolation() ),
+             union_bbox );
+    } else {
+      dem2_trans =
+        crop(geo_transform( dem2_heights, dem2_georef, dem1_georef, dem2_edge ),
+             union_bbox );
+    }
 
     ImageViewRef<double> difference;
     if ( opt.use_absolute ) {
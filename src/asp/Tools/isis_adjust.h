@@ -66,6 +66,28 @@ class IsisBundleAdjustmentModel : public vw::ba::ModelBase< IsisBundleAdjustment
   float m_spacecraft_pose_sigma;
   float m_gcp_scalar;
 
+  void init_network() {
+    // Compute the number of observations from the bundle.
+    m_num_pixel_observations = 0;
+    for (unsigned i = 0; i < m_network->size(); ++i)
+      m_num_pixel_observations += (*m_network)[i].size();
+
+    // Setting up B vectors
+    for (unsigned i = 0; i < m_network->size(); ++i) {
+      b_target[i] = (*m_network)[i].position();
+    }
+
+    // Checking to see if this Control Network is compatible with
+    // IsisBundleAdjustmentModel
+    if ( !(*m_network)[0][0].is_pixels_dominant() )
+      vw_out(vw::WarningMessage,"asp") << "WARNING: Control Network doesn't appear to be using pixels" << std::endl;
+  }
+
+  void check_camera( int j ) const {
+    VW_ASSERT( j >= 0 && size_t(j) < m_cameras.size(),
+               vw::LogicErr() << "IsisBundleAdjustmentModel: no camera model for camera " << j << "." );
+  }
+
 public:
 
   IsisBundleAdjustmentModel( std::vector< boost::shared_ptr< vw::camera::IsisAdjustCameraModel> > const& camera_models,
@@ -79,11 +101,6 @@ public:
     m_spacecraft_position_sigma(spacecraft_position_sigma),
     m_spacecraft_pose_sigma(spacecraft_pose_sigma), m_gcp_scalar(gcp_scalar) {
 
-    // Compute the number of observations from the bundle.
-    m_num_pixel_observations = 0;
-    for (unsigned i = 0; i < network->size(); ++i)
-      m_num_pixel_observations += (*network)[i].size();
-
     // Set up the A and B vectors, storing the initial values.
     for (unsigned j = 0; j < m_cameras.size(); ++j) {
       // I'm using what is already in the IsisAdjust camera file as
@@ -101,16 +118,23 @@ public:
       a_target[j] = a[j];
     }
 
-    // Setting up B vectors
-    for (unsigned i = 0; i < network->size(); ++i) {
-      b_target[i] = (*m_network)[i].position();
-    }
-
-    // Checking to see if this Control Network is compatible with
-    // IsisBundleAdjustmentModel
-    if ( !(*m_network)[0][0].is_pixels_dominant() )
-      vw_out(vw::WarningMessage,"asp") << "WARNING: Control Network doesn't appear to be using pixels" << std::endl;
+    init_network();
+  }
 
+  // A model without camera models, starting from the given camera
+  // parameters. This is all the master of isis_mpi_adjust needs, as
+  // the slaves hold the cameras. The projection and the adjusted
+  // cameras are then unavailable.
+  IsisBundleAdjustmentModel( std::vector<camera_vector_t> const& camera_parameters,
+                             boost::shared_ptr<vw::ba::ControlNetwork> network,
+                             std::vector< std::string > input_names,
+                             float const& spacecraft_position_sigma,
+                             float const& spacecraft_pose_sigma, float const& gcp_scalar ) :
+    m_network(network), a( camera_parameters ), a_target( camera_parameters ),
+    b_target( network->size() ), m_files( input_names ),
+    m_spacecraft_position_sigma(spacecraft_position_sigma),
+    m_spacecraft_pose_sigma(spacecraft_pose_sigma), m_gcp_scalar(gcp_scalar) {
+    init_network();
   }
 
   // Return a reference to the camera and point parameters.
@@ -188,6 +212,7 @@ public:
 
   // This is for writing isis_adjust file for later
   void write_adjustment( int j, std::string const& filename ) const {
+    check_camera( j );
     std::ofstream ostr( filename.c_str() );
 
     write_equation( ostr, m_cameras[j]->position_func() );
@@ -198,6 +223,7 @@ public:
 
   boost::shared_ptr< vw::camera::IsisAdjustCameraModel >
   adjusted_camera( int j ) const {
+    check_camera( j );
     // Adjusting position and pose equations
     boost::shared_ptr<asp::BaseEquation> posF = m_cameras[j]->position_func();
     boost::shared_ptr<asp::BaseEquation> poseF = m_cameras[j]->pose_func();
@@ -227,6 +253,7 @@ public:
   vw::Vector2 operator() ( unsigned /*i*/, unsigned j,
                            camera_vector_t const& a_j,
                            point_vector_t const& b_i ) const {
+    check_camera( j );
 
     // Loading equations
     boost::shared_ptr<asp::BaseEquation> posF = m_cameras[j]->position_func();
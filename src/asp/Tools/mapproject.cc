@@ -29,12 +29,17 @@ using namespace vw::cartography;
 
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/StereoSettings.h>
+#include <asp/Core/ApproxTransform.h>
 #include <asp/Sessions/DG/StereoSessionDG.h>
 #include <asp/Sessions/DG/XML.h>
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
 #include "ogr_spatialref.h"
+#include "gdal.h"
+
+#include <fstream>
 
 typedef PixelMask<float> PMaskT;
 
@@ -46,7 +51,13 @@ struct Options : asp::BaseOptions {
   // Settings
   std::string target_srs_string;
   double nodata_value, target_resolution, mpp, ppd;
+  double approx_tolerance;
+  int approx_grid_spacing, num_processes;
   BBox2 target_projwin, target_pixelwin;
+
+  // Set once the camera is loaded
+  bool thread_safe_camera;
+  Options() : thread_safe_camera(true) {}
 };
 
 void handle_arguments( int argc, char *argv[], Options& opt ) {
@@ -70,7 +81,17 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("t_projwin",        po::value(&opt.target_projwin),
      "Selects a subwindow from the source image for copying, with the corners given in georeferenced coordinates (xmin ymin xmax ymax). Max is exclusive.")
     ("t_pixelwin",       po::value(&opt.target_pixelwin),
-      "Selects a subwindow from the source image for copying, with the corners given in georeferenced pixel coordinates (xmin ymin xmax ymax). Max is exclusive.");
+      "Selects a subwindow from the source image for copying, with the corners given in georeferenced pixel coordinates (xmin ymin xmax ymax). Max is exclusive.")
+    ("isis-tabulated-camera", po::bool_switch(&asp::stereo_settings().isis_tabulated_camera)->default_value(false)->implicit_value(true),
+     "Sample ISIS line scan cameras once into a thread-safe table so that map-projection can use multiple threads.")
+    ("isis-tabulated-tolerance", po::value(&asp::stereo_settings().isis_tabulated_tolerance)->default_value(0.05),
+     "Maximum reprojection error, in pixels, of the tabulated ISIS camera versus ISIS itself.")
+    ("approximate-tolerance", po::value(&opt.approx_tolerance)->default_value(0.0),
+     "Interpolate the camera projection on an adaptive grid instead of projecting each output pixel, keeping the error below this many image pixels (e.g., 0.05). Use 0 to project every pixel.")
+    ("approximate-grid-spacing", po::value(&opt.approx_grid_spacing)->default_value(32),
+     "Spacing in output pixels of the coarse grid used with --approximate-tolerance.")
+    ("processes", po::value(&opt.num_processes)->default_value(1),
+     "Number of processes to use with ISIS cameras, which are not thread safe. Each process projects a strip of the output with its own camera. Use 0 for as many as threads.");
 
   general_options.add( asp::BaseOptionsDescription(opt) );
 
@@ -102,6 +123,14 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_out(WarningMessage) << "Images map-projected using the 'dg' camera model cannot be used later to run stereo with the 'dg' session. If that is desired, please specify here the 'rpc' camera model instead.\n";
   }
 
+  if ( opt.num_processes < 0 )
+    vw_throw( ArgumentErr() << "The number of processes must be non-negative.\n" );
+  if ( opt.num_processes == 0 )
+    opt.num_processes = vw_settings().default_num_threads();
+
+  if ( opt.approx_tolerance < 0 || opt.approx_grid_spacing < 2 )
+    vw_throw( ArgumentErr() << "The approximation tolerance must be non-negative and the grid spacing at least 2.\n" );
+
   if ( boost::iends_with(boost::to_lower_copy(opt.camera_model_file), ".xml") &&
        opt.stereo_session == "" ){
     opt.stereo_session = "rpc";
@@ -109,6 +138,14 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   
 }
 
+// Save the session type. Later in stereo we will check that we use
+// only images written by mapproject with the -t rpc session.
+std::map<std::string, std::string> output_keywords( Options const& opt ) {
+  std::map<std::string, std::string> keywords;
+  keywords["CAMERA_MODEL_TYPE" ] = opt.stereo_session;
+  return keywords;
+}
+
 template <class ImageT>
 void write_parallel_cond( std::string              const& filename,
                           ImageViewBase<ImageT>    const& image,
@@ -117,16 +154,12 @@ void write_parallel_cond( std::string              const& filename,
                           Options                  const& opt,
                           TerminalProgressCallback const& tpc ) {
 
-  // Save the session type. Later in stereo we will check that we use
-  // only images written by mapproject with the -t rpc session.
-  std::map<std::string, std::string> keywords;
-  keywords["CAMERA_MODEL_TYPE" ] = opt.stereo_session;
-
-  // ISIS is not thread safe so we must switch out base on what the session is.
+  std::map<std::string, std::string> keywords = output_keywords( opt );
+  bool single_threaded = !opt.thread_safe_camera;
 
   vw_out() << "Writing: " << filename << "\n";
   if (has_nodata){
-    if ( opt.stereo_session == "isis" ) {
+    if ( single_threaded ) {
       asp::write_gdal_georeferenced_image(filename, image.impl(), georef,
                                           nodata_val, opt, tpc, keywords);
     } else {
@@ -134,7 +167,7 @@ void write_parallel_cond( std::string              const& filename,
                                   nodata_val, opt, tpc, keywords);
     }
   }else{ // Does not have nodata
-    if ( opt.stereo_session == "isis" ) {
+    if ( single_threaded ) {
       asp::write_gdal_georeferenced_image(filename, image.impl(), georef,
                                           opt, tpc, keywords);
     } else {
@@ -145,6 +178,266 @@ void write_parallel_cond( std::string              const& filename,
 
 }
 
+/// Mosaic of horizontal strips of the output, each in its own file,
+/// stacked top to bottom.
+class StripMosaicView : public ImageViewBase<StripMosaicView> {
+  std::vector<DiskImageView<float> > m_strips;
+  std::vector<int> m_starts; // First row of each strip
+  int m_cols, m_rows;
+
+public:
+  StripMosaicView( std::vector<std::string> const& files ) : m_cols(0), m_rows(0) {
+    for ( size_t k = 0; k < files.size(); k++ ) {
+      m_strips.push_back( DiskImageView<float>( files[k] ) );
+      m_starts.push_back( m_rows );
+      if ( k > 0 && m_strips[k].cols() != m_cols )
+        vw_throw( IOErr() << "Strip " << files[k] << " has "
+                  << m_strips[k].cols() << " columns instead of " << m_cols << ".\n" );
+      m_cols  = m_strips[k].cols();
+      m_rows += m_strips[k].rows();
+    }
+  }
+
+  typedef float pixel_type;
+  typedef pixel_type result_type;
+  typedef ProceduralPixelAccessor<StripMosaicView> pixel_accessor;
+
+  inline int32 cols() const { return m_cols; }
+  inline int32 rows() const { return m_rows; }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+  inline pixel_type operator()( double/*i*/, double/*j*/, int32/*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "StripMosaicView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    for ( size_t k = 0; k < m_strips.size(); k++ ) {
+      BBox2i strip_box( 0, m_starts[k], m_strips[k].cols(), m_strips[k].rows() );
+      strip_box.crop( bbox );
+      if ( strip_box.empty() ) continue;
+      crop( tile, strip_box - bbox.min() ) =
+        crop( m_strips[k], strip_box - Vector2i(0, m_starts[k]) );
+    }
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows() );
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+// Quote an argument for the shell
+std::string shell_quote( std::string const& arg ) {
+  std::string quoted = "'";
+  for ( size_t i = 0; i < arg.size(); i++ ) {
+    if ( arg[i] == '\'' ) quoted += "'\\''";
+    else                  quoted += arg[i];
+  }
+  return quoted + "'";
+}
+
+// Escape the characters that are special in XML
+std::string xml_escape( std::string const& text ) {
+  std::string escaped;
+  for ( size_t i = 0; i < text.size(); i++ ) {
+    switch ( text[i] ) {
+    case '&':  escaped += "&amp;";  break;
+    case '<':  escaped += "&lt;";   break;
+    case '>':  escaped += "&gt;";   break;
+    case '"':  escaped += "&quot;"; break;
+    default:   escaped += text[i];
+    }
+  }
+  return escaped;
+}
+
+// Run one mapproject process on a strip of the output
+class StripTask : public Task, private boost::noncopyable {
+  std::string m_cmd;
+  int & m_status;
+public:
+  StripTask( std::string const& cmd, int & status ) : m_cmd(cmd), m_status(status) {}
+  void operator()() { m_status = system( m_cmd.c_str() ); }
+};
+
+/// Split the output into horizontal strips and project each one in
+/// a separate invocation of this program, since ISIS cameras cannot
+/// be shared between threads. The strips are assembled into a VRT if
+/// the output file has that extension, and into a GeoTIFF otherwise.
+/// Each pixel is computed exactly as in a single process.
+void write_multi_process( std::string const& program, Options const& opt,
+                          BBox2i const& croppedImageBB,
+                          GeoReference const& croppedGeoRef ) {
+
+  // Command line of the children, from the parsed options. The
+  // resolution is the one computed here, so that the children need
+  // not redo that and get the same georeference.
+  std::ostringstream base;
+  base.precision(17);
+  base << shell_quote( program )
+       << " --session-type " << shell_quote( opt.stereo_session )
+       << " --tr " << opt.target_resolution
+       << " --nodata-value " << opt.nodata_value
+       << " --approximate-tolerance " << opt.approx_tolerance
+       << " --approximate-grid-spacing " << opt.approx_grid_spacing
+       << " --threads 1 --processes 1"
+       << " --tif-compress " << shell_quote( opt.tif_compress )
+       << " --cache-dir " << shell_quote( opt.cache_dir );
+  if ( !opt.target_srs_string.empty() )
+    base << " --t_srs " << shell_quote( opt.target_srs_string );
+  if ( opt.target_projwin != BBox2() )
+    base << " --t_projwin "
+         << opt.target_projwin.min().x() << " " << opt.target_projwin.min().y() << " "
+         << opt.target_projwin.max().x() << " " << opt.target_projwin.max().y();
+  if ( asp::stereo_settings().isis_tabulated_camera )
+    base << " --isis-tabulated-camera --isis-tabulated-tolerance "
+         << asp::stereo_settings().isis_tabulated_tolerance;
+  if ( opt.gdal_options.count("BIGTIFF") &&
+       opt.gdal_options.find("BIGTIFF")->second == "NO" )
+    base << " --no-bigtiff";
+  base << " " << shell_quote( opt.dem_file ) << " " << shell_quote( opt.image_file );
+  if ( !opt.camera_model_file.empty() )
+    base << " " << shell_quote( opt.camera_model_file );
+  std::string base_cmd = base.str();
+
+  // Strips of whole rows, several per process for load balance
+  int rows_per_strip = std::max( 256, int(ceil( croppedImageBB.height() /
+                                                (4.0*opt.num_processes) )) );
+  std::string prefix = fs::path(opt.output_file).replace_extension("").string();
+  std::vector<BBox2i> strips;
+  std::vector<std::string> files;
+  for ( int row = croppedImageBB.min().y(); row < croppedImageBB.max().y();
+        row += rows_per_strip ) {
+    strips.push_back( BBox2i( croppedImageBB.min().x(), row, croppedImageBB.width(),
+                              std::min( rows_per_strip, croppedImageBB.max().y() - row ) ) );
+    std::ostringstream os;
+    os << prefix << "-strip-" << strips.size()-1 << ".tif";
+    files.push_back( os.str() );
+  }
+
+  vw_out() << "Projecting " << strips.size() << " strips using "
+           << opt.num_processes << " processes.\n";
+  std::vector<int> status( strips.size(), 0 );
+  {
+    FifoWorkQueue queue( opt.num_processes );
+    for ( size_t k = 0; k < strips.size(); k++ ) {
+      std::ostringstream cmd;
+      cmd << base_cmd << " --t_pixelwin "
+          << strips[k].min().x() << " " << strips[k].min().y() << " "
+          << strips[k].max().x() << " " << strips[k].max().y() << " "
+          << shell_quote( files[k] ) << " > " << shell_quote( files[k] + ".log" ) << " 2>&1";
+      boost::shared_ptr<Task> task( new StripTask( cmd.str(), status[k] ) );
+      queue.add_task( task );
+    }
+    queue.join_all();
+  }
+  for ( size_t k = 0; k < strips.size(); k++ ) {
+    if ( status[k] != 0 )
+      vw_throw( IOErr() << "Failed to project " << files[k] << ". See "
+                << files[k] << ".log for details.\n" );
+    fs::remove( files[k] + ".log" );
+  }
+
+  // Output in VRT format references the strips
+  if ( boost::iends_with( opt.output_file, ".vrt" ) ) {
+    vw_out() << "Writing: " << opt.output_file << "\n";
+    // Take the georeference and data type from the first strip,
+    // whose origin is the origin of the output
+    GDALDatasetH dataset = GDALOpen( files[0].c_str(), GA_ReadOnly );
+    if ( dataset == NULL )
+      vw_throw( IOErr() << "Failed to open " << files[0] << ".\n" );
+    double gt[6];
+    GDALGetGeoTransform( dataset, gt );
+    std::string wkt = GDALGetProjectionRef( dataset );
+    std::string data_type =
+      GDALGetDataTypeName( GDALGetRasterDataType( GDALGetRasterBand( dataset, 1 ) ) );
+    GDALClose( dataset );
+
+    std::ofstream vrt( opt.output_file.c_str() );
+    vrt.precision(17);
+    vrt << "<VRTDataset rasterXSize=\"" << croppedImageBB.width()
+        << "\" rasterYSize=\"" << croppedImageBB.height() << "\">\n";
+    vrt << "  <SRS>" << xml_escape( wkt ) << "</SRS>\n";
+    vrt << "  <GeoTransform>" << gt[0] << ", " << gt[1] << ", " << gt[2] << ", "
+        << gt[3] << ", " << gt[4] << ", " << gt[5] << "</GeoTransform>\n";
+    std::map<std::string, std::string> keywords = output_keywords( opt );
+    vrt << "  <Metadata>\n";
+    for ( std::map<std::string, std::string>::const_iterator it = keywords.begin();
+          it != keywords.end(); it++ )
+      vrt << "    <MDI key=\"" << it->first << "\">" << it->second << "</MDI>\n";
+    vrt << "  </Metadata>\n";
+    vrt << "  <VRTRasterBand dataType=\"" << data_type << "\" band=\"1\">\n";
+    vrt << "    <NoDataValue>" << opt.nodata_value << "</NoDataValue>\n";
+    for ( size_t k = 0; k < strips.size(); k++ ) {
+      BBox2i dst = strips[k] - croppedImageBB.min();
+      std::string relative = fs::path(files[k]).filename().string();
+      vrt << "    <SimpleSource>\n"
+          << "      <SourceFilename relativeToVRT=\"1\">" << relative << "</SourceFilename>\n"
+          << "      <SourceBand>1</SourceBand>\n"
+          << "      <SrcRect xOff=\"0\" yOff=\"0\" xSize=\"" << dst.width()
+          << "\" ySize=\"" << dst.height() << "\"/>\n"
+          << "      <DstRect xOff=\"" << dst.min().x() << "\" yOff=\"" << dst.min().y()
+          << "\" xSize=\"" << dst.width() << "\" ySize=\"" << dst.height() << "\"/>\n"
+          << "    </SimpleSource>\n";
+    }
+    vrt << "  </VRTRasterBand>\n</VRTDataset>\n";
+    return;
+  }
+
+  // Otherwise the strips are copied into a single GeoTIFF. Reading
+  // them is thread safe even though projecting them was not.
+  vw_out() << "Writing: " << opt.output_file << "\n";
+  asp::block_write_gdal_image( opt.output_file, StripMosaicView( files ),
+                               croppedGeoRef, opt.nodata_value, opt,
+                               TerminalProgressCallback("",""),
+                               output_keywords( opt ) );
+  for ( size_t k = 0; k < files.size(); k++ )
+    fs::remove( files[k] );
+}
+
+/// Project the camera image through the given DEM to camera
+/// transform and write the result. The transform is either the exact
+/// Map2CamTrans or its interpolated approximation.
+template <class TransformT>
+void project_image( Options & opt,
+                    boost::shared_ptr<DiskImageResource> img_rsrc,
+                    TransformT const& map2cam,
+                    BBox2i const& target_image_size,
+                    BBox2i const& croppedImageBB,
+                    GeoReference const& croppedGeoRef ) {
+  bool has_img_nodata = true;
+  PMaskT nodata_mask = PMaskT(); // invalid value for a PixelMask
+  write_parallel_cond
+    ( // Write to the output file
+     opt.output_file,
+     crop( // Apply crop (only happens if --t_pixelwin was specified)
+          apply_mask
+          ( // Handle nodata
+           transform_nodata( // Apply the output from Map2CamTrans
+                            create_mask(DiskImageView<float>(img_rsrc),
+                                        opt.nodata_value), // Handle nodata
+                            map2cam,
+                            target_image_size.width(),
+                            target_image_size.height(),
+                            ValueEdgeExtension<PMaskT>(nodata_mask),
+                            BicubicInterpolation(), nodata_mask
+                            ),
+           opt.nodata_value
+           ),
+          croppedImageBB
+          ),
+     croppedGeoRef, has_img_nodata, opt.nodata_value, opt,
+     TerminalProgressCallback("","")
+     );
+}
+
 /// Compute output georeference to use
 void calc_target_geom(// Inputs
                       bool first_pass,
@@ -260,6 +553,9 @@ int main( int argc, char* argv[] ) {
     boost::shared_ptr<camera::CameraModel> camera_model =
       session->camera_model(opt.image_file, opt.camera_model_file);
 
+    // ISIS cameras are not thread safe, the tabulated ISIS cameras are
+    opt.thread_safe_camera = asp::camera_thread_safe(*camera_model);
+
     // Safety check that the users are not trying to map project map projected images.
     {
       GeoReference dummy_georef;
@@ -422,38 +718,31 @@ int main( int argc, char* argv[] ) {
     // if it is not available in the input file.
     if (img_rsrc->has_nodata_read()) opt.nodata_value = img_rsrc->nodata_read();
     asp::create_out_dir(opt.output_file);
-    bool has_img_nodata = true;
-    PMaskT nodata_mask = PMaskT(); // invalid value for a PixelMask
+
+    if ( !opt.thread_safe_camera && opt.num_processes > 1 ) {
+      write_multi_process( argv[0], opt, croppedImageBB, croppedGeoRef );
+      return 0;
+    }
+
     bool call_from_mapproject = true;
-    write_parallel_cond
-      ( // Write to the output file
-       opt.output_file,
-       crop( // Apply crop (only happens if --t_pixelwin was specified)
-            apply_mask
-            ( // Handle nodata
-             transform_nodata( // Apply the output from Map2CamTrans
-                              create_mask(DiskImageView<float>(img_rsrc),
-                                          opt.nodata_value), // Handle nodata
-                              Map2CamTrans
-                              ( // Converts coordinates in DEM
-                                // georeference to camera pixels
-                               camera_model.get(), target_georef,
-                               dem_georef, dem_rsrc, image_size,
-                               call_from_mapproject
-                               ),
-                              target_image_size.width(),
-                              target_image_size.height(),
-                              ValueEdgeExtension<PMaskT>(nodata_mask),
-                              BicubicInterpolation(), nodata_mask
-                              ),
-             opt.nodata_value
-             ),
-            croppedImageBB
-            ),
-       croppedGeoRef, has_img_nodata, opt.nodata_value, opt,
-       TerminalProgressCallback("","")
-       );
-    
+    Map2CamTrans map2cam( // Converts coordinates in DEM
+                          // georeference to camera pixels
+                         camera_model.get(), target_georef,
+                         dem_georef, dem_rsrc, image_size,
+                         call_from_mapproject
+                         );
+    if ( opt.approx_tolerance > 0 ) {
+      vw_out() << "Interpolating the camera projection with tolerance "
+               << opt.approx_tolerance << " pixels.\n";
+      project_image( opt, img_rsrc,
+                     asp::approx_transform( map2cam, opt.approx_tolerance,
+                                            opt.approx_grid_spacing ),
+                     target_image_size, croppedImageBB, croppedGeoRef );
+    } else {
+      project_image( opt, img_rsrc, map2cam,
+                     target_image_size, croppedImageBB, croppedGeoRef );
+    }
+
   } ASP_STANDARD_CATCHES;
 
   return 0;
@@ -26,6 +26,8 @@ using namespace vw::cartography;
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/AntiAliasing.h>
+#include <asp/Core/InpaintView.h>
+#include <asp/Core/ApproxGeoTransform.h>
 namespace po = boost::program_options;
 
 #include <vw/Core/Stopwatch.h>
@@ -80,7 +82,7 @@ struct Options : asp::BaseOptions {
   bool remove_outliers;
   Vector2 remove_outliers_params;
   double max_valid_triangulation_error;
-  double search_radius_factor;
+  double search_radius_factor, approx_tolerance;
   bool use_surface_sampling;
   
   // Output
@@ -145,7 +147,7 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("output-prefix,o", po::value(&opt.out_prefix), "Specify the output prefix.")
     ("output-filetype,t", po::value(&opt.output_file_type)->default_value("tif"), "Specify the output file.")
     ("errorimage", po::bool_switch(&opt.do_error)->default_value(false), "Write a triangulation intersection error image.")
-    ("hole-fill-mode", po::value(&opt.hole_fill_mode)->default_value(1), "Choose the algorithm to fill holes. [1: Interpolate based on valid values in four directions: left, right, up, and down (fast). 2: Weighted average of all valid pixels within a window of size hole-fill-len (slow).")
+    ("hole-fill-mode", po::value(&opt.hole_fill_mode)->default_value(1), "Choose the algorithm to fill holes. [1: Interpolate based on valid values in four directions: left, right, up, and down (fast). 2: Weighted average of all valid pixels within a window of size hole-fill-len (slow). 3: Fill each hole no larger than hole-fill-len and away from the DEM border with a multi-scale average of the valid pixels around it, then smooth it hole-fill-num-smooth-iter times (DEM only).]")
     ("hole-fill-num-smooth-iter", po::value(&opt.hole_fill_num_smooth_iter)->default_value(4), "How many times to iterate to smooth the result of hole-filling with a Gaussian kernel.")
     ("dem-hole-fill-len", po::value(&opt.dem_hole_fill_len)->default_value(0), "Maximum dimensions of a hole in the output DEM to fill in, in pixels.")
     ("orthoimage-hole-fill-len", po::value(&opt.ortho_hole_fill_len)->default_value(0), "Maximum dimensions of a hole in the output orthoimage to fill in, in pixels.")
@@ -157,6 +159,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "How much to round the output DEM and errors, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. [Default: 1/2^10]")
     ("search-radius-factor", po::value(&opt.search_radius_factor)->default_value(0.0),
      "Multiply this factor by dem-spacing to get the search radius. The DEM height at a given grid point is obtained as a weighted average of heights of all points in the cloud within search radius of the grid point, with the weights given by a Gaussian. Default search radius: max(dem-spacing, default_dem_spacing), so the default factor is about 1.")
+    ("approximate-tolerance", po::value(&opt.approx_tolerance)->default_value(0.0),
+     "Interpolate the projection of the points from a lattice in longitude and latitude instead of projecting each point, keeping the error below this many units of the output projection (e.g., 0.001 meters). Use 0 to project every point.")
     ("use-surface-sampling", po::bool_switch(&opt.use_surface_sampling)->default_value(false),
      "Use the older algorithm, interpret the point cloud as a surface made up of triangles and interpolate into it (prone to aliasing).")
     ("fsaa", po::value(&opt.fsaa)->implicit_value(3), "Oversampling amount to perform antialiasing (obsolete).")
@@ -206,8 +210,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_throw( ArgumentErr() << "The --fsaa option is obsolete. It can be used only with the --use-surface-sampling option which invokes the old algorithm.\n" << usage << general_options );
   }
   
-  if (opt.hole_fill_mode != 1 && opt.hole_fill_mode != 2)
-    vw_throw( ArgumentErr() << "The value of --hole-fill-mode must be 1 or 2.\n");
+  if (opt.approx_tolerance < 0)
+    vw_throw( ArgumentErr() << "The value of --approximate-tolerance must not be negative.\n");
+  if (opt.hole_fill_mode < 1 || opt.hole_fill_mode > 3)
+    vw_throw( ArgumentErr() << "The value of --hole-fill-mode must be 1, 2, or 3.\n");
   if (opt.hole_fill_num_smooth_iter < 0)
     vw_throw( ArgumentErr() << "The value of "
               << "--hole-fill-num-smooth-iter must not be negative.\n");
@@ -245,12 +251,53 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 
 // If a pixel has invalid data, fill its value with the average of
 // valid pixel values within a given window around the pixel.
+//
+// When rasterizing, the sums and counts of valid pixels in each
+// window are read from integral images of the tile, so the cost per
+// pixel does not depend on the window size.
 template <class ImageT>
 class FillNoDataWithAvg:
   public ImageViewBase< FillNoDataWithAvg<ImageT> > {
   ImageT m_img;
   int m_kernel_size;
   typedef typename ImageT::pixel_type PixelT;
+  typedef typename CompoundChannelCast<PixelT, double>::type AccumT;
+  typedef typename PixelChannelType<PixelT>::type ChannelT;
+
+  // Fill 'img' in place. Only the averages of the pixels that were
+  // valid on input are used.
+  static void fill_tile( ImageView<PixelT> & img, int kernel_size ) {
+    int nc = img.cols(), nr = img.rows(), k2 = kernel_size/2;
+    AccumT zero; zero.validate();
+    ImageView<AccumT> sum  ( nc+1, nr+1 );
+    ImageView<int32>  count( nc+1, nr+1 );
+    for (int c = 0; c <= nc; c++){ sum(c, 0) = zero; count(c, 0) = 0; }
+    for (int r = 1; r <= nr; r++){
+      sum(0, r) = zero; count(0, r) = 0;
+      AccumT row_sum = zero;
+      int row_count = 0;
+      for (int c = 1; c <= nc; c++){
+        if (is_valid(img(c-1, r-1))){
+          row_sum += channel_cast<double>( img(c-1, r-1) );
+          row_count++;
+        }
+        sum  (c, r) = sum  (c, r-1) + row_sum;
+        count(c, r) = count(c, r-1) + row_count;
+      }
+    }
+
+    for (int r = 0; r < nr; r++){
+      int r0 = std::max(0, r-k2), r1 = std::min(nr, r+k2+1);
+      for (int c = 0; c < nc; c++){
+        if (is_valid(img(c, r))) continue;
+        int c0 = std::max(0, c-k2), c1 = std::min(nc, c+k2+1);
+        int nvalid = count(c1, r1) - count(c0, r1) - count(c1, r0) + count(c0, r0);
+        if (nvalid == 0) continue; // could not find valid points
+        AccumT val = sum(c1, r1) - sum(c0, r1) - sum(c1, r0) + sum(c0, r0);
+        img(c, r) = channel_cast<ChannelT>( val/nvalid );
+      }
+    }
+  }
 
 public:
 
@@ -275,23 +322,26 @@ public:
     if (is_valid(m_img(i, j)))
       return m_img(i, j);
 
-    pixel_type val; val.validate();
+    // Single pixels are averaged directly. Tiles are filled by
+    // prerasterize() instead.
+    AccumT val; val.validate();
     int nvalid = 0;
     int c0 = i, r0 = j; // convert to int from size_t
     int k2 = m_kernel_size/2, nc = m_img.cols(), nr = m_img.rows();
-    for (int c = std::max(0, c0-k2); c <= std::min(nc-1, c0+k2); c++){
-      for (int r = std::max(0, r0-k2); r <= std::min(nr-1, r0+k2); r++){
-        if (!is_valid(m_img(c, r))) continue;
-        val += m_img(c, r);
+    for (int r = std::max(0, r0-k2); r <= std::min(nr-1, r0+k2); r++){
+      for (int c = std::max(0, c0-k2); c <= std::min(nc-1, c0+k2); c++){
+        PixelT pix = m_img(c, r);
+        if (!is_valid(pix)) continue;
+        val += channel_cast<double>( pix );
         nvalid++;
       }
     }
 
     if (nvalid == 0) return m_img(i, j); // could not find valid points
-    return val/nvalid; // average of valid values within window
+    return channel_cast<ChannelT>( val/nvalid ); // average of valid values within window
   }
 
-  typedef FillNoDataWithAvg<CropView<ImageView<PixelT> > > prerasterize_type;
+  typedef CropView<ImageView<PixelT> > prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
 
     // Crop into an expanded box as to have enough pixels to do
@@ -300,10 +350,10 @@ public:
     biased_box.expand(m_kernel_size/2);
     biased_box.crop(bounding_box(m_img));
     ImageView<PixelT> dest( crop( m_img, biased_box ) );
- 
-    return prerasterize_type( crop( dest, -biased_box.min().x(), -biased_box.min().y(), cols(), rows() ), m_kernel_size );
-    
-}
+    fill_tile(dest, m_kernel_size);
+
+    return prerasterize_type( dest, -biased_box.min().x(), -biased_box.min().y(), cols(), rows() );
+  }
   template <class DestT> inline void rasterize( DestT const& dest, BBox2i const& bbox ) const { vw::rasterize( prerasterize(bbox), dest, bbox ); }
   
 };
@@ -614,11 +664,14 @@ void do_software_rasterization( const ImageViewBase<ViewT>& proj_point_input,
   Stopwatch sw1;
   sw1.start();
 
+  // The orthoimage holes are filled by the rasterizer, which does
+  // not have the multi-pass averaging mode. Use mode 1 there instead.
+  int ortho_hole_fill_mode = (opt.hole_fill_mode == 3) ? 1 : opt.hole_fill_mode;
   OrthoRasterizerView<PixelGray<float>, ViewT >
     rasterizer(proj_point_input.impl(), select_channel(proj_point_input.impl(),2),
                opt.dem_spacing, opt.search_radius_factor, opt.use_surface_sampling,
                Options::tri_tile_size(), // to efficiently process the cloud
-               opt.hole_fill_mode, opt.hole_fill_num_smooth_iter,
+               ortho_hole_fill_mode, opt.hole_fill_num_smooth_iter,
                opt.remove_outliers, opt.remove_outliers_params,
                error_image, estim_max_error, opt.max_valid_triangulation_error,
                TerminalProgressCallback("asp","QuadTree: ") );
@@ -700,7 +753,23 @@ void do_software_rasterization( const ImageViewBase<ViewT>& proj_point_input,
     ImageViewRef< PixelGray<float> > dem
       = asp::round_image_pixels_skip_nodata(rasterizer_fsaa, opt.rounding_error,
                                             opt.nodata_value);
-    if (opt.dem_hole_fill_len > 0){
+    boost::scoped_ptr<asp::BlobIndexThreaded> hole_index; // Must outlive 'dem'
+    if (opt.dem_hole_fill_len > 0 && opt.hole_fill_mode == 3){
+      // Only the holes found by the blob index, no larger than the
+      // fill length and away from the DEM border, are filled, so
+      // large voids stay empty. Finding them reads the whole DEM
+      // once before it is written.
+      ImageViewRef< PixelMask< PixelGray<float> > > masked_dem
+        = create_mask(block_cache(dem, tile_size, opt.num_threads), opt.nodata_value);
+      hole_index.reset(new asp::BlobIndexThreaded
+                       (invert_mask(masked_dem),
+                        opt.dem_hole_fill_len*opt.dem_hole_fill_len));
+      vw_out() << "\t    * Identified " << hole_index->num_blobs() << " holes\n";
+      dem = apply_mask(asp::inpaint_multiscale(masked_dem, *hole_index,
+                                               opt.dem_hole_fill_len,
+                                               opt.hole_fill_num_smooth_iter),
+                       opt.nodata_value);
+    }else if (opt.dem_hole_fill_len > 0){
       // Note that we first cache the tiles of the rasterized DEM, and fill holes
       // later. This greatly improves the performance.
       dem = apply_mask(fill_holes(create_mask
@@ -957,19 +1026,20 @@ int main( int argc, char *argv[] ) {
       vw_out() << "\t--> Applying offset: " << opt.x_offset
                << " " << opt.y_offset << " " << opt.z_offset << "\n";
       do_software_rasterization
-        (geodetic_to_point
+        (asp::approx_geodetic_to_point
          (point_image_offset
           (recenter_longitude(cartesian_to_geodetic(point_image,georef),
                               avg_lon),
            Vector3(opt.x_offset,
                    opt.y_offset,
-                   opt.z_offset)),georef),
+                   opt.z_offset)),georef,opt.approx_tolerance),
          opt, georef, error_image, estim_max_error);
     } else {
       do_software_rasterization
-        (geodetic_to_point
+        (asp::approx_geodetic_to_point
          (recenter_longitude
-          (cartesian_to_geodetic(point_image,georef), avg_lon),georef),
+          (cartesian_to_geodetic(point_image,georef), avg_lon),georef,
+          opt.approx_tolerance),
          opt, georef, error_image, estim_max_error);
     }
 
@@ -26,13 +26,17 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <math.h>
+#include <float.h>
 
 //VisionWorkbench & ASP
 #include <asp/Tools/point2dem.h> // We share common functions with point2dem
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/TileMesher.h>
+#include <boost/filesystem.hpp>
 using namespace vw;
 namespace po = boost::program_options;
+namespace fs = boost::filesystem;
 
 //OpenSceneGraph
 #include <osg/Geode>
@@ -42,6 +46,7 @@ namespace po = boost::program_options;
 #include <osgUtil/SmoothingVisitor>
 #include <osgUtil/Simplifier>
 #include <osg/Node>
+#include <osg/PagedLOD>
 #include <osg/Texture1D>
 #include <osg/Texture2D>
 #include <osg/TexGen>
@@ -74,7 +79,9 @@ struct Options : asp::BaseOptions {
   std::string pointcloud_filename, texture_file_name;
 
   // Settings
-  uint32 step_size;
+  uint32 step_size, tile_size;
+  double max_error;
+  bool paged;
   osg::ref_ptr<osg::Group> root;
   float simplify_percent;
   osg::Vec3f dataNormal;
@@ -151,279 +158,266 @@ osg::StateSet* create1DTexture( osg::Node* loadedModel , const osg::Vec3f& Direc
 }
 
 // ---------------------------------------------------------
-// BUILD MESH
+// TEXTURE
 //
-// Takes in an image and builds geodes for every triangle strip.
+// Writes the texture as an 8 bit jpg that osg can load, reduced so
+// that its width or height is at most 4096.
 // ---------------------------------------------------------
-template <class ViewT>
-osg::Node* build_mesh( vw::ImageViewBase<ViewT> const& point_image,
-                       Options& opt ) {
+std::string prepare_texture( Vector2i const& cloud_size, Options& opt ) {
+  DiskImageView<PixelGray<uint8> > previous_texture(opt.texture_file_name);
+  std::string tex_file = prefix_from_pointcloud_filename(opt.output_prefix) + "-tex";
+  if (cloud_size.x() > 4096 || cloud_size.y() > 4096 ) {
+    vw_out() << "Resampling to reduce texture size:\n";
+    float tex_sub_scale = 4096.0/float(std::max(previous_texture.cols(),previous_texture.rows()));
+    ImageViewRef<PixelGray<uint8> > new_texture = resample(previous_texture,tex_sub_scale);
+    vw_out() << "\t--> Texture size: [" << new_texture.cols() << ", " << new_texture.rows() << "]\n";
+    vw_out() << "Writing temporary file: " << tex_file+".tif" << "\n";
+    asp::block_write_gdal_image( tex_file+".tif", new_texture, opt,
+                                 TerminalProgressCallback("asp","\tSubsampling:") );
+  } else {
+    // Always saving as an 8bit texture. These second handedly
+    // normalizes the data for us (which is a problem for datasets
+    // like HiRISE which will feed us tiffs with values outside of
+    // 0-1).
+    vw_out() << "Writing temporary file: " << tex_file+".tif" << "\n";
+    asp::block_write_gdal_image( tex_file+".tif", previous_texture, opt,
+                                 TerminalProgressCallback("asp","\tNormalizing:") );
+  }
+  // When we subsample, we use tiff because we can block write the image.
+  // However, trying to load the tiff with osg causes problems because
+  // osg uses libtiff to load the images. libtiff conflicts with gdal
+  // if gdal was compiled with internal tiff, and osg will fail to load
+  // the texture. To avoid all this, we resave our subsampled texture as a jpg
+  DiskImageView<PixelGray<uint8> > new_texture(tex_file+".tif");
+  vw_out() << "Writing temporary file: " << tex_file+".jpg" << "\n";
+  write_image(tex_file+".jpg", new_texture);
+  unlink((tex_file+".tif").c_str());
+  return tex_file + ".jpg";
+}
+
+// ---------------------------------------------------------
+// TILE MESH
+//
+// The point cloud, subsampled by the step size, is a grid of
+// vertices. It is meshed in square tiles of tile_size cells, each
+// read from the cloud in one piece with a border of one vertex for
+// the normals. Only the cells with at least three valid corners are
+// drawn.
+// ---------------------------------------------------------
+
+// Normal at a vertex, averaged over the four quadrants around it.
+// These calculations seems backwards from what they should be. Its
+// because for the indexing of the image is weird, its column then row.
+Vector3 vertex_normal( ImageView<Vector3> const& grid, int c, int r ) {
+  Vector3 p = grid(c,r), normal;
+  bool up = r > 0, down = r+1 < grid.rows(), left = c > 0, right = c+1 < grid.cols();
+  if ( up && right && asp::valid_point(grid(c+1,r)) && asp::valid_point(grid(c,r-1)) )
+    normal += normalize(cross_prod( grid(c+1,r) - p, grid(c,r-1) - p ));
+  if ( right && down && asp::valid_point(grid(c,r+1)) && asp::valid_point(grid(c+1,r)) )
+    normal += normalize(cross_prod( grid(c,r+1) - p, grid(c+1,r) - p ));
+  if ( down && left && asp::valid_point(grid(c-1,r)) && asp::valid_point(grid(c,r+1)) )
+    normal += normalize(cross_prod( grid(c-1,r) - p, grid(c,r+1) - p ));
+  if ( left && up && asp::valid_point(grid(c,r-1)) && asp::valid_point(grid(c-1,r)) )
+    normal += normalize(cross_prod( grid(c,r-1) - p, grid(c-1,r) - p ));
+  if ( normal == Vector3() )
+    return normal;
+  return normalize( normal );
+}
+
+// Mesh the cells [c0, c0+cols) x [r0, r0+rows) of 'grid', whose
+// vertex (0,0) is vertex 'grid_origin' of the whole cloud. Returns
+// NULL if there is nothing to draw.
+osg::Geode* build_tile( ImageView<Vector3> const& grid, Vector2i const& grid_origin,
+                        int c0, int r0, int cols, int rows, double max_error,
+                        Vector2i const& cloud_size, bool textured, Options const& opt ) {
+
+  std::vector<Vector2i> corners;
+  asp::TileMesher( grid, c0, r0, cols, rows, max_error ).triangles( corners );
+  if ( corners.empty() )
+    return NULL;
 
-  //const ViewT& point_image_impl = point_image.impl();
-  osg::Geode* mesh = new osg::Geode();
   osg::Geometry* geometry = new osg::Geometry();
   osg::Vec3Array* vertices = new osg::Vec3Array();
   osg::Vec2Array* texcoords = new osg::Vec2Array();
   osg::Vec3Array* normals = new osg::Vec3Array();
-
-  opt.dataNormal = osg::Vec3f( 0.0f , 0.0f , 0.0f );
-
-  vw_out() << "\t--> Orginal size: [" << point_image.impl().cols() << ", " << point_image.impl().rows() << "]\n";
-  vw_out() << "\t--> Subsampled:   [" << point_image.impl().cols()/opt.step_size << ", "
-            << point_image.impl().rows()/opt.step_size << "]\n";
-
-  //////////////////////////////////////////////////
-  // Deciding how to reduce the texture size
-  //   Max texture width or height is 4096
-  std::string tex_file;
-  if ( opt.texture_file_name.size() ) {
-    DiskImageView<PixelGray<uint8> > previous_texture(opt.texture_file_name);
-    tex_file = prefix_from_pointcloud_filename(opt.output_prefix) + "-tex";
-    if (point_image.impl().cols() > 4096 ||
-        point_image.impl().rows() > 4096 ) {
-      vw_out() << "Resampling to reduce texture size:\n";
-      float tex_sub_scale = 4096.0/float(std::max(previous_texture.cols(),previous_texture.rows()));
-      ImageViewRef<PixelGray<uint8> > new_texture = resample(previous_texture,tex_sub_scale);
-      vw_out() << "\t--> Texture size: [" << new_texture.cols() << ", " << new_texture.rows() << "]\n";
-      vw_out() << "Writing temporary file: " << tex_file+".tif" << "\n";
-      asp::block_write_gdal_image( tex_file+".tif", new_texture, opt,
-                                   TerminalProgressCallback("asp","\tSubsampling:") );
-    } else {
-      // Always saving as an 8bit texture. These second handedly
-      // normalizes the data for us (which is a problem for datasets
-      // like HiRISE which will feed us tiffs with values outside of
-      // 0-1).
-      vw_out() << "Writing temporary file: " << tex_file+".tif" << "\n";
-      asp::block_write_gdal_image( tex_file+".tif", previous_texture, opt,
-                                   TerminalProgressCallback("asp","\tNormalizing:") );
+  osg::DrawElementsUInt* triangles = new osg::DrawElementsUInt(GL_TRIANGLES);
+
+  // Each grid vertex is added once, the first time a triangle uses it
+  std::vector<int> index( grid.cols() * grid.rows(), -1 );
+  for ( size_t i = 0; i < corners.size(); i++ ) {
+    int c = corners[i].x(), r = corners[i].y();
+    int& vertex = index[r * grid.cols() + c];
+    if ( vertex < 0 ) {
+      vertex = vertices->size();
+      Vector3 const& p = grid(c,r);
+      vertices->push_back( osg::Vec3f( p[0], p[1], p[2] ) );
+      if ( opt.enable_lighting ) {
+        Vector3 n = vertex_normal( grid, c, r );
+        normals->push_back( osg::Vec3f( n[0], n[1], n[2] ) );
+      }
+      if ( textured ) {
+        float c_step = float( (grid_origin.x() + c) * opt.step_size );
+        float r_step = float( (grid_origin.y() + r) * opt.step_size );
+        texcoords->push_back( osg::Vec2f( c_step / float(cloud_size.x()),
+                                          1 - r_step / float(cloud_size.y()) ) );
+      }
     }
-    // When we subsample, we use tiff because we can block write the image.
-    // However, trying to load the tiff with osg causes problems because
-    // osg uses libtiff to load the images. libtiff conflicts with gdal
-    // if gdal was compiled with internal tiff, and osg will fail to load
-    // the texture. To avoid all this, we resave our subsampled texture as a jpg
-    DiskImageView<PixelGray<uint8> > new_texture(tex_file+".tif");
-    vw_out() << "Writing temporary file: " << tex_file+".jpg" << "\n";
-    write_image(tex_file+".jpg", new_texture);
-    unlink((tex_file+".tif").c_str());
-    tex_file += ".jpg";
+    triangles->push_back( vertex );
   }
 
-  //////////////////////////////////////////////////
-  /// Setting name of geode
-  {
-    std::ostringstream os;
-    os << "Simple Mesh" << std::endl;
-    mesh->setName( os.str() );
+  geometry->setVertexArray( vertices );
+  if ( opt.enable_lighting ) {
+    geometry->setNormalArray( normals );
+    geometry->setNormalBinding( osg::Geometry::BIND_PER_VERTEX );
   }
+  if ( textured )
+    geometry->setTexCoordArray( 0, texcoords );
 
-  //////////////////////////////////////////////////
-  /// PUSHING ALL VERTICES & Also texture coordinates
-  {
-
-    // Some constants for the calculation in here
-    uint32 num_rows = point_image.impl().rows()/opt.step_size;
-    uint32 num_cols = point_image.impl().cols()/opt.step_size;
-
-    TerminalProgressCallback progress("asp", "\tVertices:   ");
-    double progress_mult = 1.0/double(num_rows*num_cols);
-
-    for ( uint32 r = 0; r < (num_rows); ++r ){
-      for (uint32 c = 0; c < (num_cols); ++c ){
-        progress.report_progress((r*num_cols+c)*progress_mult);
-
-        uint32 r_step = r * opt.step_size;
-        uint32 c_step = c * opt.step_size;
-
-        vertices->push_back( osg::Vec3f( point_image.impl()(c_step,r_step)[0] ,
-                                         point_image.impl()(c_step,r_step)[1] ,
-                                         point_image.impl()(c_step,r_step)[2] ) );
-
-        // Calculating normals, if the user wants shading
-        if (opt.enable_lighting) {
-          Vector3 temp_normal;
-
-          // These calculations seems backwards from what they should
-          // be. Its because for the indexing of the image is weird,
-          // its column then row.
-
-          // Is quadrant 1 normal calculation possible?
-          if ( (r > 0) && ( (c+1) < (num_cols)) ) {
-            if ( (point_image.impl()(c_step+opt.step_size,r_step) != Vector3(0,0,0)) &&
-                 (point_image.impl()(c_step,r_step-opt.step_size) != Vector3(0,0,0)) ) {
-              temp_normal = temp_normal + normalize(cross_prod( point_image.impl()(c_step+opt.step_size,r_step) -
-                                                                point_image.impl()(c_step,r_step),
-                                                                point_image.impl()(c_step,r_step-opt.step_size) -
-                                                                point_image.impl()(c_step,r_step) ) );
-            }
-          }
-          // Is quadrant 2 normal calculation possible?
-          if ( ( (c+1) < (num_cols) ) && ((r+1) < (num_rows))){
-            if ( (point_image.impl()(c_step,r_step+opt.step_size) != Vector3(0,0,0)) &&
-                 (point_image.impl()(c_step+opt.step_size,r_step) != Vector3(0,0,0)) ) {
-              temp_normal = temp_normal + normalize(cross_prod( point_image.impl()(c_step,r_step+opt.step_size) -
-                                                                point_image.impl()(c_step,r_step),
-                                                                point_image.impl()(c_step+opt.step_size,r_step) -
-                                                                point_image.impl()(c_step,r_step) ) );
-            }
-          }
-          // Is quadrant 3 normal calculation possible?
-          if ( ((r+1) < (num_rows)) && (c>0) ) {
-            if ( (point_image.impl()(c_step-opt.step_size,r_step) != Vector3(0,0,0)) &&
-                 (point_image.impl()(c_step,r_step+opt.step_size) != Vector3(0,0,0)) ) {
-              temp_normal = temp_normal + normalize(cross_prod( point_image.impl()(c_step-opt.step_size,r_step) -
-                                                                point_image.impl()(c_step,r_step),
-                                                                point_image.impl()(c_step,r_step+opt.step_size) -
-                                                                point_image.impl()(c_step,r_step) ) );
-            }
-          }
-          // Is quadrant 4 normal calculation possible?
-          if ( (c>0) && (r>0) ) {
-            if ( (point_image.impl()(c_step,r_step-opt.step_size) != Vector3(0,0,0)) &&
-                 (point_image.impl()(c_step-opt.step_size,r_step) != Vector3(0,0,0)) ) {
-              temp_normal = temp_normal + normalize(cross_prod( point_image.impl()(c_step,r_step-opt.step_size) -
-                                                                point_image.impl()(c_step,r_step),
-                                                                point_image.impl()(c_step-opt.step_size,r_step) -
-                                                                point_image.impl()(c_step,r_step) ) );
-            }
-          }
-
-          temp_normal = normalize( temp_normal );
-          normals->push_back( osg::Vec3f( temp_normal[0],
-                                          temp_normal[1],
-                                          temp_normal[2] ) );
-        }
+  osg::Vec4Array* colour = new osg::Vec4Array();
+  colour->push_back( osg::Vec4f( 1.0f, 1.0f, 1.0f, 1.0f ) );
+  geometry->setColorArray( colour );
+  geometry->setColorBinding( osg::Geometry::BIND_OVERALL );
+  geometry->addPrimitiveSet( triangles );
 
-        if ( tex_file.size() ) {
-          texcoords->push_back( osg::Vec2f ( (float)c_step / (float)point_image.impl().cols() ,
-                                             1-(float)r_step / (float)point_image.impl().rows() ) );
-        } else if ( (point_image.impl()(c_step,r_step)[0] != 0 ) &&
-                    (point_image.impl()(c_step,r_step)[1] != 0 ) &&
-                    (point_image.impl()(c_step,r_step)[2] != 0 ) ) {
-          //I'm calculating the main normal for the data.
-          opt.dataNormal[0] += point_image.impl()(c_step,r_step)[0];
-          opt.dataNormal[1] += point_image.impl()(c_step,r_step)[1];
-          opt.dataNormal[2] += point_image.impl()(c_step,r_step)[2];
-        }
-      }
-    }
-    progress.report_finished();
-
-    vw_out() << "\t > size: " << vertices->size() << " vertices\n";
-
-    geometry->setVertexArray( vertices );
-
-    if (opt.enable_lighting)
-      geometry->setNormalArray( normals );
-
-    if ( tex_file.size() ) {
-      geometry->setTexCoordArray( 0,texcoords );
-    } else {
-      opt.dataNormal.normalize();
-    }
-
-    osg::Vec4Array* colour = new osg::Vec4Array();
-    colour->push_back( osg::Vec4f( 1.0f, 1.0f, 1.0f, 1.0f ) );
-    geometry->setColorArray( colour );
-    geometry->setColorBinding( osg::Geometry::BIND_OVERALL );
+  osg::Geode* mesh = new osg::Geode();
+  mesh->addDrawable( geometry );
+  return mesh;
+}
 
+// Smoothing, simplification and optimization of a piece of the scene
+void post_process( osg::Node* node, Options const& opt ) {
+  if ( opt.smooth_mesh ) {
+    osgUtil::SmoothingVisitor sv;
+    node->accept(sv);
   }
 
-  //////////////////////////////////////////////////
-  // Deciding How to draw triangle strips
-  vw_out() << "Drawing triangle strips\n";
-  {
-    uint32 col_steps = point_image.impl().cols()/opt.step_size;
-
-    for (uint32 r = 0;
-         r < ( point_image.impl().rows()/opt.step_size - 1); ++r){
-
-      bool add_direction_down = true;
-      osg::DrawElementsUInt* dui = new osg::DrawElementsUInt(GL_TRIANGLE_STRIP);
-
-      for (uint32 c = 0; c < ( col_steps ); ++c){
-
-        uint32 pointing_index = r*(col_steps) + c;
-
-        //vw_out() << "V: " << vertices->at(pointing_index)[0] << " " << vertices->at(pointing_index)[1] << " " << vertices->at(pointing_index)[2] << std::endl;
-
-        if (add_direction_down) {
-
-          // Adding top point ...
-          if ( (vertices->at(pointing_index)[0] != 0) &&
-               (vertices->at(pointing_index)[1] != 0) &&
-               (vertices->at(pointing_index)[2] != 0) ) {
-
-            dui->push_back( pointing_index );
-          }
-
-          // Adding bottom point ..
-          if ( (vertices->at(pointing_index+col_steps)[0] != 0) &&
-               (vertices->at(pointing_index+col_steps)[1] != 0) &&
-               (vertices->at(pointing_index+col_steps)[2] != 0) ) {
-
-            dui->push_back( pointing_index+col_steps );
-          } else {
-            // If there's a drop out here... we switch adding direction.
-            add_direction_down = false;
-          }
+  if ( opt.simplify_mesh ) {
+    osgUtil::Simplifier simple;
+    simple.setSmoothing( opt.smooth_mesh );
+    simple.setSampleRatio( opt.simplify_percent );
+    node->accept(simple);
+  }
 
-        } else {
+  osgUtil::Optimizer optimizer;
+  optimizer.optimize( node );
+}
 
-          // Adding bottom point ..
-          if ( (vertices->at(pointing_index+col_steps)[0] != 0) &&
-               (vertices->at(pointing_index+col_steps)[1] != 0) &&
-               (vertices->at(pointing_index+col_steps)[2] != 0) ) {
+// ---------------------------------------------------------
+// BUILD MESH
+//
+// Meshes the cloud tile by tile. Without paging, all the tiles are
+// added to the root. With paging, each tile is written to its own
+// file as soon as it is built, and the root only keeps a coarse
+// version of it in a PagedLOD node, so memory stays bounded.
+// ---------------------------------------------------------
+template <class ViewT>
+void build_mesh( vw::ImageViewBase<ViewT> const& point_image,
+                 bool textured, Options& opt ) {
 
-            dui->push_back( pointing_index+col_steps );
-          }
+  opt.dataNormal = osg::Vec3f( 0.0f , 0.0f , 0.0f );
 
-          // Adding top point ...
-          if ( (vertices->at(pointing_index)[0] != 0) &&
-               (vertices->at(pointing_index)[1] != 0) &&
-               (vertices->at(pointing_index)[2] != 0) ) {
+  Vector2i cloud_size( point_image.impl().cols(), point_image.impl().rows() );
+  int num_cols = cloud_size.x() / opt.step_size;
+  int num_rows = cloud_size.y() / opt.step_size;
+  vw_out() << "\t--> Orginal size: [" << cloud_size.x() << ", " << cloud_size.y() << "]\n";
+  vw_out() << "\t--> Subsampled:   [" << num_cols << ", " << num_rows << "]\n";
+  if ( num_cols < 2 || num_rows < 2 )
+    vw_throw( ArgumentErr() << "The point cloud is too small for step size "
+              << opt.step_size << ".\n" );
+
+  // Tiles are a power of two cells wide, for the quadtree
+  int tile_size = 1;
+  while ( tile_size < int(opt.tile_size) )
+    tile_size *= 2;
+  int num_tile_cols = (num_cols - 2) / tile_size + 1;
+  int num_tile_rows = (num_rows - 2) / tile_size + 1;
+
+  std::string tile_dir, tile_dir_name;
+  if ( opt.paged ) {
+    tile_dir = opt.output_prefix + "-tiles";
+    tile_dir_name = fs::path(tile_dir).filename().string();
+    fs::create_directories( tile_dir );
+  }
 
-            dui->push_back( pointing_index );
-          } else {
-            // If there's a drop out here... we switch adding direction.
-            add_direction_down = true;
+  ImageViewRef<Vector3> grid_image = subsample( point_image.impl(), opt.step_size );
+  BBox2i grid_box( 0, 0, num_cols, num_rows );
+  size_t num_vertices = 0;
+
+  TerminalProgressCallback progress("asp", "\tTiles:      ");
+  for ( int tr = 0; tr < num_tile_rows; tr++ ) {
+    for ( int tc = 0; tc < num_tile_cols; tc++ ) {
+      progress.report_fractional_progress( tr*num_tile_cols + tc,
+                                           num_tile_rows*num_tile_cols );
+
+      // Cells of this tile, and the vertices to read around them
+      int c0 = tc * tile_size, r0 = tr * tile_size;
+      int cols = std::min( tile_size, num_cols - 1 - c0 );
+      int rows = std::min( tile_size, num_rows - 1 - r0 );
+      BBox2i box( c0 - 1, r0 - 1, cols + 3, rows + 3 );
+      box.crop( grid_box );
+      ImageView<Vector3> grid = crop( grid_image, box );
+
+      if ( !textured ) {
+        // The main direction of the data, for the contour coloring
+        for ( int r = r0; r < r0 + rows; r++ )
+          for ( int c = c0; c < c0 + cols; c++ ) {
+            Vector3 const& p = grid( c - box.min().x(), r - box.min().y() );
+            if ( p[0] != 0 && p[1] != 0 && p[2] != 0 )
+              opt.dataNormal += osg::Vec3f( p[0], p[1], p[2] );
           }
-        }
       }
 
-      geometry->addPrimitiveSet(dui);
-
-    }
-  }
-
-  ////////////////////////////////////////////////
-  /// Adding texture to the DTM
-  if (tex_file.size()){
-
-    vw_out() << "Attaching texture data\n";
-
-    osg::Image* textureImage = osgDB::readImageFile(tex_file.c_str());
-
-    if ( textureImage ) {
-      if ( textureImage->valid() ){
-        osg::Texture2D* texture = new osg::Texture2D;
-        texture->setImage(textureImage);
-        osg::StateSet* stateset = geometry->getOrCreateStateSet();
-        stateset->setTextureAttributeAndModes(0,texture,osg::StateAttribute::ON);
-      } else {
-        vw_out() << "Failed to open texture data in " << tex_file << std::endl;
+      // A negative error is relative to the spacing of the points
+      int tile_c0 = c0 - box.min().x(), tile_r0 = r0 - box.min().y();
+      double max_error = opt.max_error;
+      if ( max_error < 0 )
+        max_error = -max_error * asp::mean_point_spacing( grid, tile_c0, tile_r0, cols, rows );
+
+      osg::ref_ptr<osg::Geode> tile =
+        build_tile( grid, box.min(), tile_c0, tile_r0,
+                    cols, rows, max_error, cloud_size, textured, opt );
+      if ( !tile.valid() )
+        continue;
+      num_vertices += tile->getDrawable(0)->asGeometry()->getVertexArray()->getNumElements();
+
+      if ( !opt.paged ) {
+        opt.root->addChild( tile.get() );
+        continue;
       }
-    } else {
-      vw_out() << "Failed to open texture data in " << tex_file << std::endl;
+
+      // The coarse version stands in for the tile when seen from
+      // farther than a few times its size.
+      post_process( tile.get(), opt );
+      osg::BoundingSphere bound = tile->getBound();
+      osg::ref_ptr<osg::Geode> coarse =
+        build_tile( grid, box.min(), tile_c0, tile_r0,
+                    cols, rows, std::max( max_error, 0.01 * bound.radius() ),
+                    cloud_size, textured, opt );
+      post_process( coarse.get(), opt );
+
+      std::ostringstream name;
+      name << tr << "_" << tc << "." << opt.output_file_type;
+      osgDB::writeNodeFile( *tile.get(), tile_dir + "/" + name.str(),
+                            new osgDB::Options("Compressor=zlib") );
+
+      osg::PagedLOD* lod = new osg::PagedLOD();
+      lod->setCenterMode( osg::LOD::USER_DEFINED_CENTER );
+      lod->setCenter( bound.center() );
+      lod->setRadius( bound.radius() );
+      lod->addChild( coarse.get(), 5 * bound.radius(), FLT_MAX );
+      lod->setFileName( 1, tile_dir_name + "/" + name.str() );
+      lod->setRange( 1, 0, 5 * bound.radius() );
+      opt.root->addChild( lod );
     }
   }
+  progress.report_finished();
 
-  mesh->addDrawable( geometry );
-
-  return mesh;
-
+  vw_out() << "\t > size: " << num_vertices << " vertices\n";
+  if ( !textured )
+    opt.dataNormal.normalize();
 }
 
+// ---------------------------------------------------------
 // MAIN
 // ---------------------------------------------------------
 
@@ -437,6 +431,12 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("use-delaunay", "Uses the delaunay triangulator to create a surface from the point cloud. This is not recommended for point clouds with serious noise issues.")
     ("step,s", po::value(&opt.step_size)->default_value(10),
      "Step size for mesher, sets the polygons size per point")
+    ("tile-size", po::value(&opt.tile_size)->default_value(256),
+     "Mesh the subsampled cloud in tiles of this many points on the side, rounded up to a power of two.")
+    ("max-error", po::value(&opt.max_error)->default_value(-0.1),
+     "Merge the cells of a tile where the points are within this distance of a bilinear surface, in the units of the point cloud. A negative value is a fraction of the mean distance between neighboring points of the tile. Use 0 to keep every cell.")
+    ("paged", po::bool_switch(&opt.paged)->default_value(false),
+     "Write each tile to its own file, in a directory next to the output, and page them in from a scene of coarse tiles. Only this keeps memory bounded for large clouds; otherwise the whole mesh is held in memory until it is written.")
     ("output-prefix,o", po::value(&opt.output_prefix),
      "Specify the output prefix.")
     ("output-filetype,t",
@@ -479,6 +479,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   asp::log_to_file(argc, argv, "", opt.output_prefix);
 
   opt.simplify_mesh = vm.count("simplify-mesh");
+  if ( opt.simplify_mesh && opt.simplify_percent == 0.0 )
+    opt.simplify_percent = 1.0;
+  if ( opt.step_size < 1 || opt.tile_size < 1 )
+    vw_throw( ArgumentErr() << "The step and tile sizes must be positive.\n"
+              << usage << general_options );
 
   // The purpose of this is to force ASP to link to the OSG libraries
   // at link-time, otherwise it fails to find them at run-time
@@ -512,9 +517,12 @@ int main( int argc, char *argv[] ){
 
     {
       vw_out() << "\nGenerating 3D mesh from point cloud:\n";
-      opt.root->addChild(build_mesh(point_image, opt));
+      std::string tex_file;
+      if ( !opt.texture_file_name.empty() )
+        tex_file = prepare_texture( Vector2i( point_image.cols(), point_image.rows() ), opt );
+      build_mesh( point_image, !tex_file.empty(), opt );
 
-      if ( !opt.texture_file_name.empty() ) {
+      if ( !tex_file.empty() ) {
         // Turning off lighting and other likes
         osg::StateSet* stateSet = new osg::StateSet();
         if ( !opt.enable_lighting )
@@ -522,6 +530,16 @@ int main( int argc, char *argv[] ){
         stateSet->setMode( GL_BLEND , osg::StateAttribute::ON );
         opt.root->setStateSet( stateSet );
 
+        // The texture is shared by all tiles
+        vw_out() << "Attaching texture data\n";
+        osg::Image* textureImage = osgDB::readImageFile(tex_file.c_str());
+        if ( textureImage && textureImage->valid() ) {
+          osg::Texture2D* texture = new osg::Texture2D;
+          texture->setImage(textureImage);
+          stateSet->setTextureAttributeAndModes(0,texture,osg::StateAttribute::ON);
+        } else {
+          vw_out() << "Failed to open texture data in " << tex_file << std::endl;
+        }
       } else {
         vw_out() << "Adding contour coloring\n";
         osg::StateSet* stateSet =
@@ -533,27 +551,10 @@ int main( int argc, char *argv[] ){
       }
     }
 
-    if ( opt.smooth_mesh ) {
-      vw_out() << "Smoothing data\n";
-      osgUtil::SmoothingVisitor sv;
-      opt.root->accept(sv);
-    }
-
-    if ( opt.simplify_mesh ) {
-      if ( opt.simplify_percent == 0.0 )
-        opt.simplify_percent = 1.0;
-
-      vw_out() << "Simplifying data\n";
-      osgUtil::Simplifier simple;
-      simple.setSmoothing( opt.smooth_mesh );
-      simple.setSampleRatio( opt.simplify_percent );
-      opt.root->accept(simple);
-    }
-
-    {
-      vw_out() << "Optimizing data\n";
-      osgUtil::Optimizer optimizer;
-      optimizer.optimize( opt.root.get() );
+    // Paged tiles were processed as they were written
+    if ( !opt.paged ) {
+      vw_out() << "Smoothing, simplifying and optimizing data\n";
+      post_process( opt.root.get(), opt );
     }
 
     {
@@ -31,6 +31,12 @@
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+
 using namespace vw;
 using namespace vw::cartography;
 
@@ -83,7 +89,8 @@ namespace asp {
     general_options_sub.add_options()
       ("session-type,t", po::value(&opt.stereo_session_string), "Select the stereo session type to use for processing. [options: pinhole isis dg rpc]")
       ("stereo-file,s", po::value(&opt.stereo_default_filename)->default_value("./stereo.default"), "Explicitly specify the stereo.default file to use. [default: ./stereo.default]")
-      ("left-image-crop-win", po::value(&opt.left_image_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"), "Do stereo in a subregion of the left image [default: use the entire image].");
+      ("left-image-crop-win", po::value(&opt.left_image_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"), "Do stereo in a subregion of the left image [default: use the entire image].")
+      ("tile-queue", po::value(&opt.tile_queue)->default_value(""), "Do correlation, refinement or triangulation for each tile listed in this file, one per line as: output_prefix xoff yoff xsize ysize. Used by parallel_stereo.");
 
     // We distinguish between all_general_options, which is all the
     // options we must parse, even if we don't need some of them, and
@@ -228,15 +235,124 @@ namespace asp {
     // The last thing we do before we get started is to copy the
     // stereo.default settings over into the results directory so that
     // we have a record of the most recent stereo.default that was used
-    // with this data set.
-    asp::stereo_settings().write_copy( argc, argv,
-                                       opt.stereo_default_filename,
-                                       opt.out_prefix + "-stereo.default" );
+    // with this data set. With a tile queue this is done per tile.
+    if ( opt.tile_queue.empty() )
+      asp::stereo_settings().write_copy( argc, argv,
+                                         opt.stereo_default_filename,
+                                         opt.out_prefix + "-stereo.default" );
+  }
+
+  // Create the claim file of a tile, which fails if another process
+  // created it first. O_EXCL makes this atomic, also on NFS from
+  // version 3 on.
+  bool claim_tile( std::string const& claim_file ) {
+    int fd = open( claim_file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 );
+    if ( fd < 0 ) {
+      if ( errno == EEXIST )
+        return false;
+      vw_throw( IOErr() << "Could not create: " << claim_file << "\n" );
+    }
+    close( fd );
+    return true;
+  }
+
+  void run_tile_queue( int argc, char *argv[], Options const& opt,
+                       std::string const& name, void (*stage)( Options& ) ) {
+
+    std::ifstream queue( opt.tile_queue.c_str() );
+    if ( !queue )
+      vw_throw( IOErr() << "Could not read: " << opt.tile_queue << "\n" );
+
+    // The stages may change the settings, so each tile starts from
+    // the settings as parsed.
+    StereoSettings const settings = stereo_settings();
+
+    int num_tiles = 0;
+    std::string line;
+    while ( std::getline( queue, line ) ) {
+      if ( boost::algorithm::trim_copy( line ).empty() )
+        continue;
+      std::istringstream is( line );
+      std::string prefix;
+      int xoff, yoff, xsize, ysize;
+      if ( !( is >> prefix >> xoff >> yoff >> xsize >> ysize ) )
+        vw_throw( ArgumentErr() << "Invalid line in " << opt.tile_queue
+                  << ": " << line << "\n" );
+
+      asp::create_out_dir( prefix );
+      if ( !claim_tile( prefix + "-" + name + ".claim" ) )
+        continue;
+
+      vw_out() << "\n[ " << current_posix_time_string() << " ] : Tile "
+               << prefix << "\n";
+
+      // As handle_arguments() would do for this tile
+      stereo_settings() = settings;
+      stereo_settings().trans_crop_win = BBox2i( xoff, yoff, xsize, ysize );
+      if ( fs::exists( prefix + "-L.tif" ) ) {
+        DiskImageView<PixelGray<float> > L_img( prefix + "-L.tif" );
+        stereo_settings().trans_crop_win.crop( bounding_box( L_img ) );
+      }
+      if ( stereo_settings().trans_crop_win.width() <= 0 ||
+           stereo_settings().trans_crop_win.height() <= 0 ) {
+        vw_out(WarningMessage) << "Skipping tile outside of the image: "
+                               << prefix << "\n";
+        continue;
+      }
+      stereo_settings().write_copy( argc, argv, opt.stereo_default_filename,
+                                    prefix + "-stereo.default" );
+
+      Options tile_opt = opt;
+      tile_opt.out_prefix = prefix;
+      tile_opt.tile_queue.clear();
+      std::string& log = tile_opt.tile_scheduler.timing_log;
+      if ( boost::algorithm::starts_with( log, opt.out_prefix ) )
+        log = prefix + log.substr( opt.out_prefix.size() );
+
+      stage( tile_opt );
+      num_tiles++;
+    }
+
+    vw_out() << "\n[ " << current_posix_time_string() << " ] : Processed "
+             << num_tiles << " tile(s) from " << opt.tile_queue << "\n";
+  }
+
+  void use_tile_scheduler( Options& opt, std::string const& name,
+                           int split_rows ) {
+    if ( stereo_settings().disable_tile_scheduler )
+      return;
+    opt.tile_scheduler.enabled    = true;
+    opt.tile_scheduler.split_rows = split_rows;
+    if ( stereo_settings().log_tile_timings )
+      opt.tile_scheduler.timing_log = opt.out_prefix + "-" + name + "-tiles.txt";
+  }
+
+  std::string disparity_write_file( Options const& opt, std::string const& suffix ) {
+    if ( stereo_settings().compact_disparity )
+      return opt.out_prefix + suffix + ".dsp";
+    return opt.out_prefix + suffix + ".tif";
+  }
+
+  std::string disparity_read_file( Options const& opt, std::string const& suffix ) {
+    std::string file = disparity_write_file( opt, suffix );
+    if ( fs::exists( file ) )
+      return file;
+    std::string other = opt.out_prefix + suffix +
+      ( stereo_settings().compact_disparity ? ".tif" : ".dsp" );
+    if ( fs::exists( other ) )
+      return other;
+    return file;
   }
 
   // Register Session types
   void stereo_register_sessions() {
 
+    // The compact disparity format, see disparity_write_file()
+    DiskImageResource::register_file_type(".dsp",
+                                          DiskImageResourceDisparity::type_static(),
+                                          &DiskImageResourceDisparity::construct_open,
+                                          &DiskImageResourceDisparity::construct_create);
+
 #if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
     // Register the Isis file handler with the Vision Workbench
     // DiskImageResource system.
@@ -425,11 +541,11 @@ namespace asp {
     float i_scale = 1.0/scale;
 
     std::string left_ip_file, right_ip_file;
-    ip::ip_filenames(out_prefix, left_sub_file, right_sub_file,
+    asp::ip_filenames(out_prefix, left_sub_file, right_sub_file,
                      left_ip_file, right_ip_file);
 
     std::string match_filename
-      = ip::match_filename(out_prefix, left_sub_file, right_sub_file);
+      = asp::match_filename(out_prefix, left_sub_file, right_sub_file);
 
     // Building / Loading Interest point data
     if ( fs::exists(match_filename) ) {
@@ -514,15 +630,27 @@ namespace asp {
         BOOST_FOREACH( ip::InterestPoint& ip, ip2 ) ip.orientation = 0;
 
         vw_out() << "\t    * Building descriptors..." << std::flush;
-        ip::SGradDescriptorGenerator descriptor;
-        if ( boost::math::isnan(left_nodata_value) )
-          describe_interest_points( left_sub_image, descriptor, ip1 );
-        else
-          describe_interest_points( apply_mask(create_mask_less_or_equal(left_sub_image,left_nodata_value)), descriptor, ip1 );
-        if ( boost::math::isnan(right_nodata_value) )
-          describe_interest_points( right_sub_image, descriptor, ip2 );
-        else
-          describe_interest_points( apply_mask(create_mask_less_or_equal(right_sub_image,right_nodata_value)), descriptor, ip2 );
+        if ( stereo_settings().binary_ip_descriptors ) {
+          BinaryDescriptorGenerator descriptor;
+          if ( boost::math::isnan(left_nodata_value) )
+            descriptor( select_channel(left_sub_image,0), ip1 );
+          else
+            descriptor( select_channel(apply_mask(create_mask_less_or_equal(left_sub_image,left_nodata_value)),0), ip1 );
+          if ( boost::math::isnan(right_nodata_value) )
+            descriptor( select_channel(right_sub_image,0), ip2 );
+          else
+            descriptor( select_channel(apply_mask(create_mask_less_or_equal(right_sub_image,right_nodata_value)),0), ip2 );
+        } else {
+          ip::SGradDescriptorGenerator descriptor;
+          if ( boost::math::isnan(left_nodata_value) )
+            describe_interest_points( left_sub_image, descriptor, ip1 );
+          else
+            describe_interest_points( apply_mask(create_mask_less_or_equal(left_sub_image,left_nodata_value)), descriptor, ip1 );
+          if ( boost::math::isnan(right_nodata_value) )
+            describe_interest_points( right_sub_image, descriptor, ip2 );
+          else
+            describe_interest_points( apply_mask(create_mask_less_or_equal(right_sub_image,right_nodata_value)), descriptor, ip2 );
+        }
 
         vw_out() << "done.\n";
 
@@ -539,10 +667,13 @@ namespace asp {
       ip2_copy = ip::read_binary_ip_file(right_ip_file);
 
       vw_out() << "\t    * Matching interest points\n";
-      ip::InterestPointMatcher<ip::L2NormMetric,ip::NullConstraint> matcher(0.6);
-
-      matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2,
-              TerminalProgressCallback( "asp", "\t    Matching: "));
+      if ( stereo_settings().binary_ip_descriptors ) {
+        match_binary_descriptors( ip1_copy, ip2_copy, matched_ip1, matched_ip2, 0.6 );
+      } else {
+        ip::InterestPointMatcher<ip::L2NormMetric,ip::NullConstraint> matcher(0.6);
+        matcher(ip1_copy, ip2_copy, matched_ip1, matched_ip2,
+                TerminalProgressCallback( "asp", "\t    Matching: "));
+      }
       vw_out(InfoMessage) << "\t    " << matched_ip1.size() << " putative matches.\n";
 
       vw_out() << "\t    * Rejecting outliers using RANSAC.\n";
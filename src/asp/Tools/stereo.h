@@ -33,6 +33,7 @@
 #include <asp/Core/MedianFilter.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/DiskImageResourceDisparity.h>
 #include <asp/Sessions.h>
 
 namespace po = boost::program_options;
@@ -73,6 +74,49 @@ namespace asp {
                          boost::program_options::options_description const&
                          additional_options);
 
+  // Have the block writers of a stage use the tile scheduler, unless
+  // disabled. If asked for, the tile timings are logged to
+  // <prefix>-<name>-tiles.txt.
+  // A positive 'split_rows' lets idle threads share a tile by rows.
+  void use_tile_scheduler( Options& opt, std::string const& name,
+                           int split_rows = 0 );
+
+  // Run 'stage' on the tiles listed in opt.tile_queue, one per line
+  // as: output_prefix xoff yoff xsize ysize, where the crop window is
+  // with respect to L.tif. This process keeps its session, cameras
+  // and settings from one tile to the next, so parallel_stereo needs
+  // to start only one process per slot rather than one per tile. A
+  // tile is done by the process that first creates its claim file,
+  // <output_prefix>-<name>.claim, so several processes can share a
+  // queue.
+  void run_tile_queue( int argc, char *argv[], Options const& opt,
+                       std::string const& name, void (*stage)( Options& ) );
+
+  // Name of the disparity <prefix><suffix> to write, for suffix -D,
+  // -RD or -F. It is a .dsp file with --compact-disparity, else a
+  // .tif file.
+  std::string disparity_write_file( Options const& opt, std::string const& suffix );
+
+  // Name of the disparity to read. This is the file that would be
+  // written if it exists, else the one in the other format, so a run
+  // can be resumed with or without --compact-disparity.
+  std::string disparity_read_file( Options const& opt, std::string const& suffix );
+
+  // Block write a disparity in the format given by the file extension
+  template <class ImageT>
+  void block_write_disparity( std::string const& filename,
+                              vw::ImageViewBase<ImageT> const& image,
+                              Options const& opt,
+                              vw::ProgressCallback const& progress_callback ) {
+    if ( DiskImageResourceDisparity::is_disparity_file( filename ) ) {
+      DiskImageResourceDisparity rsrc( filename, image.impl().format(),
+                                       opt.raster_tile_size );
+      block_write_rsrc( rsrc, image.impl(), opt, progress_callback );
+    } else {
+      block_write_gdal_image( filename, image.impl(), opt, progress_callback );
+    }
+  }
+
   // Register Session types
   void stereo_register_sessions();
 
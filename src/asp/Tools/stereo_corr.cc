@@ -29,6 +29,9 @@
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/CorrelationCostModel.h>
+#include <vw/Core/Stopwatch.h>
+#include <boost/lexical_cast.hpp>
 
 using namespace vw;
 using namespace vw::stereo;
@@ -126,7 +129,7 @@ void lowres_correlation( Options & opt ) {
 
     // Match file between the input files
     std::string match_filename
-      = ip::match_filename(opt.out_prefix, opt.in_file1, opt.in_file2);
+      = asp::match_filename(opt.out_prefix, opt.in_file1, opt.in_file2);
 
     if (!fs::exists(match_filename)) {
       // If there is not any match files for the input image. Let's
@@ -236,6 +239,43 @@ class SeededCorrelatorView : public ImageViewBase<SeededCorrelatorView<Image1T,
   stereo::CostFunctionType m_cost_mode;
   int m_corr_timeout;
   double m_seconds_per_op;
+  boost::shared_ptr<CorrelationCostModel> m_cost_model; // May be null
+
+  // What the cost model needs to know of a tile before correlating it
+  CorrelationSample tile_sample( BBox2i const& bbox, BBox2f const& search_range ) const {
+    CorrelationSample sample;
+    sample.pixels      = double(bbox.width()) * bbox.height();
+    sample.search_area = (search_range.width() + 1.0) * (search_range.height() + 1.0);
+    sample.kernel_area = double(m_kernel_size[0]) * m_kernel_size[1];
+
+    // Only the mask is read, the left image being correlated later
+    ImageView<typename Mask1T::pixel_type> mask = crop( m_left_mask, bbox );
+    double count = 0;
+    for ( int row = 0; row < mask.rows(); row++ )
+      for ( int col = 0; col < mask.cols(); col++ )
+        if ( mask(col,row) ) count++;
+    if ( sample.pixels > 0 )
+      sample.valid_fraction = count / sample.pixels;
+    return sample;
+  }
+
+  // Tiles without a single valid disparity may have been cut short by
+  // the timeout, so they do not tell how long the work takes.
+  void record_sample( CorrelationSample sample, Stopwatch const& sw,
+                      CropView<ImageView<PixelMask<Vector2i> > > const& disparity ) const {
+    if ( !m_cost_model )
+      return;
+    ImageView<PixelMask<Vector2i> > const& tile = disparity.child();
+    for ( int row = 0; row < tile.rows(); row++ ) {
+      for ( int col = 0; col < tile.cols(); col++ ) {
+        if ( is_valid( tile(col,row) ) ) {
+          sample.elapsed = sw.elapsed_seconds();
+          m_cost_model->add( sample );
+          return;
+        }
+      }
+    }
+  }
 
 public:
   SeededCorrelatorView( ImageViewBase<Image1T>   const& left_image,
@@ -249,14 +289,16 @@ public:
                         BBox2i trans_crop_win,
                         Vector2i const& kernel_size,
                         stereo::CostFunctionType cost_mode,
-                        int corr_timeout, double seconds_per_op) :
+                        int corr_timeout, double seconds_per_op,
+                        boost::shared_ptr<CorrelationCostModel> cost_model) :
     m_left_image    (left_image.impl()),  m_right_image    (right_image.impl    ()),
     m_left_mask     (left_mask.impl ()),  m_right_mask     (right_mask.impl     ()),
     m_sub_disp      (sub_disp.impl  ()),  m_sub_disp_spread(sub_disp_spread.impl()),
     m_local_hom     (local_hom), m_preproc_func( filter.impl() ),
     m_trans_crop_win(trans_crop_win),
     m_kernel_size   (kernel_size),  m_cost_mode(cost_mode),
-    m_corr_timeout  (corr_timeout), m_seconds_per_op(seconds_per_op){
+    m_corr_timeout  (corr_timeout), m_seconds_per_op(seconds_per_op),
+    m_cost_model    (cost_model){
     m_upscale_factor[0] = double(m_left_image.cols()) / m_sub_disp.cols();
     m_upscale_factor[1] = double(m_left_image.rows()) / m_sub_disp.rows();
     m_seed_bbox = bounding_box( m_sub_disp );
@@ -411,26 +453,46 @@ public:
                                     << stereo_settings().search_range << "\n";
     }
 
+    // With a cost model, give the tile a time budget suited to its
+    // search range, and time it to improve the model.
+    CorrelationSample sample;
+    int corr_timeout = m_corr_timeout;
+    if ( m_cost_model ) {
+      sample = tile_sample( bbox, local_search_range );
+      corr_timeout = m_cost_model->timeout( sample, m_corr_timeout );
+      VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView(" << bbox
+                                     << ") predicted time " << m_cost_model->predict( sample )
+                                     << " s, timeout " << corr_timeout << " s\n";
+    }
+    Stopwatch sw;
+    sw.start();
+
     if (use_local_homography){
       typedef stereo::PyramidCorrelationView<Image1T, ImageViewRef<typename Image2T::pixel_type>, Mask1T,ImageViewRef<typename Mask2T::pixel_type>, PProcT> CorrView;
       CorrView corr_view( m_left_image,   right_trans_img,
                           m_left_mask,    right_trans_mask,
                           m_preproc_func, local_search_range,
                           m_kernel_size,  m_cost_mode,
-                          m_corr_timeout, m_seconds_per_op,
+                          corr_timeout,   m_seconds_per_op,
                           stereo_settings().xcorr_threshold,
                           stereo_settings().corr_max_levels );
-      return corr_view.prerasterize(bbox);
+      prerasterize_type disparity = corr_view.prerasterize(bbox);
+      sw.stop();
+      record_sample( sample, sw, disparity );
+      return disparity;
     }else{
       typedef stereo::PyramidCorrelationView<Image1T, Image2T, Mask1T, Mask2T, PProcT> CorrView;
       CorrView corr_view( m_left_image,   m_right_image,
                           m_left_mask,    m_right_mask,
                           m_preproc_func, local_search_range,
                           m_kernel_size,  m_cost_mode,
-                          m_corr_timeout, m_seconds_per_op,
+                          corr_timeout,   m_seconds_per_op,
                           stereo_settings().xcorr_threshold,
                           stereo_settings().corr_max_levels );
-      return corr_view.prerasterize(bbox);
+      prerasterize_type disparity = corr_view.prerasterize(bbox);
+      sw.stop();
+      record_sample( sample, sw, disparity );
+      return disparity;
     }
   }
 
@@ -453,14 +515,72 @@ seeded_correlation( ImageViewBase<Image1T>        const& left,
                     BBox2i trans_crop_win,
                     Vector2i const& kernel_size,
                     stereo::CostFunctionType cost_type,
-                    int corr_timeout, double seconds_per_op) {
+                    int corr_timeout, double seconds_per_op,
+                    boost::shared_ptr<CorrelationCostModel> cost_model) {
   typedef SeededCorrelatorView<Image1T, Image2T, Mask1T, Mask2T, SeedDispT, PProcT> return_type;
   return return_type( left.impl(), right.impl(), lmask.impl(), rmask.impl(),
                       sub_disp.impl(), sub_disp_spread.impl(),
                       local_hom, filter.impl(), trans_crop_win, kernel_size,
-                      cost_type, corr_timeout, seconds_per_op );
+                      cost_type, corr_timeout, seconds_per_op, cost_model );
 }
 
+// The estimate of the cost of a tile that the tile scheduler uses to
+// start the costliest tiles first, so that they do not hold up the end
+// of the run. The scheduler asks for all the costs before the first
+// tile starts, so this is the time predicted from the timings of
+// earlier runs if there are enough of them, otherwise the tile area
+// times the area of its search range, both from the low-resolution
+// disparity alone.
+class SeededTileCost : public TileCostEstimator {
+  ImageView<PixelMask<Vector2i> > m_sub_disp; // Empty without seed
+  Vector2  m_upscale_factor;
+  BBox2i   m_trans_crop_win;
+  Vector2i m_kernel_size;
+  boost::shared_ptr<CorrelationCostModel> m_cost_model;
+public:
+  SeededTileCost( ImageViewRef<PixelMask<Vector2i> > const& sub_disp,
+                  Vector2i const& image_size, BBox2i const& trans_crop_win,
+                  Vector2i const& kernel_size,
+                  boost::shared_ptr<CorrelationCostModel> cost_model ) :
+    m_trans_crop_win(trans_crop_win), m_kernel_size(kernel_size),
+    m_cost_model(cost_model) {
+    if ( stereo_settings().seed_mode > 0 ) {
+      m_sub_disp = sub_disp;
+      m_upscale_factor[0] = double(image_size[0]) / m_sub_disp.cols();
+      m_upscale_factor[1] = double(image_size[1]) / m_sub_disp.rows();
+    }
+  }
+
+  virtual double operator()( BBox2i const& bbox ) const {
+    BBox2i intersection = bbox; intersection.crop(m_trans_crop_win);
+    if ( intersection.empty() )
+      return 0;
+
+    BBox2f search_range = stereo_settings().search_range;
+    if ( m_sub_disp.cols() > 0 ) {
+      BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
+                        elem_quot(bbox.max(), m_upscale_factor) );
+      seed_bbox.expand(1);
+      seed_bbox.crop( bounding_box( m_sub_disp ) );
+      if ( seed_bbox.empty() )
+        return 0;
+      search_range = stereo::get_disparity_range( crop( m_sub_disp, seed_bbox ) );
+      search_range.min() = floor(elem_prod(search_range.min(), m_upscale_factor));
+      search_range.max() = ceil (elem_prod(search_range.max(), m_upscale_factor));
+    }
+
+    CorrelationSample sample;
+    sample.pixels         = double(bbox.width()) * bbox.height();
+    sample.search_area    = std::max( 0.0, search_range.width()  + 1.0 ) *
+                            std::max( 0.0, search_range.height() + 1.0 );
+    sample.kernel_area    = double(m_kernel_size[0]) * m_kernel_size[1];
+    sample.valid_fraction = 1.0;
+    if ( m_cost_model && m_cost_model->is_ready() )
+      return m_cost_model->predict( sample );
+    return sample.pixels * sample.search_area;
+  }
+};
+
 void stereo_correlation( Options& opt ) {
 
   lowres_correlation(opt);
@@ -534,6 +654,22 @@ void stereo_correlation( Options& opt ) {
     seconds_per_op = calc_seconds_per_op(cost_mode, left_disk_image, right_disk_image,
                                          kernel_size);
 
+  // Tiles are timed, and timings of earlier runs kept, one file per
+  // cost mode, only for the per-tile timeouts of
+  // --adaptive-corr-timeout.
+  use_tile_scheduler( opt, "D" );
+  boost::shared_ptr<CorrelationCostModel> cost_model;
+  bool adaptive_timeout = stereo_settings().adaptive_corr_timeout;
+  if ( adaptive_timeout )
+    cost_model.reset( new CorrelationCostModel() );
+  std::string stats_file = opt.out_prefix + "-corr-stats-mode"
+    + boost::lexical_cast<std::string>( stereo_settings().cost_mode ) + ".txt";
+  if ( adaptive_timeout && fs::exists( stats_file ) ) {
+    cost_model->read( stats_file );
+    vw_out() << "\t--> Read " << cost_model->size()
+             << " tile timings from: " << stats_file << "\n";
+  }
+
   if ( stereo_settings().pre_filter_mode == 2 ) {
     vw_out() << "\t--> Using LOG pre-processing filter with "
              << stereo_settings().slogW << " sigma blur.\n";
@@ -542,7 +678,7 @@ void stereo_correlation( Options& opt ) {
                           sub_disp, sub_disp_spread, local_hom,
                           stereo::LaplacianOfGaussian(stereo_settings().slogW),
                           trans_crop_win, kernel_size, cost_mode, corr_timeout,
-                          seconds_per_op );
+                          seconds_per_op, cost_model );
   } else if ( stereo_settings().pre_filter_mode == 1 ) {
     vw_out() << "\t--> Using Subtracted Mean pre-processing filter with "
              << stereo_settings().slogW << " sigma blur.\n";
@@ -551,7 +687,7 @@ void stereo_correlation( Options& opt ) {
                           sub_disp, sub_disp_spread, local_hom,
                           stereo::SubtractedMean(stereo_settings().slogW),
                           trans_crop_win, kernel_size, cost_mode, corr_timeout,
-                          seconds_per_op );
+                          seconds_per_op, cost_model );
   } else {
     vw_out() << "\t--> Using NO pre-processing filter." << std::endl;
     fullres_disparity =
@@ -559,14 +695,23 @@ void stereo_correlation( Options& opt ) {
                           sub_disp, sub_disp_spread, local_hom,
                           stereo::NullOperation(),
                           trans_crop_win, kernel_size, cost_mode, corr_timeout,
-                          seconds_per_op );
+                          seconds_per_op, cost_model );
   }
 
-  std::string d_file = opt.out_prefix + "-D.tif";
+  std::string d_file = disparity_write_file( opt, "-D" );
   vw_out() << "Writing: " << d_file << "\n";
-  asp::block_write_gdal_image(d_file,
-                              fullres_disparity, opt,
-                              TerminalProgressCallback("asp", "\t--> Correlation :") );
+  if ( opt.tile_scheduler.enabled )
+    opt.tile_scheduler.tile_cost.reset
+      ( new SeededTileCost( sub_disp, Vector2i( left_disk_image.cols(), left_disk_image.rows() ),
+                            trans_crop_win, kernel_size, cost_model ) );
+  asp::block_write_disparity(d_file,
+                             fullres_disparity, opt,
+                             TerminalProgressCallback("asp", "\t--> Correlation :") );
+
+  if ( adaptive_timeout ) {
+    vw_out() << "Writing: " << stats_file << "\n";
+    cost_model->write( stats_file );
+  }
 
   vw_out() << "\n[ " << current_posix_time_string()
            << " ] : CORRELATION FINISHED \n";
@@ -588,7 +733,10 @@ int main(int argc, char* argv[]) {
 
     // Internal Processes
     //---------------------------------------------------------
-    stereo_correlation( opt );
+    if ( opt.tile_queue.empty() )
+      stereo_correlation( opt );
+    else
+      run_tile_queue( argc, argv, opt, "corr", stereo_correlation );
 
   } ASP_STANDARD_CATCHES;
 
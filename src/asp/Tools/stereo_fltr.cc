@@ -36,61 +36,180 @@ namespace vw {
 }
 
 // Run several cleanup passes with desired cleanup mode.
-template <class ViewT>
-struct MultipleDisparityCleanUp {
-  typedef ImageViewRef< typename ViewT::pixel_type > result_type;
-  
-  inline result_type operator()( ImageViewBase<ViewT> const& input, int N) {
-
-    result_type out = input;
-    for (int i = 0; i < N; i++){
-      int mode = stereo_settings().filter_mode;
-      if (mode == 1){
-        out = stereo::disparity_cleanup_using_mean
-          (out.impl(),
-           stereo_settings().rm_half_kernel.x(),
-           stereo_settings().rm_half_kernel.y(),
-           stereo_settings().max_mean_diff);
-      }else if (mode == 2){
-        out = stereo::disparity_cleanup_using_thresh
-          (out.impl(),
-           stereo_settings().rm_half_kernel.x(),
-           stereo_settings().rm_half_kernel.y(),
-           stereo_settings().rm_threshold,
-           stereo_settings().rm_min_matches/100.0);
-      }else
-        vw_throw( ArgumentErr() << "\nExpecting value of 1 or 2 for filter-mode. "
-                  << "Got: " << mode << "\n" );
+//
+// Chaining the lazy cleanup views would make each output pixel
+// re-evaluate the previous pass over its whole neighborhood, for a
+// cost growing like the kernel size to the power of the number of
+// passes. Instead, each tile reads the input once, with a border of
+// one half-kernel per pass, and runs the passes one after another on
+// in-memory buffers, each pass shrinking the region by a half-kernel.
+// The buffers are cropped to the image, so the edge handling of the
+// filters at the image boundary is the same as before.
+template <class ImageT>
+class MultipleDisparityCleanUpView:
+  public ImageViewBase< MultipleDisparityCleanUpView<ImageT> > {
+  ImageT m_img;
+  int m_num_passes, m_mode;
+  Vector2i m_half_kernel;
+
+  typedef typename ImageT::pixel_type PixelT;
+
+  // One cleanup pass over an in-memory region, cropped to 'out_box'
+  // (relative to that region).
+  ImageView<PixelT> cleanup_pass(ImageView<PixelT> const& region,
+                                 BBox2i const& out_box) const {
+    if (m_mode == 1)
+      return crop(stereo::disparity_cleanup_using_mean
+                  (region, m_half_kernel.x(), m_half_kernel.y(),
+                   stereo_settings().max_mean_diff),
+                  out_box);
+    return crop(stereo::disparity_cleanup_using_thresh
+                (region, m_half_kernel.x(), m_half_kernel.y(),
+                 stereo_settings().rm_threshold,
+                 stereo_settings().rm_min_matches/100.0),
+                out_box);
+  }
+
+  // The tile grown by the given number of half-kernels, within the image
+  BBox2i pass_region(BBox2i const& bbox, int num_half_kernels) const {
+    BBox2i region_box = bbox;
+    region_box.min() -= m_half_kernel*num_half_kernels;
+    region_box.max() += m_half_kernel*num_half_kernels;
+    region_box.crop(bounding_box(m_img));
+    return region_box;
+  }
+
+public:
+  MultipleDisparityCleanUpView( ImageT const& img, int num_passes ):
+    m_img(img), m_num_passes(num_passes),
+    m_mode(stereo_settings().filter_mode),
+    m_half_kernel(stereo_settings().rm_half_kernel){
+    if (m_num_passes > 0 && m_mode != 1 && m_mode != 2)
+      vw_throw( ArgumentErr() << "\nExpecting value of 1 or 2 for filter-mode. "
+                << "Got: " << m_mode << "\n" );
+  }
+
+  typedef PixelT pixel_type;
+  typedef PixelT result_type;
+  typedef ProceduralPixelAccessor<MultipleDisparityCleanUpView> pixel_accessor;
+
+  inline int32 cols() const { return m_img.cols(); }
+  inline int32 rows() const { return m_img.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+  inline pixel_type operator()( double/*i*/, double/*j*/, int32/*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "MultipleDisparityCleanUpView::operator()(...) is not implemented");
+    return pixel_type();
+  }
+
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    // The region needed before the first pass, in image coordinates
+    BBox2i region_box = pass_region(bbox, m_num_passes);
+    ImageView<pixel_type> region = crop(m_img, region_box);
+
+    for (int pass = 0; pass < m_num_passes; pass++){
+      BBox2i next_box = pass_region(bbox, m_num_passes - pass - 1);
+      region = cleanup_pass(region, next_box - region_box.min());
+      region_box = next_box;
+    }
+
+    return prerasterize_type(region, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows() );
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+};
+
+template <class ImageT>
+MultipleDisparityCleanUpView<ImageT>
+multiple_disparity_cleanup( ImageViewBase<ImageT> const& img, int num_passes ){
+  return MultipleDisparityCleanUpView<ImageT>(img.impl(), num_passes);
+}
+
+// Pass-through view which, as tiles of the filtered disparity get
+// rasterized for F.tif, saves the pixels needed for the subsampled
+// good pixel map. That way the filtering is evaluated once for both
+// outputs. Views over it must rasterize it (rather than query it per
+// pixel), which is the case for inpaint and ErodeView.
+template <class ImageT>
+class GoodPixelSamplerView: public ImageViewBase< GoodPixelSamplerView<ImageT> > {
+  ImageT m_img;
+  int32 m_step;
+  boost::shared_ptr< ImageView<typename ImageT::pixel_type> > m_samples;
+  boost::shared_ptr<Mutex> m_mutex;
+
+public:
+  typedef typename ImageT::pixel_type pixel_type;
+  typedef pixel_type result_type;
+  typedef ProceduralPixelAccessor<GoodPixelSamplerView> pixel_accessor;
+
+  GoodPixelSamplerView( ImageT const& img, int32 step ):
+    m_img(img), m_step(step),
+    m_samples(new ImageView<pixel_type>((img.cols() - 1)/step + 1,
+                                        (img.rows() - 1)/step + 1)),
+    m_mutex(new Mutex){}
+
+  inline int32 cols() const { return m_img.cols(); }
+  inline int32 rows() const { return m_img.rows(); }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+  inline result_type operator()( int32 i, int32 j, int32 p = 0 ) const {
+    return m_img(i, j, p);
+  }
+
+  // Every m_step-th pixel of every m_step-th row, as vw::subsample
+  // would pick them.
+  ImageView<pixel_type> const& samples() const { return *m_samples; }
+
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+    ImageView<pixel_type> tile = crop(m_img, bbox);
+
+    BBox2i sample_box = bbox;
+    sample_box.crop(bounding_box(m_img));
+    int32 first_col = (sample_box.min().x() + m_step - 1)/m_step*m_step;
+    int32 first_row = (sample_box.min().y() + m_step - 1)/m_step*m_step;
+    {
+      Mutex::Lock lock(*m_mutex);
+      for (int32 row = first_row; row < sample_box.max().y(); row += m_step){
+        for (int32 col = first_col; col < sample_box.max().x(); col += m_step)
+          (*m_samples)(col/m_step, row/m_step)
+            = tile(col - bbox.min().x(), row - bbox.min().y());
+      }
     }
 
-    return out;
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows() );
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
   }
 };
 
 template <class ImageT>
 void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
                                     Options const& opt ) {
-  // Write Good Pixel Map
-  // Sub-sampling so that the user can actually view it.
+  // The good pixel map is sub-sampled so that the user can actually
+  // view it. It is made from samples saved while writing F.tif.
   float sub_scale =
     float( std::min( inputview.impl().cols(),
                      inputview.impl().rows() ) ) / 2048.0;
-  
-  asp::block_write_gdal_image
-    ( opt.out_prefix + "-GoodPixelMap.tif",
-      subsample
-      (apply_mask
-       (copy_mask
-        (stereo::missing_pixel_image(inputview.impl()),
-         create_mask(DiskImageView<vw::uint8>(opt.out_prefix+"-lMask.tif"), 0)
-         )
-        ),
-       sub_scale < 1 ? 1 : sub_scale
-       ),
-      opt, TerminalProgressCallback
-      ("asp", "\t--> Good Pxl Map: ") );
-  
+  int32 sub_step = sub_scale < 1 ? 1 : int32(sub_scale);
+  GoodPixelSamplerView<ImageT> sampled_view(inputview.impl(), sub_step);
+
   bool removeSmallBlobs = (stereo_settings().erode_max_size > 0);
+  std::string f_file = disparity_write_file( opt, "-F" );
 
   // Fill holes
   if(stereo_settings().enable_fill_holes) {
@@ -107,11 +226,11 @@ void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
 
     if (!removeSmallBlobs) { // Skip small blob removal
       // Write out the image to disk, filling in the blobs in the process
-      asp::block_write_gdal_image( opt.out_prefix + "-F.tif",
-                                   inpaint(inputview.impl(), smallHoleIndex,
-                                           use_grassfire, default_inpaint_val),
-                                   opt, TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
+      asp::block_write_disparity( f_file,
+                                  inpaint(sampled_view, smallHoleIndex,
+                                          use_grassfire, default_inpaint_val),
+                                  opt, TerminalProgressCallback
+                                  ("asp","\t--> Filtering: ") );
     }
     else { // Add small blob removal step
       // Get a list of small blobs, almost identical to how the fill holes
@@ -142,21 +261,21 @@ void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
 
       // Write out the image to disk, filling in and removing blobs in the process
       // - Blob removal is done second to make sure inner-blob holes are removed.
-      asp::block_write_gdal_image( opt.out_prefix + "-F.tif",
-                                   applyErodeView(inpaint(inputview.impl(),
-                                                          smallHoleIndex,
-                                                          use_grassfire,
-                                                          default_inpaint_val),
-                                                  fullBlobList),
-                                   opt, TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
+      asp::block_write_disparity( f_file,
+                                  applyErodeView(inpaint(sampled_view,
+                                                         smallHoleIndex,
+                                                         use_grassfire,
+                                                         default_inpaint_val),
+                                                 fullBlobList),
+                                  opt, TerminalProgressCallback
+                                  ("asp","\t--> Filtering: ") );
     }
 
   } else { // No hole filling
     if (!removeSmallBlobs) { // Skip small blob removal
-      asp::block_write_gdal_image( opt.out_prefix + "-F.tif",
-                                       inputview.impl(), opt,
-                                       TerminalProgressCallback("asp", "\t--> Filtering: ") );
+      asp::block_write_disparity( f_file,
+                                  sampled_view, opt,
+                                  TerminalProgressCallback("asp", "\t--> Filtering: ") );
     }
     else { // Add small blob removal step
       // Get a list of small blobs, almost identical to how the fill holes
@@ -165,18 +284,31 @@ void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
       vw_out() << "\t    * Identified " << smallBlobIndex.num_blobs() << " small blobs\n";
 
       // Write out the image to disk, removing the blobs in the process
-      asp::block_write_gdal_image( opt.out_prefix + "-F.tif",
-                                   applyErodeView(inputview.impl(), smallBlobIndex),
-                                   opt, TerminalProgressCallback("asp","\t--> Filtering: ") );
+      asp::block_write_disparity( f_file,
+                                  applyErodeView(sampled_view, smallBlobIndex),
+                                  opt, TerminalProgressCallback("asp","\t--> Filtering: ") );
     }
 
   } // End no hole filling case
+
+  // Write Good Pixel Map
+  asp::block_write_gdal_image
+    ( opt.out_prefix + "-GoodPixelMap.tif",
+      apply_mask
+      (copy_mask
+       (stereo::missing_pixel_image(sampled_view.samples()),
+        create_mask(subsample(DiskImageView<vw::uint8>(opt.out_prefix+"-lMask.tif"),
+                              sub_step), 0)
+        )
+       ),
+      opt, TerminalProgressCallback
+      ("asp", "\t--> Good Pxl Map: ") );
 }
 
 void stereo_filtering( Options& opt ) {
 
   std::string post_correlation_fname;
-  opt.session->pre_filtering_hook(opt.out_prefix+"-RD.tif",
+  opt.session->pre_filtering_hook(disparity_read_file(opt, "-RD"),
                                   post_correlation_fname);
 
   try {
@@ -210,7 +342,7 @@ void stereo_filtering( Options& opt ) {
       {
         filtered_disparity =
           stereo::disparity_mask
-          (MultipleDisparityCleanUp<input_type>()
+          (multiple_disparity_cleanup
            (disparity_disk_image, stereo_settings().rm_cleanup_passes),
            apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
            apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024)));
@@ -241,7 +373,7 @@ void stereo_filtering( Options& opt ) {
         // Apply an outlier removal filter
         write_good_pixel_and_filtered
           (stereo::disparity_mask
-            (MultipleDisparityCleanUp<input_type>()
+            (multiple_disparity_cleanup
               (disparity_disk_image, stereo_settings().rm_cleanup_passes),
                apply_mask(asp::threaded_edge_mask(left_mask, 0,mask_buffer,1024)),
                apply_mask(asp::threaded_edge_mask(right_mask,0,mask_buffer,1024))),
@@ -90,6 +90,7 @@ int main( int argc, char* argv[] ) {
     vw_out() << "corr_tile_size," << Options::corr_tile_size() << std::endl;
     vw_out() << "rfne_tile_size," << Options::rfne_tile_size() << std::endl;
     vw_out() << "tri_tile_size,"  << Options::tri_tile_size()  << std::endl;
+    vw_out() << "compact_disparity," << stereo_settings().compact_disparity << std::endl;
 
   } ASP_STANDARD_CATCHES;
 
@@ -186,6 +186,7 @@ class PerTileRfne: public ImageViewBase<PerTileRfne<Image1T, Image2T, SeedDispT>
   SeedDispT            m_integer_disp;
   SeedDispT            m_sub_disp;
   ImageView<Matrix3x3> m_local_hom;
+  DisparityTileIndex   m_integer_disp_index;
   Options const&       m_opt;
   Vector2              m_upscale_factor;
 
@@ -196,11 +197,12 @@ public:
                ImageViewBase<SeedDispT> const& integer_disp,
                ImageViewBase<SeedDispT> const& sub_disp,
                ImageView    <Matrix3x3> const& local_hom,
+               DisparityTileIndex       const& integer_disp_index,
                Options const& opt):
     m_left_image(left_image.impl()), m_right_image(right_image.impl()),
     m_right_mask(right_mask),
     m_integer_disp( integer_disp.impl() ), m_sub_disp( sub_disp.impl() ),
-    m_local_hom(local_hom), m_opt(opt){
+    m_local_hom(local_hom), m_integer_disp_index(integer_disp_index), m_opt(opt){
 
     m_upscale_factor
       = Vector2(double(m_left_image.impl().cols()) / m_sub_disp.cols(),
@@ -227,10 +229,11 @@ public:
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
 
     // We do stereo only in trans_crop_win. Skip the current tile if
-    // it does not intersect this region.
+    // it does not intersect this region, or if the integer disparity
+    // has no valid pixels in it.
     BBox2i trans_crop_win = stereo_settings().trans_crop_win;
     BBox2i intersection = bbox; intersection.crop(trans_crop_win);
-    if (intersection.empty()){
+    if (intersection.empty() || m_integer_disp_index.empty(bbox)){
       return prerasterize_type(ImageView<pixel_type>(bbox.width(),
                                                      bbox.height()),
                                -bbox.min().x(), -bbox.min().y(),
@@ -304,19 +307,22 @@ per_tile_rfne( ImageViewBase<Image1T> const& left,
                ImageViewBase<SeedDispT> const& integer_disp,
                ImageViewBase<SeedDispT> const& sub_disp,
                ImageView<Matrix3x3> const& local_hom,
+               DisparityTileIndex const& integer_disp_index,
                Options const& opt) {
   typedef PerTileRfne<Image1T, Image2T, SeedDispT> return_type;
   return return_type( left.impl(), right.impl(), right_mask,
-                      integer_disp.impl(), sub_disp.impl(), local_hom, opt );
+                      integer_disp.impl(), sub_disp.impl(), local_hom,
+                      integer_disp_index, opt );
 }
 
-void stereo_refinement( Options const& opt ) {
+void stereo_refinement( Options& opt ) {
 
   ImageViewRef<PixelGray<float> > left_image, right_image;
   ImageViewRef<uint8> left_mask, right_mask;
   ImageViewRef<PixelMask<Vector2i> > integer_disp;
   ImageViewRef<PixelMask<Vector2i> > sub_disp;
   ImageView<Matrix3x3> local_hom;
+  DisparityTileIndex integer_disp_index;
   std::string left_image_file  = opt.out_prefix+"-L.tif";
   std::string right_image_file = opt.out_prefix+"-R.tif";
   std::string left_mask_file  = opt.out_prefix+"-lMask.tif";
@@ -327,7 +333,9 @@ void stereo_refinement( Options const& opt ) {
     right_image  = DiskImageView< PixelGray<float> >(right_image_file);
     left_mask    = DiskImageView<uint8>(left_mask_file);
     right_mask   = DiskImageView<uint8>(right_mask_file);
-    integer_disp = DiskImageView< PixelMask<Vector2i> >(opt.out_prefix + "-D.tif");
+    std::string d_file = disparity_read_file( opt, "-D" );
+    integer_disp       = DiskImageView< PixelMask<Vector2i> >(d_file);
+    integer_disp_index = DisparityTileIndex(d_file);
     if ( stereo_settings().seed_mode > 0 &&
          stereo_settings().use_local_homography ){
       sub_disp = DiskImageView<PixelMask<Vector2i> >(opt.out_prefix+"-D_sub.tif");
@@ -373,13 +381,13 @@ void stereo_refinement( Options const& opt ) {
 
   ImageViewRef< PixelMask<Vector2f> > refined_disp
     = per_tile_rfne(left_image, right_image, right_mask,
-                    integer_disp, sub_disp, local_hom, opt);
+                    integer_disp, sub_disp, local_hom, integer_disp_index, opt);
 
-  std::string rd_file = opt.out_prefix + "-RD.tif";
+  std::string rd_file = disparity_write_file( opt, "-RD" );
   vw_out() << "Writing: " << rd_file << "\n";
-  asp::block_write_gdal_image(rd_file,
-                              refined_disp, opt,
-                              TerminalProgressCallback("asp", "\t--> Refinement :") );
+  asp::block_write_disparity(rd_file,
+                             refined_disp, opt,
+                             TerminalProgressCallback("asp", "\t--> Refinement :") );
 }
 
 int main(int argc, char* argv[]) {
@@ -397,9 +405,16 @@ int main(int argc, char* argv[]) {
     int ts = Options::rfne_tile_size();
     opt.raster_tile_size = Vector2i(ts, ts);
 
+    // Refinement works on whole tiles, as the local homographies are
+    // per tile, so the tiles are not split.
+    use_tile_scheduler( opt, "RD" );
+
     // Internal Processes
     //---------------------------------------------------------
-    stereo_refinement( opt );
+    if ( opt.tile_queue.empty() )
+      stereo_refinement( opt );
+    else
+      run_tile_queue( argc, argv, opt, "rfne", stereo_refinement );
 
     vw_out() << "\n[ " << current_posix_time_string()
              << " ] : REFINEMENT FINISHED \n";
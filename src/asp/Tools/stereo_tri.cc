@@ -66,8 +66,12 @@ namespace asp{
     std::string point_cloud_file = opt.out_prefix + "-PC.tif";
     vw_out() << "Writing point cloud: " << point_cloud_file << "\n";
 
-    if ( opt.session->name() == "isis" ){
-      // ISIS does not support multi-threading
+    boost::shared_ptr<camera::CameraModel> camera_model1, camera_model2;
+    opt.session->camera_models(camera_model1, camera_model2);
+    if ( !asp::camera_thread_safe(*camera_model1) ||
+         !asp::camera_thread_safe(*camera_model2) ){
+      // ISIS does not support multi-threading. The tabulated ISIS
+      // cameras do.
       asp::write_approx_gdal_image
         ( point_cloud_file, shift,
           stereo_settings().point_cloud_rounding_error,
@@ -375,7 +379,7 @@ void stereo_triangulation( Options const& opt ) {
   typedef typename SessionT::stereo_model_type StereoModelT;
   try {
     PVImageT disparity_map =
-      opt.session->pre_pointcloud_hook(opt.out_prefix+"-F.tif");
+      opt.session->pre_pointcloud_hook(disparity_read_file(opt, "-F"));
 
     boost::shared_ptr<camera::CameraModel> camera_model1, camera_model2;
     opt.session->camera_models(camera_model1, camera_model2);
@@ -503,6 +507,22 @@ void stereo_triangulation( Options const& opt ) {
   }
 }
 
+// Triangulation with the session type in use
+void stereo_triangulation_any( Options& opt ) {
+#define INSTANTIATE(T,NAME) if ( opt.session->name() == NAME ) { stereo_triangulation<T>(opt); }
+
+  INSTANTIATE(StereoSessionPinhole,"pinhole");
+  INSTANTIATE(StereoSessionNadirPinhole,"nadirpinhole");
+#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
+  INSTANTIATE(StereoSessionIsis,"isis");
+#endif
+  INSTANTIATE(StereoSessionRPC,"rpc");
+  INSTANTIATE(StereoSessionDG,"dg");
+  INSTANTIATE(StereoSessionDGMapRPC,"dgmaprpc");
+
+#undef INSTANTIATE
+}
+
 int main( int argc, char* argv[] ) {
 
   vw_out() << "\n[ " << current_posix_time_string()
@@ -520,20 +540,16 @@ int main( int argc, char* argv[] ) {
     int ts = Options::tri_tile_size();
     opt.raster_tile_size = Vector2i(ts, ts);
 
+    // Each point depends only on its own disparity, so idle threads
+    // may triangulate parts of the tiles of other threads.
+    use_tile_scheduler( opt, "PC", ts/4 );
+
     // Internal Processes
     //---------------------------------------------------------
-#define INSTANTIATE(T,NAME) if ( opt.session->name() == NAME ) { stereo_triangulation<T>(opt); }
-
-    INSTANTIATE(StereoSessionPinhole,"pinhole");
-    INSTANTIATE(StereoSessionNadirPinhole,"nadirpinhole");
-#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
-    INSTANTIATE(StereoSessionIsis,"isis");
-#endif
-    INSTANTIATE(StereoSessionRPC,"rpc");
-    INSTANTIATE(StereoSessionDG,"dg");
-    INSTANTIATE(StereoSessionDGMapRPC,"dgmaprpc");
-
-#undef INSTANTIATE
+    if ( opt.tile_queue.empty() )
+      stereo_triangulation_any( opt );
+    else
+      run_tile_queue( argc, argv, opt, "tri", stereo_triangulation_any );
 
     vw_out() << "\n[ " << current_posix_time_string()
              << " ] : TRIANGULATION FINISHED \n";
@@ -29,6 +29,8 @@ using namespace vw;
 namespace po = boost::program_options;
 
 #include <limits>
+#include <algorithm>
+#include <functional>
 
 struct ImageData{
   std::string src_file;
@@ -128,6 +130,14 @@ void parseImgData(std::string data, int& dst_cols, int& dst_rows,
 }
 
 // A class to mosaic and rescale images using bilinear interpolation.
+//
+// The images to mosaic are indexed by the output rows they cover, so
+// a tile only looks at the few images near it. Since the transforms
+// only scale and shift, within a tile each image covers a contiguous
+// span of every output row, and the source column and interpolation
+// weight of each output column are the same for all rows. These are
+// computed once per image and tile, and the rows are filled with a
+// plain loop over the span.
 
 class TifMosaicView: public ImageViewBase<TifMosaicView>{
   int m_dst_cols, m_dst_rows;
@@ -135,11 +145,35 @@ class TifMosaicView: public ImageViewBase<TifMosaicView>{
   double m_scale;
   double m_output_nodata_value;
 
+  // Images whose destination box may intersect each band of
+  // m_bin_rows output rows, in increasing order.
+  static const int m_bin_rows = 256;
+  std::vector< std::vector<int> > m_row_bins;
+
+  // Source pixel = m_src_origin + dst pixel * m_src_step, per image
+  std::vector<Vector2> m_src_origin, m_src_step;
+
 public:
   TifMosaicView(int dst_cols, int dst_rows, std::vector<ImageData> & img_data,
             double scale, double output_nodata_value):
     m_dst_cols((int)(scale*dst_cols)), m_dst_rows((int)(scale*dst_rows)),
-    m_img_data(img_data), m_scale(scale), m_output_nodata_value(output_nodata_value){}
+    m_img_data(img_data), m_scale(scale), m_output_nodata_value(output_nodata_value){
+
+    m_row_bins.resize( m_dst_rows/m_bin_rows + 1 );
+    for (int k = 0; k < (int)m_img_data.size(); k++){
+      Vector2 origin = m_img_data[k].transform.reverse(Vector2(0, 0));
+      m_src_origin.push_back(origin);
+      m_src_step.push_back(m_img_data[k].transform.reverse(Vector2(1, 1)) - origin);
+
+      // Be generous, the exact test is done per tile
+      BBox2 box = m_img_data[k].dst_box;
+      if (box.empty()) continue;
+      int beg = std::max((int)floor(m_scale*box.min().y()) - 2, 0);
+      int end = std::min((int)ceil (m_scale*box.max().y()) + 2, m_dst_rows - 1);
+      for (int bin = beg/m_bin_rows; bin <= end/m_bin_rows && end >= beg; bin++)
+        m_row_bins[bin].push_back(k);
+    }
+  }
 
   typedef float pixel_type;
   typedef pixel_type result_type;
@@ -160,78 +194,89 @@ public:
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
 
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    fill( tile, m_output_nodata_value );
+    if (bbox.empty()) return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
+                                               cols(), rows() );
+
+    // The images in the row bins of this tile, top image first
+    std::vector<int> candidates;
+    int first_bin = std::max(bbox.min().y(), 0)/m_bin_rows;
+    int last_bin  = std::min((bbox.max().y() - 1)/m_bin_rows, (int)m_row_bins.size() - 1);
+    for (int bin = first_bin; bin <= last_bin; bin++)
+      candidates.insert(candidates.end(), m_row_bins[bin].begin(), m_row_bins[bin].end());
+    std::sort(candidates.begin(), candidates.end(), std::greater<int>());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
     // Scaled box
     Vector2i b = floor(bbox.min()/m_scale);
     Vector2i e = ceil(elem_diff(bbox.max(),1)/m_scale) + Vector2i(1, 1);
     BBox2i scaled_box(b[0], b[1], e[0] - b[0], e[1] - b[1]);
 
-    // The scaled box can potentially intersect several of the images
-    // to be mosaicked. So prepare to interpolate into all of them.
-    // Note 1: the cropped sub-images we get below are non-overlapping
-    // and no bigger than they need to be.
-    // Note 2: We mask each image using its individual nodata-value.
-    // The output mosaic uses the global m_output_nodata_value.
-    typedef ImageView<masked_pixel_type> ImageT;
-    typedef InterpolationView<ImageT, BilinearInterpolation> InterpT;
-
-    std::vector<BBox2i>  src_vec(m_img_data.size());  // Effective area of image tile
-    std::vector<InterpT> crop_vec(m_img_data.size(),
-                                  InterpT(ImageT())); // Image data but expanded a bit for interpolation's sake
+    // Each output pixel is taken from the top image whose effective
+    // area contains its source pixel and where all four pixels used
+    // in bilinear interpolation are valid, that is, not less than or
+    // equal to the nodata value of that image.
+    ImageView<uint8> filled(bbox.width(), bbox.height());
+    fill( filled, 0 );
     int extra = BilinearInterpolation::pixel_buffer;
-    for (int k = 0; k < (int)m_img_data.size(); k++){
-      BBox2 box = m_img_data[k].dst_box;
+    std::vector<int>   src_col(bbox.width());
+    std::vector<float> col_wt (bbox.width());
+    for (size_t c = 0; c < candidates.size(); c++){
+      int k = candidates[c];
+      ImageData const& data = m_img_data[k];
+
+      BBox2 box = data.dst_box;
       box.crop(scaled_box);
       if (box.empty()) continue;
       box.expand(1); // since reverse_bbox will truncate input box to BBox2i
-      box = m_img_data[k].transform.reverse_bbox(box);
+      box = data.transform.reverse_bbox(box);
       box = grow_bbox_to_int(box);
-      box.crop(bounding_box(m_img_data[k].src_img));
+      box.crop(bounding_box(data.src_img));
       if (box.empty()) continue;
-      src_vec[k] = ( box );                          // Recording active area of the tile
-      box.expand( extra ); // Expanding so Interpolation doesn't reach outside image
-      crop_vec[k] =
-        InterpT(create_mask_less_or_equal
-                (crop(edge_extend(m_img_data[k].src_img, ConstantEdgeExtension()),
-                      box),
-                 m_img_data[k].nodata_value));
-    }
-
-    ImageView<pixel_type> tile(bbox.width(), bbox.height());
-    fill( tile, m_output_nodata_value );
-
-    // TODO: This could possibly be performed entirely with a
-    // TransformView and apply_mask.
-    // -- or --
-    // Since we have no rotations, we can assume whole lines will come
-    // from a single image
-    for (int row = 0; row < bbox.height(); row++){
+      BBox2 src_box = box;  // Effective area of the image in this tile
+      box.expand( extra );  // Expanding so interpolation doesn't reach outside image
+      ImageView<float> src = crop(edge_extend(data.src_img, ConstantEdgeExtension()), box);
+      float nodata = data.nodata_value;
+
+      // The span of output columns whose source column is in the
+      // effective area, and their source columns and weights.
+      int col_beg = bbox.width(), col_end = 0;
       for (int col = 0; col < bbox.width(); col++){
+        double x = m_src_origin[k].x() + m_src_step[k].x()*(col + bbox.min().x())/m_scale;
+        if (x < src_box.min().x() || x >= src_box.max().x()) continue;
+        col_beg = std::min(col_beg, col);
+        col_end = col + 1;
+        x += extra - box.min().x();
+        src_col[col] = (int)floor(x);
+        col_wt [col] = x - src_col[col];
+      }
+      if (col_beg >= col_end) continue;
+
+      for (int row = 0; row < bbox.height(); row++){
+        double y = m_src_origin[k].y() + m_src_step[k].y()*(row + bbox.min().y())/m_scale;
+        if (y < src_box.min().y() || y >= src_box.max().y()) continue;
+        y += extra - box.min().y();
+        int   y0 = (int)floor(y);
+        float wy = y - y0;
+
+        const float* top    = &src(0, y0);
+        const float* bottom = &src(0, y0 + 1);
+        float*       out    = &tile  (0, row);
+        uint8*       done   = &filled(0, row);
+        for (int col = col_beg; col < col_end; col++){
+          int   x0 = src_col[col];
+          float wx = col_wt[col];
+          float p00 = top[x0], p10 = top[x0+1], p01 = bottom[x0], p11 = bottom[x0+1];
+          bool valid = !done[col] && !(p00 <= nodata) && !(p10 <= nodata)
+            && !(p01 <= nodata) && !(p11 <= nodata);
+          float val = (1-wy)*((1-wx)*p00 + wx*p10) + wy*((1-wx)*p01 + wx*p11);
+          out [col] = valid ? val : out[col];
+          done[col] = done[col] | valid;
+        }
+      }
+    }
 
-        Vector2 dst_pix
-          = Vector2(col + bbox.min().x(), row + bbox.min().y())/m_scale;
-
-        // See which src image we end up in. Start from the later
-        // images, as those are on top. Stop when we find an image
-        // with a valid pixel at given location.
-        for (int k = (int)m_img_data.size()-1; k >= 0; k--){
-          Vector2 src_pix = m_img_data[k].transform.reverse(dst_pix);
-          if (!src_vec[k].contains(src_pix)) continue;
-
-          // Go to the coordinate system of image crop_vec[k]. Note that
-          // we add back the 'extra' number used in expanding the image
-          // earlier.
-          src_pix += elem_diff(extra, src_vec[k].min());
-          
-          masked_pixel_type r = crop_vec[k](src_pix[0], src_pix[1] );
-          if (is_valid(r)){
-            tile(col, row) = r.child();
-            break;
-          }
-        } // image stack iteration
-        
-      } // col iteration
-    } // row iteration
-    
     return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
                              cols(), rows() );
   }
@@ -134,20 +134,100 @@ void get_offsets(bool is_wv01, bool is_forward, std::vector<double> & off){
   
 }
 
+// The x and y CCD offset corrections to apply at each image column.
+// They depend only on the column, so are computed once for the whole
+// image rather than for every tile and every column of it.
+struct ColumnShifts {
+  std::vector<double> x, y;
+  double max_abs; // Largest correction in absolute value
+};
+
+void compute_column_shifts(int num_cols, bool is_wv01, bool is_forward,
+                           double shift, double period,
+                           double xoffset, double yoffset,
+                           ColumnShifts & shifts){
+
+  vector<double> off;
+  get_offsets(is_wv01, is_forward, off);
+
+  // partial_sums[k] is the sum of the first k tabulated offsets,
+  // accumulated in the same order as they used to be summed.
+  int noff = off.size();
+  vector<double> partial_sums(noff + 1, 0.0);
+  for (int k = 0; k < noff; k++)
+    partial_sums[k+1] = partial_sums[k] + off[k];
+
+  // Columns to the left of this have no y offset for WV01 forward scans
+  double s = 8000;
+  s = period*floor((s - shift)/period) + shift;
+
+  shifts.x.resize(num_cols);
+  shifts.y.resize(num_cols);
+  shifts.max_abs = 0;
+  for (int col = 0; col < num_cols; col++){
+
+    // The sign of CCD offsets alternates as one moves along the image
+    // columns. As such, at "even" blocks, the offsets accumulated so
+    // far cancel each other, so we need to correct the "odd" blocks
+    // only.
+    int block_index = (int)floor((col - shift)/period);
+    double valx = 0, valy = 0;
+    if (block_index % 2 == 1){
+      valx = -xoffset;
+      valy = -yoffset;
+    }
+
+    // Special treatment for WV01
+    if (is_wv01){
+      if (!is_forward){
+        // Use a list of tabulated values to find the y offsets
+        valy = -yoffset*partial_sums[std::max(0, std::min(noff, block_index))];
+      }else{
+        // Just set the early y offsets to 0
+        if (col < s)
+          valy = 0;
+      }
+    }
+
+    shifts.x[col] = valx;
+    shifts.y[col] = valy;
+    shifts.max_abs = std::max(shifts.max_abs,
+                              std::max(std::abs(valx), std::abs(valy)));
+  }
+}
+
+// Bilinearly resample 'num' consecutive pixels of an output row which
+// are all shifted by the same subpixel amount (fx, fy). 'row0' and
+// 'row1' point to the first needed pixels of the two bracketing input
+// rows. The loop runs over contiguous memory with no edge checks so
+// that it gets vectorized by the compiler.
+template <class PixelT>
+inline void shift_row_span(PixelT const* row0, PixelT const* row1,
+                           PixelT * out, int num, double fx, double fy){
+  typedef typename CompoundChannelCast<PixelT, double>::type AccumT;
+  typedef typename CompoundChannelType<PixelT>::type ChannelT;
+  const double gx = 1.0 - fx, gy = 1.0 - fy;
+  for (int i = 0; i < num; i++){
+    AccumT top = channel_cast<double>(row0[i])*gx + channel_cast<double>(row0[i+1])*fx;
+    AccumT bot = channel_cast<double>(row1[i])*gx + channel_cast<double>(row1[i+1])*fx;
+    out[i] = channel_cast<ChannelT>(top*gy + bot*fy);
+  }
+}
+
 template <class ImageT>
 class WVCorrectView: public ImageViewBase< WVCorrectView<ImageT> >{
   ImageT m_img;
-  bool m_is_wv01, m_is_forward;
-  double m_shift, m_period, m_xoffset, m_yoffset;
+  boost::shared_ptr<ColumnShifts> m_shifts;
   typedef typename ImageT::pixel_type PixelT;
 
 public:
   WVCorrectView( ImageT const& img, bool is_wv01, bool is_forward,
                  double shift, double period, double xoffset, double yoffset):
-    m_img(img), m_is_wv01(is_wv01), m_is_forward(is_forward),
-    m_shift(shift), m_period(period),
-    m_xoffset(xoffset), m_yoffset(yoffset){}
-  
+    m_img(img), m_shifts(new ColumnShifts){
+    compute_column_shifts(img.cols(), is_wv01, is_forward, shift, period,
+                          xoffset, yoffset, *m_shifts);
+  }
+
   typedef PixelT pixel_type;
   typedef PixelT result_type;
   typedef ProceduralPixelAccessor<WVCorrectView> pixel_accessor;
@@ -166,60 +246,48 @@ public:
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
 
-    vector<double> off;
-    get_offsets(m_is_wv01, m_is_forward, off);
-    
+    std::vector<double> const& shift_x = m_shifts->x;
+    std::vector<double> const& shift_y = m_shifts->y;
+
     // Need to see a bit more of the input image for the purpose
-    // of interpolation.
-    int bias = (int)ceil(std::max(std::abs(m_xoffset), std::abs(m_yoffset)))
+    // of interpolation. Pixels beyond the image boundary are
+    // replicated from the boundary, so the resampling loop below
+    // never needs to check for edges.
+    int bias = (int)ceil(m_shifts->max_abs)
       + BilinearInterpolation::pixel_buffer + 1;
     BBox2i biased_box = bbox;
     biased_box.expand(bias);
-    biased_box.crop(bounding_box(m_img));
-    
-    ImageView<result_type> cropped_img = crop(m_img, biased_box);
-    InterpolationView<EdgeExtensionView< ImageView<result_type>, ConstantEdgeExtension >, BilinearInterpolation> interp_img
-      = interpolate(cropped_img, BilinearInterpolation(),
-                    ConstantEdgeExtension());
-    
+    ImageView<result_type> src
+      = crop(edge_extend(m_img, ConstantEdgeExtension()), biased_box);
+
     ImageView<result_type> tile(bbox.width(), bbox.height());
-    for (int col = bbox.min().x(); col < bbox.max().x(); col++){
-
-      // The sign of CCD offsets alternates as one moves along the image
-      // columns. As such, at "even" blocks, the offsets accumulated so
-      // far cancel each other, so we need to correct the "odd" blocks
-      // only.
-      int block_index = (int)floor((col - m_shift)/m_period);
-      double valx = 0, valy = 0;
-      if (block_index % 2 == 1){
-        valx = -m_xoffset;
-        valy = -m_yoffset;
+    int dx = bbox.min().x() - biased_box.min().x();
+    int dy = bbox.min().y() - biased_box.min().y();
+
+    // The corrections are constant over runs of columns (a CCD block
+    // each), so resample the tile one such run at a time.
+    int span_beg = 0;
+    while (span_beg < tile.cols()){
+      int col = bbox.min().x() + span_beg;
+      double valx = shift_x[col], valy = shift_y[col];
+      int span_end = span_beg + 1;
+      while (span_end < tile.cols() &&
+             shift_x[bbox.min().x() + span_end] == valx &&
+             shift_y[bbox.min().x() + span_end] == valy)
+        span_end++;
+
+      double ix = floor(valx), iy = floor(valy);
+      double fx = valx - ix, fy = valy - iy;
+      int src_col = span_beg + dx + (int)ix;
+      for (int row = 0; row < tile.rows(); row++){
+        int src_row = row + dy + (int)iy;
+        shift_row_span(&src(src_col, src_row), &src(src_col, src_row + 1),
+                       &tile(span_beg, row), span_end - span_beg, fx, fy);
       }
 
-      // Special treatment for WV01
-      if (m_is_wv01){
-        if (!m_is_forward){
-          // Use a list of tabulated values to find the y offsets
-          double sum = 0;
-          int noff = off.size();
-          for (int k = 0; k < std::min(noff, block_index); k++) sum += off[k];
-          valy = -m_yoffset*sum;
-        }else{
-          // Just set the early y offsets to 0
-          double s = 8000;
-          s = m_period*floor((s - m_shift)/m_period) + m_shift;
-          if (col < s)
-            valy = 0;
-        }
-      }
-      
-      for (int row = bbox.min().y(); row < bbox.max().y(); row++){
-        tile(col - bbox.min().x(), row - bbox.min().y() )
-          = interp_img(col - biased_box.min().x() + valx,
-                       row - biased_box.min().y() + valy);
-      }
+      span_beg = span_end;
     }
-    
+
     return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(),
                              cols(), rows() );
   }
@@ -229,6 +297,7 @@ public:
     vw::rasterize(prerasterize(bbox), dest, bbox);
   }
 };
+
 template <class ImageT>
 WVCorrectView<ImageT> wv_correct(ImageT const& img,
                                  bool is_wv01, bool is_forward, double shift,
@@ -0,0 +1,154 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BundleAdjustTestModel.h
+///
+/// A small bundle adjustment problem shared by the tests of the
+/// adjusters.
+
+#ifndef __ASP_TESTS_BUNDLE_ADJUST_TEST_MODEL_H__
+#define __ASP_TESTS_BUNDLE_ADJUST_TEST_MODEL_H__
+
+#include <vw/Math/Quaternion.h>
+#include <vw/BundleAdjustment/BundleAdjustmentBase.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
+#include <boost/shared_ptr.hpp>
+#include <cmath>
+#include <vector>
+
+namespace asp {
+namespace test {
+
+using namespace vw;
+using namespace vw::ba;
+
+// Pinhole cameras looking down the Z axis, adjusted by a position and
+// an axis angle rotation.
+class TestModel : public ModelBase<TestModel, 6, 3> {
+  typedef Vector<double,6> camera_vector_t;
+  typedef Vector<double,3> point_vector_t;
+
+  std::vector<Vector3> m_centers;
+  boost::shared_ptr<ControlNetwork> m_network;
+  std::vector<camera_vector_t> a, a_target;
+  std::vector<point_vector_t> b, b_target;
+  unsigned m_num_pixel_observations;
+
+public:
+  TestModel( std::vector<Vector3> const& centers,
+             boost::shared_ptr<ControlNetwork> network ) :
+    m_centers(centers), m_network(network), a(centers.size()),
+    a_target(centers.size()), b(network->size()), b_target(network->size()),
+    m_num_pixel_observations(0) {
+    for ( unsigned i = 0; i < network->size(); ++i ) {
+      b[i] = b_target[i] = (*network)[i].position();
+      m_num_pixel_observations += (*network)[i].size();
+    }
+  }
+
+  camera_vector_t A_parameters(int j) const { return a[j]; }
+  point_vector_t B_parameters(int i) const { return b[i]; }
+  void set_A_parameters(int j, camera_vector_t const& a_j) { a[j] = a_j; }
+  void set_B_parameters(int i, point_vector_t const& b_i) { b[i] = b_i; }
+  camera_vector_t A_target(int j) const { return a_target[j]; }
+  point_vector_t B_target(int i) const { return b_target[i]; }
+
+  unsigned num_cameras() const { return a.size(); }
+  unsigned num_points() const { return b.size(); }
+  unsigned num_pixel_observations() const { return m_num_pixel_observations; }
+
+  Matrix<double,6,6> A_inverse_covariance( unsigned /*j*/ ) const {
+    Matrix<double,6,6> result;
+    result.set_identity();
+    return result;
+  }
+  Matrix<double,3,3> B_inverse_covariance( unsigned /*i*/ ) const {
+    Matrix<double,3,3> result;
+    result.set_identity();
+    return result;
+  }
+
+  Vector2 operator()( unsigned /*i*/, unsigned j,
+                      camera_vector_t const& a_j,
+                      point_vector_t const& b_i ) const {
+    Quat pose = axis_angle_to_quaternion( subvector(a_j,3,3) );
+    Vector3 p = pose.rotate( b_i - m_centers[j] - subvector(a_j,0,3) );
+    return Vector2( 1000*p[0]/p[2], 1000*p[1]/p[2] );
+  }
+
+  boost::shared_ptr<ControlNetwork> control_network() const { return m_network; }
+  std::string image_unit() const { return "px"; }
+  double image_compare( Vector2 const& meas, Vector2 const& obj ) { return norm_2(meas-obj); }
+  double position_compare( camera_vector_t const& meas, camera_vector_t const& obj ) {
+    return norm_2(subvector(meas,0,3)-subvector(obj,0,3));
+  }
+  double pose_compare( camera_vector_t const& meas, camera_vector_t const& obj ) {
+    return norm_2(subvector(meas,3,3)-subvector(obj,3,3));
+  }
+  double gcp_compare( point_vector_t const& meas, point_vector_t const& obj ) {
+    return norm_2(meas-obj);
+  }
+};
+
+// Noise free measures of a grid of cols x rows points seen by a row
+// of cameras. With a positive 'reach', a point is only seen by the
+// cameras within that distance along the row, so that the points of
+// a camera are shared with different neighbors. The points start off
+// their true position. With 'gcps', a few are ground control points.
+inline boost::shared_ptr<ControlNetwork>
+make_network( std::vector<Vector3>& centers, int num_cameras, int cols, int rows,
+              double reach = 0, bool gcps = false ) {
+  centers.clear();
+  for ( int j = 0; j < num_cameras; j++ )
+    centers.push_back( Vector3( 10*j, 0, -100 ) );
+
+  boost::shared_ptr<ControlNetwork> cnet( new ControlNetwork("Test") );
+  for ( int x = 0; x < cols; x++ )
+    for ( int y = 0; y < rows; y++ ) {
+      Vector3 point( 5*x, 5*y - 5*(rows/2), 10*((x+y)%3) );
+      ControlPoint cp( gcps && (x+y) % 7 == 0 ? ControlPoint::GroundControlPoint :
+                       ControlPoint::TiePoint );
+      for ( unsigned j = 0; j < centers.size(); j++ ) {
+        if ( reach > 0 && std::fabs( point[0] - centers[j][0] ) > reach )
+          continue;
+        Vector3 p = point - centers[j];
+        ControlMeasure cm( 1000*p[0]/p[2], 1000*p[1]/p[2], 1, 1, j );
+        cp.add_measure( cm );
+      }
+      cp.set_position( point + Vector3( 0.2*(x%2), -0.3*(y%3), 0.1 ) );
+      cnet->add_control_point( cp );
+    }
+  return cnet;
+}
+
+// Mean reprojection error of the model over its control network
+inline double image_error( TestModel& model ) {
+  double error = 0;
+  ControlNetwork const& cnet = *model.control_network();
+  for ( unsigned i = 0; i < cnet.size(); i++ )
+    for ( unsigned m = 0; m < cnet[i].size(); m++ ) {
+      unsigned j = cnet[i][m].image_id();
+      error += norm_2( cnet[i][m].dominant() -
+                       model(i,j,model.A_parameters(j),model.B_parameters(i)) );
+    }
+  return error / model.num_pixel_observations();
+}
+
+}} // namespace asp::test
+
+#endif//__ASP_TESTS_BUNDLE_ADJUST_TEST_MODEL_H__